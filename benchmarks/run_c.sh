@@ -0,0 +1,42 @@
+#!/bin/sh
+# Compares the stack engine (with its JIT) with the same scripts translated to C.
+# Translates every benchmark script with --emit-c, builds it with gcc -O2 against the runtime
+# library and prints the best wall time of each.
+# Usage: benchmarks/run_c.sh <cllc> <libclockrt.a> [runs]
+
+CLLC=$1
+RUNTIME=$2
+RUNS=${3:-3}
+DIR=$(dirname "$0")
+CC=${CC:-gcc}
+WORK=${TMPDIR:-/tmp}/clock_bench_c
+
+if [ ! -x "$CLLC" ] || [ ! -f "$RUNTIME" ]; then
+    echo "usage: $0 <cllc> <libclockrt.a> [runs]" >&2
+    exit 1
+fi
+mkdir -p "$WORK"
+
+# best_time <command...>: fastest of $RUNS runs in seconds
+best_time() {
+    best=""
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        start=$(date +%s.%N)
+        "$@" > /dev/null
+        end=$(date +%s.%N)
+        best=$(echo "$start $end $best" | awk '{ t = $2 - $1; if ($3 == "" || t < $3) print t; else print $3 }')
+        i=$((i + 1))
+    done
+    echo "$best"
+}
+
+printf "%-20s %9s %9s %9s\n" "benchmark" "jit(s)" "c(s)" "speedup"
+for script in "$DIR"/*.clk; do
+    name=$(basename "$script" .clk)
+    "$CLLC" --emit-c "$script" -o "$WORK/$name.c" || continue
+    $CC -O2 -I"$DIR/../include" "$WORK/$name.c" "$RUNTIME" -lm -o "$WORK/$name" || continue
+    jt=$(best_time "$CLLC" --vm --no-cache "$script")
+    ct=$(best_time "$WORK/$name")
+    echo "$name.clk $jt $ct" | awk '{ printf "%-20s %9.3f %9.3f %8.2fx\n", $1, $2, $3, $2 / $3 }'
+done
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Compares the two dispatch styles of the bytecode VM.
+# Runs every benchmark script with both builds and prints the best wall time of each.
+# Usage: benchmarks/run_dispatch.sh <threaded cllc> <switch cllc> [runs]
+
+THREADED=$1
+SWITCH=$2
+RUNS=${3:-3}
+DIR=$(dirname "$0")
+
+if [ ! -x "$THREADED" ] || [ ! -x "$SWITCH" ]; then
+    echo "usage: $0 <threaded cllc> <switch cllc> [runs]" >&2
+    exit 1
+fi
+
+# best_time <binary> <script>: fastest of $RUNS runs in seconds
+best_time() {
+    best=""
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        start=$(date +%s.%N)
+        "$1" --vm "$2" > /dev/null
+        end=$(date +%s.%N)
+        best=$(echo "$start $end $best" | awk '{ t = $2 - $1; if ($3 == "" || t < $3) print t; else print $3 }')
+        i=$((i + 1))
+    done
+    echo "$best"
+}
+
+printf "%-20s %12s %12s %9s\n" "benchmark" "threaded(s)" "switch(s)" "speedup"
+for script in "$DIR"/*.clk; do
+    t=$(best_time "$THREADED" "$script")
+    s=$(best_time "$SWITCH" "$script")
+    echo "$(basename "$script") $t $s" | awk '{ printf "%-20s %12.3f %12.3f %8.2fx\n", $1, $2, $3, $3 / $2 }'
+done
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Compares the stack engine with and without its JIT.
+# Runs every benchmark script with --no-jit and with the JIT and prints the best wall time of each.
+# Usage: benchmarks/run_jit.sh <cllc> [runs]
+
+CLLC=$1
+RUNS=${2:-3}
+DIR=$(dirname "$0")
+
+if [ ! -x "$CLLC" ]; then
+    echo "usage: $0 <cllc> [runs]" >&2
+    exit 1
+fi
+
+# best_time <script> [flags]: fastest of $RUNS runs in seconds
+best_time() {
+    best=""
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        start=$(date +%s.%N)
+        "$CLLC" --vm --no-cache "$@" > /dev/null
+        end=$(date +%s.%N)
+        best=$(echo "$start $end $best" | awk '{ t = $2 - $1; if ($3 == "" || t < $3) print t; else print $3 }')
+        i=$((i + 1))
+    done
+    echo "$best"
+}
+
+printf "%-20s %14s %9s %9s\n" "benchmark" "interpreted(s)" "jit(s)" "speedup"
+for script in "$DIR"/*.clk; do
+    it=$(best_time "$script" --no-jit)
+    jt=$(best_time "$script")
+    echo "$(basename "$script") $it $jt" | awk '{ printf "%-20s %14.3f %9.3f %8.2fx\n", $1, $2, $3, $2 / $3 }'
+done
@@ -0,0 +1,43 @@
+#!/bin/sh
+# Compares the register engine with the stack engine of the bytecode VM.
+# Prints the instructions each engine executes (from a build with -DCLOCK_COUNT_DISPATCH)
+# and the best wall time of each.
+# Usage: benchmarks/run_registers.sh <cllc> <cllc built with -DCLOCK_COUNT_DISPATCH> [runs]
+
+CLLC=$1
+COUNTING=$2
+RUNS=${3:-3}
+DIR=$(dirname "$0")
+
+if [ ! -x "$CLLC" ] || [ ! -x "$COUNTING" ]; then
+    echo "usage: $0 <cllc> <counting cllc> [runs]" >&2
+    exit 1
+fi
+
+# best_time <engine flag> <script>: fastest of $RUNS runs in seconds
+best_time() {
+    best=""
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        start=$(date +%s.%N)
+        "$CLLC" "$1" --no-cache "$2" > /dev/null
+        end=$(date +%s.%N)
+        best=$(echo "$start $end $best" | awk '{ t = $2 - $1; if ($3 == "" || t < $3) print t; else print $3 }')
+        i=$((i + 1))
+    done
+    echo "$best"
+}
+
+# executed <engine flag> <script>: instructions dispatched by the counting build
+executed() {
+    "$COUNTING" "$1" --no-cache "$2" 2>&1 > /dev/null | awk '/^Instructions executed:/ { print $3 }'
+}
+
+printf "%-18s %13s %13s %7s %10s %12s %8s\n" "benchmark" "stack instrs" "reg instrs" "ratio" "stack(s)" "registers(s)" "speedup"
+for script in "$DIR"/*.clk; do
+    si=$(executed --vm "$script")
+    ri=$(executed --registers "$script")
+    st=$(best_time --vm "$script")
+    rt=$(best_time --registers "$script")
+    echo "$(basename "$script") $si $ri $st $rt" | awk '{ printf "%-18s %13d %13d %7.2f %10.3f %12.3f %7.2fx\n", $1, $2, $3, $3 / $2, $4, $5, $4 / $5 }'
+done
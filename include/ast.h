@@ -33,7 +33,7 @@ typedef enum {
     AST_FOR_STATEMENT,        // For loop
     AST_RETURN_STATEMENT,     // Return statement
     AST_FUNCTION_DECLARATION, // Function declaration
-    AST_FUNCTION_CALL,        // Function call
+    AST_FUNCTION_CALL,        // Function call: the callee, then one child per argument
     AST_ARRAY_LITERAL,        // Array literal
     AST_ARRAY_ACCESS,         // Array access
     AST_COMMENT,			  // Comment
@@ -49,6 +49,46 @@ typedef enum {
 
 
 
+/**
+ * The operator of a binary, unary or assignment node, resolved from its symbol when the
+ * node is created so the evaluators switch on it instead of comparing strings.
+ */
+typedef enum {
+    OPERATOR_NONE,            // Not an operator node, or a symbol the evaluators don't handle
+    OPERATOR_ADD,             // +
+    OPERATOR_SUBTRACT,        // - (also the unary minus)
+    OPERATOR_MULTIPLY,        // *
+    OPERATOR_DIVIDE,          // /
+    OPERATOR_MODULO,          // %
+    OPERATOR_EQUAL,           // ==
+    OPERATOR_NOT_EQUAL,       // !=
+    OPERATOR_LESS,            // <
+    OPERATOR_GREATER,         // >
+    OPERATOR_LESS_EQUAL,      // <=
+    OPERATOR_GREATER_EQUAL,   // >=
+    OPERATOR_AND,             // &&
+    OPERATOR_OR,              // ||
+    OPERATOR_NOT,             // !
+    OPERATOR_COMPLEMENT,      // ~
+    OPERATOR_ASSIGN,          // =
+    OPERATOR_ADD_ASSIGN,      // +=
+    OPERATOR_SUBTRACT_ASSIGN, // -=
+    OPERATOR_MULTIPLY_ASSIGN, // *=
+    OPERATOR_DIVIDE_ASSIGN,   // /=
+    OPERATOR_MODULO_ASSIGN,   // %=
+    OPERATOR_COMMA,           // , (separates the arguments of a call and the elements of an array)
+    OPERATOR_COUNT_
+} ASTOperator;
+
+/**
+ * The symbol of each operator (for error messages).
+ */
+extern const char* ASTOperatorSymbols[OPERATOR_COUNT_];
+
+
+
+
+
 /**
  * A tag for which type of data is stored in the ASTValue union
  * (used only if this node is AST_LITERAL or otherwise stores a value).
@@ -71,6 +111,16 @@ typedef union {
     char* str_val;    // For string literals
 } ASTValue;
 
+/**
+ * Where the interpreter finds a variable, decided by the resolver (see resolver.h).
+ */
+typedef enum {
+    SCOPE_UNRESOLVED, // Looked up by name
+    SCOPE_LOCAL,      // Slot of the current call frame
+    SCOPE_UPVALUE,    // Variable of an enclosing function, captured when the function was declared
+    SCOPE_GLOBAL      // Slot of the global variables
+} VariableScope;
+
 /**
  * The primary AST node structure.
  */
@@ -81,11 +131,19 @@ typedef struct ASTNode {
     ASTValue      value;      // The literal data (if any)
 
     char* operator_;  // Operator symbol (e.g. "+", "-", "==") for expression nodes
+    ASTOperator operator_kind; // operator_ resolved, for binary, unary and assignment nodes
     // Children: We store all children in a dynamic array, which can include
     // the left and right sides of a binary expression or multiple statements in a block.
     struct ASTNode** children;
     size_t        child_count;
 	bool isFunction;
+    void* call_cache;  // Inline cache of a function call site, filled by the interpreter
+    bool tail_call;    // Return of a function call in tail position (see mark_tail_calls)
+    VariableScope scope; // Variables: where the value lives (see resolver.h)
+    int slot;            // Variables: index in that scope, -1 if looked up by name
+    int global_slot;     // Locals that hide a global: the global read while the local is unassigned, -1 otherwise
+    struct ASTNode* frame_layout;   // Function declarations and the program: one node per slot of the frame
+    struct ASTNode* upvalue_layout; // Function declarations: one identifier per captured variable, resolved in the declaring frame
 
     // So we can easily find the parent node when needed.
     struct ASTNode* parent;
@@ -110,6 +168,11 @@ typedef struct {
  */
 ASTNode* create_ast_node(ASTNodeType type, size_t line, size_t column, const char* operator_);
 
+/**
+ * Resolves an operator symbol (OPERATOR_NONE if it isn't one of ASTOperatorSymbols).
+ */
+ASTOperator ast_operator_from_symbol(const char* symbol);
+
 /**
  * These functions set the literal value in the node and update value_kind.
  */
@@ -13,6 +13,7 @@
 #pragma once
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include "ast.h"
 
 #ifndef BYTECODE_H
@@ -55,7 +56,7 @@
 #define OP_PRINT   0x1A   // Print a value
 #define OP_INPUT   0x1B   // Read a value from the user
 
-#define INITIAL_BYTECODE_CAPACITY 1024
+#define INITIAL_BYTECODE_CAPACITY 64 // Instructions of a new bytecode buffer (one per function, grows as needed)
 typedef enum {
     OP_PUSH_INT,
     OP_PUSH_FLOAT,
@@ -104,12 +105,74 @@ typedef enum {
     OP_DEFAULT_,
     OP_PARAMETER_LIST_,
 	OP_SCOPE,
+    OP_PUSH_NULL,
+    OP_DUP,
+    OP_BUILD_ARRAY,
+    OP_BIT_NOT,
+    OP_LOAD_LOCAL,
+    OP_STORE_LOCAL,
+    OP_LOAD_GLOBAL,
+    OP_STORE_GLOBAL,
+    OP_LOAD_UPVALUE,                 // variable of an enclosing function, captured by OP_DECL_FUNCTION
+    OP_UNSET_LOCAL,                  // a local that hides a global starts unassigned (see RUNTIME_VALUE_UNSET)
+    OP_OR_GLOBAL,                    // an unassigned local on top of the stack is replaced by the global it hides
+    // Counted loops of `for (a to b)`: the counter and the limit are in two consecutive hidden slots
+    OP_FOR_PREP_LOCAL,               // jump past the loop unless counter < limit
+    OP_FOR_LOOP_LOCAL,               // counter += 1, jump back to the body while counter < limit
+    OP_FOR_PREP_GLOBAL,
+    OP_FOR_LOOP_GLOBAL,
+    // Superinstructions, only produced by the optimizer (see fuse_superinstructions)
+    OP_INC_LOCAL,                    // local += constant
+    OP_INC_GLOBAL,                   // global += constant
+    OP_COMPARE_JUMP_IF_FALSE,        // comparison + OP_JUMP_TO_IF_FALSE
+    OP_COMPARE_LOCALS_JUMP_IF_FALSE, // load local, load local, comparison, OP_JUMP_TO_IF_FALSE
+    OP_LOAD_LOCAL_ELEMENT,           // load local array, load local index, OP_ARRAY_GET_
+    OP_TAIL_CALL,                    // OP_CALL_FUNCTION of `return f(...)` in a function: the callee reuses the frame
+    // Quickened operators, only written by vm_run over a generic operator that saw these operand types
+    OP_ADD_INT_INT,
+    OP_SUBTRACT_INT_INT,
+    OP_MULTIPLY_INT_INT,
+    OP_DIVIDE_INT_INT,
+    OP_MODULO_INT_INT,
+    OP_LESS_INT_INT,
+    OP_GREATER_INT_INT,
+    OP_LESS_EQUAL_INT_INT,
+    OP_GREATER_EQUAL_INT_INT,
+    OP_EQUAL_INT_INT,
+    OP_NOT_EQUAL_INT_INT,
+    OP_ADD_FLOAT_FLOAT,
+    OP_SUBTRACT_FLOAT_FLOAT,
+    OP_MULTIPLY_FLOAT_FLOAT,
+    OP_DIVIDE_FLOAT_FLOAT,
+    OP_LESS_FLOAT_FLOAT,
+    OP_GREATER_FLOAT_FLOAT,
+    OP_COUNT_ // Number of opcodes (keep last)
 } BytecodeOpcode;
 
+/**
+ * A case of a switch dispatched through a table: a constant and the instruction its body starts at.
+ */
+typedef struct {
+    bool is_string;            // String case, otherwise int
+    long int_value;
+    const char* string_value;  // Points into the AST, which outlives the assembly
+    int target_index;
+} SwitchCase;
+
+/**
+ * A variable a nested function captures when it is declared (read with OP_LOAD_UPVALUE):
+ * a local slot of the declaring call, or a variable the declaring call captured itself.
+ */
+typedef struct {
+    uint8_t from_local;        // 1 for a local slot, 0 for a capture of the declaring call
+    uint8_t index;             // The slot or the capture index
+} Capture;
+
 typedef struct {
     BytecodeOpcode opcode;
     union {
-        int int_operand;
+        int int_operand;    // Jump targets
+        long int_value;     // OP_PUSH_INT literal, as wide as RuntimeValue.int_val
         float float_operand;
         bool bool_operand;
         char* string_operand;
@@ -144,15 +207,25 @@ typedef struct {
             int value_reg;  // Register for the value
         } array_assignment;
 
-        // For function declarations
+        // For function calls (callee resolved by name at runtime)
+        struct {
+            char* name;
+            int arg_count;
+        } call;
+
+        // For function declarations (the body is generated on its own, see generate_function_body_bytecode)
         struct {
             int param_count;
-            int body_index;
+            char* name;
+            const ASTNode* declaration; // The AST_FUNCTION_DECLARATION, kept until the body is compiled
+            Capture* captures;          // Variables of the declaring call the function reads
+            int capture_count;
         } function_decl;
-        // For switch statements
+        // For switch statements dispatched through a table (OP_SWITCH_)
         struct {
             int default_index;
             int when_count;
+            SwitchCase* cases;
         } switch_;
         // For when statements
         struct {
@@ -169,11 +242,22 @@ typedef struct {
             int column_number;
         } debug_info;
 
+        // For variable access resolved at compile time (OP_LOAD_LOCAL, OP_STORE_GLOBAL, ...),
+        // OP_LOAD_UPVALUE keeps the index of the capture in local_index
+        // (OP_UNSET_LOCAL uses local_index and OP_OR_GLOBAL global_index)
         struct {
             int local_index;
             int global_index;
         } scope;
 
+        // For superinstructions and counted loops (target_index aliases jump.target_index)
+        struct {
+            int target_index;
+            int first;         // Local or global slot (the counter of a counted loop)
+            int second;        // Second local slot, the increment, or the slot of the loop's named counter
+            int compare;       // Comparison opcode of the fused jumps
+        } fused;
+
     } operand;
 
 } BytecodeInstruction;
@@ -184,13 +268,14 @@ void generate_binary_expr_bytecode(const ASTNode* node, BytecodeInstruction** by
 void generate_assignment_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity);
 void generate_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity);
 void ensure_bytecode_capacity(BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity);
-void print_byteCode(const BytecodeInstruction* bytecode, size_t count);
+void print_instructions(const BytecodeInstruction* bytecode, size_t count); // Unassembled bytecode, see print_byteCode in codeObject.h
 void generate_identifier_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity);
 void generate_unary_exp_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity);
 void generate_if_statement_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity); 
 void generate_for_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity);
 void generate_while_loop_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity);
 void generate_function_declaration_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity);
+int generate_function_body_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity); // Returns the local count
 void generate_function_call_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity);
 void generate_return_statement_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity);
 void generate_array_literal_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity);
@@ -201,5 +286,21 @@ void generate_switch_bytecode(const ASTNode* node, BytecodeInstruction** bytecod
 void generate_when_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity);
 void generate_stop_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity);
 void generate_default_switch_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity);
+void generate_loop_jump_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity);
+void emit_instruction(BytecodeInstruction instr, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity);
+bool is_expression_node(const ASTNode* node);
+void generate_variable_bytecode(const char* name, bool store, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity);
+
+/**
+ * Global variable slots assigned by the last generate_bytecode call.
+ * load_bytecode_globals starts over from the slots of a program, to generate more of its code.
+ */
+size_t bytecode_global_count(void);
+const char* bytecode_global_name(size_t index);
+void reset_bytecode_globals(void);
+void load_bytecode_globals(char* const* names, size_t count);
+size_t count_comma_operands(const ASTNode* node);
+
+extern const char* ByteCodeNames[];
 
 #endif BYTECODE_H
\ No newline at end of file
@@ -0,0 +1,71 @@
+/***********************************************************
+* File: bytecodeFile.h
+* This file have the compiled bytecode file format (.clkb).
+* A .clkb file holds the function table, the packed code, the constant pools
+* and the global slots of a program, so it can run without the lexer and parser.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#pragma once
+#ifndef BYTECODE_FILE_H
+#define BYTECODE_FILE_H
+
+#include <stdbool.h>
+#include "codeObject.h"
+
+#define CLKB_MAGIC "CLKB"
+#define CLKB_VERSION 6              // Bump whenever the packed format or the file layout changes
+#define CLKB_EXTENSION ".clkb"
+
+/*
+ * File layout (all integers little endian, offsets from the start of the file):
+ *   header     magic[4], u32 version, u32 function_count, u32 global_count,
+ *              u32 functions_offset, u32 globals_offset
+ *   functions  function_count records of 10 u32:
+ *              name, param_count, local_count, code, code_size, constants, constant_count,
+ *              captures, capture_count, reserved
+ *   constants  records of u32 type (0 int, 1 float, 2 string), u32 reserved, u64 value
+ *              (the integer, the bits of the double, or the offset of the string)
+ *   globals    global_count u32 offsets of the global names
+ *   data       the packed code, the captures (2 bytes each, see Capture) and the NUL terminated strings
+ */
+
+/**
+ * Writes a compiled program to a .clkb file.
+ * Returns false (after printing the reason) if the file could not be written.
+ */
+bool save_program(const BytecodeProgram* program, const char* path);
+
+/**
+ * Same as save_program but silent, for optional writes like the compilation cache.
+ */
+bool save_program_quiet(const BytecodeProgram* program, const char* path);
+
+/**
+ * Maps a .clkb file into memory. The code and the strings of the program point into the
+ * mapping, which is released by free_program. Returns NULL (after printing the reason) on error.
+ */
+BytecodeProgram* load_program(const char* path);
+
+/**
+ * Same as load_program but silent, for callers that fall back to compiling the source.
+ */
+BytecodeProgram* load_program_quiet(const char* path);
+
+/**
+ * Unmaps the file a program was loaded from (called by free_program).
+ */
+void release_program_mapping(BytecodeProgram* program);
+
+/**
+ * Tells if a file name has the .clkb extension.
+ */
+bool is_bytecode_file(const char* path);
+
+
+#endif // BYTECODE_FILE_H
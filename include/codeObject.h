@@ -0,0 +1,174 @@
+/***********************************************************
+* File: codeObject.h
+* This file have the packed bytecode executed by the virtual machine.
+* The instructions produced by generate_bytecode are assembled into one code object
+* per function: a 1 byte opcode followed by fixed width little endian operands,
+* with the strings, floats and large ints kept in the function's constant pool.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#pragma once
+#ifndef CODE_OBJECT_H
+#define CODE_OBJECT_H
+
+#include <stdint.h>
+#include "bytecode.h"
+#include "runtimeValue.h"
+
+/*
+ * Operand layout of the packed opcodes (every other opcode has no operand):
+ *   OP_PUSH_INT          i16  small integer
+ *   OP_PUSH_BOOL         u8   0 or 1
+ *   OP_LOAD_CONST_       u16  constant pool index (string, float or large int)
+ *   OP_LOAD_LOCAL/STORE  u8   local slot (OP_UNSET_LOCAL too)
+ *   OP_LOAD_GLOBAL/STORE u16  global slot (OP_OR_GLOBAL too)
+ *   OP_LOAD_UPVALUE      u8   capture index of the function
+ *   OP_JUMP_TO(_IF_FALSE)u32  byte offset in the same code object
+ *   OP_BUILD_ARRAY       u16  element count
+ *   OP_DECL_FUNCTION     u16  function index in the program
+ *   OP_CALL_FUNCTION     u16  constant index of the name, u8 argument count
+ *   OP_SWITCH_           u8   table layout, u16 constant index of the table, u32 byte offset of the default
+ *   OP_FOR_PREP/LOOP_LOCAL  u8 counter slot (the limit is the next slot), u8 named counter slot, u32 byte offset
+ *   OP_FOR_PREP/LOOP_GLOBAL u16 counter slot, u16 named counter slot, u32 byte offset
+ *                        (a loop without a name gives the counter slot as its named counter)
+ * Superinstructions:
+ *   OP_INC_LOCAL                    u8 local slot, i16 increment
+ *   OP_INC_GLOBAL                   u16 global slot, i16 increment
+ *   OP_COMPARE_JUMP_IF_FALSE        u8 comparison opcode, u32 byte offset
+ *   OP_COMPARE_LOCALS_JUMP_IF_FALSE u8 local slot, u8 local slot, u8 comparison opcode, u32 byte offset
+ *   OP_LOAD_LOCAL_ELEMENT           u8 local slot of the array, u8 local slot of the index
+ * The quickened operators (OP_ADD_INT_INT, ...) have no operand either. They only exist in
+ * running code: vm_run rewrites a generic operator in place once it has seen its operand types.
+ */
+
+/*
+ * Layouts of the OP_SWITCH_ tables. A table is a run of constants at the end of the pool,
+ * every target is the byte offset of a case body (or of the default, for unused slots):
+ *   SWITCH_DENSE   lowest case, slot count n, n targets (slot = selector - lowest case)
+ *   SWITCH_SORTED  case count n, n int cases in ascending order, n targets (binary search)
+ *   SWITCH_HASH    slot count m (a power of two, at most half used), seed, m string cases
+ *                  (int 0 in unused slots), m targets (linear probing from the seeded hash)
+ * An int case only matches an int selector and a string case only a string selector.
+ */
+#define SWITCH_DENSE  0
+#define SWITCH_SORTED 1
+#define SWITCH_HASH   2
+
+/**
+ * The compiled code of one function (function 0 is the top level program).
+ */
+typedef struct CodeObject {
+    char* name;                 // Function name ("<main>" for the program)
+    int param_count;            // Number of parameters (first local slots)
+    int local_count;            // Parameters + variables assigned in the body
+    uint8_t* code;              // Packed instructions
+    size_t code_size;           // Size of the code in bytes
+    RuntimeValue* constants;    // Constant pool
+    size_t constant_count;      // Number of constants
+    size_t max_stack;           // Deepest operand stack of a call, above the locals (set by the verifier)
+    const ASTNode* declaration; // Stub not compiled yet: its declaration (NULL once compiled, see compile_function)
+    Capture* captures;          // Variables the declaring call passes in, read with OP_LOAD_UPVALUE
+    int capture_count;          // Number of captures
+} CodeObject;
+
+/**
+ * A whole compiled program: its functions and its global variable slots.
+ */
+typedef struct {
+    CodeObject* functions;      // Function table, [0] is the top level code
+    size_t function_count;      // Number of functions
+    size_t function_capacity;   // Room of the table, sized once so code objects never move
+    char** global_names;        // Name of each global slot
+    size_t global_count;        // Number of global slots
+    void* mapping;              // .clkb file the code and strings point into (NULL if compiled in memory)
+    size_t mapping_size;        // Size of the mapping
+    bool verified;              // Passed verify_program, the VM only runs verified programs
+} BytecodeProgram;
+
+/**
+ * Assembles the output of generate_bytecode into a packed program with room for
+ * function_capacity functions. The global slots are taken from the last generate_bytecode call.
+ */
+BytecodeProgram* assemble_program(const BytecodeInstruction* bytecode, size_t bytecode_count, size_t function_capacity);
+
+/**
+ * Generates the bytecode of an AST and assembles it into a packed program.
+ * Only the top level code is compiled: every declared function is a stub that keeps its
+ * declaration, so the AST must outlive the program until compile_all_functions.
+ * The AST is resolved on the way (see resolver.h).
+ */
+BytecodeProgram* compile_program(ASTNode* root);
+
+/**
+ * Compiles a stub of the program in place (the VM does it on the first call). Functions
+ * declared in its body become new stubs and its new global variables new slots.
+ */
+void compile_function(const BytecodeProgram* program, const CodeObject* function);
+
+/**
+ * Compiles every stub left, for the users of the whole program (.clkb files, register code).
+ */
+void compile_all_functions(const BytecodeProgram* program);
+
+/**
+ * Frees a program and everything it owns.
+ */
+void free_program(BytecodeProgram* program);
+
+/**
+ * Returns the size in bytes of the instruction starting with the given opcode, 0 if the opcode is unknown.
+ */
+size_t packed_instruction_size(uint8_t opcode);
+
+/**
+ * Position of the u32 jump target inside a packed instruction, 0 if the opcode doesn't jump.
+ */
+size_t packed_jump_operand(uint8_t opcode);
+
+/**
+ * Number of operand stack values the instruction at p takes (pops) and leaves (pushes).
+ * `opcode` is its opcode, or the generic operator of a quickened one.
+ */
+void packed_stack_effect(uint8_t opcode, const uint8_t* p, int* pops, int* pushes);
+
+/**
+ * Byte offset an OP_SWITCH_ (starting at p) jumps to for the given selector.
+ */
+uint32_t switch_target(const CodeObject* function, const uint8_t* p, const RuntimeValue* selector);
+
+/**
+ * Number of target slots in the table of an OP_SWITCH_, 0 if the table is malformed,
+ * and the byte offset stored in one of them.
+ */
+size_t switch_slot_count(const CodeObject* function, const uint8_t* p);
+uint32_t switch_slot_target(const CodeObject* function, const uint8_t* p, size_t slot);
+
+/**
+ * Little endian operand readers.
+ */
+static inline uint16_t read_u16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t read_u32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * Prints the decoded packed bytecode of every function of the program.
+ */
+void print_byteCode(const BytecodeProgram* program);
+
+/**
+ * Prints the decoded packed bytecode of one function. counts, when not NULL, holds one
+ * execution count per byte of code and each instruction is printed with its own.
+ */
+void print_function_code(const BytecodeProgram* program, size_t index, const unsigned long long* counts, FILE* out);
+
+
+#endif // CODE_OBJECT_H
@@ -0,0 +1,38 @@
+/***********************************************************
+* File: compileCache.h
+* This file have the compilation cache of the interpreter.
+* Compiled programs are stored as .clkb files keyed by a hash of the source,
+* so running an unchanged script again skips the lexer, the parser and the compiler.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#pragma once
+#ifndef COMPILE_CACHE_H
+#define COMPILE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "codeObject.h"
+
+#define CLOCK_CACHE_ENV "CLOCK_CACHE_DIR"   // Overrides the cache directory
+
+/**
+ * Returns the cached program compiled from this source, or NULL on a miss.
+ * Entries written by another interpreter build never match.
+ */
+BytecodeProgram* cache_lookup(const char* source, size_t length);
+
+/**
+ * Stores a program compiled from this source. The entry is written to a temporary
+ * file and renamed into place, so readers never see a partial file.
+ * Returns false if the cache could not be written (the program still runs).
+ */
+bool cache_store(const char* source, size_t length, const BytecodeProgram* program);
+
+
+#endif // COMPILE_CACHE_H
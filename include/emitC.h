@@ -0,0 +1,33 @@
+/***********************************************************
+* File: emitC.h
+* This file have the C back end of the compiler (cllc --emit-c).
+* The AST is translated into a standalone C file that links against the runtime
+* library (runtimeValue.c and runtimeEnv.c) and builds with any C compiler.
+* Variables whose type is known when the program is translated become native
+* long/double/bool locals, everything else stays a RuntimeValue.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#pragma once
+#ifndef EMIT_C_H
+#define EMIT_C_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "ast.h"
+
+/**
+ * Writes the C translation of a parsed program to `out`. `source_name` only goes
+ * into the comment at the top of the file. Returns false (after reporting why on
+ * stderr) if the program uses something the translator can't express, in which case
+ * nothing is written.
+ */
+bool emit_c_program(const ASTNode* root, const char* source_name, FILE* out);
+
+
+#endif // EMIT_C_H
@@ -17,6 +17,9 @@
 
 #include "RuntimeEnv.h"
 
+#define INTERPRETER_STACK_SIZE 65536 // Value stack shared by the call frames (arguments and locals)
+#define INTERPRETER_MAX_CALL_DEPTH 1024 // Nested calls (a tail call reuses its frame), like the VM's VM_MAX_FRAMES
+
 
 /**
  * Evaluate (execute) the AST starting from the given node.
@@ -42,26 +45,20 @@ RuntimeValue eval_for_statement(ASTNode* node, RuntimeEnvironment* env);
 RuntimeValue eval_binary_expr(ASTNode* node, RuntimeEnvironment* env);
 RuntimeValue eval_unary_expr(ASTNode* node, RuntimeEnvironment* env);
 RuntimeValue eval_function_call(ASTNode* node, RuntimeEnvironment* env);
-RuntimeValue evaluate_comparison(const char* op, RuntimeValue leftVal, RuntimeValue rightVal);
-RuntimeValue* collect_arguments(ASTNode* argsNode, RuntimeEnvironment* env, size_t* out_count);
+RuntimeValue evaluate_comparison(ASTOperator op, RuntimeValue leftVal, RuntimeValue rightVal);
+bool push_arguments(ASTNode* callNode, RuntimeEnvironment* env, size_t* out_count);
 RuntimeValue eval_condition(ASTNode* node, RuntimeEnvironment* env);
-RuntimeValue make_special_value(const char* special);
 RuntimeValue make_array_value(RuntimeValue* elements, size_t count);
 RuntimeValue eval_array_literal(ASTNode* node, RuntimeEnvironment* env);
 RuntimeValue eval_array_access(ASTNode* node, RuntimeEnvironment* env);
-RuntimeValue apply_compound_operator(const char* op, RuntimeValue leftVal, RuntimeValue rightVal);
+RuntimeValue apply_compound_operator(ASTOperator op, RuntimeValue leftVal, RuntimeValue rightVal);
 RuntimeValue eval_function_declaration(ASTNode* node, RuntimeEnvironment* env);
 RuntimeValue eval_user_function_call(RuntimeValue functionVal, RuntimeValue* args, size_t arg_count);
-ASTNode* create_param_list_node(ASTNode** paramList, size_t paramCount);
 RuntimeValue convert_return_val_to_datatype(RuntimeValue value);
 RuntimeValue eval_switch_statement(ASTNode* node, RuntimeEnvironment* env);
 
-// Helper functions for switch statements
-RuntimeValue eval_when_case(ASTNode* caseNode, RuntimeValue switchValue, RuntimeEnvironment* env);
-RuntimeValue eval_default_case(ASTNode* defaultNode, RuntimeEnvironment* env);
-
-// Helper functions for return statements
-ASTNode* find_next_node_after_return(ASTNode* returnNode);
+// Return statements (the value goes to the frame, see CompletionType)
+RuntimeValue eval_return_statement(ASTNode* node, RuntimeEnvironment* env);
 
 // Helper function to print master return value
 void print_return(RuntimeEnvironment* env);
@@ -70,9 +67,9 @@ void print_return(RuntimeEnvironment* env);
 /**
  * The main entry point for interpreting the entire AST program.
  * Creates an environment, evaluates the root node (usually AST_PROGRAM),
- * and then cleans up.
+ * and then cleans up. Returns false when a runtime error stopped the program.
  */
-void interpret(ASTNode* root);
+bool interpret(ASTNode* root);
 
 
 
@@ -0,0 +1,113 @@
+/***********************************************************
+* File: jit.h
+* This file have the baseline JIT of the stack engine.
+* A hot code object is translated into x86-64 machine code by stitching one template
+* per instruction into an executable buffer. The templates keep the operand stack in
+* memory, inline the int fast paths and call back into the VM for everything else.
+* Only Linux x86-64 has a code generator, on other targets jit_compile always fails.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#pragma once
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "codeObject.h"
+
+// The templates use the System V calling convention, build with -DCLOCK_NO_JIT to leave the JIT out
+#if defined(__x86_64__) && !defined(_WIN32) && !defined(CLOCK_NO_JIT)
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+#ifndef JIT_HOT_THRESHOLD
+#define JIT_HOT_THRESHOLD 1000   // Calls + loop backedges before a function is compiled
+#endif
+
+/**
+ * The slow paths the machine code calls back into. They have the same semantics
+ * as the vm_run handlers, so compiled and interpreted code can't be told apart.
+ * `top` is the first free operand stack slot, the operands are right below it.
+ */
+typedef struct {
+    void (*binary)(RuntimeValue* top, int op);                  // top[-2] = top[-2] op top[-1]
+    void (*unary)(RuntimeValue* top, int op);                   // top[-1] = op top[-1]
+    bool (*truthy)(const RuntimeValue* value);                  // truthiness of if/while
+    bool (*test)(const RuntimeValue* left, const RuntimeValue* right, int op); // fused compare-and-jump
+    void (*increment)(RuntimeValue* slot, int delta);           // OP_INC_LOCAL / OP_INC_GLOBAL on a non int
+    bool (*for_next)(RuntimeValue* counter, const RuntimeValue* limit, RuntimeValue* named, int step); // OP_FOR_* on a non int
+    void (*unset_global)(void* vm, int slot);                   // warning of a read of an unset global
+    void (*array_get)(RuntimeValue* result, const RuntimeValue* array, const RuntimeValue* index);
+    void (*array_set)(RuntimeValue* top);                       // top[-3][top[-2]] = top[-1], leaves the value
+    void (*build_array)(void* vm, RuntimeValue* top, int count); // top[-count] = array of the top count values
+} JitRuntime;
+
+/**
+ * The machine code of one code object. It can be entered at any instruction and runs
+ * until an instruction it leaves to the interpreter (calls, returns, declarations, halt).
+ */
+typedef struct {
+    uint8_t* memory;             // Executable mapping
+    size_t memory_size;          // Size of the mapping
+    uint32_t* entries;           // Machine code offset of each bytecode offset (UINT32_MAX inside instructions)
+    size_t code_size;            // Bytecode size of the code object
+    size_t max_depth;            // Deepest operand stack the code object reaches above its locals
+} JitCode;
+
+/**
+ * Where the machine code stopped: the next instruction for the interpreter and the
+ * new top of the operand stack.
+ */
+typedef struct {
+    const uint8_t* ip;
+    RuntimeValue* top;
+} JitExit;
+
+/**
+ * Totals of the JIT for the current run (used by --vm-stats).
+ */
+typedef struct {
+    size_t functions_compiled;   // Code objects translated
+    size_t functions_rejected;   // Hot code objects the JIT couldn't translate
+    size_t code_bytes;           // Machine code generated
+    unsigned long long entries;  // Transfers from the interpreter into machine code
+} JitStats;
+
+/**
+ * Translates a code object, NULL if it can't be compiled (unsupported target, stack
+ * depths that don't match or no executable memory). Constants are referenced in place,
+ * so the code object must outlive the machine code.
+ */
+JitCode* jit_compile(const CodeObject* function, const JitRuntime* runtime);
+
+/**
+ * Runs the machine code from the instruction at ip until it leaves to the interpreter.
+ * `locals` is the frame's first local slot, `top` the first free operand stack slot and
+ * `vm` is passed back to the runtime calls.
+ */
+JitExit jit_enter(const JitCode* code, const CodeObject* function, const uint8_t* ip,
+    void* vm, RuntimeValue* locals, RuntimeValue* globals, RuntimeValue* top);
+
+/**
+ * Frees the machine code.
+ */
+void jit_free(JitCode* code);
+
+/**
+ * Statistics of the current run.
+ */
+const JitStats* jit_stats(void);
+void jit_reset_stats(void);
+void print_jit_stats(FILE* out);
+
+
+#endif // JIT_H
@@ -0,0 +1,53 @@
+/***********************************************************
+* File: optimizer.h
+* This file have the peephole optimizer of the bytecode.
+* It runs between generate_bytecode and the assembler, so every engine
+* that executes the bytecode gets the smaller program.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#pragma once
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "bytecode.h"
+
+/**
+ * What the optimize_bytecode calls since the last reset_optimizer_stats did.
+ */
+typedef struct {
+    size_t instructions_before;   // Instructions generated
+    size_t instructions_after;    // Instructions left
+    size_t constants_folded;      // push/push/op (and push/op) sequences folded into one push
+    size_t branches_folded;       // Conditional jumps on a constant removed or made unconditional
+    size_t jumps_threaded;        // Jumps retargeted past a chain of OP_JUMP_TO
+    size_t stores_forwarded;      // store x / load x pairs turned into dup / store x
+    size_t dead_removed;          // Unreachable instructions removed
+    size_t superinstructions;     // Sequences fused into one superinstruction
+} OptimizerStats;
+
+/**
+ * Optimizes the bytecode of one function in place and returns the new instruction count.
+ * Jump targets are kept consistent.
+ */
+size_t optimize_bytecode(BytecodeInstruction* bytecode, size_t bytecode_count);
+
+/**
+ * Statistics of the optimize_bytecode calls since the last reset (compile_program resets
+ * them, the functions compiled on their first call add to them).
+ */
+const OptimizerStats* optimizer_stats(void);
+void reset_optimizer_stats(void);
+
+/**
+ * Prints the statistics of the optimize_bytecode calls since the last reset (used by --vm-stats).
+ */
+void print_optimizer_stats(FILE* out);
+
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,133 @@
+/***********************************************************
+* File: registerCode.h
+* This file have the register encoding of the bytecode, run by the --registers engine.
+* Each code object of a packed program is translated into three address code:
+* the operand stack becomes virtual registers, which a linear scan allocator
+* then maps onto a small register window per call.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#pragma once
+#ifndef REGISTER_CODE_H
+#define REGISTER_CODE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "codeObject.h"
+
+#define REGISTER_WINDOW_MAX 256   // Register operands are one byte
+
+/*
+ * Register window of a call (every register operand indexes it):
+ *   [0, local_count)                   parameters and locals (the global slots in <main>)
+ *   [local_count, constant_base)       temporaries given by the register allocator
+ *   [constant_base, register_count)    constants, copied in when the call starts
+ *   [register_count, frame_size)       outgoing arguments of calls and array literals
+ *
+ * Instructions are 32 bit words: opcode | A << 8 | B << 16 | C << 24.
+ * Jumps, calls, compare-and-jumps, switches, counted loops and REG_OR_GLOBAL are followed by a second word (W).
+ */
+typedef enum {
+    REG_MOVE,                       // R[A] = R[B]
+    REG_LOAD_GLOBAL,                // R[A] = global slot (B | C << 8)
+    REG_STORE_GLOBAL,               // global slot (B | C << 8) = R[A]
+    REG_LOAD_UPVALUE,               // R[A] = captured variable (B | C << 8) of the function
+    REG_OR_GLOBAL,                  // R[A] = R[B], or global slot W while R[B] is an unassigned local (OP_OR_GLOBAL)
+    REG_ADD,                        // R[A] = R[B] + R[C] (same for the operators below)
+    REG_SUBTRACT,
+    REG_MULTIPLY,
+    REG_DIVIDE,
+    REG_MODULO,
+    REG_LESS,
+    REG_GREATER,
+    REG_LESS_EQUAL,
+    REG_GREATER_EQUAL,
+    REG_EQUAL,
+    REG_NOT_EQUAL,
+    REG_AND,
+    REG_OR,
+    REG_NEGATE,                     // R[A] = -R[B]
+    REG_NOT,                        // R[A] = !R[B]
+    REG_BIT_NOT,                    // R[A] = ~R[B]
+    REG_JUMP,                       // jump to the instruction (word >> 8)
+    REG_JUMP_IF_FALSE,              // if R[A] is false: jump to W
+    REG_SWITCH,                     // jump to labels[switch_target of the OP_SWITCH_ at stack code offset W, R[A]]
+    REG_FOR_PREP,                   // unless R[A] < R[B]: jump to W, else R[C] = R[A]
+    REG_FOR_LOOP,                   // R[A] += 1, if R[A] < R[B]: R[C] = R[A] and jump to W
+    REG_LESS_JUMP_IF_FALSE,         // if !(R[B] < R[C]): jump to W (same for the comparisons below)
+    REG_GREATER_JUMP_IF_FALSE,
+    REG_LESS_EQUAL_JUMP_IF_FALSE,
+    REG_GREATER_EQUAL_JUMP_IF_FALSE,
+    REG_EQUAL_JUMP_IF_FALSE,
+    REG_NOT_EQUAL_JUMP_IF_FALSE,
+    REG_GET_ELEMENT,                // R[A] = R[B][R[C]]
+    REG_SET_ELEMENT,                // R[A][R[B]] = R[C]
+    REG_BUILD_ARRAY,                // R[A] = array of the first (B | C << 8) outgoing registers
+    REG_DECL_FUNCTION,              // declare the function (word >> 8) of the program
+    REG_CALL,                       // R[A] = call of the function named by constant W with B outgoing arguments
+    REG_TAIL_CALL,                  // REG_CALL of `return f(...)`: the callee takes over the frame (REG_RETURN R[A] follows)
+    REG_RETURN,                     // return R[A]
+    REG_HALT,                       // stop the program
+    REG_COUNT_ // Number of register opcodes (keep last)
+} RegisterOpcode;
+
+/**
+ * The register code of one function, parallel to its CodeObject.
+ */
+typedef struct {
+    uint32_t* code;              // Register instructions
+    size_t code_size;            // Number of words
+    size_t instruction_count;    // Number of instructions (jumps and calls take two words)
+    size_t stack_instruction_count; // Instructions of the stack code it was translated from
+    int param_count;             // Number of parameters (first registers)
+    int local_count;             // Parameters + locals, or the global slots in <main>
+    int virtual_count;           // Virtual registers before allocation
+    int temp_count;              // Registers given to them by the allocator
+    int constant_base;           // First constant register
+    int register_count;          // Locals + temporaries + constants
+    int frame_size;              // register_count + the largest outgoing argument list
+    RuntimeValue* constants;     // Initial values of the constant registers
+    size_t constant_count;       // Number of constant registers
+    uint32_t* labels;            // Word position of each stack code offset a switch jumps to (NULL without switches)
+} RegisterFunction;
+
+/**
+ * A whole program in register code.
+ */
+typedef struct {
+    const BytecodeProgram* program;  // Stack code it was translated from (owns the names and strings)
+    RegisterFunction* functions;     // Parallel to program->functions
+    size_t function_count;           // Number of functions
+} RegisterProgram;
+
+/**
+ * Translates every function of a packed program into register code.
+ * Returns NULL when a function doesn't fit in REGISTER_WINDOW_MAX registers
+ * (the program then has to run on the stack engine).
+ */
+RegisterProgram* build_register_program(const BytecodeProgram* program);
+
+/**
+ * Frees a register program (the stack program it was built from is left alone).
+ */
+void free_register_program(RegisterProgram* registers);
+
+/**
+ * Prints the register code of every function of the program.
+ */
+void print_register_code(const RegisterProgram* registers);
+
+/**
+ * Prints the instruction and register counts of the translation (used by --vm-stats).
+ */
+void print_register_stats(const RegisterProgram* registers, FILE* out);
+
+extern const char* RegisterOpcodeNames[];
+
+
+#endif // REGISTER_CODE_H
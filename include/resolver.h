@@ -0,0 +1,33 @@
+/***********************************************************
+* File: resolver.h
+* This file have the resolver of the tree-walking interpreter. It runs once over the AST
+* before the program is interpreted and gives every variable its frame slot: each function
+* declaration gets the layout of its frame (parameters first, then every variable the body
+* assigns and every for counter), the program gets one for its global variables, and every
+* use of a variable is annotated with where it lives (see VariableScope) and its index there.
+* A function that uses variables of the functions around it captures just those (its
+* upvalue_layout): the declaration stores a pointer to each one and the calls read them
+* through it, so reading any variable is an array index instead of a search by name up the
+* chain of environments.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#pragma once
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "ast.h"
+
+/**
+ * Resolves the variables of a program (root is the AST_PROGRAM node). The layout of the
+ * global variables is left in root->frame_layout. Resolving a program twice does nothing.
+ */
+void resolve_program(ASTNode* root);
+
+
+#endif // RESOLVER_H
@@ -28,6 +28,18 @@ typedef struct EnvEntry {
     struct EnvEntry* next;
 } EnvEntry;
 
+/**
+ * How the statement evaluated last completed. Anything but COMPLETION_NORMAL makes the
+ * enclosing statements stop one by one up to the one that handles it: the innermost loop
+ * (or switch, for stop) or the function call, for return.
+ */
+typedef enum {
+    COMPLETION_NORMAL,   // Run the next statement
+    COMPLETION_BREAK,    // stop
+    COMPLETION_CONTINUE, // continue
+    COMPLETION_RETURN    // return, the value is in return_value
+} CompletionType;
+
 /**
  * The environment (or context) with a hash table of EnvEntries.
  */
@@ -36,11 +48,35 @@ typedef struct RuntimeEnvironment {
 	EnvEntry* variables; // The hash table of variable bindings
 	EnvEntry* functions; // The hash table of function bindings
     struct RuntimeEnvironment* parent;
-    bool function_returned; // Flag to indicate if a function has returned
+    CompletionType completion; // How the last statement of this frame completed
     bool is_Function;
     RuntimeValue return_value; // The value returned by a function
+    RuntimeValue* slots;       // Call frame: window of the interpreter value stack (NULL otherwise)
+    const ASTNode* layout;     // Call frame: one identifier per slot, parameters first
+    RuntimeValue** upvalues;   // Call frame: the variables the function captured
 } RuntimeEnvironment;
 
+/**
+ * Bumped when a declaration changes what a function name resolves to (see env_set_func),
+ * so an inline cache is valid as long as the version it was filled at is still current.
+ */
+extern unsigned long function_definition_version;
+
+/**
+ * Monomorphic inline cache of a function call site.
+ */
+typedef struct {
+    unsigned long version;  // function_definition_version when filled (0 = empty)
+    RuntimeValue function;  // Resolved callee
+} FunctionCache;
+
+/**
+ * Whether a call site may keep the callee in its FunctionCache: builtins and functions
+ * declared in the global environment. A function declared inside a call only lives as
+ * long as that call, so it is looked up by name every time.
+ */
+bool function_is_cacheable(RuntimeValue function);
+
 /**
  * Initialize an environment with a given capacity (e.g., 128).
  */
@@ -51,6 +87,12 @@ RuntimeEnvironment* create_environment(RuntimeEnvironment* parent);
  */
 void free_environment(RuntimeEnvironment* env);
 
+/**
+ * Free the EnvEntry nodes of a finished call but not the values, which may still be in use
+ * (e.g. the return value). The environment itself is not freed.
+ */
+void release_environment_entries(RuntimeEnvironment* env);
+
 /**
  * Set or update a variable in the environment.
  * - If the key already exists, updates the value.
@@ -32,7 +32,8 @@ typedef enum {
     RUNTIME_VALUE_BUILTIN,
     RUNTIME_VALUE_FUNCTION,
     RUNTIME_VALUE_SPECIAL,
-    RUNTIME_VALUE_ARRAY
+    RUNTIME_VALUE_ARRAY,
+    RUNTIME_VALUE_UNSET     // A local that hides a global and was not assigned yet (never seen by the program)
 } RuntimeValueType;
 
 struct RuntimeValue; // Forward declaration
@@ -55,10 +56,11 @@ typedef struct RuntimeValue {
         } array_val;
 
         struct {
-            struct RuntimeValue* (*fn)(struct RuntimeValue* args, size_t argc); // Function pointer
+            struct RuntimeValue** upvalues;                                    // Captured variables (see resolver.h), NULL if none
             struct RuntimeEnvironment* env;                                    // Environment for the function
             ASTNode* body;                                                     // User-defined function bod
             ASTNode* parameters;                                               // Parameters of the function
+            const void* code;                                                  // Compiled declaration when run by the bytecode VM (NULL otherwise)
         } function_val;
 
 
@@ -96,6 +98,11 @@ RuntimeValue make_string_value(const char* s);
  */
 RuntimeValue make_null_value(void);
 
+/**
+ * Create the value of a local that was not assigned yet (see RUNTIME_VALUE_UNSET).
+ */
+RuntimeValue make_unset_value(void);
+
 /**
  * Create a runtime value for a built-in function.
  */
@@ -0,0 +1,36 @@
+/***********************************************************
+* File: verifier.h
+* This file have the bytecode verifier. Every program is verified once, when it is
+* assembled or loaded from a .clkb file, before any engine runs it: the operands are in
+* range, jumps land on instructions and the operand stack has the same depth on every path,
+* which never goes below the frame nor above the depth recorded for the function.
+* The stack VM relies on it to push and pop without checks.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#pragma once
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+#include <stdbool.h>
+#include "codeObject.h"
+
+/**
+ * Verifies one function of a program and records its deepest operand stack in max_stack.
+ * Returns false (without reporting anything) if the code can't be run safely.
+ */
+bool verify_function(CodeObject* function, const BytecodeProgram* program);
+
+/**
+ * Verifies every compiled function of a program and marks it as verified.
+ * Returns false if any function fails.
+ */
+bool verify_program(BytecodeProgram* program);
+
+
+#endif // VERIFIER_H
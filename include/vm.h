@@ -0,0 +1,148 @@
+/***********************************************************
+* File: vm.h
+* This file contains the virtual machine for the Clock coding language.
+* The virtual machine executes the bytecode produced by generate_bytecode
+* with an operand stack and call frames instead of walking the AST.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#pragma once
+#ifndef VM_H
+#define VM_H
+
+#include "codeObject.h"
+#include "registerCode.h"
+#include "jit.h"
+#include "runtimeEnv.h"
+
+#define VM_MAX_FRAMES 1024   // Maximum call depth
+// Operand stack slots shared by every frame. A register window never has more than
+// REGISTER_WINDOW_MAX registers, so both engines reach VM_MAX_FRAMES before running out of slots
+#define VM_STACK_SIZE (VM_MAX_FRAMES * REGISTER_WINDOW_MAX)
+
+/**
+ * The two encodings the VM can execute: the packed stack code, or the register
+ * code translated from it (--registers).
+ */
+typedef enum {
+    VM_ENGINE_STACK,
+    VM_ENGINE_REGISTER
+} VmEngine;
+
+/**
+ * One activation of a function (frame 0 is the top level program).
+ */
+typedef struct {
+    const CodeObject* function; // Function running in this frame
+    const uint8_t* return_ip;  // Instruction to resume in the caller
+    size_t stack_base;         // First operand stack slot owned by this frame (its locals start here)
+    RuntimeEnvironment* env;   // Functions visible to this activation
+    bool owns_env;             // env was created for this call and is released on return
+    RuntimeValue** upvalues;   // Variables the function captured where it was declared (OP_LOAD_UPVALUE)
+    FunctionCache* caches;     // Inline caches of the function, indexed by the constant of the callee name
+    const uint32_t* return_pc; // Register engine: instruction to resume in the caller
+    size_t return_register;    // Register engine: caller register receiving the result
+} CallFrame;
+
+/**
+ * The state of the virtual machine.
+ */
+typedef struct {
+    const BytecodeProgram* program;  // Program being executed
+    const CodeObject* function;      // Function of the current frame
+    const uint8_t* ip;               // Next instruction (synced with vm_run's copy around calls)
+
+    const RegisterProgram* registers;  // Register code of the program (register engine only)
+
+    RuntimeValue stack[VM_STACK_SIZE]; // Operand stack (register windows in the register engine)
+    size_t sp;                         // Number of values on the operand stack
+
+    CallFrame frames[VM_MAX_FRAMES];   // Call stack
+    size_t frame_count;                // Number of active frames
+
+    RuntimeEnvironment* globals;       // Global environment (with the built in functions)
+    RuntimeValue* global_slots;        // Global variables, indexed by the compiler's global slots
+    size_t global_count;               // Number of global slots
+    FunctionCache** call_caches;       // Inline caches of each function (one per constant), allocated on its first call
+    JitCode** jit_code;                // Machine code of each function, NULL until it gets hot (NULL array without the JIT)
+    unsigned* jit_counters;            // Calls + loop backedges of each function, UINT_MAX once the JIT gave up on it
+    bool returned;                     // A top level `return` stopped the program
+    RuntimeValue return_value;         // Value of the top level `return`
+    unsigned long long dispatch_count; // Instructions executed (only counted with -DCLOCK_COUNT_DISPATCH)
+} VirtualMachine;
+
+/**
+ * What quickening did during the last run of the stack engine.
+ */
+typedef struct {
+    unsigned long long quickened;     // Generic operators rewritten to a type specialized opcode
+    unsigned long long dequickened;   // Specialized opcodes put back after a type miss
+} QuickeningStats;
+
+/**
+ * Prepares a virtual machine to run the given program.
+ */
+void vm_init(VirtualMachine* vm, const BytecodeProgram* program);
+
+/**
+ * Runs the bytecode until OP_HALT, the end of the code or a top level return.
+ */
+RuntimeValue vm_run(VirtualMachine* vm);
+
+/**
+ * Switches a virtual machine prepared by vm_init to the register code of its program.
+ * <main>'s register window starts with the global slots.
+ */
+void vm_init_registers(VirtualMachine* vm, const RegisterProgram* registers);
+
+/**
+ * Runs the register code until REG_HALT or a top level return.
+ */
+RuntimeValue vm_run_registers(VirtualMachine* vm);
+
+/**
+ * Releases the environments owned by the virtual machine.
+ */
+void vm_free(VirtualMachine* vm);
+
+/**
+ * Selects the encoding run_program executes (the stack code by default).
+ */
+void vm_select_engine(VmEngine engine);
+
+/**
+ * Enables or disables the JIT of the stack engine (enabled by default where it is supported).
+ */
+void vm_set_jit(bool enabled);
+
+/**
+ * Enables or disables the instruction profiler of the stack engine (see vmProfile.h).
+ * The profile of the last run stays until free_profile.
+ */
+void vm_set_profile(bool enabled);
+
+/**
+ * Runs a compiled program on the virtual machine and prints its master return value.
+ * With the register engine, programs that don't fit the register windows run on the stack engine.
+ */
+void run_program(const BytecodeProgram* program);
+
+/**
+ * Statistics of the quickening done by the last run (used by --vm-stats).
+ */
+const QuickeningStats* vm_quickening_stats(void);
+void print_quickening_stats(FILE* out);
+
+/**
+ * The main entry point for running a program on the virtual machine.
+ * Compiles the AST to bytecode, executes it and prints the master return value.
+ */
+void interpret_bytecode(ASTNode* root);
+
+
+#endif // VM_H
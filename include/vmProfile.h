@@ -0,0 +1,107 @@
+/***********************************************************
+* File: vmProfile.h
+* This file have the instruction profiler of the stack engine (--vm-stats). While it is on,
+* every dispatch of vm_run goes through profile_instruction, which counts the executions of
+* each opcode, of each pair of consecutive opcodes and of each instruction, and charges the
+* time until the next dispatch to the opcode (cycles of the time stamp counter on x86,
+* nanoseconds elsewhere). When it is off, vm_run dispatches exactly as without it.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#pragma once
+#ifndef VM_PROFILE_H
+#define VM_PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "codeObject.h"
+
+// Time source of the profiler: the time stamp counter where there is one
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define PROFILE_UNIT "cycles"
+static inline uint64_t profile_clock(void) {
+    return __rdtsc();
+}
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define PROFILE_UNIT "cycles"
+static inline uint64_t profile_clock(void) {
+    return __rdtsc();
+}
+#else
+#include <time.h>
+#define PROFILE_UNIT "ns"
+static inline uint64_t profile_clock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+#endif
+
+/**
+ * What the profiler measured during the last run.
+ */
+typedef struct {
+    bool active;                                    // profile_instruction is called on every dispatch
+    const BytecodeProgram* program;                 // Program being profiled
+    unsigned long long counts[OP_COUNT_];           // Executions of each opcode
+    unsigned long long cycles[OP_COUNT_];           // Time from a dispatch of the opcode to the next dispatch
+    unsigned long long pairs[OP_COUNT_][OP_COUNT_]; // pairs[a][b]: b dispatched right after a
+    unsigned long long** executions;                // Executions of each instruction, per function (NULL until it runs) and byte of code
+    unsigned previous;                              // Opcode of the last dispatch, OP_COUNT_ before the first one
+    uint64_t previous_clock;                        // Time at the end of the last profile_instruction
+    uint64_t clock_overhead;                        // Cost of one profile_clock, included in every dispatch
+} VmProfile;
+
+extern VmProfile vm_profile;
+
+/**
+ * Clears the profile and starts profiling a program (its run must follow).
+ */
+void profile_start(const BytecodeProgram* program);
+
+/**
+ * Allocates the execution counts of a function the first time it runs (it may have been
+ * compiled after profile_start).
+ */
+unsigned long long* profile_function(const CodeObject* function);
+
+/**
+ * Records the dispatch of the instruction at ip, in the given function of the profiled program.
+ */
+static inline void profile_instruction(const CodeObject* function, const uint8_t* ip) {
+    uint64_t now = profile_clock();
+    uint8_t opcode = *ip;
+    if (vm_profile.previous < OP_COUNT_) {
+        vm_profile.cycles[vm_profile.previous] += now - vm_profile.previous_clock;
+        vm_profile.pairs[vm_profile.previous][opcode]++;
+    }
+    vm_profile.counts[opcode]++;
+    unsigned long long* executions = vm_profile.executions[function - vm_profile.program->functions];
+    if (!executions) executions = profile_function(function);
+    executions[ip - function->code]++;
+    vm_profile.previous = opcode;
+    // Read the clock again so the bookkeeping above isn't charged to the instruction
+    vm_profile.previous_clock = profile_clock();
+}
+
+/**
+ * Prints the opcodes sorted by time, the most frequent pairs and the annotated code of the
+ * hottest functions.
+ */
+void print_profile(FILE* out);
+
+/**
+ * Releases the profile (profiling stops).
+ */
+void free_profile(void);
+
+
+#endif // VM_PROFILE_H
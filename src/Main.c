@@ -5,6 +5,14 @@
 #include "parser.h"
 #include "interpreter.h"
 #include "bytecode.h"
+#include "vm.h"
+#include "vmProfile.h"
+#include "codeObject.h"
+#include "bytecodeFile.h"
+#include "compileCache.h"
+#include "optimizer.h"
+#include "registerCode.h"
+#include "emitC.h"
 
 #pragma warning(disable : 4996) 
 
@@ -115,13 +123,13 @@ void init_interpreter()
 
     // 5) Clean up: free AST, tokens, etc.
     if (debug) {
-        BytecodeInstruction* bytecode = malloc(sizeof(BytecodeInstruction) * 1024);
-        size_t bytecode_count = 0;
-        size_t bytecode_capacity = 1024;
-        generate_bytecode(root, &bytecode, &bytecode_count, &bytecode_capacity);
-        print_byteCode(bytecode, bytecode_count);
-
-        free(bytecode);
+        BytecodeProgram* program = compile_program(root);
+        compile_all_functions(program);
+        print_byteCode(program);
+        RegisterProgram* registers = build_register_program(program);
+        if (registers) print_register_code(registers);
+        free_register_program(registers);
+        free_program(program);
     }
 
 
@@ -135,10 +143,82 @@ void init_interpreter()
 }
 
 
+// --vm-stats: what quickening and the JIT did on the stack engine and where its time went, or how the program translated to register code
+static void print_engine_stats(const BytecodeProgram* program, bool use_registers) {
+    if (!use_registers) {
+        print_quickening_stats(stderr);
+        print_jit_stats(stderr);
+        print_profile(stderr);
+        free_profile();
+        return;
+    }
+    RegisterProgram* registers = build_register_program(program);
+    if (registers) print_register_stats(registers, stderr);
+    free_register_program(registers);
+}
+
+
 int main(int argc, char* argv[]) {
-    if (argc == 2) {
+    // Options may appear before or after the file name
+    bool use_vm = false;
+    bool compile_only = false;
+    bool emit_c = false;
+    bool use_cache = true;
+    bool vm_stats = false;
+    bool use_registers = false;
+    const char* filename = NULL;
+    const char* output = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--vm") == 0) {
+            use_vm = true;
+        }
+        else if (strcmp(argv[i], "--vm-stats") == 0) {
+            use_vm = true;
+            vm_stats = true;
+            vm_set_profile(true);
+        }
+        else if (strcmp(argv[i], "--registers") == 0) {
+            use_vm = true;
+            use_registers = true;
+        }
+        else if (strcmp(argv[i], "--no-jit") == 0) {
+            vm_set_jit(false);
+        }
+        else if (strcmp(argv[i], "--no-cache") == 0) {
+            use_cache = false;
+        }
+        else if (strcmp(argv[i], "--compile") == 0) {
+            compile_only = true;
+        }
+        else if (strcmp(argv[i], "--emit-c") == 0) {
+            emit_c = true;
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        }
+        else {
+            filename = argv[i];
+        }
+    }
+
+    if (use_registers) {
+        vm_select_engine(VM_ENGINE_REGISTER);
+    }
+
+    if (filename && is_bytecode_file(filename)) {
+        // Compiled file: no lexer/parser, the bytecode runs straight from the mapped file
+        BytecodeProgram* program = load_program(filename);
+        if (!program) {
+            return 1;
+        }
+
+        printf("\033[0;36m\n");
+        printf("Program Output: \n\n");
+        run_program(program);
+        free_program(program);
+    }
+    else if (filename) {
         // File mode
-        const char* filename = argv[1];
         FILE* file = fopen(filename, "rb");  // Open in binary mode
         if (!file) {
             perror("Error opening file");
@@ -171,20 +251,117 @@ int main(int argc, char* argv[]) {
         // Null-terminate the string
         sourceCode[length] = '\0';
 
+        // --emit-c translates the program to C (on stdout unless -o names a file)
+        if (emit_c) {
+            TokenArray tokens = tokenize(sourceCode);
+            Parser parser = create_parser(&tokens);
+            ASTNode* root = parse_program(&parser);
+
+            FILE* out = output ? fopen(output, "w") : stdout;
+            if (!out) {
+                perror("Error opening output file");
+                return 1;
+            }
+            bool written = emit_c_program(root, filename, out);
+            if (output) fclose(out);
+            if (!written && output) remove(output);
+
+            free_ast_node(root);
+            free_token_array(&tokens);
+            free(sourceCode);
+            return written ? 0 : 1;
+        }
+
+        // --compile writes the bytecode to a .clkb file instead of running the program
+        if (compile_only) {
+            TokenArray tokens = tokenize(sourceCode);
+            Parser parser = create_parser(&tokens);
+            ASTNode* root = parse_program(&parser);
+
+            // Default output: the source file name with the .clkb extension
+            char* defaultOutput = NULL;
+            if (!output) {
+                const char* dot = strrchr(filename, '.');
+                size_t stem = dot ? (size_t)(dot - filename) : strlen(filename);
+                defaultOutput = (char*)malloc(stem + sizeof(CLKB_EXTENSION));
+                if (!defaultOutput) {
+                    fprintf(stderr, "Memory allocation failed.\n");
+                    return 1;
+                }
+                memcpy(defaultOutput, filename, stem);
+                memcpy(defaultOutput + stem, CLKB_EXTENSION, sizeof(CLKB_EXTENSION));
+                output = defaultOutput;
+            }
+
+            BytecodeProgram* program = compile_program(root);
+            bool saved = save_program(program, output);
+
+            free_program(program);
+            free(defaultOutput);
+            free_ast_node(root);
+            free_token_array(&tokens);
+            free(sourceCode);
+            return saved ? 0 : 1;
+        }
+
         printf("\033[0;36m\n");
         printf("Program Output: \n\n");
 
+        // On the VM an unchanged script runs straight from the compilation cache
+        if (use_vm && use_cache) {
+            BytecodeProgram* program = cache_lookup(sourceCode, (size_t)length);
+            bool cached = program != NULL;
+            TokenArray tokens = { 0 };
+            ASTNode* root = NULL;
+            if (!program) {
+                tokens = tokenize(sourceCode);
+                Parser parser = create_parser(&tokens);
+                root = parse_program(&parser);
+                program = compile_program(root);
+                cache_store(sourceCode, (size_t)length, program);
+            }
+
+            // Functions not stored in the cache are compiled on their first call, from the AST
+            run_program(program);
+            if (vm_stats) {
+                if (cached) fprintf(stderr, "Loaded from the compilation cache: nothing was optimized (use --no-cache).\n");
+                else print_optimizer_stats(stderr);
+                print_engine_stats(program, use_registers);
+            }
+            free_program(program);
+            if (root) {
+                free_ast_node(root);
+                free_token_array(&tokens);
+            }
+            free(sourceCode);
+            return 0;
+        }
+
         TokenArray tokens = tokenize(sourceCode);
 
         Parser parser = create_parser(&tokens);
         ASTNode* root = parse_program(&parser);
 
-        interpret(root);
+        // --vm runs the compiled bytecode instead of walking the AST
+        bool completed = true;
+        if (use_vm) {
+            BytecodeProgram* program = compile_program(root);
+            run_program(program);
+            if (vm_stats) {
+                print_optimizer_stats(stderr);
+                print_engine_stats(program, use_registers);
+            }
+            free_program(program);
+        }
+        else {
+            completed = interpret(root);
+        }
 
         // Clean up
         free_ast_node(root);
         free_token_array(&tokens);
         free(sourceCode);
+        if (!completed) return 1;   // Like the VM, a runtime error that stops the program fails the run
     }
     else {
         // Interactive mode
@@ -42,6 +42,11 @@ const char* ASTNodeTypeNames[] = {
     "AST_DEFAULT",
 };
 
+const char* ASTOperatorSymbols[OPERATOR_COUNT_] = {
+    "", "+", "-", "*", "/", "%", "==", "!=", "<", ">", "<=", ">=", "&&", "||", "!", "~",
+    "=", "+=", "-=", "*=", "/=", "%=", ",",
+};
+
 
 /***********************
  * AST Node Functions
@@ -70,6 +75,25 @@ char* str_duplicate(const char* src) {
 
 
 
+/***********************************************************
+ * Function: ast_operator_from_symbol
+ * Description: this function resolves an operator symbol to its ASTOperator.
+ * Parameters: const char* symbol
+ * Return: ASTOperator
+ * ***********************************************************/
+ASTOperator ast_operator_from_symbol(const char* symbol) {
+    if (!symbol) return OPERATOR_NONE;
+    for (int op = OPERATOR_NONE + 1; op < OPERATOR_COUNT_; op++) {
+        if (strcmp(symbol, ASTOperatorSymbols[op]) == 0) return (ASTOperator)op;
+    }
+    return OPERATOR_NONE;
+}
+
+
+
+
+
+
 /***********************************************************
  * Function: create_ast_node
  * Description: this function creates a new AST node.
@@ -89,10 +113,20 @@ ASTNode* create_ast_node(ASTNodeType type, size_t line, size_t column, const cha
     node->value.int_val = 0;
 
     node->operator_ = str_duplicate(operator_);
+    // Operator nodes are resolved once here, the evaluators never compare the symbol again
+    node->operator_kind = (type == AST_BINARY_EXPR || type == AST_UNARY_EXPR || type == AST_ASSIGNMENT) ?
+        ast_operator_from_symbol(operator_) : OPERATOR_NONE;
 
     node->children = NULL;
     node->child_count = 0;
     node->parent = NULL;
+    node->call_cache = NULL;
+    node->tail_call = false;
+    node->scope = SCOPE_UNRESOLVED;
+    node->slot = -1;
+    node->global_slot = -1;
+    node->frame_layout = NULL;
+    node->upvalue_layout = NULL;
     node->line = line;
     node->column = column;
 
@@ -211,6 +245,21 @@ void free_ast_node(ASTNode* node) {
     free(node->operator_);
     node->operator_ = NULL;
 
+    free(node->call_cache);
+    node->call_cache = NULL;
+
+    // The layout only points at nodes of the tree
+    if (node->frame_layout) {
+        free(node->frame_layout->children);
+        free(node->frame_layout);
+        node->frame_layout = NULL;
+    }
+    // The captures are nodes of their own
+    if (node->upvalue_layout) {
+        free_ast_node(node->upvalue_layout);
+        node->upvalue_layout = NULL;
+    }
+
     // Recursively free children
     for (size_t i = 0; i < node->child_count; i++) {
         free_ast_node(node->children[i]);
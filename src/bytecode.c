@@ -10,8 +10,52 @@
 
 
 
+#include <string.h>
 #include "bytecode.h"
 
+#define MAX_LOOP_DEPTH 64
+#define MAX_LOOP_JUMPS 256
+#define MAX_FUNCTION_LOCALS 256
+#define SWITCH_TABLE_MIN_CASES 4 // Fewer cases are compared in order
+
+/***********************************************************
+* Struct: LoopContext
+* Description: keeps the pending `stop`/`continue` jumps of the loop
+* being generated so they can be patched once the loop is closed.
+************************************************************/
+typedef struct {
+    size_t break_jumps[MAX_LOOP_JUMPS];
+    size_t break_count;
+    size_t continue_jumps[MAX_LOOP_JUMPS];
+    size_t continue_count;
+} LoopContext;
+
+static LoopContext loop_stack[MAX_LOOP_DEPTH];
+static size_t loop_depth = 0;
+
+// Hidden variable names used by `for (a to b)`, one pair per nesting level
+static char for_counter_names[MAX_LOOP_DEPTH][16];
+static char for_limit_names[MAX_LOOP_DEPTH][16];
+
+/***********************************************************
+* Struct: FunctionScope
+* Description: the local slots of the function being generated. Parameters take
+* the first slots, followed by every variable the body assigns.
+************************************************************/
+typedef struct {
+    const char* names[MAX_FUNCTION_LOCALS];
+    bool hides_global[MAX_FUNCTION_LOCALS]; // Read the global of the same name until assigned (see resolve_function)
+    int count;
+    const ASTNode* captures; // Variables of the enclosing functions the body reads (the resolver's upvalue_layout)
+} FunctionScope;
+
+static FunctionScope* current_function = NULL; // NULL while generating top level code
+
+// Global slot names in slot order (copies, so they outlive the AST)
+static char** global_names = NULL;
+static size_t global_count = 0;
+static size_t global_capacity = 0;
+
 const char* ByteCodeNames[] = {
     "OP_PUSH_INT",
     "OP_PUSH_FLOAT",
@@ -59,7 +103,45 @@ const char* ByteCodeNames[] = {
     "OP_WHEN_",
     "OP_DEFAULT_",
     "OP_PARAMETER_LIST_",
-    "OP_SCOPE"
+    "OP_SCOPE",
+    "OP_PUSH_NULL",
+    "OP_DUP",
+    "OP_BUILD_ARRAY",
+    "OP_BIT_NOT",
+    "OP_LOAD_LOCAL",
+    "OP_STORE_LOCAL",
+    "OP_LOAD_GLOBAL",
+    "OP_STORE_GLOBAL",
+    "OP_LOAD_UPVALUE",
+    "OP_UNSET_LOCAL",
+    "OP_OR_GLOBAL",
+    "OP_FOR_PREP_LOCAL",
+    "OP_FOR_LOOP_LOCAL",
+    "OP_FOR_PREP_GLOBAL",
+    "OP_FOR_LOOP_GLOBAL",
+    "OP_INC_LOCAL",
+    "OP_INC_GLOBAL",
+    "OP_COMPARE_JUMP_IF_FALSE",
+    "OP_COMPARE_LOCALS_JUMP_IF_FALSE",
+    "OP_LOAD_LOCAL_ELEMENT",
+    "OP_TAIL_CALL",
+    "OP_ADD_INT_INT",
+    "OP_SUBTRACT_INT_INT",
+    "OP_MULTIPLY_INT_INT",
+    "OP_DIVIDE_INT_INT",
+    "OP_MODULO_INT_INT",
+    "OP_LESS_INT_INT",
+    "OP_GREATER_INT_INT",
+    "OP_LESS_EQUAL_INT_INT",
+    "OP_GREATER_EQUAL_INT_INT",
+    "OP_EQUAL_INT_INT",
+    "OP_NOT_EQUAL_INT_INT",
+    "OP_ADD_FLOAT_FLOAT",
+    "OP_SUBTRACT_FLOAT_FLOAT",
+    "OP_MULTIPLY_FLOAT_FLOAT",
+    "OP_DIVIDE_FLOAT_FLOAT",
+    "OP_LESS_FLOAT_FLOAT",
+    "OP_GREATER_FLOAT_FLOAT"
 };
 
 
@@ -85,6 +167,296 @@ void ensure_bytecode_capacity(BytecodeInstruction** bytecode, size_t* bytecode_c
 
 
 
+/***********************************************************
+ * Function: emit_instruction
+ * Description: appends one instruction to the bytecode, growing the buffer when needed.
+ * Parameters: BytecodeInstruction instr, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity
+ * Return: void
+ * ***********************************************************/
+void emit_instruction(BytecodeInstruction instr, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity) {
+    ensure_bytecode_capacity(bytecode, bytecode_count, bytecode_capacity);
+    (*bytecode)[(*bytecode_count)++] = instr;
+}
+
+
+
+
+/***********************************************************
+ * Function: is_expression_node
+ * Description: tells if a node leaves a value on the stack, so statements made of it need an OP_POP.
+ * Parameters: const ASTNode* node
+ * Return: bool
+ * ***********************************************************/
+bool is_expression_node(const ASTNode* node) {
+    if (!node) return false;
+
+    switch (node->type) {
+    case AST_LITERAL:
+    case AST_IDENTIFIER:
+    case AST_BINARY_EXPR:
+    case AST_UNARY_EXPR:
+    case AST_FUNCTION_CALL:
+    case AST_ARRAY_LITERAL:
+    case AST_ARRAY_ACCESS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+
+
+/***********************************************************
+ * Function: count_comma_operands
+ * Description: counts the values produced by a comma separated expression (a, b, c).
+ * Parameters: const ASTNode* node
+ * Return: size_t
+ * ***********************************************************/
+size_t count_comma_operands(const ASTNode* node) {
+    if (!node) return 0;
+
+    if (node->type == AST_BINARY_EXPR && node->operator_ && strcmp(node->operator_, ",") == 0) {
+        return count_comma_operands(node->children[0]) + count_comma_operands(node->children[1]);
+    }
+    return 1;
+}
+
+
+
+
+/***********************************************************
+ * Function: find_local / declare_local
+ * Description: look up (or add) a variable in the slots of the function being generated.
+ * Parameters: const char* name
+ * Return: int (slot index, -1 if not a local)
+ * ***********************************************************/
+static int find_local(const char* name) {
+    if (!current_function) return -1;
+    for (int i = 0; i < current_function->count; i++) {
+        if (strcmp(current_function->names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+static int declare_local(const char* name) {
+    int slot = find_local(name);
+    if (slot >= 0) return slot;
+
+    if (current_function->count >= MAX_FUNCTION_LOCALS) {
+        fprintf(stderr, "Too many local variables in one function (max %d).\n", MAX_FUNCTION_LOCALS);
+        exit(EXIT_FAILURE);
+    }
+    current_function->names[current_function->count] = name;
+    return current_function->count++;
+}
+
+
+
+
+/***********************************************************
+ * Function: find_capture
+ * Description: looks up a variable the function being generated captured from the
+ * functions around it.
+ * Parameters: const char* name
+ * Return: int (capture index, -1 if not captured)
+ * ***********************************************************/
+static int find_capture(const char* name) {
+    const ASTNode* captures = current_function ? current_function->captures : NULL;
+    if (!captures) return -1;
+    for (size_t i = 0; i < captures->child_count; i++) {
+        if (strcmp(captures->children[i]->operator_, name) == 0) return (int)i;
+    }
+    return -1;
+}
+
+
+
+
+/***********************************************************
+ * Function: resolve_global
+ * Description: returns the global slot of a variable, adding a new slot the first time it is seen.
+ * Parameters: const char* name
+ * Return: int
+ * ***********************************************************/
+static int resolve_global(const char* name) {
+    for (size_t i = 0; i < global_count; i++) {
+        if (strcmp(global_names[i], name) == 0) return (int)i;
+    }
+
+    if (global_count >= global_capacity) {
+        global_capacity = global_capacity ? global_capacity * 2 : 32;
+        char** names = (char**)realloc(global_names, sizeof(char*) * global_capacity);
+        if (!names) {
+            fprintf(stderr, "Memory allocation failed during bytecode generation.\n");
+            exit(EXIT_FAILURE);
+        }
+        global_names = names;
+    }
+    global_names[global_count] = strdup(name);
+    if (!global_names[global_count]) {
+        fprintf(stderr, "Memory allocation failed during bytecode generation.\n");
+        exit(EXIT_FAILURE);
+    }
+    return (int)global_count++;
+}
+
+
+
+
+/***********************************************************
+ * Function: bytecode_global_count / bytecode_global_name / reset_bytecode_globals / load_bytecode_globals
+ * Description: access to the global slots assigned during generation.
+ * Parameters: size_t index / char* const* names, size_t count
+ * Return: size_t / const char* / void
+ * ***********************************************************/
+size_t bytecode_global_count(void) {
+    return global_count;
+}
+
+const char* bytecode_global_name(size_t index) {
+    return index < global_count ? global_names[index] : NULL;
+}
+
+void reset_bytecode_globals(void) {
+    for (size_t i = 0; i < global_count; i++) {
+        free(global_names[i]);
+    }
+    free(global_names);
+    global_names = NULL;
+    global_count = 0;
+    global_capacity = 0;
+}
+
+void load_bytecode_globals(char* const* names, size_t count) {
+    reset_bytecode_globals();
+    for (size_t i = 0; i < count; i++) {
+        resolve_global(names[i]);
+    }
+}
+
+
+
+
+/***********************************************************
+ * Function: collect_function_locals
+ * Description: gives a slot to every variable assigned in a function body (and to every named
+ * `for` counter) before the body is generated, so reads that come before the assignment
+ * still see the local.
+ * Nested function declarations have their own scope and are skipped.
+ * Parameters: const ASTNode* node
+ * Return: void
+ * ***********************************************************/
+static void collect_function_locals(const ASTNode* node) {
+    if (!node || node->type == AST_FUNCTION_DECLARATION) return;
+
+    if (node->type == AST_ASSIGNMENT && node->child_count > 0 &&
+        node->children[0] && node->children[0]->type == AST_IDENTIFIER) {
+        declare_local(node->children[0]->operator_);
+    }
+    else if (node->type == AST_FOR_STATEMENT && node->operator_) {
+        declare_local(node->operator_);
+    }
+    for (size_t i = 0; i < node->child_count; i++) {
+        collect_function_locals(node->children[i]);
+    }
+}
+
+
+
+
+/***********************************************************
+ * Function: generate_variable_bytecode
+ * Description: emits a load or store of a variable resolved to a slot.
+ * Inside a function, stores always target a local (like the interpreter) and loads use the
+ * local slot if there is one, then a variable captured from an enclosing function, otherwise
+ * the global slot. A load of a local that hides a global is followed by OP_OR_GLOBAL.
+ * Parameters: const char* name, bool store, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity
+ * Return: void
+ * ***********************************************************/
+void generate_variable_bytecode(const char* name, bool store, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity) {
+    BytecodeInstruction instr = { .opcode = OP_LOAD_GLOBAL };
+    instr.operand.scope.local_index = -1;
+    instr.operand.scope.global_index = -1;
+
+    int local = current_function ? (store ? declare_local(name) : find_local(name)) : -1;
+    int capture = local < 0 && !store ? find_capture(name) : -1;
+    bool hides_global = false;
+    if (local >= 0) {
+        instr.opcode = store ? OP_STORE_LOCAL : OP_LOAD_LOCAL;
+        instr.operand.scope.local_index = local;
+        hides_global = !store && current_function->hides_global[local];
+    }
+    else if (capture >= 0) {
+        instr.opcode = OP_LOAD_UPVALUE;
+        instr.operand.scope.local_index = capture;
+        hides_global = current_function->captures->children[capture]->global_slot >= 0;
+    }
+    else {
+        instr.opcode = store ? OP_STORE_GLOBAL : OP_LOAD_GLOBAL;
+        instr.operand.scope.global_index = resolve_global(name);
+    }
+    emit_instruction(instr, bytecode, bytecode_count, bytecode_capacity);
+
+    if (hides_global) {
+        BytecodeInstruction or_global = { .opcode = OP_OR_GLOBAL };
+        or_global.operand.scope.local_index = -1;
+        or_global.operand.scope.global_index = resolve_global(name);
+        emit_instruction(or_global, bytecode, bytecode_count, bytecode_capacity);
+    }
+}
+
+
+
+
+/***********************************************************
+ * Function: generate_statement_bytecode
+ * Description: generates a statement and discards the value of expression statements.
+ * Parameters: const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity
+ * Return: void
+ * ***********************************************************/
+static void generate_statement_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity) {
+    generate_bytecode(node, bytecode, bytecode_count, bytecode_capacity);
+
+    if (is_expression_node(node)) {
+        BytecodeInstruction pop = { .opcode = OP_POP };
+        emit_instruction(pop, bytecode, bytecode_count, bytecode_capacity);
+    }
+}
+
+
+
+
+/***********************************************************
+ * Function: begin_loop / end_loop
+ * Description: open a loop context and, when the loop is done, patch its `stop` jumps
+ * to the exit and its `continue` jumps to the given target.
+ * Parameters: size_t continue_target, size_t exit_target, BytecodeInstruction* bytecode
+ * Return: void
+ * ***********************************************************/
+static void begin_loop(void) {
+    if (loop_depth >= MAX_LOOP_DEPTH) {
+        fprintf(stderr, "Loops nested too deeply for bytecode generation.\n");
+        exit(EXIT_FAILURE);
+    }
+    loop_stack[loop_depth].break_count = 0;
+    loop_stack[loop_depth].continue_count = 0;
+    loop_depth++;
+}
+
+static void end_loop(BytecodeInstruction* bytecode, size_t continue_target, size_t exit_target) {
+    LoopContext* loop = &loop_stack[--loop_depth];
+    for (size_t i = 0; i < loop->break_count; i++) {
+        bytecode[loop->break_jumps[i]].operand.int_operand = (int)exit_target;
+    }
+    for (size_t i = 0; i < loop->continue_count; i++) {
+        bytecode[loop->continue_jumps[i]].operand.int_operand = (int)continue_target;
+    }
+}
+
+
+
+
 
 
 /***********************************************************
@@ -98,7 +470,7 @@ void generate_literal_bytecode(const ASTNode* node, BytecodeInstruction** byteco
 
     BytecodeInstruction instr = { .opcode = OP_PUSH_INT };
     if (node->value_kind == VALUE_INT) {
-        instr.operand.int_operand = node->value.int_val;
+        instr.operand.int_value = node->value.int_val;
     }
     else if (node->value_kind == VALUE_FLOAT) {
         instr.opcode = OP_PUSH_FLOAT;
@@ -174,7 +546,7 @@ void generate_binary_expr_bytecode(const ASTNode* node, BytecodeInstruction** by
         instr.opcode = OP_EQUAL;
     }
     else if (strcmp(node->operator_, "!=") == 0) {
-        instr.opcode = OP_NEGATE;
+        instr.opcode = OP_NOT_EQUAL;
     }
 	else if (strcmp(node->operator_, "%=") == 0) {
 		instr.opcode = OP_MODULO_EQUAL;
@@ -212,16 +584,32 @@ void generate_binary_expr_bytecode(const ASTNode* node, BytecodeInstruction** by
  * Return: void
  * ***********************************************************/
 void generate_assignment_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity) {
+    const char* op = node->operator_ ? node->operator_ : "=";
+    BytecodeInstruction instr = { .opcode = OP_ADD_ };
+
+    // Compound assignments (+=, -=, ...) load the current value first
+    if (strcmp(op, "=") != 0) {
+        generate_identifier_bytecode(node->children[0], bytecode, bytecode_count, bytecode_capacity);
+    }
+
     // Generate bytecode for the right-hand side (RHS)
     generate_bytecode(node->children[1], bytecode, bytecode_count, bytecode_capacity);
 
+    if (strcmp(op, "=") != 0) {
+        if (strcmp(op, "+=") == 0) instr.opcode = OP_ADD_;
+        else if (strcmp(op, "-=") == 0) instr.opcode = OP_SUBTRACT;
+        else if (strcmp(op, "*=") == 0) instr.opcode = OP_MULTIPLY;
+        else if (strcmp(op, "/=") == 0) instr.opcode = OP_DIVIDE;
+        else if (strcmp(op, "%=") == 0) instr.opcode = OP_MODULO;
+        else {
+            fprintf(stderr, "Unsupported assignment operator: %s\n", op);
+            exit(EXIT_FAILURE);
+        }
+        emit_instruction(instr, bytecode, bytecode_count, bytecode_capacity);
+    }
+
     // Generate a STORE instruction for the left-hand side (LHS)
-    ensure_bytecode_capacity(bytecode, bytecode_count, bytecode_capacity);
-    BytecodeInstruction instr = {
-        .opcode = OP_STORE_VAR_,
-        .operand.string_operand = node->children[0]->operator_
-    };
-    (*bytecode)[(*bytecode_count)++] = instr;
+    generate_variable_bytecode(node->children[0]->operator_, true, bytecode, bytecode_count, bytecode_capacity);
 }
 
 
@@ -235,12 +623,21 @@ void generate_assignment_bytecode(const ASTNode* node, BytecodeInstruction** byt
  * Return: void
  * ***********************************************************/
 void generate_identifier_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity) {
-    ensure_bytecode_capacity(bytecode, bytecode_count, bytecode_capacity);
-    BytecodeInstruction instr = {
-        .opcode = OP_LOAD_VAR_,
-        .operand.string_operand = node->operator_
-    };
-    (*bytecode)[(*bytecode_count)++] = instr;
+    generate_variable_bytecode(node->operator_, false, bytecode, bytecode_count, bytecode_capacity);
+}
+
+
+
+
+/***********************************************************
+ * Function: variable_slot
+ * Description: the slot a store to the variable writes (see generate_variable_bytecode):
+ * a local inside a function, a global at the top level.
+ * Parameters: const char* name
+ * Return: int
+ * ***********************************************************/
+static int variable_slot(const char* name) {
+    return current_function ? declare_local(name) : resolve_global(name);
 }
 
 
@@ -249,6 +646,10 @@ void generate_identifier_bytecode(const ASTNode* node, BytecodeInstruction** byt
 /***********************************************************
  * Function: generate_for_bytecode
  * Description: this function is responsible for generating bytecode for a 'for' loop.
+ * The counter and the limit live in two consecutive hidden slots. OP_FOR_PREP_* skips the loop
+ * when it runs zero times, and OP_FOR_LOOP_* at the end of the body increments the counter,
+ * compares it with the limit and jumps back in one dispatch. Both copy the counter to the
+ * named slot of `for (i = a to b)` when the body runs.
  * Parameters: const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity
  * Return: void
  * ***********************************************************/
@@ -263,78 +664,61 @@ void generate_for_bytecode(const ASTNode* node, BytecodeInstruction** bytecode,
     const ASTNode* end_node = node->children[1];    // End value
     const ASTNode* body_node = node->children[2];   // Loop body
 
-    const char* loop_var_name = "i"; // Loop variable name (default for simplicity)
+    // The counter and the limit live in hidden variables ('$' can't appear in a user identifier),
+    // one pair per nesting level so inner loops don't clobber outer ones.
+    if (loop_depth >= MAX_LOOP_DEPTH) {
+        fprintf(stderr, "Loops nested too deeply for bytecode generation.\n");
+        exit(EXIT_FAILURE);
+    }
+    char* loop_var_name = for_counter_names[loop_depth];
+    char* loop_end_name = for_limit_names[loop_depth];
+    snprintf(loop_var_name, sizeof(for_counter_names[0]), "$for%zu", loop_depth);
+    snprintf(loop_end_name, sizeof(for_limit_names[0]), "$end%zu", loop_depth);
+
+    // The pair is always declared together, so the limit is the slot after the counter
+    int counter_slot = variable_slot(loop_var_name);
+    int limit_slot = variable_slot(loop_end_name);
+    if (limit_slot != counter_slot + 1) {
+        fprintf(stderr, "Invalid slots for the 'for' loop counter.\n");
+        exit(EXIT_FAILURE);
+    }
+    int named_slot = node->operator_ ? variable_slot(node->operator_) : counter_slot;
+    bool global = current_function == NULL;
 
-    // 1. Initialization: i = start
+    // 1. Initialization: counter = start, limit = end (evaluated once, like the interpreter does)
     generate_bytecode(start_node, bytecode, bytecode_count, bytecode_capacity);
-    BytecodeInstruction init_instr = {
-        .opcode = OP_STORE_VAR_,
-        .operand.string_operand = loop_var_name
-    };
-    (*bytecode)[(*bytecode_count)++] = init_instr;
-
-    // 2. Condition check: i < end
-    size_t condition_index = *bytecode_count;
-    BytecodeInstruction load_var_instr = {
-        .opcode = OP_LOAD_VAR_,
-        .operand.string_operand = loop_var_name
-    };
-    (*bytecode)[(*bytecode_count)++] = load_var_instr;
+    generate_variable_bytecode(loop_var_name, true, bytecode, bytecode_count, bytecode_capacity);
 
     generate_bytecode(end_node, bytecode, bytecode_count, bytecode_capacity);
+    generate_variable_bytecode(loop_end_name, true, bytecode, bytecode_count, bytecode_capacity);
 
-    BytecodeInstruction condition_instr = { .opcode = OP_LESS };
-	condition_instr.operand.binary.left_reg = *bytecode_count - 2;
-	condition_instr.operand.binary.right_reg = *bytecode_count - 1;
-    (*bytecode)[(*bytecode_count)++] = condition_instr;
-
-    // Placeholder for JUMP_TO_IF_FALSE
-    BytecodeInstruction jump_if_false_instr = {
-        .opcode = OP_JUMP_TO_IF_FALSE,
-        .operand.int_operand = -1 // Placeholder
-    };
-    size_t jump_if_false_index = *bytecode_count;
-    (*bytecode)[(*bytecode_count)++] = jump_if_false_instr;
+    // 2. Skip the loop when counter >= limit (the exit is patched below)
+    BytecodeInstruction prep_instr = { .opcode = global ? OP_FOR_PREP_GLOBAL : OP_FOR_PREP_LOCAL };
+    prep_instr.operand.fused.target_index = -1;
+    prep_instr.operand.fused.first = counter_slot;
+    prep_instr.operand.fused.second = named_slot;
+    size_t prep_index = *bytecode_count;
+    emit_instruction(prep_instr, bytecode, bytecode_count, bytecode_capacity);
 
     // 3. Loop body
+    size_t body_index = *bytecode_count;
+    begin_loop();
     generate_bytecode(body_node, bytecode, bytecode_count, bytecode_capacity);
 
-    // 4. Increment: i = i + 1
-    BytecodeInstruction load_loop_var_instr = {
-        .opcode = OP_LOAD_VAR_,
-        .operand.string_operand = loop_var_name
-    };
-    (*bytecode)[(*bytecode_count)++] = load_loop_var_instr;
-
-    BytecodeInstruction push_constant_instr = {
-        .opcode = OP_PUSH_INT,
-        .operand.int_operand = 1 // Increment
-    };
-    (*bytecode)[(*bytecode_count)++] = push_constant_instr;
-
-    BytecodeInstruction increment_instr = { .opcode = OP_ADD_ };
-	increment_instr.operand.binary.left_reg = *bytecode_count - 2;
-	increment_instr.operand.binary.right_reg = *bytecode_count - 1;
-    (*bytecode)[(*bytecode_count)++] = increment_instr;
-
-    BytecodeInstruction store_loop_var_instr = {
-        .opcode = OP_STORE_VAR_,
-        .operand.string_operand = loop_var_name
-    };
-    (*bytecode)[(*bytecode_count)++] = store_loop_var_instr;
+    // 4. Increment, test and jump back, `continue` lands here
+    BytecodeInstruction loop_instr = { .opcode = global ? OP_FOR_LOOP_GLOBAL : OP_FOR_LOOP_LOCAL };
+    loop_instr.operand.fused.target_index = (int)body_index;
+    loop_instr.operand.fused.first = counter_slot;
+    loop_instr.operand.fused.second = named_slot;
+    size_t loop_index = *bytecode_count;
+    emit_instruction(loop_instr, bytecode, bytecode_count, bytecode_capacity);
 
-    // 5. Jump back to condition check
-    BytecodeInstruction jump_to_condition_instr = {
-        .opcode = OP_JUMP_TO,
-        .operand.int_operand = condition_index
-    };
-    (*bytecode)[(*bytecode_count)++] = jump_to_condition_instr;
-
-    // Update the JUMP_TO_IF_FALSE placeholder
-    (*bytecode)[jump_if_false_index].operand.int_operand = *bytecode_count;
+    (*bytecode)[prep_index].operand.fused.target_index = (int)*bytecode_count;
+    end_loop(*bytecode, loop_index, *bytecode_count);
 }
 
 
+
 	
 
 
@@ -348,15 +732,19 @@ void generate_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size
     if (!node) return;
 
     switch (node->type) {
-    case AST_PROGRAM:
+    case AST_PROGRAM: {
+        reset_bytecode_globals();
         for (size_t i = 0; i < node->child_count; i++) {
-            generate_bytecode(node->children[i], bytecode, bytecode_count, bytecode_capacity);
+            generate_statement_bytecode(node->children[i], bytecode, bytecode_count, bytecode_capacity);
         }
+        BytecodeInstruction halt = { .opcode = OP_HALT };
+        emit_instruction(halt, bytecode, bytecode_count, bytecode_capacity);
         break;
+    }
 
     case AST_BLOCK:
         for (size_t i = 0; i < node->child_count; i++) {
-            generate_bytecode(node->children[i], bytecode, bytecode_count, bytecode_capacity);
+            generate_statement_bytecode(node->children[i], bytecode, bytecode_count, bytecode_capacity);
         }
         break;
 
@@ -424,11 +812,12 @@ void generate_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size
 		break;
 
 	case AST_BREAK:
-		generate_stop_bytecode(node, bytecode, bytecode_count, bytecode_capacity);
+	case AST_CONTINUE:
+		generate_loop_jump_bytecode(node, bytecode, bytecode_count, bytecode_capacity);
 		break;
 
 	case AST_DEFAULT:
-		generate_stop_bytecode(node, bytecode, bytecode_count, bytecode_capacity);
+		generate_default_switch_bytecode(node, bytecode, bytecode_count, bytecode_capacity);
 		break;
 
     default:
@@ -453,13 +842,16 @@ void generate_unary_exp_bytecode(const ASTNode* node, BytecodeInstruction** byte
     // Generate bytecode for the unary operation
     ensure_bytecode_capacity(bytecode, bytecode_count, bytecode_capacity);
 
-    BytecodeInstruction instr;
+    BytecodeInstruction instr = { .opcode = OP_NEGATE };
     if (strcmp(node->operator_, "-") == 0) {
         instr.opcode = OP_NEGATE;
     }
     else if (strcmp(node->operator_, "!") == 0) {
         instr.opcode = OP_NOT_;
     }
+    else if (strcmp(node->operator_, "~") == 0) {
+        instr.opcode = OP_BIT_NOT;
+    }
     else {
         fprintf(stderr, "Unsupported unary operator: %s\n", node->operator_);
         exit(EXIT_FAILURE);
@@ -550,6 +942,7 @@ void generate_while_loop_bytecode(const ASTNode* node, BytecodeInstruction** byt
     (*bytecode)[(*bytecode_count)++] = jumpToFalseInstr;
 
     // Generate bytecode for the body of the while loop
+    begin_loop();
     generate_bytecode(node->children[1], bytecode, bytecode_count, bytecode_capacity);
 
     // Generate a JUMP_TO instruction to loop back to the condition
@@ -562,6 +955,7 @@ void generate_while_loop_bytecode(const ASTNode* node, BytecodeInstruction** byt
 
     // Update the JUMP_TO_IF_FALSE to point to the first instruction after the loop
     (*bytecode)[jumpToFalseIndex].operand.int_operand = *bytecode_count;
+    end_loop(*bytecode, conditionIndex, *bytecode_count);
 }
 
 
@@ -569,12 +963,12 @@ void generate_while_loop_bytecode(const ASTNode* node, BytecodeInstruction** byt
 
 
 /***********************************************************
- * Function: print_byteCode
+ * Function: print_instructions
  * Description: this function prints the bytecode.
  * Parameters: const BytecodeInstruction* bytecode, size_t count
  * Return: void
  * ***********************************************************/
-void print_byteCode(const BytecodeInstruction* bytecode, size_t count) {
+void print_instructions(const BytecodeInstruction* bytecode, size_t count) {
     printf("=== BYTECODE ===\n");
     for (size_t i = 0; i < count; i++) {
         const BytecodeInstruction* instr = &bytecode[i];
@@ -587,7 +981,7 @@ void print_byteCode(const BytecodeInstruction* bytecode, size_t count) {
 
         switch (instr->opcode) {
         case OP_PUSH_INT:
-            printf(" INT_OPERAND: %d\n", instr->operand.int_operand);
+            printf(" INT_OPERAND: %ld\n", instr->operand.int_value);
             break;
 
         case OP_PUSH_FLOAT:
@@ -607,19 +1001,73 @@ void print_byteCode(const BytecodeInstruction* bytecode, size_t count) {
             printf(" VAR_NAME: \"%s\"\n", instr->operand.string_operand);
             break;
 
+        case OP_LOAD_LOCAL:
+        case OP_STORE_LOCAL:
+        case OP_UNSET_LOCAL:
+            printf(" LOCAL_INDEX: %d\n", instr->operand.scope.local_index);
+            break;
+
+        case OP_LOAD_UPVALUE:
+            printf(" UPVALUE_INDEX: %d\n", instr->operand.scope.local_index);
+            break;
+
+        case OP_LOAD_GLOBAL:
+        case OP_STORE_GLOBAL:
+        case OP_OR_GLOBAL:
+            printf(" GLOBAL_INDEX: %d (\"%s\")\n", instr->operand.scope.global_index,
+                bytecode_global_name((size_t)instr->operand.scope.global_index));
+            break;
+
         case OP_JUMP_TO_IF_FALSE:
         case OP_JUMP_TO:
             printf(" TARGET_INDEX: %d\n", instr->operand.jump.target_index);
             break;
 
+        case OP_INC_LOCAL:
+            printf(" LOCAL_INDEX: %d, BY: %d\n", instr->operand.fused.first, instr->operand.fused.second);
+            break;
+
+        case OP_INC_GLOBAL:
+            printf(" GLOBAL_INDEX: %d (\"%s\"), BY: %d\n", instr->operand.fused.first,
+                bytecode_global_name((size_t)instr->operand.fused.first), instr->operand.fused.second);
+            break;
+
+        case OP_COMPARE_JUMP_IF_FALSE:
+            printf(" %s, TARGET_INDEX: %d\n", ByteCodeNames[instr->operand.fused.compare], instr->operand.fused.target_index);
+            break;
+
+        case OP_COMPARE_LOCALS_JUMP_IF_FALSE:
+            printf(" %s (LOCAL_INDEX: %d, LOCAL_INDEX: %d), TARGET_INDEX: %d\n", ByteCodeNames[instr->operand.fused.compare],
+                instr->operand.fused.first, instr->operand.fused.second, instr->operand.fused.target_index);
+            break;
+
+        case OP_LOAD_LOCAL_ELEMENT:
+            printf(" ARRAY: LOCAL_INDEX %d, INDEX: LOCAL_INDEX %d\n", instr->operand.fused.first, instr->operand.fused.second);
+            break;
+
+        case OP_FOR_PREP_LOCAL:
+        case OP_FOR_LOOP_LOCAL:
+            printf(" COUNTER: LOCAL_INDEX %d, NAMED: LOCAL_INDEX %d, TARGET_INDEX: %d\n", instr->operand.fused.first,
+                instr->operand.fused.second, instr->operand.fused.target_index);
+            break;
+
+        case OP_FOR_PREP_GLOBAL:
+        case OP_FOR_LOOP_GLOBAL:
+            printf(" COUNTER: GLOBAL_INDEX %d, NAMED: GLOBAL_INDEX %d (\"%s\"), TARGET_INDEX: %d\n", instr->operand.fused.first,
+                instr->operand.fused.second, bytecode_global_name((size_t)instr->operand.fused.second), instr->operand.fused.target_index);
+            break;
+
         case OP_ADD_:
         case OP_SUBTRACT:
         case OP_MULTIPLY:
         case OP_DIVIDE:
         case OP_MODULO:
         case OP_EQUAL:
+        case OP_NOT_EQUAL:
         case OP_GREATER:
         case OP_LESS:
+        case OP_GREATER_EQUAL:
+        case OP_LESS_EQUAL:
             printf(" BINARY_OP: (LEFT_REG: %d, RIGHT_REG: %d)\n",
                 instr->operand.binary.left_reg,
                 instr->operand.binary.right_reg);
@@ -637,15 +1085,27 @@ void print_byteCode(const BytecodeInstruction* bytecode, size_t count) {
             break;
 
 		case OP_ARRAY_SET_:
-            printf(" ARRAY_LITERAL: (ARRAY_REG: %d, COUNT: %d)\n",
-                instr->operand.array_literal.array_reg,
-                instr->operand.array_literal.count);
+            printf(" ARRAY_ASSIGNMENT: (ARRAY_REG: %d, INDEX_REG: %d, VALUE_REG: %d)\n",
+                instr->operand.array_assignment.array_reg,
+                instr->operand.array_assignment.index_reg,
+                instr->operand.array_assignment.value_reg);
             break;
 
 		case OP_DECL_FUNCTION:
-            printf(" FUNCTION_DECL: (PARAM_COUNT: %d, BODY_INDEX: %d)\n",
-                instr->operand.function_decl.param_count,
-                instr->operand.function_decl.body_index);
+            printf(" FUNCTION_DECL: (NAME: \"%s\", PARAM_COUNT: %d)\n",
+                instr->operand.function_decl.name,
+                instr->operand.function_decl.param_count);
+            break;
+
+        case OP_CALL_FUNCTION:
+        case OP_TAIL_CALL:
+            printf(" CALL: (NAME: \"%s\", ARG_COUNT: %d)\n",
+                instr->operand.call.name,
+                instr->operand.call.arg_count);
+            break;
+
+        case OP_BUILD_ARRAY:
+            printf(" COUNT: %d\n", instr->operand.array_literal.count);
             break;
 
         case OP_SWITCH_:
@@ -685,7 +1145,9 @@ void print_byteCode(const BytecodeInstruction* bytecode, size_t count) {
 
 /***********************************************************
 * Function: generate_function_declaration_bytecode
-* Description: Generates bytecode for function declarations.
+* Description: Generates bytecode for function declarations. Only the declaration is
+* emitted: the body is generated on its own when the function is compiled (see
+* generate_function_body_bytecode), which the VM does on the first call.
 * Parameters: const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity
 * Return: void
 ***********************************************************/
@@ -695,54 +1157,99 @@ void generate_function_declaration_bytecode(const ASTNode* node, BytecodeInstruc
         exit(EXIT_FAILURE);
     }
 
-    // Ensure bytecode capacity
-    ensure_bytecode_capacity(bytecode, bytecode_count, bytecode_capacity);
-
     // The first child is the function name (identifier node)
     const ASTNode* identifierNode = node->children[0];
-    if (!identifierNode || identifierNode->type != AST_IDENTIFIER || !identifierNode->isFunction) {
+    if (!identifierNode || identifierNode->type != AST_IDENTIFIER) {
         fprintf(stderr, "Invalid function identifier.\n");
         exit(EXIT_FAILURE);
     }
 
-    // Add function declaration instruction
+    // Everything between the name and the body are the parameters
     BytecodeInstruction instr = {
         .opcode = OP_DECL_FUNCTION,
-        .operand.function_decl.param_count = node->child_count - 2, // Remaining children after identifier and body
-        .operand.function_decl.body_index = *bytecode_count + 1    // Body starts next
+        .operand.function_decl.param_count = (int)node->child_count - 2,
+        .operand.function_decl.name = identifierNode->operator_,
+        .operand.function_decl.declaration = node
     };
-    (*bytecode)[(*bytecode_count)++] = instr;
 
-    // Track whether a return statement has been encountered
-    bool has_returned = false;
-
-    // Generate bytecode for the function body (last child is the body block)
-    const ASTNode* body = node->children[node->child_count - 1];
-    for (size_t i = 0; i < body->child_count; i++) {
-        if (has_returned) {
-            // Skip generating bytecode for statements after a return
-            break;
+    // The variables of this call (or of the calls around it) the body reads, found by name
+    // among the slots and captures of the code being generated
+    const ASTNode* captures = node->upvalue_layout;
+    if (captures && captures->child_count > 0) {
+        if (captures->child_count > UINT8_MAX + 1) {
+            fprintf(stderr, "Too many captured variables in function '%s'.\n", identifierNode->operator_);
+            exit(EXIT_FAILURE);
+        }
+        Capture* list = (Capture*)malloc(sizeof(Capture) * captures->child_count);
+        if (!list) {
+            fprintf(stderr, "Memory allocation failed for the captures of '%s'.\n", identifierNode->operator_);
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < captures->child_count; i++) {
+            const ASTNode* capture = captures->children[i];
+            int index = capture->scope == SCOPE_LOCAL ? find_local(capture->operator_) : find_capture(capture->operator_);
+            if (index < 0) {
+                fprintf(stderr, "Function '%s' captures unknown variable '%s'.\n", identifierNode->operator_, capture->operator_);
+                exit(EXIT_FAILURE);
+            }
+            list[i].from_local = capture->scope == SCOPE_LOCAL;
+            list[i].index = (uint8_t)index;
         }
+        instr.operand.function_decl.captures = list;
+        instr.operand.function_decl.capture_count = (int)captures->child_count;
+    }
+    emit_instruction(instr, bytecode, bytecode_count, bytecode_capacity);
+}
 
-        const ASTNode* statement = body->children[i];
 
-        // Check if the statement is a return
-        if (statement->type == AST_RETURN_STATEMENT) {
-            has_returned = true;
-        }
 
-        // Generate bytecode for the statement
-        generate_bytecode(statement, bytecode, bytecode_count, bytecode_capacity);
-    }
 
-    // Add return instruction if there wasn't an explicit return in the function
-    if (!has_returned) {
-        ensure_bytecode_capacity(bytecode, bytecode_count, bytecode_capacity);
-        instr.opcode = OP_RETURN_;
-        (*bytecode)[(*bytecode_count)++] = instr;
+/***********************************************************
+* Function: generate_function_body_bytecode
+* Description: Generates the code of a declared function, starting a new bytecode: the
+* body followed by a return of null for falling off its end.
+* Parameters: const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity
+* Return: int (the local slots of the function: parameters + variables assigned in the body)
+***********************************************************/
+int generate_function_body_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity) {
+    // Parameters take the first local slots, then every variable assigned in the body
+    int param_count = (int)node->child_count - 2;
+    FunctionScope scope = { .count = 0, .captures = node->upvalue_layout };
+    FunctionScope* saved_function = current_function;
+    current_function = &scope;
+    for (int i = 0; i < param_count; i++) {
+        declare_local(node->children[1 + i]->operator_);
+    }
+    const ASTNode* body = node->children[node->child_count - 1];
+    collect_function_locals(body);
+
+    // The locals that hide a global start unassigned, also when a tail call reuses the frame
+    const ASTNode* layout = node->frame_layout;
+    for (size_t i = (size_t)param_count; layout && i < layout->child_count; i++) {
+        if (layout->children[i]->global_slot < 0) continue;
+        BytecodeInstruction unset = { .opcode = OP_UNSET_LOCAL };
+        unset.operand.scope.local_index = find_local(layout->children[i]->operator_);
+        unset.operand.scope.global_index = -1;
+        scope.hides_global[unset.operand.scope.local_index] = true;
+        emit_instruction(unset, bytecode, bytecode_count, bytecode_capacity);
     }
-}
 
+    // Loops of the caller are not visible from inside the body
+    size_t saved_loop_depth = loop_depth;
+    loop_depth = 0;
+    generate_bytecode(body, bytecode, bytecode_count, bytecode_capacity);
+    loop_depth = saved_loop_depth;
+
+    // Falling off the end of the body returns null
+    BytecodeInstruction push_null = { .opcode = OP_PUSH_NULL };
+    emit_instruction(push_null, bytecode, bytecode_count, bytecode_capacity);
+    BytecodeInstruction ret = { .opcode = OP_RETURN_ };
+    emit_instruction(ret, bytecode, bytecode_count, bytecode_capacity);
+
+    // The hidden loop variables of the body are only known now
+    current_function = saved_function;
+    return scope.count;
+}
 
 
 
@@ -766,22 +1273,20 @@ void generate_function_call_bytecode(const ASTNode* node, BytecodeInstruction**
         exit(EXIT_FAILURE);
     }
 
-    // Generate bytecode for each argument (remaining children)
+    // Generate bytecode for each argument (remaining children, possibly a comma list)
+    int arg_count = 0;
     for (size_t i = 1; i < node->child_count; i++) {
         generate_bytecode(node->children[i], bytecode, bytecode_count, bytecode_capacity);
+        arg_count += (int)count_comma_operands(node->children[i]);
     }
 
-    // Ensure bytecode capacity
-    ensure_bytecode_capacity(bytecode, bytecode_count, bytecode_capacity);
-
-    // Add function call instruction
+    // Add function call instruction, the result is left on the stack
     BytecodeInstruction instr = {
         .opcode = OP_CALL_FUNCTION,
-        .operand.string_operand = identifierNode->operator_  // Function name
+        .operand.call.name = identifierNode->operator_,  // Function name
+        .operand.call.arg_count = arg_count
     };
-    (*bytecode)[(*bytecode_count)++] = instr;
-
-    // Handle the return value if necessary
+    emit_instruction(instr, bytecode, bytecode_count, bytecode_capacity);
 }
 
 
@@ -843,22 +1348,19 @@ void generate_array_literal_bytecode(const ASTNode* node, BytecodeInstruction**
     // Allocate a new register for the array
     int array_reg = (*bytecode_count);  // Assign the current bytecode count as a pseudo-register index
 
-    // Traverse the binary expression tree to generate bytecode for all elements
-    traverse_binary_expression(node->children[0], bytecode, bytecode_count, bytecode_capacity, &element_count);
-
-    // Ensure capacity for the array creation instruction
-    ensure_bytecode_capacity(bytecode, bytecode_count, bytecode_capacity);
+    // Push every element, in order (each child may be a comma separated list)
+    for (size_t i = 0; i < node->child_count; i++) {
+        generate_bytecode(node->children[i], bytecode, bytecode_count, bytecode_capacity);
+        element_count += count_comma_operands(node->children[i]);
+    }
 
     // Add an instruction to create an array with the specified number of elements
     BytecodeInstruction instr = {
-        .opcode = OP_ARRAY_SET_,
+        .opcode = OP_BUILD_ARRAY,
         .operand.array_literal.array_reg = array_reg,  // Assign the register for the array
-        .operand.array_literal.count = element_count   // Use the tracked element count
+        .operand.array_literal.count = (int)element_count   // Use the tracked element count
     };
-    (*bytecode)[(*bytecode_count)++] = instr;
-
-    // Optionally, print or log the number of elements for debugging
-    printf("Generated array literal bytecode with %zu elements, assigned to register %d.\n", element_count, array_reg);
+    emit_instruction(instr, bytecode, bytecode_count, bytecode_capacity);
 }
 
 
@@ -878,7 +1380,7 @@ void generate_array_access_bytecode(const ASTNode* node, BytecodeInstruction** b
 
     // The first child is the array identifier (variable holding the array)
     const ASTNode* array_node = node->children[0];
-    if (!array_node || array_node->type != AST_IDENTIFIER) {
+    if (!array_node) {
         fprintf(stderr, "Invalid array identifier in array access.\n");
         exit(EXIT_FAILURE);
     }
@@ -896,20 +1398,13 @@ void generate_array_access_bytecode(const ASTNode* node, BytecodeInstruction** b
     // Generate bytecode for the index expression (loads the index onto the stack)
     generate_bytecode(index_node, bytecode, bytecode_count, bytecode_capacity);
 
-    // Ensure capacity for the array access instruction
-    ensure_bytecode_capacity(bytecode, bytecode_count, bytecode_capacity);
-
     // Add the OP_ARRAY_GET_ instruction
     BytecodeInstruction instr = {
         .opcode = OP_ARRAY_GET_,
         .operand.array_access.array_reg = *bytecode_count - 2, // Array register
         .operand.array_access.index_reg = *bytecode_count - 1  // Index register
     };
-    (*bytecode)[(*bytecode_count)++] = instr;
-
-    // Optionally, log the generated instruction
-    printf("Generated OP_ARRAY_GET_ bytecode: ARRAY_REG = %d, INDEX_REG = %d\n",
-        instr.operand.array_access.array_reg, instr.operand.array_access.index_reg);
+    emit_instruction(instr, bytecode, bytecode_count, bytecode_capacity);
 }
 
 
@@ -941,38 +1436,26 @@ void generate_array_assignment_bytecode(const ASTNode* node, BytecodeInstruction
         exit(EXIT_FAILURE);
     }
 
-    // Generate bytecode for the array access (loads the array and index onto the stack)
-    generate_array_access_bytecode(array_access_node, bytecode, bytecode_count, bytecode_capacity);
+    // Load the array and the index onto the stack (without reading the element)
+    generate_bytecode(array_access_node->children[0], bytecode, bytecode_count, bytecode_capacity);
+    generate_bytecode(array_access_node->children[1], bytecode, bytecode_count, bytecode_capacity);
 
     // Generate bytecode for the value expression (loads the value onto the stack)
     generate_bytecode(value_node, bytecode, bytecode_count, bytecode_capacity);
 
-    // Ensure capacity for the array set instruction
-    ensure_bytecode_capacity(bytecode, bytecode_count, bytecode_capacity);
-
-    // Add the OP_ARRAY_SET_ instruction
+    // Add the OP_ARRAY_SET_ instruction, the assigned value stays on the stack
     BytecodeInstruction instr = {
         .opcode = OP_ARRAY_SET_,
         .operand.array_assignment.array_reg = *bytecode_count - 3, // Array register
         .operand.array_assignment.index_reg = *bytecode_count - 2, // Index register
         .operand.array_assignment.value_reg = *bytecode_count - 1  // Value register
     };
-    (*bytecode)[(*bytecode_count)++] = instr;
-
-    // Optionally, log the generated instruction
-    printf("Generated OP_ARRAY_SET_ bytecode: ARRAY_REG = %d, INDEX_REG = %d, VALUE_REG = %d\n",
-        instr.operand.array_assignment.array_reg,
-        instr.operand.array_assignment.index_reg,
-        instr.operand.array_assignment.value_reg);
+    emit_instruction(instr, bytecode, bytecode_count, bytecode_capacity);
 }
 
 
 
 
-
-
-
-
 /***********************************************************
 * Function: generate_return_statement_bytecode
 * Description: Generates bytecode for a `return` statement.
@@ -989,17 +1472,104 @@ void generate_return_statement_bytecode(const ASTNode* node, BytecodeInstruction
     if (node->child_count > 0) {
         // Generate bytecode for the return expression
         generate_bytecode(node->children[0], bytecode, bytecode_count, bytecode_capacity);
-    }
 
-    // Ensure capacity for the return instruction
-    ensure_bytecode_capacity(bytecode, bytecode_count, bytecode_capacity);
+        // A returned call inside a function runs in the caller's frame. The return stays
+        // behind it for the calls that can't (builtins, functions declared by the caller)
+        if (current_function && node->children[0]->type == AST_FUNCTION_CALL &&
+            (*bytecode)[*bytecode_count - 1].opcode == OP_CALL_FUNCTION) {
+            (*bytecode)[*bytecode_count - 1].opcode = OP_TAIL_CALL;
+        }
+    }
+    else {
+        BytecodeInstruction push_null = { .opcode = OP_PUSH_NULL };
+        emit_instruction(push_null, bytecode, bytecode_count, bytecode_capacity);
+    }
 
     // Add the return instruction
     BytecodeInstruction instr = { .opcode = OP_RETURN_ };
-    (*bytecode)[(*bytecode_count)++] = instr;
+    emit_instruction(instr, bytecode, bytecode_count, bytecode_capacity);
 }
 
 
+
+
+/***********************************************************
+* Function: switch_case_constant
+* Description: reads the value of a `when` case that is an int literal (optionally negated)
+* or a string literal.
+* Parameters: const ASTNode* value, SwitchCase* out
+* Return: bool (false if the case isn't such a constant)
+* ***********************************************************/
+static bool switch_case_constant(const ASTNode* value, SwitchCase* out) {
+    if (!value) return false;
+    if (value->type == AST_LITERAL && value->value_kind == VALUE_INT) {
+        out->is_string = false;
+        out->int_value = value->value.int_val;
+        return true;
+    }
+    if (value->type == AST_LITERAL && value->value_kind == VALUE_STRING && value->value.str_val) {
+        out->is_string = true;
+        out->string_value = value->value.str_val;
+        return true;
+    }
+    if (value->type == AST_UNARY_EXPR && value->operator_ && strcmp(value->operator_, "-") == 0 &&
+        value->child_count == 1 && value->children[0] &&
+        value->children[0]->type == AST_LITERAL && value->children[0]->value_kind == VALUE_INT) {
+        out->is_string = false;
+        out->int_value = -value->children[0]->value.int_val;
+        return true;
+    }
+    return false;
+}
+
+
+
+
+/***********************************************************
+* Function: switch_table_cases
+* Description: collects the cases of a switch that can be dispatched through a table:
+* at least SWITCH_TABLE_MIN_CASES cases, all int constants or all string constants.
+* The target of every case is filled in while its body is generated.
+* Parameters: const ASTNode* node
+* Return: SwitchCase* (one per `when` in order, NULL if the switch needs the compare chain)
+* ***********************************************************/
+static SwitchCase* switch_table_cases(const ASTNode* node) {
+    size_t when_count = 0;
+    for (size_t i = 1; i < node->child_count; i++) {
+        if (node->children[i] && node->children[i]->type == AST_WHEN) when_count++;
+    }
+    if (when_count < SWITCH_TABLE_MIN_CASES) return NULL;
+
+    SwitchCase* cases = (SwitchCase*)calloc(when_count, sizeof(SwitchCase));
+    if (!cases) {
+        fprintf(stderr, "Memory allocation failed for switch cases.\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t count = 0;
+    for (size_t i = 1; i < node->child_count; i++) {
+        const ASTNode* c = node->children[i];
+        if (!c || c->type != AST_WHEN) continue;
+        if (c->child_count == 0 || !switch_case_constant(c->children[0], &cases[count]) ||
+            cases[count].is_string != cases[0].is_string) {
+            free(cases);
+            return NULL;
+        }
+        count++;
+    }
+    return cases;
+}
+
+
+
+
+/***********************************************************
+* Function: generate_switch_bytecode
+* Description: generates a switch. The selector is evaluated once, then switches with enough
+* constant cases jump to the matching case through OP_SWITCH_ (its table is built by the
+* assembler) and the others compare the selector with each case in order.
+* Parameters: const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity
+* Return: void
+* ***********************************************************/
 void generate_switch_bytecode(const ASTNode* node,
     BytecodeInstruction** bytecode,
     size_t* bytecode_count,
@@ -1010,78 +1580,121 @@ void generate_switch_bytecode(const ASTNode* node,
         exit(EXIT_FAILURE);
     }
 
+    // The selector is evaluated once and kept on the stack while the cases are tested
     generate_bytecode(node->children[0], bytecode, bytecode_count, bytecode_capacity);
-    int switch_expr_reg = (int)(*bytecode_count) - 1;
 
-    int when_count = 0;
     int default_child_ix = -1;
     for (size_t i = 1; i < node->child_count; i++) {
         const ASTNode* c = node->children[i];
         if (!c) continue;
-        if (c->type == AST_WHEN) when_count++;
-        else if (c->type == AST_DEFAULT) default_child_ix = (int)i;
-        else {
+        if (c->type == AST_DEFAULT) default_child_ix = (int)i;
+        else if (c->type != AST_WHEN) {
             fprintf(stderr, "Invalid node type inside switch.\n");
             exit(EXIT_FAILURE);
         }
     }
 
-    ensure_bytecode_capacity(bytecode, bytecode_count, bytecode_capacity);
-    size_t switch_index = *bytecode_count;
-    BytecodeInstruction si;
-    memset(&si, 0, sizeof(si));
-    si.opcode = OP_SWITCH_;
-    si.operand.switch_.when_count = when_count;
-    si.operand.switch_.default_index = -1;
-    (*bytecode)[(*bytecode_count)++] = si;
+    // A `stop` inside a case leaves the switch, a `continue` still belongs to the enclosing loop
+    begin_loop();
+    size_t end_jumps[MAX_LOOP_JUMPS];
+    size_t end_jump_count = 0;
+
+    // Enough constant cases of one kind: jump straight to the matching case through a table
+    SwitchCase* cases = switch_table_cases(node);
+    if (cases) {
+        BytecodeInstruction dispatch = { .opcode = OP_SWITCH_ };
+        dispatch.operand.switch_.default_index = -1;
+        dispatch.operand.switch_.cases = cases;
+        size_t dispatch_index = *bytecode_count;
+        emit_instruction(dispatch, bytecode, bytecode_count, bytecode_capacity);
+
+        int case_index = 0;
+        for (size_t i = 1; i < node->child_count; i++) {
+            ASTNode* c = node->children[i];
+            if (!c || c->type != AST_WHEN) continue;
+
+            // OP_SWITCH_ already popped the selector
+            cases[case_index++].target_index = (int)*bytecode_count;
+            for (size_t j = 1; j < c->child_count; j++) {
+                generate_statement_bytecode(c->children[j], bytecode, bytecode_count, bytecode_capacity);
+            }
+
+            if (end_jump_count >= MAX_LOOP_JUMPS) {
+                fprintf(stderr, "Too many cases in switch for bytecode generation.\n");
+                exit(EXIT_FAILURE);
+            }
+            BytecodeInstruction to_end = { .opcode = OP_JUMP_TO, .operand.int_operand = -1 };
+            end_jumps[end_jump_count++] = *bytecode_count;
+            emit_instruction(to_end, bytecode, bytecode_count, bytecode_capacity);
+        }
+        (*bytecode)[dispatch_index].operand.switch_.default_index = (int)*bytecode_count;
+        (*bytecode)[dispatch_index].operand.switch_.when_count = case_index;
+    }
 
-    for (size_t i = 1; i < node->child_count; i++) {
+    for (size_t i = 1; i < node->child_count && !cases; i++) {
         ASTNode* c = node->children[i];
         if (!c || c->type != AST_WHEN) continue;
 
+        // selector == case value ?
+        BytecodeInstruction dup = { .opcode = OP_DUP };
+        emit_instruction(dup, bytecode, bytecode_count, bytecode_capacity);
         generate_bytecode(c->children[0], bytecode, bytecode_count, bytecode_capacity);
-        int cond_reg = (int)(*bytecode_count) - 1;
 
         BytecodeInstruction eq;
         memset(&eq, 0, sizeof(eq));
         eq.opcode = OP_EQUAL;
-        eq.operand.binary.left_reg = switch_expr_reg;
-        eq.operand.binary.right_reg = cond_reg;
-        ensure_bytecode_capacity(bytecode, bytecode_count, bytecode_capacity);
-        (*bytecode)[(*bytecode_count)++] = eq;
+        eq.operand.binary.left_reg = (int)(*bytecode_count) - 2;
+        eq.operand.binary.right_reg = (int)(*bytecode_count) - 1;
+        emit_instruction(eq, bytecode, bytecode_count, bytecode_capacity);
 
-        BytecodeInstruction wi;
-        memset(&wi, 0, sizeof(wi));
-        wi.opcode = OP_WHEN_;
-        wi.operand.when.condition_reg = (int)(*bytecode_count) - 1;
-        wi.operand.when.body_index = (int)(*bytecode_count) + 1;
-        ensure_bytecode_capacity(bytecode, bytecode_count, bytecode_capacity);
-        (*bytecode)[(*bytecode_count)++] = wi;
+        BytecodeInstruction next_case = { .opcode = OP_JUMP_TO_IF_FALSE, .operand.int_operand = -1 };
+        size_t next_case_index = *bytecode_count;
+        emit_instruction(next_case, bytecode, bytecode_count, bytecode_capacity);
 
+        // Matched: drop the selector and run the case body
+        BytecodeInstruction pop = { .opcode = OP_POP };
+        emit_instruction(pop, bytecode, bytecode_count, bytecode_capacity);
         for (size_t j = 1; j < c->child_count; j++) {
-            generate_bytecode(c->children[j], bytecode, bytecode_count, bytecode_capacity);
+            generate_statement_bytecode(c->children[j], bytecode, bytecode_count, bytecode_capacity);
         }
 
-        ensure_bytecode_capacity(bytecode, bytecode_count, bytecode_capacity);
-        BytecodeInstruction br;
-        memset(&br, 0, sizeof(br));
-        br.opcode = OP_BREAK_;
-        (*bytecode)[(*bytecode_count)++] = br;
+        if (end_jump_count >= MAX_LOOP_JUMPS) {
+            fprintf(stderr, "Too many cases in switch for bytecode generation.\n");
+            exit(EXIT_FAILURE);
+        }
+        BytecodeInstruction to_end = { .opcode = OP_JUMP_TO, .operand.int_operand = -1 };
+        end_jumps[end_jump_count++] = *bytecode_count;
+        emit_instruction(to_end, bytecode, bytecode_count, bytecode_capacity);
+
+        (*bytecode)[next_case_index].operand.int_operand = (int)*bytecode_count;
     }
 
+    // No case matched: drop the selector and run the default (if any)
+    if (!cases) {
+        BytecodeInstruction pop = { .opcode = OP_POP };
+        emit_instruction(pop, bytecode, bytecode_count, bytecode_capacity);
+    }
     if (default_child_ix != -1) {
-        int def_ix = (int)(*bytecode_count);
         ASTNode* def_node = node->children[default_child_ix];
         for (size_t i = 0; i < def_node->child_count; i++) {
-            generate_bytecode(def_node->children[i], bytecode, bytecode_count, bytecode_capacity);
+            generate_statement_bytecode(def_node->children[i], bytecode, bytecode_count, bytecode_capacity);
         }
-        ensure_bytecode_capacity(bytecode, bytecode_count, bytecode_capacity);
-        BytecodeInstruction br;
-        memset(&br, 0, sizeof(br));
-        br.opcode = OP_BREAK_;
-        (*bytecode)[(*bytecode_count)++] = br;
-        (*bytecode)[switch_index].operand.switch_.default_index = def_ix;
     }
+
+    for (size_t i = 0; i < end_jump_count; i++) {
+        (*bytecode)[end_jumps[i]].operand.int_operand = (int)*bytecode_count;
+    }
+
+    // Patch the `stop`s of the switch and hand the `continue`s to the enclosing loop
+    LoopContext* inner = &loop_stack[loop_depth - 1];
+    if (loop_depth > 1) {
+        LoopContext* outer = &loop_stack[loop_depth - 2];
+        for (size_t i = 0; i < inner->continue_count && outer->continue_count < MAX_LOOP_JUMPS; i++) {
+            outer->continue_jumps[outer->continue_count++] = inner->continue_jumps[i];
+        }
+        inner->continue_count = 0;
+    }
+    end_loop(*bytecode, *bytecode_count, *bytecode_count);
 }
 
 
@@ -1155,4 +1768,38 @@ void generate_default_switch_bytecode(const ASTNode* node, BytecodeInstruction**
 	// Add the default instruction
 	BytecodeInstruction instr = { .opcode = OP_DEFAULT_ };
 	(*bytecode)[(*bytecode_count)++] = instr;
-}
\ No newline at end of file
+}
+
+
+
+
+
+/***********************************************************
+ * Function: generate_loop_jump_bytecode
+ * Description: generates a `stop` or `continue` as a jump that gets patched when the loop ends.
+ * Parameters: const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity
+ * Return: void
+ * ***********************************************************/
+void generate_loop_jump_bytecode(const ASTNode* node, BytecodeInstruction** bytecode, size_t* bytecode_count, size_t* bytecode_capacity) {
+    if (!node || (node->type != AST_BREAK && node->type != AST_CONTINUE)) {
+        fprintf(stderr, "Invalid node type for loop jump.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (loop_depth == 0) {
+        fprintf(stderr, "'%s' used outside of a loop (line %zu).\n",
+            node->type == AST_BREAK ? "stop" : "continue", node->line);
+        exit(EXIT_FAILURE);
+    }
+
+    LoopContext* loop = &loop_stack[loop_depth - 1];
+    size_t* count = node->type == AST_BREAK ? &loop->break_count : &loop->continue_count;
+    size_t* jumps = node->type == AST_BREAK ? loop->break_jumps : loop->continue_jumps;
+    if (*count >= MAX_LOOP_JUMPS) {
+        fprintf(stderr, "Too many 'stop'/'continue' in one loop.\n");
+        exit(EXIT_FAILURE);
+    }
+    jumps[(*count)++] = *bytecode_count;
+
+    BytecodeInstruction instr = { .opcode = OP_JUMP_TO, .operand.int_operand = -1 };
+    emit_instruction(instr, bytecode, bytecode_count, bytecode_capacity);
+}
@@ -0,0 +1,470 @@
+/***********************************************************
+* File: bytecodeFile.c
+* This file writes compiled programs to .clkb files and maps them back into memory.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#include <string.h>
+#include "bytecodeFile.h"
+#include "verifier.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define CLKB_HEADER_SIZE 24
+#define CLKB_FUNCTION_SIZE 40
+#define CLKB_CONSTANT_SIZE 16
+
+enum { CLKB_CONST_INT = 0, CLKB_CONST_FLOAT = 1, CLKB_CONST_STRING = 2 };
+
+/***********************************************************
+* Struct: FileBuffer
+* Description: growable buffer for the data section of the file being written.
+************************************************************/
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+} FileBuffer;
+
+
+
+
+/***********************************************************
+* Function: put_u32 / put_u64 / get_u32 / get_u64
+* Description: little endian integer access to file bytes.
+* Parameters: uint8_t* at, value
+* Return: void / value
+* ***********************************************************/
+static void put_u32(uint8_t* at, uint32_t value) {
+    for (int i = 0; i < 4; i++) at[i] = (uint8_t)(value >> (8 * i));
+}
+
+static void put_u64(uint8_t* at, uint64_t value) {
+    for (int i = 0; i < 8; i++) at[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint32_t get_u32(const uint8_t* at) {
+    return read_u32(at);
+}
+
+static uint64_t get_u64(const uint8_t* at) {
+    return (uint64_t)read_u32(at) | ((uint64_t)read_u32(at + 4) << 32);
+}
+
+
+
+
+/***********************************************************
+* Function: buffer_append
+* Description: appends bytes to the data section and returns their offset in the section.
+* Parameters: FileBuffer* buffer, const void* bytes, size_t size
+* Return: size_t
+* ***********************************************************/
+static size_t buffer_append(FileBuffer* buffer, const void* bytes, size_t size) {
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 1024;
+        while (buffer->size + size > capacity) capacity *= 2;
+        uint8_t* data = (uint8_t*)realloc(buffer->data, capacity);
+        if (!data) {
+            fprintf(stderr, "Memory allocation failed while writing bytecode.\n");
+            exit(EXIT_FAILURE);
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    size_t offset = buffer->size;
+    memcpy(buffer->data + buffer->size, bytes, size);
+    buffer->size += size;
+    return offset;
+}
+
+
+
+
+/***********************************************************
+* Function: write_program
+* Description: writes a compiled program to a .clkb file.
+* Parameters: const BytecodeProgram* program, const char* path, bool report (print why it failed)
+* Return: bool
+* ***********************************************************/
+static bool write_program(const BytecodeProgram* program, const char* path, bool report) {
+    // The file holds the whole program, including the functions that never ran
+    compile_all_functions(program);
+
+    // The tables have a fixed size, the code and strings go to the data section after them
+    size_t constant_total = 0;
+    for (size_t f = 0; f < program->function_count; f++) {
+        constant_total += program->functions[f].constant_count;
+    }
+    size_t functions_offset = CLKB_HEADER_SIZE;
+    size_t constants_offset = functions_offset + program->function_count * CLKB_FUNCTION_SIZE;
+    size_t globals_offset = constants_offset + constant_total * CLKB_CONSTANT_SIZE;
+    size_t data_offset = globals_offset + program->global_count * 4;
+
+    uint8_t* table = (uint8_t*)calloc(1, data_offset);
+    FileBuffer data = { NULL, 0, 0 };
+    if (!table) {
+        fprintf(stderr, "Memory allocation failed while writing bytecode.\n");
+        return false;
+    }
+
+    memcpy(table, CLKB_MAGIC, 4);
+    put_u32(table + 4, CLKB_VERSION);
+    put_u32(table + 8, (uint32_t)program->function_count);
+    put_u32(table + 12, (uint32_t)program->global_count);
+    put_u32(table + 16, (uint32_t)functions_offset);
+    put_u32(table + 20, (uint32_t)globals_offset);
+
+    size_t constant_index = 0;
+    for (size_t f = 0; f < program->function_count; f++) {
+        const CodeObject* function = &program->functions[f];
+        uint8_t* record = table + functions_offset + f * CLKB_FUNCTION_SIZE;
+
+        put_u32(record, (uint32_t)(data_offset + buffer_append(&data, function->name, strlen(function->name) + 1)));
+        put_u32(record + 4, (uint32_t)function->param_count);
+        put_u32(record + 8, (uint32_t)function->local_count);
+        put_u32(record + 12, (uint32_t)(data_offset + buffer_append(&data, function->code, function->code_size)));
+        put_u32(record + 16, (uint32_t)function->code_size);
+        put_u32(record + 20, (uint32_t)(constants_offset + constant_index * CLKB_CONSTANT_SIZE));
+        put_u32(record + 24, (uint32_t)function->constant_count);
+        if (function->capture_count > 0) {
+            put_u32(record + 28, (uint32_t)(data_offset + buffer_append(&data, function->captures, function->capture_count * sizeof(Capture))));
+            put_u32(record + 32, (uint32_t)function->capture_count);
+        }
+
+        for (size_t c = 0; c < function->constant_count; c++, constant_index++) {
+            const RuntimeValue* value = &function->constants[c];
+            uint8_t* constant = table + constants_offset + constant_index * CLKB_CONSTANT_SIZE;
+            switch (value->type) {
+            case RUNTIME_VALUE_INT:
+                put_u32(constant, CLKB_CONST_INT);
+                put_u64(constant + 8, (uint64_t)(int64_t)value->int_val);
+                break;
+            case RUNTIME_VALUE_FLOAT: {
+                uint64_t bits;
+                memcpy(&bits, &value->float_val, sizeof(bits));
+                put_u32(constant, CLKB_CONST_FLOAT);
+                put_u64(constant + 8, bits);
+                break;
+            }
+            case RUNTIME_VALUE_STRING:
+                put_u32(constant, CLKB_CONST_STRING);
+                put_u64(constant + 8, data_offset + buffer_append(&data, value->string_val, strlen(value->string_val) + 1));
+                break;
+            default:
+                if (report) fprintf(stderr, "Cannot write a constant of type %d.\n", value->type);
+                free(table);
+                free(data.data);
+                return false;
+            }
+        }
+    }
+
+    for (size_t g = 0; g < program->global_count; g++) {
+        const char* name = program->global_names[g];
+        put_u32(table + globals_offset + g * 4, (uint32_t)(data_offset + buffer_append(&data, name, strlen(name) + 1)));
+    }
+
+    if (data_offset + data.size > UINT32_MAX) {
+        if (report) fprintf(stderr, "Program too large for the bytecode file format.\n");
+        free(table);
+        free(data.data);
+        return false;
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        if (report) perror("Error opening output file");
+        free(table);
+        free(data.data);
+        return false;
+    }
+    bool ok = fwrite(table, 1, data_offset, file) == data_offset &&
+        fwrite(data.data, 1, data.size, file) == data.size;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok && report) {
+        fprintf(stderr, "Error writing bytecode file '%s'.\n", path);
+    }
+
+    free(table);
+    free(data.data);
+    return ok;
+}
+
+
+
+
+/***********************************************************
+* Function: save_program / save_program_quiet
+* Description: writes a compiled program to a .clkb file, with or without reporting errors.
+* Parameters: const BytecodeProgram* program, const char* path
+* Return: bool
+* ***********************************************************/
+bool save_program(const BytecodeProgram* program, const char* path) {
+    return write_program(program, path, true);
+}
+
+bool save_program_quiet(const BytecodeProgram* program, const char* path) {
+    return write_program(program, path, false);
+}
+
+
+
+
+/***********************************************************
+* Function: map_file / unmap_file
+* Description: copy on write memory mapping of a whole file. The file is never written,
+* but the VM rewrites instructions of the running code in place (quickening).
+* Parameters: const char* path, size_t* size / void* base, size_t size
+* Return: const uint8_t* (NULL on error) / void
+* ***********************************************************/
+static const uint8_t* map_file(const char* path, size_t* size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return NULL;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) return NULL;
+
+    // The view keeps the mapping alive after its handle is closed
+    void* base = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!base) return NULL;
+
+    *size = (size_t)file_size.QuadPart;
+    return (const uint8_t*)base;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    void* base = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+
+    *size = (size_t)info.st_size;
+    return (const uint8_t*)base;
+#endif
+}
+
+static void unmap_file(void* base, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(base);
+#else
+    munmap(base, size);
+#endif
+}
+
+
+
+
+/***********************************************************
+* Function: release_program_mapping
+* Description: unmaps the file a program was loaded from (called by free_program).
+* Parameters: BytecodeProgram* program
+* Return: void
+* ***********************************************************/
+void release_program_mapping(BytecodeProgram* program) {
+    if (program->mapping) {
+        unmap_file(program->mapping, program->mapping_size);
+        program->mapping = NULL;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: file_string
+* Description: returns the NUL terminated string at an offset of the file, NULL if it leaves the file.
+* Parameters: const uint8_t* base, size_t size, uint64_t offset
+* Return: char*
+* ***********************************************************/
+static char* file_string(const uint8_t* base, size_t size, uint64_t offset) {
+    if (offset >= size || !memchr(base + offset, '\0', size - (size_t)offset)) return NULL;
+    return (char*)(base + offset);
+}
+
+
+
+
+/***********************************************************
+* Function: map_program
+* Description: maps a .clkb file and builds the program around it. The code, the names and
+* the string constants are used in place; only the small tables are allocated.
+* Parameters: const char* path, bool report (print why the file can't be used)
+* Return: BytecodeProgram* (NULL on error)
+* ***********************************************************/
+static BytecodeProgram* map_program(const char* path, bool report) {
+    size_t size = 0;
+    const uint8_t* base = map_file(path, &size);
+    if (!base) {
+        if (report) fprintf(stderr, "Error opening bytecode file '%s'.\n", path);
+        return NULL;
+    }
+
+    if (size < CLKB_HEADER_SIZE || memcmp(base, CLKB_MAGIC, 4) != 0) {
+        if (report) fprintf(stderr, "'%s' is not a Clock bytecode file.\n", path);
+        unmap_file((void*)base, size);
+        return NULL;
+    }
+    if (get_u32(base + 4) != CLKB_VERSION) {
+        if (report) fprintf(stderr, "'%s' was compiled for bytecode version %u, this interpreter runs version %d. Recompile it.\n",
+            path, get_u32(base + 4), CLKB_VERSION);
+        unmap_file((void*)base, size);
+        return NULL;
+    }
+
+    uint64_t function_count = get_u32(base + 8);
+    uint64_t global_count = get_u32(base + 12);
+    uint64_t functions_offset = get_u32(base + 16);
+    uint64_t globals_offset = get_u32(base + 20);
+
+    BytecodeProgram* program = (BytecodeProgram*)calloc(1, sizeof(BytecodeProgram));
+    if (!program) {
+        fprintf(stderr, "Memory allocation failed while loading bytecode.\n");
+        unmap_file((void*)base, size);
+        return NULL;
+    }
+    program->mapping = (void*)base;
+    program->mapping_size = size;
+
+    bool ok = function_count > 0 && function_count <= UINT16_MAX && global_count <= UINT16_MAX + 1 &&
+        functions_offset + function_count * CLKB_FUNCTION_SIZE <= size &&
+        globals_offset + global_count * 4 <= size;
+
+    if (ok) {
+        program->functions = (CodeObject*)calloc((size_t)function_count, sizeof(CodeObject));
+        program->function_capacity = (size_t)function_count;
+        program->global_names = (char**)calloc(global_count ? (size_t)global_count : 1, sizeof(char*));
+        ok = program->functions && program->global_names;
+    }
+
+    // Global names first, the verifier needs the global count
+    for (uint64_t g = 0; ok && g < global_count; g++) {
+        program->global_names[g] = file_string(base, size, get_u32(base + globals_offset + g * 4));
+        ok = program->global_names[g] != NULL;
+        program->global_count = (size_t)g + 1;
+    }
+
+    for (uint64_t f = 0; ok && f < function_count; f++) {
+        const uint8_t* record = base + functions_offset + f * CLKB_FUNCTION_SIZE;
+        CodeObject* function = &program->functions[f];
+        program->function_count = (size_t)f + 1;
+
+        uint64_t code_offset = get_u32(record + 12);
+        uint64_t code_size = get_u32(record + 16);
+        uint64_t constants_offset = get_u32(record + 20);
+        uint64_t constant_count = get_u32(record + 24);
+        uint64_t captures_offset = get_u32(record + 28);
+        uint64_t capture_count = get_u32(record + 32);
+
+        function->name = file_string(base, size, get_u32(record));
+        function->param_count = (int)get_u32(record + 4);
+        function->local_count = (int)get_u32(record + 8);
+        function->code = (uint8_t*)(base + code_offset);
+        function->code_size = (size_t)code_size;
+        function->captures = (Capture*)(base + captures_offset);
+        function->capture_count = (int)capture_count;
+        ok = function->name && code_offset + code_size <= size &&
+            capture_count <= UINT8_MAX + 1 && captures_offset + capture_count * sizeof(Capture) <= size &&
+            constant_count <= UINT16_MAX && constants_offset + constant_count * CLKB_CONSTANT_SIZE <= size &&
+            function->param_count >= 0 && function->local_count >= function->param_count && function->local_count <= 256;
+        if (!ok) break;
+
+        if (constant_count > 0) {
+            function->constants = (RuntimeValue*)malloc(sizeof(RuntimeValue) * (size_t)constant_count);
+            ok = function->constants != NULL;
+        }
+        for (uint64_t c = 0; ok && c < constant_count; c++) {
+            const uint8_t* constant = base + constants_offset + c * CLKB_CONSTANT_SIZE;
+            RuntimeValue* value = &function->constants[c];
+            uint64_t bits = get_u64(constant + 8);
+            switch (get_u32(constant)) {
+            case CLKB_CONST_INT:
+                *value = make_int_value((long)(int64_t)bits);
+                break;
+            case CLKB_CONST_FLOAT: {
+                double d;
+                memcpy(&d, &bits, sizeof(d));
+                *value = make_float_value(d);
+                break;
+            }
+            case CLKB_CONST_STRING:
+                value->type = RUNTIME_VALUE_STRING;
+                value->string_val = file_string(base, size, bits);
+                ok = value->string_val != NULL;
+                break;
+            default:
+                ok = false;
+                break;
+            }
+            function->constant_count = (size_t)c + 1;
+        }
+    }
+
+    // Nothing in the file is trusted: the code must pass the verifier like compiled code does
+    ok = ok && verify_program(program);
+
+    if (!ok) {
+        if (report) fprintf(stderr, "Bytecode file '%s' is corrupted.\n", path);
+        free_program(program);
+        return NULL;
+    }
+    return program;
+}
+
+
+
+
+/***********************************************************
+* Function: load_program / load_program_quiet
+* Description: maps a .clkb file, with or without reporting why it can't be used.
+* Parameters: const char* path
+* Return: BytecodeProgram* (NULL on error)
+* ***********************************************************/
+BytecodeProgram* load_program(const char* path) {
+    return map_program(path, true);
+}
+
+BytecodeProgram* load_program_quiet(const char* path) {
+    return map_program(path, false);
+}
+
+
+
+
+/***********************************************************
+* Function: is_bytecode_file
+* Description: tells if a file name has the .clkb extension.
+* Parameters: const char* path
+* Return: bool
+* ***********************************************************/
+bool is_bytecode_file(const char* path) {
+    size_t length = strlen(path);
+    size_t extension = strlen(CLKB_EXTENSION);
+    return length > extension && strcmp(path + length - extension, CLKB_EXTENSION) == 0;
+}
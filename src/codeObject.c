@@ -0,0 +1,1365 @@
+/***********************************************************
+* File: codeObject.c
+* This file assembles the bytecode into packed code objects (one per function)
+* and prints them back in a readable form.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#include <string.h>
+#include "codeObject.h"
+#include "bytecodeFile.h"
+#include "optimizer.h"
+#include "resolver.h"
+#include "verifier.h"
+
+/***********************************************************
+* Struct: JumpFixup
+* Description: a jump whose byte offset is only known once its whole function is assembled.
+************************************************************/
+typedef struct {
+    size_t position;   // Offset of the u32 operand in the code
+    int target;        // Target instruction in the generated bytecode
+} JumpFixup;
+
+/***********************************************************
+* Struct: SwitchFixup
+* Description: an OP_SWITCH_ whose table is built once its function is assembled.
+************************************************************/
+typedef struct {
+    size_t position;   // Offset of the u8 layout operand in the code
+    size_t index;      // The OP_SWITCH_ in the generated bytecode
+} SwitchFixup;
+
+/***********************************************************
+* Struct: SwitchEntry
+* Description: a case of a switch table being built, with the byte offset of its body.
+************************************************************/
+typedef struct {
+    const SwitchCase* when;
+    size_t order;      // Position of the case in the switch, the first of equal cases wins
+    uint32_t target;
+} SwitchEntry;
+
+#define SWITCH_HASH_SEEDS 64 // Seeds tried for the hash of a string table
+
+/***********************************************************
+* Struct: Assembler
+* Description: state shared by the functions being assembled.
+************************************************************/
+typedef struct {
+    const BytecodeInstruction* input;  // Output of generate_bytecode
+    size_t input_count;
+    size_t* offsets;                   // Byte offset of every input instruction in its code object
+    BytecodeProgram* program;
+} Assembler;
+
+
+
+
+/***********************************************************
+* Function: assembler_fail
+* Description: reports a fatal assembler error.
+* Parameters: const char* message
+* Return: void
+* ***********************************************************/
+static void assembler_fail(const char* message) {
+    fprintf(stderr, "Bytecode assembly error: %s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+
+
+
+/***********************************************************
+* Function: emit_byte / emit_u16 / emit_u32
+* Description: append bytes to a code object, growing it when needed.
+* Parameters: CodeObject* function, size_t* capacity, value
+* Return: void
+* ***********************************************************/
+static void emit_byte(CodeObject* function, size_t* capacity, uint8_t byte) {
+    if (function->code_size >= *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        uint8_t* code = (uint8_t*)realloc(function->code, *capacity);
+        if (!code) {
+            assembler_fail("memory allocation failed.");
+        }
+        function->code = code;
+    }
+    function->code[function->code_size++] = byte;
+}
+
+static void emit_u16(CodeObject* function, size_t* capacity, uint16_t value) {
+    emit_byte(function, capacity, (uint8_t)(value & 0xFF));
+    emit_byte(function, capacity, (uint8_t)(value >> 8));
+}
+
+static void emit_u32(CodeObject* function, size_t* capacity, uint32_t value) {
+    emit_u16(function, capacity, (uint16_t)(value & 0xFFFF));
+    emit_u16(function, capacity, (uint16_t)(value >> 16));
+}
+
+
+
+
+/***********************************************************
+* Function: add_constant
+* Description: returns the index of a constant in the function's pool, adding it if needed.
+* Strings are copied so the pool does not depend on the AST.
+* Parameters: CodeObject* function, RuntimeValue value
+* Return: uint16_t
+* ***********************************************************/
+static uint16_t add_constant(CodeObject* function, RuntimeValue value) {
+    for (size_t i = 0; i < function->constant_count; i++) {
+        const RuntimeValue* existing = &function->constants[i];
+        if (existing->type != value.type) continue;
+        if (value.type == RUNTIME_VALUE_INT && existing->int_val == value.int_val) return (uint16_t)i;
+        if (value.type == RUNTIME_VALUE_FLOAT && existing->float_val == value.float_val) return (uint16_t)i;
+        if (value.type == RUNTIME_VALUE_STRING && strcmp(existing->string_val, value.string_val) == 0) return (uint16_t)i;
+    }
+
+    if (function->constant_count >= UINT16_MAX) {
+        assembler_fail("too many constants in one function.");
+    }
+    RuntimeValue* constants = (RuntimeValue*)realloc(function->constants, sizeof(RuntimeValue) * (function->constant_count + 1));
+    if (!constants) {
+        assembler_fail("memory allocation failed.");
+    }
+    function->constants = constants;
+
+    if (value.type == RUNTIME_VALUE_STRING) {
+        value.string_val = strdup(value.string_val);
+        if (!value.string_val) {
+            assembler_fail("memory allocation failed.");
+        }
+    }
+    function->constants[function->constant_count] = value;
+    return (uint16_t)function->constant_count++;
+}
+
+
+
+
+/***********************************************************
+* Function: append_table
+* Description: appends `count` int constants to the pool for a switch table. Unlike
+* add_constant nothing is shared, the table is filled in by the caller.
+* Parameters: CodeObject* function, size_t count
+* Return: uint16_t (index of the first one)
+* ***********************************************************/
+static uint16_t append_table(CodeObject* function, size_t count) {
+    if (function->constant_count + count > UINT16_MAX) {
+        assembler_fail("too many constants in one function.");
+    }
+    RuntimeValue* constants = (RuntimeValue*)realloc(function->constants, sizeof(RuntimeValue) * (function->constant_count + count));
+    if (!constants) {
+        assembler_fail("memory allocation failed.");
+    }
+    function->constants = constants;
+
+    size_t first = function->constant_count;
+    for (size_t i = 0; i < count; i++) {
+        function->constants[first + i] = make_int_value(0);
+    }
+    function->constant_count += count;
+    return (uint16_t)first;
+}
+
+
+
+
+/***********************************************************
+* Function: switch_hash
+* Description: seeded FNV-1a hash of a string case.
+* Parameters: const char* key, uint32_t seed
+* Return: uint32_t
+* ***********************************************************/
+static uint32_t switch_hash(const char* key, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;
+    for (const unsigned char* c = (const unsigned char*)key; *c; c++) {
+        hash ^= *c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+
+
+/***********************************************************
+* Function: compare_switch_entries
+* Description: qsort order of switch cases: by value, then by position in the switch.
+* Parameters: const void* a, const void* b
+* Return: int
+* ***********************************************************/
+static int compare_switch_entries(const void* a, const void* b) {
+    const SwitchEntry* x = (const SwitchEntry*)a;
+    const SwitchEntry* y = (const SwitchEntry*)b;
+    if (x->when->is_string) {
+        int order = strcmp(x->when->string_value, y->when->string_value);
+        if (order != 0) return order;
+    }
+    else if (x->when->int_value != y->when->int_value) {
+        return x->when->int_value < y->when->int_value ? -1 : 1;
+    }
+    return x->order < y->order ? -1 : (x->order > y->order);
+}
+
+
+
+
+/***********************************************************
+* Function: hash_collisions
+* Description: number of string cases that don't land in their own slot of a table
+* of `slots` entries with the given seed.
+* Parameters: const SwitchEntry* entries, size_t count, size_t slots, uint32_t seed, bool* used
+* Return: size_t
+* ***********************************************************/
+static size_t hash_collisions(const SwitchEntry* entries, size_t count, size_t slots, uint32_t seed, bool* used) {
+    memset(used, 0, slots * sizeof(bool));
+    size_t collisions = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t slot = switch_hash(entries[i].when->string_value, seed) & (slots - 1);
+        while (used[slot]) {
+            slot = (slot + 1) & (slots - 1);
+            collisions++;
+        }
+        used[slot] = true;
+    }
+    return collisions;
+}
+
+
+
+
+/***********************************************************
+* Function: assemble_switch_table
+* Description: builds the table of an OP_SWITCH_ at the end of the constant pool and writes
+* its layout and index into the instruction. Ints that fill at least half of their range get
+* a dense table, other ints a sorted one, strings a hash table whose seed is picked to
+* avoid collisions (so a case is usually found at its first slot).
+* Parameters: Assembler* as, CodeObject* out, const SwitchFixup* fixup
+* Return: void
+* ***********************************************************/
+static void assemble_switch_table(Assembler* as, CodeObject* out, const SwitchFixup* fixup) {
+    const BytecodeInstruction* instr = &as->input[fixup->index];
+    size_t when_count = (size_t)instr->operand.switch_.when_count;
+    uint32_t default_target = (uint32_t)as->offsets[instr->operand.switch_.default_index];
+
+    SwitchEntry* entries = (SwitchEntry*)malloc(sizeof(SwitchEntry) * when_count);
+    if (!entries) {
+        assembler_fail("memory allocation failed.");
+    }
+    for (size_t i = 0; i < when_count; i++) {
+        entries[i].when = &instr->operand.switch_.cases[i];
+        entries[i].order = i;
+        entries[i].target = (uint32_t)as->offsets[entries[i].when->target_index];
+    }
+
+    // Only the first of equal cases can ever match
+    qsort(entries, when_count, sizeof(SwitchEntry), compare_switch_entries);
+    size_t count = 0;
+    for (size_t i = 0; i < when_count; i++) {
+        if (count > 0 && entries[i].when->is_string == entries[count - 1].when->is_string &&
+            (entries[i].when->is_string ? strcmp(entries[i].when->string_value, entries[count - 1].when->string_value) == 0
+                                        : entries[i].when->int_value == entries[count - 1].when->int_value)) {
+            continue;
+        }
+        entries[count++] = entries[i];
+    }
+
+    uint8_t layout;
+    uint16_t first;
+    if (!entries[0].when->is_string) {
+        long lowest = entries[0].when->int_value;
+        unsigned long range = (unsigned long)entries[count - 1].when->int_value - (unsigned long)lowest + 1;
+        if (range != 0 && range <= 2 * count) {
+            layout = SWITCH_DENSE;
+            first = append_table(out, 2 + range);
+            RuntimeValue* table = &out->constants[first];
+            table[0].int_val = lowest;
+            table[1].int_val = (long)range;
+            for (unsigned long slot = 0; slot < range; slot++) {
+                table[2 + slot].int_val = default_target;
+            }
+            for (size_t i = 0; i < count; i++) {
+                table[2 + ((unsigned long)entries[i].when->int_value - (unsigned long)lowest)].int_val = entries[i].target;
+            }
+        }
+        else {
+            layout = SWITCH_SORTED;
+            first = append_table(out, 1 + 2 * count);
+            RuntimeValue* table = &out->constants[first];
+            table[0].int_val = (long)count;
+            for (size_t i = 0; i < count; i++) {
+                table[1 + i].int_val = entries[i].when->int_value;
+                table[1 + count + i].int_val = entries[i].target;
+            }
+        }
+    }
+    else {
+        // At most half of the slots are used, so probing always reaches an empty one
+        size_t slots = 2;
+        while (slots < 2 * count) slots *= 2;
+        bool* used = (bool*)malloc(slots * sizeof(bool));
+        if (!used) {
+            assembler_fail("memory allocation failed.");
+        }
+        uint32_t seed = 0;
+        size_t fewest = hash_collisions(entries, count, slots, 0, used);
+        for (uint32_t candidate = 1; candidate < SWITCH_HASH_SEEDS && fewest > 0; candidate++) {
+            size_t collisions = hash_collisions(entries, count, slots, candidate, used);
+            if (collisions < fewest) {
+                fewest = collisions;
+                seed = candidate;
+            }
+        }
+        free(used);
+
+        layout = SWITCH_HASH;
+        first = append_table(out, 2 + 2 * slots);
+        RuntimeValue* table = &out->constants[first];
+        table[0].int_val = (long)slots;
+        table[1].int_val = (long)seed;
+        for (size_t slot = 0; slot < slots; slot++) {
+            table[2 + slots + slot].int_val = default_target;
+        }
+        for (size_t i = 0; i < count; i++) {
+            size_t slot = switch_hash(entries[i].when->string_value, seed) & (slots - 1);
+            while (table[2 + slot].type == RUNTIME_VALUE_STRING) {
+                slot = (slot + 1) & (slots - 1);
+            }
+            table[2 + slot].type = RUNTIME_VALUE_STRING;
+            table[2 + slot].string_val = strdup(entries[i].when->string_value);
+            if (!table[2 + slot].string_val) {
+                assembler_fail("memory allocation failed.");
+            }
+            table[2 + slots + slot].int_val = entries[i].target;
+        }
+    }
+    free(entries);
+
+    uint8_t* p = &out->code[fixup->position];
+    p[0] = layout;
+    p[1] = (uint8_t)(first & 0xFF);
+    p[2] = (uint8_t)(first >> 8);
+}
+
+
+
+
+/***********************************************************
+* Function: new_function
+* Description: reserves the next slot of the function table. The table never grows: the
+* running program points into it, and it has room for every declaration of the source.
+* Parameters: Assembler* as
+* Return: size_t (index of the new function)
+* ***********************************************************/
+static size_t new_function(Assembler* as) {
+    BytecodeProgram* program = as->program;
+    if (program->function_count >= UINT16_MAX) {
+        assembler_fail("too many functions.");
+    }
+    if (program->function_count >= program->function_capacity) {
+        assembler_fail("more functions than declarations.");
+    }
+    memset(&program->functions[program->function_count], 0, sizeof(CodeObject));
+    return program->function_count++;
+}
+
+
+
+
+/***********************************************************
+* Function: assemble_range
+* Description: packs the instructions [first, end) of the generated bytecode into one code object.
+* Function declarations found on the way get a stub in the function table.
+* Parameters: Assembler* as, size_t first, size_t end, CodeObject* out
+* Return: void
+* ***********************************************************/
+static void assemble_range(Assembler* as, size_t first, size_t end, CodeObject* out) {
+    size_t capacity = 0;
+    JumpFixup* fixups = NULL;
+    size_t fixup_count = 0;
+    size_t fixup_capacity = 0;
+    SwitchFixup* switches = NULL;
+    size_t switch_count = 0;
+    size_t switch_capacity = 0;
+
+    for (size_t i = first; i < end; i++) {
+        const BytecodeInstruction* instr = &as->input[i];
+        as->offsets[i] = out->code_size;
+
+        switch (instr->opcode) {
+        case OP_PUSH_INT:
+            // Small ints are inlined, the others go to the constant pool
+            if (instr->operand.int_value >= INT16_MIN && instr->operand.int_value <= INT16_MAX) {
+                emit_byte(out, &capacity, OP_PUSH_INT);
+                emit_u16(out, &capacity, (uint16_t)(int16_t)instr->operand.int_value);
+            }
+            else {
+                emit_byte(out, &capacity, OP_LOAD_CONST_);
+                emit_u16(out, &capacity, add_constant(out, make_int_value(instr->operand.int_value)));
+            }
+            break;
+
+        case OP_PUSH_FLOAT:
+            emit_byte(out, &capacity, OP_LOAD_CONST_);
+            emit_u16(out, &capacity, add_constant(out, make_float_value(instr->operand.float_operand)));
+            break;
+
+        case OP_PUSH_STRING: {
+            RuntimeValue value;
+            value.type = RUNTIME_VALUE_STRING;
+            value.string_val = instr->operand.string_operand;
+            emit_byte(out, &capacity, OP_LOAD_CONST_);
+            emit_u16(out, &capacity, add_constant(out, value));
+            break;
+        }
+
+        case OP_PUSH_BOOL:
+            emit_byte(out, &capacity, OP_PUSH_BOOL);
+            emit_byte(out, &capacity, instr->operand.bool_operand ? 1 : 0);
+            break;
+
+        case OP_LOAD_LOCAL:
+        case OP_STORE_LOCAL:
+        case OP_UNSET_LOCAL:
+            emit_byte(out, &capacity, (uint8_t)instr->opcode);
+            emit_byte(out, &capacity, (uint8_t)instr->operand.scope.local_index);
+            break;
+
+        case OP_LOAD_UPVALUE:
+            emit_byte(out, &capacity, OP_LOAD_UPVALUE);
+            emit_byte(out, &capacity, (uint8_t)instr->operand.scope.local_index);
+            break;
+
+        case OP_LOAD_GLOBAL:
+        case OP_STORE_GLOBAL:
+        case OP_OR_GLOBAL:
+            if (instr->operand.scope.global_index > UINT16_MAX) {
+                assembler_fail("too many global variables.");
+            }
+            emit_byte(out, &capacity, (uint8_t)instr->opcode);
+            emit_u16(out, &capacity, (uint16_t)instr->operand.scope.global_index);
+            break;
+
+        case OP_JUMP_TO:
+        case OP_JUMP_TO_IF_FALSE:
+        case OP_COMPARE_JUMP_IF_FALSE:
+        case OP_COMPARE_LOCALS_JUMP_IF_FALSE:
+        case OP_FOR_PREP_LOCAL:
+        case OP_FOR_LOOP_LOCAL:
+        case OP_FOR_PREP_GLOBAL:
+        case OP_FOR_LOOP_GLOBAL:
+            if (instr->operand.int_operand < (int)first || instr->operand.int_operand > (int)end) {
+                assembler_fail("jump leaves its function.");
+            }
+            if (fixup_count >= fixup_capacity) {
+                fixup_capacity = fixup_capacity ? fixup_capacity * 2 : 16;
+                JumpFixup* grown = (JumpFixup*)realloc(fixups, sizeof(JumpFixup) * fixup_capacity);
+                if (!grown) {
+                    assembler_fail("memory allocation failed.");
+                }
+                fixups = grown;
+            }
+            emit_byte(out, &capacity, (uint8_t)instr->opcode);
+            if (instr->opcode == OP_COMPARE_LOCALS_JUMP_IF_FALSE) {
+                emit_byte(out, &capacity, (uint8_t)instr->operand.fused.first);
+                emit_byte(out, &capacity, (uint8_t)instr->operand.fused.second);
+            }
+            if (instr->opcode == OP_COMPARE_JUMP_IF_FALSE || instr->opcode == OP_COMPARE_LOCALS_JUMP_IF_FALSE) {
+                emit_byte(out, &capacity, (uint8_t)instr->operand.fused.compare);
+            }
+            if (instr->opcode == OP_FOR_PREP_LOCAL || instr->opcode == OP_FOR_LOOP_LOCAL) {
+                emit_byte(out, &capacity, (uint8_t)instr->operand.fused.first);
+                emit_byte(out, &capacity, (uint8_t)instr->operand.fused.second);
+            }
+            if (instr->opcode == OP_FOR_PREP_GLOBAL || instr->opcode == OP_FOR_LOOP_GLOBAL) {
+                if (instr->operand.fused.first + 1 > UINT16_MAX || instr->operand.fused.second > UINT16_MAX) {
+                    assembler_fail("too many global variables.");
+                }
+                emit_u16(out, &capacity, (uint16_t)instr->operand.fused.first);
+                emit_u16(out, &capacity, (uint16_t)instr->operand.fused.second);
+            }
+            fixups[fixup_count].position = out->code_size;
+            fixups[fixup_count].target = instr->operand.int_operand;
+            fixup_count++;
+            emit_u32(out, &capacity, 0);
+            break;
+
+        case OP_SWITCH_: {
+            // The targets are only known at the end of the function, the table is built there
+            if (instr->operand.switch_.when_count <= 0 ||
+                instr->operand.switch_.default_index < (int)first || instr->operand.switch_.default_index > (int)end) {
+                assembler_fail("malformed switch.");
+            }
+            for (int c = 0; c < instr->operand.switch_.when_count; c++) {
+                int target = instr->operand.switch_.cases[c].target_index;
+                if (target < (int)first || target > (int)end) {
+                    assembler_fail("jump leaves its function.");
+                }
+            }
+            if (fixup_count >= fixup_capacity) {
+                fixup_capacity = fixup_capacity ? fixup_capacity * 2 : 16;
+                JumpFixup* grown = (JumpFixup*)realloc(fixups, sizeof(JumpFixup) * fixup_capacity);
+                if (!grown) {
+                    assembler_fail("memory allocation failed.");
+                }
+                fixups = grown;
+            }
+            if (switch_count >= switch_capacity) {
+                switch_capacity = switch_capacity ? switch_capacity * 2 : 4;
+                SwitchFixup* grown = (SwitchFixup*)realloc(switches, sizeof(SwitchFixup) * switch_capacity);
+                if (!grown) {
+                    assembler_fail("memory allocation failed.");
+                }
+                switches = grown;
+            }
+            emit_byte(out, &capacity, OP_SWITCH_);
+            switches[switch_count].position = out->code_size;
+            switches[switch_count].index = i;
+            switch_count++;
+            emit_byte(out, &capacity, 0);
+            emit_u16(out, &capacity, 0);
+            fixups[fixup_count].position = out->code_size;
+            fixups[fixup_count].target = instr->operand.switch_.default_index;
+            fixup_count++;
+            emit_u32(out, &capacity, 0);
+            break;
+        }
+
+        case OP_INC_LOCAL:
+            emit_byte(out, &capacity, OP_INC_LOCAL);
+            emit_byte(out, &capacity, (uint8_t)instr->operand.fused.first);
+            emit_u16(out, &capacity, (uint16_t)(int16_t)instr->operand.fused.second);
+            break;
+
+        case OP_INC_GLOBAL:
+            emit_byte(out, &capacity, OP_INC_GLOBAL);
+            emit_u16(out, &capacity, (uint16_t)instr->operand.fused.first);
+            emit_u16(out, &capacity, (uint16_t)(int16_t)instr->operand.fused.second);
+            break;
+
+        case OP_LOAD_LOCAL_ELEMENT:
+            emit_byte(out, &capacity, OP_LOAD_LOCAL_ELEMENT);
+            emit_byte(out, &capacity, (uint8_t)instr->operand.fused.first);
+            emit_byte(out, &capacity, (uint8_t)instr->operand.fused.second);
+            break;
+
+        case OP_BUILD_ARRAY:
+            if (instr->operand.array_literal.count > UINT16_MAX) {
+                assembler_fail("array literal too long.");
+            }
+            emit_byte(out, &capacity, OP_BUILD_ARRAY);
+            emit_u16(out, &capacity, (uint16_t)instr->operand.array_literal.count);
+            break;
+
+        case OP_CALL_FUNCTION:
+        case OP_TAIL_CALL: {
+            if (instr->operand.call.arg_count > UINT8_MAX) {
+                assembler_fail("too many arguments in a call.");
+            }
+            RuntimeValue name;
+            name.type = RUNTIME_VALUE_STRING;
+            name.string_val = instr->operand.call.name;
+            emit_byte(out, &capacity, (uint8_t)instr->opcode);
+            emit_u16(out, &capacity, add_constant(out, name));
+            emit_byte(out, &capacity, (uint8_t)instr->operand.call.arg_count);
+            break;
+        }
+
+        case OP_DECL_FUNCTION: {
+            // The body is compiled by compile_function, on the first call
+            size_t index = new_function(as);
+            CodeObject* function = &as->program->functions[index];
+            function->name = strdup(instr->operand.function_decl.name);
+            function->param_count = instr->operand.function_decl.param_count;
+            function->declaration = instr->operand.function_decl.declaration;
+            if (!function->name) {
+                assembler_fail("memory allocation failed.");
+            }
+            int capture_count = instr->operand.function_decl.capture_count;
+            if (capture_count > 0) {
+                function->captures = (Capture*)malloc(sizeof(Capture) * capture_count);
+                if (!function->captures) {
+                    assembler_fail("memory allocation failed.");
+                }
+                memcpy(function->captures, instr->operand.function_decl.captures, sizeof(Capture) * capture_count);
+                function->capture_count = capture_count;
+            }
+
+            emit_byte(out, &capacity, OP_DECL_FUNCTION);
+            emit_u16(out, &capacity, (uint16_t)index);
+            break;
+        }
+
+        default:
+            if (packed_instruction_size((uint8_t)instr->opcode) != 1) {
+                fprintf(stderr, "Bytecode assembly error: unsupported opcode %s.\n", ByteCodeNames[instr->opcode]);
+                exit(EXIT_FAILURE);
+            }
+            emit_byte(out, &capacity, (uint8_t)instr->opcode);
+            break;
+        }
+    }
+    as->offsets[end] = out->code_size;
+
+    // Every path must end the function, so the VM never runs past the code
+    uint8_t last = out->code_size ? out->code[out->code_size - 1] : OP_HALT;
+    if (out->code_size == 0 || (last != OP_HALT && last != OP_RETURN_)) {
+        emit_byte(out, &capacity, OP_HALT);
+    }
+
+    for (size_t i = 0; i < fixup_count; i++) {
+        uint32_t offset = (uint32_t)as->offsets[fixups[i].target];
+        uint8_t* p = &out->code[fixups[i].position];
+        p[0] = (uint8_t)(offset & 0xFF);
+        p[1] = (uint8_t)((offset >> 8) & 0xFF);
+        p[2] = (uint8_t)((offset >> 16) & 0xFF);
+        p[3] = (uint8_t)(offset >> 24);
+    }
+    free(fixups);
+
+    // Switch tables go after every other constant, so add_constant never shares their entries
+    for (size_t i = 0; i < switch_count; i++) {
+        assemble_switch_table(as, out, &switches[i]);
+    }
+    free(switches);
+
+    // Give back the unused part of the code buffer
+    if (out->code_size && out->code_size < capacity) {
+        uint8_t* code = (uint8_t*)realloc(out->code, out->code_size);
+        if (code) out->code = code;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: add_new_globals
+* Description: gives the program the global slots the last generate_bytecode call added.
+* Parameters: BytecodeProgram* program
+* Return: void
+* ***********************************************************/
+static void add_new_globals(BytecodeProgram* program) {
+    size_t count = bytecode_global_count();
+    if (program->global_names && count == program->global_count) return;
+
+    char** names = (char**)realloc(program->global_names, sizeof(char*) * (count ? count : 1));
+    if (!names) {
+        assembler_fail("memory allocation failed.");
+    }
+    program->global_names = names;
+    for (size_t i = program->global_count; i < count; i++) {
+        names[i] = strdup(bytecode_global_name(i));
+        if (!names[i]) {
+            assembler_fail("memory allocation failed.");
+        }
+    }
+    program->global_count = count;
+}
+
+
+
+
+/***********************************************************
+* Function: assemble_program
+* Description: assembles the output of generate_bytecode into a packed program.
+* Parameters: const BytecodeInstruction* bytecode, size_t bytecode_count, size_t function_capacity
+* Return: BytecodeProgram*
+* ***********************************************************/
+BytecodeProgram* assemble_program(const BytecodeInstruction* bytecode, size_t bytecode_count, size_t function_capacity) {
+    BytecodeProgram* program = (BytecodeProgram*)calloc(1, sizeof(BytecodeProgram));
+    size_t* offsets = (size_t*)malloc(sizeof(size_t) * (bytecode_count + 1));
+    if (!program || !offsets) {
+        assembler_fail("memory allocation failed.");
+    }
+    program->function_capacity = function_capacity ? function_capacity : 1;
+    program->functions = (CodeObject*)malloc(sizeof(CodeObject) * program->function_capacity);
+    if (!program->functions) {
+        assembler_fail("memory allocation failed.");
+    }
+
+    Assembler as = { bytecode, bytecode_count, offsets, program };
+    CodeObject* main_function = &program->functions[new_function(&as)];
+    main_function->name = strdup("<main>");
+    assemble_range(&as, 0, bytecode_count, main_function);
+    free(offsets);
+
+    add_new_globals(program);
+    if (!verify_program(program)) {
+        assembler_fail("the generated code doesn't pass the verifier.");
+    }
+    return program;
+}
+
+
+
+
+/***********************************************************
+* Function: count_function_declarations
+* Description: counts the function declarations of an AST, nested ones included.
+* Parameters: const ASTNode* node
+* Return: size_t
+* ***********************************************************/
+static size_t count_function_declarations(const ASTNode* node) {
+    if (!node) return 0;
+    size_t count = node->type == AST_FUNCTION_DECLARATION ? 1 : 0;
+    for (size_t i = 0; i < node->child_count; i++) {
+        count += count_function_declarations(node->children[i]);
+    }
+    return count;
+}
+
+
+
+
+/***********************************************************
+* Function: new_bytecode / free_bytecode
+* Description: the buffer generate_bytecode fills (it grows as needed), and its release
+* once it is assembled: the generated bytecode is only an intermediate step.
+* Parameters: size_t* capacity / BytecodeInstruction* bytecode, size_t bytecode_count
+* Return: BytecodeInstruction* / void
+* ***********************************************************/
+static BytecodeInstruction* new_bytecode(size_t* capacity) {
+    *capacity = INITIAL_BYTECODE_CAPACITY;
+    BytecodeInstruction* bytecode = (BytecodeInstruction*)malloc(sizeof(BytecodeInstruction) * *capacity);
+    if (!bytecode) {
+        fprintf(stderr, "Memory allocation failed for bytecode.\n");
+        exit(EXIT_FAILURE);
+    }
+    return bytecode;
+}
+
+static void free_bytecode(BytecodeInstruction* bytecode, size_t bytecode_count) {
+    for (size_t i = 0; i < bytecode_count; i++) {
+        if (bytecode[i].opcode == OP_SWITCH_) {
+            free(bytecode[i].operand.switch_.cases);
+        }
+        else if (bytecode[i].opcode == OP_DECL_FUNCTION) {
+            free(bytecode[i].operand.function_decl.captures);
+        }
+    }
+    free(bytecode);
+}
+
+
+
+
+/***********************************************************
+* Function: compile_program
+* Description: generates the bytecode of the top level code, optimizes it and assembles it
+* into a packed program. Every function declared in the AST gets its entry of the function
+* table now and its code when compile_function runs. The resolver runs first: nested
+* functions read the variables of the functions around them through its captures.
+* Parameters: ASTNode* root
+* Return: BytecodeProgram*
+* ***********************************************************/
+BytecodeProgram* compile_program(ASTNode* root) {
+    resolve_program(root);
+    reset_optimizer_stats();
+    size_t bytecode_count = 0;
+    size_t bytecode_capacity;
+    BytecodeInstruction* bytecode = new_bytecode(&bytecode_capacity);
+    generate_bytecode(root, &bytecode, &bytecode_count, &bytecode_capacity);
+    bytecode_count = optimize_bytecode(bytecode, bytecode_count);
+
+    BytecodeProgram* program = assemble_program(bytecode, bytecode_count, 1 + count_function_declarations(root));
+    free_bytecode(bytecode, bytecode_count);
+    return program;
+}
+
+
+
+
+/***********************************************************
+* Function: compile_function
+* Description: generates, optimizes, assembles and verifies the body of a stub. The stub is
+* filled in place, so code already pointing at it (function values, the VM) sees the code.
+* Parameters: const BytecodeProgram* program, const CodeObject* function
+* Return: void
+* ***********************************************************/
+void compile_function(const BytecodeProgram* program, const CodeObject* function) {
+    BytecodeProgram* owner = (BytecodeProgram*)program;
+    CodeObject* out = (CodeObject*)function;
+    if (!out->declaration) return;
+
+    // The body resolves its globals against the slots the program already has
+    load_bytecode_globals(owner->global_names, owner->global_count);
+    size_t bytecode_count = 0;
+    size_t bytecode_capacity;
+    BytecodeInstruction* bytecode = new_bytecode(&bytecode_capacity);
+    out->local_count = generate_function_body_bytecode(out->declaration, &bytecode, &bytecode_count, &bytecode_capacity);
+    bytecode_count = optimize_bytecode(bytecode, bytecode_count);
+
+    size_t* offsets = (size_t*)malloc(sizeof(size_t) * (bytecode_count + 1));
+    if (!offsets) {
+        assembler_fail("memory allocation failed.");
+    }
+    Assembler as = { bytecode, bytecode_count, offsets, owner };
+    assemble_range(&as, 0, bytecode_count, out);
+    free(offsets);
+    free_bytecode(bytecode, bytecode_count);
+    add_new_globals(owner);
+
+    out->declaration = NULL;
+    if (!verify_function(out, owner)) {
+        assembler_fail("the generated code doesn't pass the verifier.");
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: compile_all_functions
+* Description: compiles every stub of the program, including the ones declared in the
+* bodies compiled on the way.
+* Parameters: const BytecodeProgram* program
+* Return: void
+* ***********************************************************/
+void compile_all_functions(const BytecodeProgram* program) {
+    for (size_t i = 0; i < program->function_count; i++) {
+        compile_function(program, &program->functions[i]);
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: free_program
+* Description: frees a program and everything it owns.
+* Parameters: BytecodeProgram* program
+* Return: void
+* ***********************************************************/
+void free_program(BytecodeProgram* program) {
+    if (!program) return;
+
+    // A loaded program only owns its tables, the code and the strings belong to the mapping
+    bool owns_data = program->mapping == NULL;
+
+    for (size_t i = 0; i < program->function_count; i++) {
+        CodeObject* function = &program->functions[i];
+        if (owns_data) {
+            for (size_t c = 0; c < function->constant_count; c++) {
+                if (function->constants[c].type == RUNTIME_VALUE_STRING) {
+                    free(function->constants[c].string_val);
+                }
+            }
+            free(function->code);
+            free(function->name);
+            free(function->captures);
+        }
+        free(function->constants);
+    }
+    free(program->functions);
+
+    if (owns_data) {
+        for (size_t i = 0; i < program->global_count; i++) {
+            free(program->global_names[i]);
+        }
+    }
+    free(program->global_names);
+    release_program_mapping(program);
+    free(program);
+}
+
+
+
+
+/***********************************************************
+* Function: packed_instruction_size
+* Description: size in bytes of a packed instruction (opcode + operands).
+* Parameters: uint8_t opcode
+* Return: size_t (0 for opcodes that can't appear in packed code)
+* ***********************************************************/
+size_t packed_instruction_size(uint8_t opcode) {
+    switch (opcode) {
+    case OP_PUSH_BOOL:
+    case OP_LOAD_LOCAL:
+    case OP_STORE_LOCAL:
+    case OP_LOAD_UPVALUE:
+    case OP_UNSET_LOCAL:
+        return 2;
+
+    case OP_PUSH_INT:
+    case OP_LOAD_CONST_:
+    case OP_LOAD_GLOBAL:
+    case OP_STORE_GLOBAL:
+    case OP_OR_GLOBAL:
+    case OP_BUILD_ARRAY:
+    case OP_DECL_FUNCTION:
+        return 3;
+
+    case OP_CALL_FUNCTION:
+    case OP_TAIL_CALL:
+        return 4;
+
+    case OP_LOAD_LOCAL_ELEMENT:
+        return 3;
+
+    case OP_INC_LOCAL:
+        return 4;
+
+    case OP_JUMP_TO:
+    case OP_JUMP_TO_IF_FALSE:
+    case OP_INC_GLOBAL:
+        return 5;
+
+    case OP_COMPARE_JUMP_IF_FALSE:
+        return 6;
+
+    case OP_FOR_PREP_LOCAL:
+    case OP_FOR_LOOP_LOCAL:
+        return 7;
+
+    case OP_FOR_PREP_GLOBAL:
+    case OP_FOR_LOOP_GLOBAL:
+        return 9;
+
+    case OP_COMPARE_LOCALS_JUMP_IF_FALSE:
+    case OP_SWITCH_:
+        return 8;
+
+    case OP_ADD_:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+    case OP_DIVIDE:
+    case OP_MODULO:
+    case OP_LESS:
+    case OP_GREATER:
+    case OP_LESS_EQUAL:
+    case OP_GREATER_EQUAL:
+    case OP_EQUAL:
+    case OP_NOT_EQUAL:
+    case OP_AND_:
+    case OP_OR_:
+    case OP_NOT_:
+    case OP_NEGATE:
+    case OP_BIT_NOT:
+    case OP_ARRAY_GET_:
+    case OP_ARRAY_SET_:
+    case OP_RETURN_:
+    case OP_POP:
+    case OP_DUP:
+    case OP_PUSH_NULL:
+    case OP_HALT:
+        return 1;
+
+    default:
+        return 0;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: packed_jump_operand
+* Description: position of the u32 jump target inside a packed instruction.
+* Parameters: uint8_t opcode
+* Return: size_t (0 if the opcode doesn't jump)
+* ***********************************************************/
+size_t packed_jump_operand(uint8_t opcode) {
+    switch (opcode) {
+    case OP_JUMP_TO:
+    case OP_JUMP_TO_IF_FALSE:
+        return 1;
+    case OP_COMPARE_JUMP_IF_FALSE:
+        return 2;
+    case OP_FOR_PREP_LOCAL:
+    case OP_FOR_LOOP_LOCAL:
+        return 3;
+    case OP_COMPARE_LOCALS_JUMP_IF_FALSE:
+    case OP_SWITCH_:
+        return 4;
+    case OP_FOR_PREP_GLOBAL:
+    case OP_FOR_LOOP_GLOBAL:
+        return 5;
+    default:
+        return 0;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: packed_stack_effect
+* Description: operand stack values taken and left by a packed instruction. A value an
+* instruction only reads (like the one OP_DUP copies) counts as taken and left again.
+* Parameters: uint8_t opcode, const uint8_t* p, int* pops (out), int* pushes (out)
+* Return: void
+* ***********************************************************/
+void packed_stack_effect(uint8_t opcode, const uint8_t* p, int* pops, int* pushes) {
+    *pops = 0;
+    *pushes = 0;
+    switch (opcode) {
+    case OP_PUSH_INT:
+    case OP_PUSH_BOOL:
+    case OP_LOAD_CONST_:
+    case OP_PUSH_NULL:
+    case OP_LOAD_LOCAL:
+    case OP_LOAD_GLOBAL:
+    case OP_LOAD_UPVALUE:
+    case OP_LOAD_LOCAL_ELEMENT:
+        *pushes = 1;
+        break;
+
+    case OP_DUP:
+        *pops = 1;
+        *pushes = 2;
+        break;
+
+    case OP_POP:
+    case OP_STORE_LOCAL:
+    case OP_STORE_GLOBAL:
+    case OP_JUMP_TO_IF_FALSE:
+    case OP_SWITCH_:
+    case OP_RETURN_:
+        *pops = 1;
+        break;
+
+    case OP_NEGATE:
+    case OP_NOT_:
+    case OP_BIT_NOT:
+    case OP_OR_GLOBAL:
+        *pops = 1;
+        *pushes = 1;
+        break;
+
+    case OP_ADD_:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+    case OP_DIVIDE:
+    case OP_MODULO:
+    case OP_LESS:
+    case OP_GREATER:
+    case OP_LESS_EQUAL:
+    case OP_GREATER_EQUAL:
+    case OP_EQUAL:
+    case OP_NOT_EQUAL:
+    case OP_AND_:
+    case OP_OR_:
+    case OP_ARRAY_GET_:
+        *pops = 2;
+        *pushes = 1;
+        break;
+
+    case OP_COMPARE_JUMP_IF_FALSE:
+        *pops = 2;
+        break;
+
+    case OP_ARRAY_SET_:
+        *pops = 3;
+        *pushes = 1;
+        break;
+
+    case OP_BUILD_ARRAY:
+        *pops = read_u16(p + 1);
+        *pushes = 1;
+        break;
+
+    case OP_CALL_FUNCTION:
+    case OP_TAIL_CALL:
+        *pops = p[3];
+        *pushes = 1;
+        break;
+
+    default:
+        // Jumps, declarations, halt, OP_UNSET_LOCAL, the increments and the counted loops only touch slots
+        break;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: switch_target
+* Description: looks the selector up in the table of an OP_SWITCH_.
+* Parameters: const CodeObject* function, const uint8_t* p, const RuntimeValue* selector
+* Return: uint32_t (byte offset of the matching case, or of the default)
+* ***********************************************************/
+uint32_t switch_target(const CodeObject* function, const uint8_t* p, const RuntimeValue* selector) {
+    const RuntimeValue* table = &function->constants[read_u16(p + 2)];
+    uint32_t default_target = read_u32(p + 4);
+
+    switch (p[1]) {
+    case SWITCH_DENSE: {
+        if (selector->type != RUNTIME_VALUE_INT) return default_target;
+        unsigned long slot = (unsigned long)selector->int_val - (unsigned long)table[0].int_val;
+        if (slot >= (unsigned long)table[1].int_val) return default_target;
+        return (uint32_t)table[2 + slot].int_val;
+    }
+
+    case SWITCH_SORTED: {
+        if (selector->type != RUNTIME_VALUE_INT) return default_target;
+        size_t count = (size_t)table[0].int_val;
+        size_t low = 0;
+        size_t high = count;
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+            long key = table[1 + middle].int_val;
+            if (key == selector->int_val) return (uint32_t)table[1 + count + middle].int_val;
+            if (key < selector->int_val) low = middle + 1;
+            else high = middle;
+        }
+        return default_target;
+    }
+
+    case SWITCH_HASH: {
+        if (selector->type != RUNTIME_VALUE_STRING || !selector->string_val) return default_target;
+        size_t slots = (size_t)table[0].int_val;
+        size_t slot = switch_hash(selector->string_val, (uint32_t)table[1].int_val) & (slots - 1);
+        while (table[2 + slot].type == RUNTIME_VALUE_STRING) {
+            if (strcmp(table[2 + slot].string_val, selector->string_val) == 0) {
+                return (uint32_t)table[2 + slots + slot].int_val;
+            }
+            slot = (slot + 1) & (slots - 1);
+        }
+        return default_target;
+    }
+
+    default:
+        return default_target;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: switch_slot_count / switch_slot_target
+* Description: the target slots of an OP_SWITCH_ table. switch_slot_count also checks the
+* table fits in the pool and has the types switch_target expects.
+* Parameters: const CodeObject* function, const uint8_t* p, size_t slot
+* Return: size_t (0 if the table is malformed) / uint32_t (byte offset)
+* ***********************************************************/
+size_t switch_slot_count(const CodeObject* function, const uint8_t* p) {
+    size_t first = read_u16(p + 2);
+    if (first + 2 > function->constant_count) return 0;
+    const RuntimeValue* table = &function->constants[first];
+    size_t available = function->constant_count - first;
+    if (table[0].type != RUNTIME_VALUE_INT || table[1].type != RUNTIME_VALUE_INT) return 0;
+
+    size_t slots;
+    size_t header;
+    switch (p[1]) {
+    case SWITCH_DENSE:
+        if (table[1].int_val <= 0 || (unsigned long)table[1].int_val > available - 2) return 0;
+        slots = (size_t)table[1].int_val;
+        header = 2;
+        break;
+
+    case SWITCH_SORTED:
+        if (table[0].int_val <= 0 || (unsigned long)table[0].int_val > (available - 1) / 2) return 0;
+        slots = (size_t)table[0].int_val;
+        header = 1 + slots;
+        for (size_t i = 0; i < slots; i++) {
+            if (table[1 + i].type != RUNTIME_VALUE_INT) return 0;
+            if (i > 0 && table[i].int_val >= table[1 + i].int_val) return 0;
+        }
+        break;
+
+    case SWITCH_HASH: {
+        // A power of two with at least one unused slot, or probing would never stop
+        if (table[0].int_val < 2 || (unsigned long)table[0].int_val > (available - 2) / 2 ||
+            (table[0].int_val & (table[0].int_val - 1)) != 0) return 0;
+        slots = (size_t)table[0].int_val;
+        header = 2 + slots;
+        bool unused = false;
+        for (size_t i = 0; i < slots; i++) {
+            const RuntimeValue* key = &table[2 + i];
+            if (key->type == RUNTIME_VALUE_INT && key->int_val == 0) unused = true;
+            else if (key->type != RUNTIME_VALUE_STRING || !key->string_val) return 0;
+        }
+        if (!unused) return 0;
+        break;
+    }
+
+    default:
+        return 0;
+    }
+
+    for (size_t i = 0; i < slots; i++) {
+        if (table[header + i].type != RUNTIME_VALUE_INT || table[header + i].int_val < 0 ||
+            (unsigned long)table[header + i].int_val >= function->code_size) return 0;
+    }
+    return slots;
+}
+
+uint32_t switch_slot_target(const CodeObject* function, const uint8_t* p, size_t slot) {
+    const RuntimeValue* table = &function->constants[read_u16(p + 2)];
+    switch (p[1]) {
+    case SWITCH_DENSE:  return (uint32_t)table[2 + slot].int_val;
+    case SWITCH_SORTED: return (uint32_t)table[1 + table[0].int_val + slot].int_val;
+    default:            return (uint32_t)table[2 + table[0].int_val + slot].int_val;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: print_constant
+* Description: prints one value of a constant pool.
+* Parameters: const RuntimeValue* value, FILE* out
+* Return: void
+* ***********************************************************/
+static void print_constant(const RuntimeValue* value, FILE* out) {
+    switch (value->type) {
+    case RUNTIME_VALUE_INT:    fprintf(out, "%ld", value->int_val); break;
+    case RUNTIME_VALUE_FLOAT:  fprintf(out, "%f", value->float_val); break;
+    case RUNTIME_VALUE_STRING: fprintf(out, "\"%s\"", value->string_val); break;
+    default:                   fprintf(out, "?"); break;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: print_function_code
+* Description: decodes and prints the packed bytecode of one function of the program. With
+* counts (one per byte of code, see --vm-stats), each instruction starts with the number of
+* times it ran.
+* Parameters: const BytecodeProgram* program, size_t index, const unsigned long long* counts, FILE* out
+* Return: void
+* ***********************************************************/
+void print_function_code(const BytecodeProgram* program, size_t index, const unsigned long long* counts, FILE* out) {
+    const CodeObject* function = &program->functions[index];
+    if (function->declaration) {
+        fprintf(out, "--- FUNCTION %zu: %s (PARAMS: %d, not compiled yet) ---\n", index, function->name, function->param_count);
+        return;
+    }
+    fprintf(out, "--- FUNCTION %zu: %s (PARAMS: %d, LOCALS: %d, %zu bytes) ---\n",
+        index, function->name, function->param_count, function->local_count, function->code_size);
+
+    for (size_t c = 0; c < function->constant_count; c++) {
+        fprintf(out, "  CONST[%zu] = ", c);
+        print_constant(&function->constants[c], out);
+        fprintf(out, "\n");
+    }
+
+    size_t offset = 0;
+    while (offset < function->code_size) {
+        const uint8_t* p = &function->code[offset];
+        // Code that already ran may hold quickened operators, which have no operand
+        size_t size = p[0] >= OP_ADD_INT_INT && p[0] < OP_COUNT_ ? 1 : packed_instruction_size(p[0]);
+        if (size == 0 || offset + size > function->code_size) {
+            fprintf(out, "[%4zu] <invalid opcode %u>\n", offset, p[0]);
+            break;
+        }
+
+        if (counts) fprintf(out, "%12llu ", counts[offset]);
+        fprintf(out, "[%4zu] %s", offset, ByteCodeNames[p[0]]);
+        switch (p[0]) {
+        case OP_PUSH_INT:
+            fprintf(out, " %d", (int16_t)read_u16(p + 1));
+            break;
+        case OP_PUSH_BOOL:
+            fprintf(out, " %s", p[1] ? "true" : "false");
+            break;
+        case OP_LOAD_CONST_:
+            fprintf(out, " CONST[%u] = ", read_u16(p + 1));
+            if (read_u16(p + 1) < function->constant_count) print_constant(&function->constants[read_u16(p + 1)], out);
+            break;
+        case OP_LOAD_LOCAL:
+        case OP_STORE_LOCAL:
+        case OP_UNSET_LOCAL:
+            fprintf(out, " LOCAL_INDEX: %u", p[1]);
+            break;
+        case OP_LOAD_UPVALUE:
+            fprintf(out, " UPVALUE_INDEX: %u", p[1]);
+            break;
+        case OP_LOAD_GLOBAL:
+        case OP_STORE_GLOBAL:
+        case OP_OR_GLOBAL:
+            fprintf(out, " GLOBAL_INDEX: %u", read_u16(p + 1));
+            if (read_u16(p + 1) < program->global_count) fprintf(out, " (\"%s\")", program->global_names[read_u16(p + 1)]);
+            break;
+        case OP_JUMP_TO:
+        case OP_JUMP_TO_IF_FALSE:
+            fprintf(out, " TARGET: %u", read_u32(p + 1));
+            break;
+        case OP_INC_LOCAL:
+            fprintf(out, " LOCAL_INDEX: %u, BY: %d", p[1], (int16_t)read_u16(p + 2));
+            break;
+        case OP_INC_GLOBAL:
+            fprintf(out, " GLOBAL_INDEX: %u", read_u16(p + 1));
+            if (read_u16(p + 1) < program->global_count) fprintf(out, " (\"%s\")", program->global_names[read_u16(p + 1)]);
+            fprintf(out, ", BY: %d", (int16_t)read_u16(p + 3));
+            break;
+        case OP_COMPARE_JUMP_IF_FALSE:
+            fprintf(out, " %s, TARGET: %u", p[1] < OP_COUNT_ ? ByteCodeNames[p[1]] : "?", read_u32(p + 2));
+            break;
+        case OP_COMPARE_LOCALS_JUMP_IF_FALSE:
+            fprintf(out, " %s (LOCAL_INDEX: %u, LOCAL_INDEX: %u), TARGET: %u",
+                p[3] < OP_COUNT_ ? ByteCodeNames[p[3]] : "?", p[1], p[2], read_u32(p + 4));
+            break;
+        case OP_LOAD_LOCAL_ELEMENT:
+            fprintf(out, " ARRAY: LOCAL_INDEX %u, INDEX: LOCAL_INDEX %u", p[1], p[2]);
+            break;
+        case OP_FOR_PREP_LOCAL:
+        case OP_FOR_LOOP_LOCAL:
+            fprintf(out, " COUNTER: LOCAL_INDEX %u, NAMED: LOCAL_INDEX %u, TARGET: %u", p[1], p[2], read_u32(p + 3));
+            break;
+        case OP_FOR_PREP_GLOBAL:
+        case OP_FOR_LOOP_GLOBAL:
+            fprintf(out, " COUNTER: GLOBAL_INDEX %u, NAMED: GLOBAL_INDEX %u", read_u16(p + 1), read_u16(p + 3));
+            if (read_u16(p + 3) < program->global_count) fprintf(out, " (\"%s\")", program->global_names[read_u16(p + 3)]);
+            fprintf(out, ", TARGET: %u", read_u32(p + 5));
+            break;
+        case OP_SWITCH_:
+            fprintf(out, " %s TABLE: CONST[%u], SLOTS: %zu, DEFAULT: %u",
+                p[1] == SWITCH_DENSE ? "DENSE" : p[1] == SWITCH_SORTED ? "SORTED" : p[1] == SWITCH_HASH ? "HASH" : "?",
+                read_u16(p + 2), switch_slot_count(function, p), read_u32(p + 4));
+            break;
+        case OP_BUILD_ARRAY:
+            fprintf(out, " COUNT: %u", read_u16(p + 1));
+            break;
+        case OP_DECL_FUNCTION:
+            fprintf(out, " FUNCTION: %u", read_u16(p + 1));
+            if (read_u16(p + 1) < program->function_count) fprintf(out, " (\"%s\")", program->functions[read_u16(p + 1)].name);
+            break;
+        case OP_CALL_FUNCTION:
+        case OP_TAIL_CALL:
+            fprintf(out, " NAME: CONST[%u]", read_u16(p + 1));
+            if (read_u16(p + 1) < function->constant_count) {
+                fprintf(out, " = ");
+                print_constant(&function->constants[read_u16(p + 1)], out);
+            }
+            fprintf(out, ", ARG_COUNT: %u", p[3]);
+            break;
+        default:
+            break;
+        }
+        fprintf(out, "\n");
+        offset += size;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: print_byteCode
+* Description: decodes and prints the packed bytecode of every function of the program.
+* Parameters: const BytecodeProgram* program
+* Return: void
+* ***********************************************************/
+void print_byteCode(const BytecodeProgram* program) {
+    printf("=== BYTECODE ===\n");
+    for (size_t f = 0; f < program->function_count; f++) {
+        print_function_code(program, f, NULL, stdout);
+    }
+    printf("=== END BYTECODE ===\n");
+}
@@ -0,0 +1,173 @@
+/***********************************************************
+* File: compileCache.c
+* This file implements the compilation cache (see compileCache.h).
+* Cache directory: $CLOCK_CACHE_DIR, else $XDG_CACHE_HOME/clock or ~/.cache/clock
+* (%LOCALAPPDATA%\clock on Windows).
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "compileCache.h"
+#include "bytecodeFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#define PATH_SEPARATOR "\\"
+#define make_directory(path) _mkdir(path)
+#define process_id() _getpid()
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#define PATH_SEPARATOR "/"
+#define make_directory(path) mkdir(path, 0755)
+#define process_id() getpid()
+#endif
+
+#define CACHE_PATH_SIZE 1024
+
+// Identifies the interpreter build: entries of other builds are never read.
+// The makefile rebuilds this file whenever any source changes.
+static const char* interpreter_build = "clkb" " " __DATE__ " " __TIME__;
+
+
+
+
+/***********************************************************
+* Function: fnv1a
+* Description: 64 bit FNV-1a hash, continued from a previous hash value.
+* Parameters: uint64_t hash, const void* data, size_t length
+* Return: uint64_t
+* ***********************************************************/
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+
+
+
+/***********************************************************
+* Function: cache_directory
+* Description: finds (and creates) the cache directory.
+* Parameters: char* out, size_t size
+* Return: bool (false if there is no usable directory)
+* ***********************************************************/
+static bool cache_directory(char* out, size_t size) {
+    const char* custom = getenv(CLOCK_CACHE_ENV);
+    int written;
+
+    if (custom && custom[0]) {
+        written = snprintf(out, size, "%s", custom);
+    }
+    else {
+#ifdef _WIN32
+        const char* base = getenv("LOCALAPPDATA");
+        if (!base || !base[0]) return false;
+        written = snprintf(out, size, "%s" PATH_SEPARATOR "clock", base);
+#else
+        const char* xdg = getenv("XDG_CACHE_HOME");
+        const char* home = getenv("HOME");
+        if (xdg && xdg[0]) {
+            make_directory(xdg);
+            written = snprintf(out, size, "%s" PATH_SEPARATOR "clock", xdg);
+        }
+        else if (home && home[0]) {
+            // Make sure ~/.cache exists before its clock subdirectory
+            written = snprintf(out, size, "%s" PATH_SEPARATOR ".cache", home);
+            if (written > 0 && (size_t)written < size) make_directory(out);
+            written = snprintf(out, size, "%s" PATH_SEPARATOR ".cache" PATH_SEPARATOR "clock", home);
+        }
+        else {
+            return false;
+        }
+#endif
+    }
+    if (written <= 0 || (size_t)written >= size) return false;
+
+    // Fails harmlessly when the directory already exists
+    make_directory(out);
+    return true;
+}
+
+
+
+
+/***********************************************************
+* Function: cache_entry_path
+* Description: builds the path of the cache entry of a source.
+* The name combines the hash of the source with its length and the hash of the interpreter build.
+* Parameters: const char* source, size_t length, char* out, size_t size
+* Return: bool
+* ***********************************************************/
+static bool cache_entry_path(const char* source, size_t length, char* out, size_t size) {
+    char directory[CACHE_PATH_SIZE];
+    if (!cache_directory(directory, sizeof(directory))) return false;
+
+    uint64_t source_hash = fnv1a(0xcbf29ce484222325ULL, source, length);
+    uint64_t build_hash = fnv1a(0xcbf29ce484222325ULL, interpreter_build, strlen(interpreter_build));
+    int written = snprintf(out, size, "%s" PATH_SEPARATOR "%016llx-%llx-%08x" CLKB_EXTENSION,
+        directory, (unsigned long long)source_hash, (unsigned long long)length, (unsigned)(build_hash & 0xFFFFFFFFu));
+    return written > 0 && (size_t)written < size;
+}
+
+
+
+
+/***********************************************************
+* Function: cache_lookup
+* Description: returns the cached program compiled from this source, or NULL on a miss.
+* Parameters: const char* source, size_t length
+* Return: BytecodeProgram*
+* ***********************************************************/
+BytecodeProgram* cache_lookup(const char* source, size_t length) {
+    char path[CACHE_PATH_SIZE];
+    if (!cache_entry_path(source, length, path, sizeof(path))) return NULL;
+
+    // A missing, foreign or damaged entry is just a miss
+    return load_program_quiet(path);
+}
+
+
+
+
+/***********************************************************
+* Function: cache_store
+* Description: writes the program to a temporary file and renames it over the entry.
+* Parameters: const char* source, size_t length, const BytecodeProgram* program
+* Return: bool
+* ***********************************************************/
+bool cache_store(const char* source, size_t length, const BytecodeProgram* program) {
+    char path[CACHE_PATH_SIZE];
+    char temporary[CACHE_PATH_SIZE + 32];
+    if (!cache_entry_path(source, length, path, sizeof(path))) return false;
+    snprintf(temporary, sizeof(temporary), "%s.%d.tmp", path, (int)process_id());
+
+    if (!save_program_quiet(program, temporary)) {
+        remove(temporary);
+        return false;
+    }
+
+#ifdef _WIN32
+    bool renamed = MoveFileExA(temporary, path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool renamed = rename(temporary, path) == 0;
+#endif
+    if (!renamed) {
+        remove(temporary);
+    }
+    return renamed;
+}
@@ -0,0 +1,2204 @@
+/***********************************************************
+* File: emitC.c
+* This file have the C back end of the compiler (cllc --emit-c).
+* The program is translated statement by statement into C with the same scoping as the
+* bytecode generator: top level variables are globals, a function's locals are its
+* parameters and every variable its body assigns, and reads inside a function fall back
+* to the globals. Expressions are split into temporaries so the operands are evaluated
+* left to right like on the VM. Before anything is written, a small type inference finds
+* the variables that always hold an int, a float or a bool and are assigned before they
+* are read; those become native long/double/bool locals and their arithmetic is plain C.
+* Function names are resolved lexically when the file is written (innermost declaration
+* first, then the built in functions), which is the environment chain the VM walks.
+* Nested functions that read a variable of an enclosing function are rejected: the VM
+* captures those, and the generated functions have no closure to keep them in.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "emitC.h"
+
+#define EMIT_MAX_LOOP_DEPTH 64
+#define EMIT_TEXT_SIZE 256
+#define EMIT_BOX_SIZE (EMIT_TEXT_SIZE + 32)
+
+/***********************************************************
+* Enum: EmitKind
+* Description: the C type a value has in the generated code. KIND_NONE is the start
+* of the type inference (no assignment seen yet), KIND_VALUE a RuntimeValue.
+************************************************************/
+typedef enum {
+    KIND_NONE,
+    KIND_INT,
+    KIND_FLOAT,
+    KIND_BOOL,
+    KIND_VALUE
+} EmitKind;
+
+/***********************************************************
+* Struct: TextBuffer
+* Description: growable text the C file is assembled in.
+************************************************************/
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} TextBuffer;
+
+/***********************************************************
+* Struct: EmitVariable
+* Description: a local of a function, or a global of the program.
+************************************************************/
+typedef struct {
+    char* name;             // Clock name (the hidden `for` variables start with '$')
+    char* cname;            // C identifier
+    EmitKind kind;          // Inferred type, KIND_VALUE if it can change at run time
+    bool native;            // Assigned before every read, so it may use a native C type
+    bool parameter;
+    bool assigned;          // Assigned by the code of its own function (or by the top level code)
+    bool read_by_function;  // Global read from inside a function
+    bool hides_global;      // Local named like an assigned global, which it reads until it is assigned itself
+} EmitVariable;
+
+struct EmitFunction;
+
+/***********************************************************
+* Struct: EmitBinding
+* Description: a function name declared in one scope. At run time it holds the
+* declaration that ran last (NULL before any did), like env_set_func does on the VM.
+************************************************************/
+typedef struct {
+    const char* name;
+    char* cname;
+    struct EmitFunction* scope;   // Function whose body declares it (the program for top level functions)
+    struct EmitFunction* only;    // The declaration when there is exactly one, called directly
+    int declarations;
+} EmitBinding;
+
+/***********************************************************
+* Struct: EmitFunction
+* Description: a function declaration, or the top level program (parent == NULL).
+************************************************************/
+typedef struct EmitFunction {
+    const ASTNode* node;            // Declaration (the program node for the top level)
+    struct EmitFunction* parent;    // Lexically enclosing function
+    const char* name;
+    char* cname;
+    int param_count;
+    EmitVariable** variables;       // Parameters first, then the other locals (globals for the top level)
+    size_t variable_count;
+    size_t variable_capacity;
+    EmitBinding* binding;           // Where the declaration stores the function
+    bool tail_loop;                 // A call to itself in tail position jumps back to the start
+} EmitFunction;
+
+/***********************************************************
+* Struct: CExpr
+* Description: the result of an expression: a temporary, a variable or a constant
+* (always side effect free, so it can be used any number of times).
+************************************************************/
+typedef struct {
+    EmitKind kind;
+    char text[EMIT_TEXT_SIZE];
+} CExpr;
+
+/***********************************************************
+* Struct: EmitLoop
+* Description: a loop or switch being written, for `stop` and `continue`.
+************************************************************/
+typedef struct {
+    bool is_switch;
+    int label;
+    bool break_used;
+    bool continue_used;
+} EmitLoop;
+
+// Everything the analysis found
+static EmitFunction* program = NULL;
+static EmitFunction** functions = NULL;     // Declarations in source order (without the program)
+static size_t function_count = 0;
+static EmitBinding** bindings = NULL;
+static size_t binding_count = 0;
+static char** builtin_names = NULL;         // Names resolved to the built in functions when the program starts
+static size_t builtin_count = 0;
+
+// State of the function being written
+static EmitFunction* current = NULL;
+static TextBuffer* text = NULL;
+static int indent_level = 0;
+static int temp_count = 0;
+static int label_count = 0;
+static EmitLoop loops[EMIT_MAX_LOOP_DEPTH];
+static int loop_depth = 0;
+static bool failed = false;
+static bool inference_changed = false;
+
+/**
+ * The runtime support of the generated file: copies of the operators of the VM
+ * (vm_arithmetic, vm_compare, vm_unary...) on RuntimeValues.
+ */
+static const char* const prelude[] = {
+    "#include <stdio.h>",
+    "#include <stdlib.h>",
+    "#include <stdbool.h>",
+    "#include <string.h>",
+    "#include \"runtimeEnv.h\"",
+    "",
+    "#define CLK_MAX_FRAMES 1024   /* Call depth limit of the VM */",
+    "",
+    "typedef RuntimeValue (*ClockFunction)(RuntimeValue* args, size_t argc);",
+    "",
+    "enum {",
+    "    CLK_ADD, CLK_SUBTRACT, CLK_MULTIPLY, CLK_DIVIDE, CLK_MODULO,",
+    "    CLK_LESS, CLK_GREATER, CLK_LESS_EQUAL, CLK_GREATER_EQUAL, CLK_EQUAL, CLK_NOT_EQUAL,",
+    "    CLK_AND, CLK_OR, CLK_NEGATE, CLK_BIT_NOT",
+    "};",
+    "",
+    "static RuntimeEnvironment* clk_builtins;",
+    "static RuntimeValue clk_no_args[1];",
+    "static int clk_depth = 1;",
+    "static bool clk_returned = false;",
+    "static RuntimeValue clk_return_value;",
+    "static ClockFunction clk_tail_fn;   /* Pending tail call, run by the caller's clk_finish */",
+    "static RuntimeValue* clk_tail_args;",
+    "static size_t clk_tail_argc = 0;",
+    "static size_t clk_tail_capacity = 0;",
+    "",
+    "static inline RuntimeValue clk_null(void) { RuntimeValue v; memset(&v, 0, sizeof(v)); v.type = RUNTIME_VALUE_NULL; return v; }",
+    "static inline RuntimeValue clk_unset(void) { RuntimeValue v; memset(&v, 0, sizeof(v)); v.type = RUNTIME_VALUE_UNSET; return v; }",
+    "static inline RuntimeValue clk_int(long i) { RuntimeValue v; v.type = RUNTIME_VALUE_INT; v.int_val = i; return v; }",
+    "static inline RuntimeValue clk_float(double f) { RuntimeValue v; v.type = RUNTIME_VALUE_FLOAT; v.float_val = f; return v; }",
+    "static inline RuntimeValue clk_bool(bool b) { RuntimeValue v; v.type = RUNTIME_VALUE_BOOL; v.bool_val = b; return v; }",
+    "static inline RuntimeValue clk_string(const char* s) { RuntimeValue v; v.type = RUNTIME_VALUE_STRING; v.string_val = (char*)s; return v; }",
+    "",
+    "static inline RuntimeValue clk_arith(int op, RuntimeValue left, RuntimeValue right) {",
+    "    if (left.type == RUNTIME_VALUE_INT && right.type == RUNTIME_VALUE_INT) {",
+    "        long l = left.int_val, r = right.int_val;",
+    "        switch (op) {",
+    "        case CLK_ADD:      return clk_int(l + r);",
+    "        case CLK_SUBTRACT: return clk_int(l - r);",
+    "        case CLK_MULTIPLY: return clk_int(l * r);",
+    "        case CLK_DIVIDE:",
+    "            if (r == 0) { fprintf(stderr, \"Runtime Error: division by zero.\\n\"); return clk_null(); }",
+    "            return clk_int(l / r);",
+    "        case CLK_MODULO:",
+    "            if (r == 0) { fprintf(stderr, \"Runtime Error: modulo by zero.\\n\"); return clk_null(); }",
+    "            return clk_int(l % r);",
+    "        }",
+    "    }",
+    "    else if (left.type == RUNTIME_VALUE_FLOAT && right.type == RUNTIME_VALUE_FLOAT) {",
+    "        double l = left.float_val, r = right.float_val;",
+    "        switch (op) {",
+    "        case CLK_ADD:      return clk_float(l + r);",
+    "        case CLK_SUBTRACT: return clk_float(l - r);",
+    "        case CLK_MULTIPLY: return clk_float(l * r);",
+    "        case CLK_DIVIDE:",
+    "            if (r == 0.0) { fprintf(stderr, \"Runtime Error: division by zero.\\n\"); return clk_null(); }",
+    "            return clk_float(l / r);",
+    "        }",
+    "    }",
+    "    return clk_null();",
+    "}",
+    "",
+    "static inline int clk_order(double l, double r) { return (l > r) - (l < r); }",
+    "",
+    "static inline bool clk_compare(int op, RuntimeValue left, RuntimeValue right) {",
+    "    if (left.type != right.type) return false;",
+    "    if (op == CLK_AND || op == CLK_OR) {",
+    "        bool l = left.type == RUNTIME_VALUE_BOOL && left.bool_val;",
+    "        bool r = right.type == RUNTIME_VALUE_BOOL && right.bool_val;",
+    "        return op == CLK_AND ? (l && r) : (l || r);",
+    "    }",
+    "    int order;",
+    "    switch (left.type) {",
+    "    case RUNTIME_VALUE_INT:    order = (left.int_val > right.int_val) - (left.int_val < right.int_val); break;",
+    "    case RUNTIME_VALUE_FLOAT:  order = clk_order(left.float_val, right.float_val); break;",
+    "    case RUNTIME_VALUE_STRING: order = strcmp(left.string_val, right.string_val); break;",
+    "    case RUNTIME_VALUE_BOOL:",
+    "        if (op == CLK_EQUAL) return left.bool_val == right.bool_val;",
+    "        if (op == CLK_NOT_EQUAL) return left.bool_val != right.bool_val;",
+    "        return false;",
+    "    default:",
+    "        return false;",
+    "    }",
+    "    switch (op) {",
+    "    case CLK_EQUAL:         return order == 0;",
+    "    case CLK_NOT_EQUAL:     return order != 0;",
+    "    case CLK_LESS:          return order < 0;",
+    "    case CLK_GREATER:       return order > 0;",
+    "    case CLK_LESS_EQUAL:    return order <= 0;",
+    "    case CLK_GREATER_EQUAL: return order >= 0;",
+    "    default:                return false;",
+    "    }",
+    "}",
+    "",
+    "static inline bool clk_truthy(RuntimeValue v) {",
+    "    switch (v.type) {",
+    "    case RUNTIME_VALUE_BOOL:  return v.bool_val;",
+    "    case RUNTIME_VALUE_INT:   return v.int_val != 0;",
+    "    case RUNTIME_VALUE_FLOAT: return v.float_val != 0.0;",
+    "    default:                  return false;",
+    "    }",
+    "}",
+    "",
+    "static inline bool clk_not(RuntimeValue v) {",
+    "    return !((v.type == RUNTIME_VALUE_BOOL && v.bool_val) || (v.type == RUNTIME_VALUE_INT && v.int_val != 0));",
+    "}",
+    "",
+    "static inline RuntimeValue clk_unary(int op, RuntimeValue v) {",
+    "    if (op == CLK_NEGATE) {",
+    "        if (v.type == RUNTIME_VALUE_INT) return clk_int(-v.int_val);",
+    "        if (v.type == RUNTIME_VALUE_FLOAT) return clk_float(-v.float_val);",
+    "        return clk_null();",
+    "    }",
+    "    return v.type == RUNTIME_VALUE_INT ? clk_int(~v.int_val) : clk_null();",
+    "}",
+    "",
+    "static inline RuntimeValue clk_array(const RuntimeValue* values, size_t count) {",
+    "    RuntimeValue* elements = (RuntimeValue*)malloc((count ? count : 1) * sizeof(RuntimeValue));",
+    "    if (!elements) { fprintf(stderr, \"Runtime Error: memory allocation failed for array.\\n\"); exit(EXIT_FAILURE); }",
+    "    memcpy(elements, values, count * sizeof(RuntimeValue));",
+    "    RuntimeValue v;",
+    "    v.type = RUNTIME_VALUE_ARRAY;",
+    "    v.array_val.elements = elements;",
+    "    v.array_val.count = count;",
+    "    return v;",
+    "}",
+    "",
+    "static inline RuntimeValue clk_array_get(RuntimeValue array, RuntimeValue index) {",
+    "    if (array.type != RUNTIME_VALUE_ARRAY) { fprintf(stderr, \"Error: Variable is not an array.\\n\"); return clk_null(); }",
+    "    if (index.type != RUNTIME_VALUE_INT) { fprintf(stderr, \"Error: Array index must be an integer.\\n\"); return clk_null(); }",
+    "    if (index.int_val < 0 || (size_t)index.int_val >= array.array_val.count) {",
+    "        fprintf(stderr, \"Error: Array index out of bounds.\\n\");",
+    "        return clk_null();",
+    "    }",
+    "    return array.array_val.elements[index.int_val];",
+    "}",
+    "",
+    "static inline void clk_array_set(RuntimeValue array, RuntimeValue index, RuntimeValue value) {",
+    "    if (array.type != RUNTIME_VALUE_ARRAY) fprintf(stderr, \"Error: Variable is not an array.\\n\");",
+    "    else if (index.type != RUNTIME_VALUE_INT) fprintf(stderr, \"Error: Array index must be an integer.\\n\");",
+    "    else if (index.int_val < 0 || (size_t)index.int_val >= array.array_val.count) fprintf(stderr, \"Error: Array index out of bounds.\\n\");",
+    "    else array.array_val.elements[index.int_val] = value;",
+    "}",
+    "",
+    "static inline void clk_global_not_found(const char* name) {",
+    "    fprintf(stderr, \"Variable '%s' not found in the current environment.\\n\", name);",
+    "}",
+    "",
+    "static inline void clk_enter(const char* caller) {",
+    "    if (clk_depth >= CLK_MAX_FRAMES) {",
+    "        fprintf(stderr, \"VM Runtime Error in %s: call stack overflow.\\n\", caller);",
+    "        exit(EXIT_FAILURE);",
+    "    }",
+    "    clk_depth++;",
+    "}",
+    "",
+    "static inline RuntimeValue clk_tail(ClockFunction fn, const RuntimeValue* args, size_t argc) {",
+    "    if (argc > clk_tail_capacity) {",
+    "        clk_tail_args = (RuntimeValue*)realloc(clk_tail_args, argc * sizeof(RuntimeValue));",
+    "        if (!clk_tail_args) { fprintf(stderr, \"Runtime Error: memory allocation failed for a call.\\n\"); exit(EXIT_FAILURE); }",
+    "        clk_tail_capacity = argc;",
+    "    }",
+    "    memcpy(clk_tail_args, args, argc * sizeof(RuntimeValue));",
+    "    clk_tail_fn = fn;",
+    "    clk_tail_argc = argc;",
+    "    return clk_null();",
+    "}",
+    "",
+    "static inline RuntimeValue clk_finish(RuntimeValue result) {",
+    "    while (clk_tail_fn) {",
+    "        ClockFunction fn = clk_tail_fn;",
+    "        clk_tail_fn = NULL;",
+    "        result = fn(clk_tail_args, clk_tail_argc);",
+    "    }",
+    "    return result;",
+    "}",
+    "",
+    "static inline ClockFunction clk_builtin(const char* name) {",
+    "    RuntimeValue fn = env_get_func(clk_builtins, name);",
+    "    return fn.type == RUNTIME_VALUE_BUILTIN ? fn.builtin_val.fn : NULL;",
+    "}",
+    "",
+    "static inline RuntimeValue clk_call_builtin(ClockFunction fn, const char* name, RuntimeValue* args, size_t argc) {",
+    "    if (!fn) {",
+    "        fprintf(stderr, \"Function '%s' not found in the current environment.\\n\", name);",
+    "        return clk_null();",
+    "    }",
+    "    return fn(args, argc);",
+    "}",
+    "",
+    "static inline void clk_print_return(void) {",
+    "    printf(\"\\033[0;93m\\n\");",
+    "    if (clk_returned) {",
+    "        printf(\"Clock Returned: \");",
+    "        switch (clk_return_value.type) {",
+    "        case RUNTIME_VALUE_INT:    printf(\"%ld\\n\", clk_return_value.int_val); break;",
+    "        case RUNTIME_VALUE_FLOAT:  printf(\"%f\\n\", clk_return_value.float_val); break;",
+    "        case RUNTIME_VALUE_BOOL:   printf(\"%s\\n\", clk_return_value.bool_val ? \"true\" : \"false\"); break;",
+    "        case RUNTIME_VALUE_STRING: printf(\"%s\\n\", clk_return_value.string_val); break;",
+    "        case RUNTIME_VALUE_NULL:   printf(\"null\\n\"); break;",
+    "        default:                   printf(\"Unknown return type\\n\"); break;",
+    "        }",
+    "        printf(\"\\n\");",
+    "    }",
+    "    printf(\"\\033[0m\\n\");",
+    "}",
+    NULL
+};
+
+
+
+
+/***********************************************************
+* Function: text_vappend / text_append
+* Description: appends formatted text to a buffer.
+* Parameters: TextBuffer* buffer, const char* format, ...
+* Return: void
+* ***********************************************************/
+static void text_vappend(TextBuffer* buffer, const char* format, va_list args) {
+    va_list copy;
+    va_copy(copy, args);
+    int needed = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+    if (needed < 0) return;
+
+    if (buffer->length + (size_t)needed + 1 > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 1024;
+        while (buffer->length + (size_t)needed + 1 > capacity) capacity *= 2;
+        char* data = (char*)realloc(buffer->data, capacity);
+        if (!data) {
+            fprintf(stderr, "Memory allocation failed during C generation.\n");
+            exit(EXIT_FAILURE);
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    vsnprintf(buffer->data + buffer->length, (size_t)needed + 1, format, args);
+    buffer->length += (size_t)needed;
+}
+
+static void text_append(TextBuffer* buffer, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    text_vappend(buffer, format, args);
+    va_end(args);
+}
+
+
+
+
+/***********************************************************
+* Function: emit_line
+* Description: appends one indented line to the function being written.
+* Parameters: const char* format, ...
+* Return: void
+* ***********************************************************/
+static void emit_line(const char* format, ...) {
+    for (int i = 0; i < indent_level; i++) {
+        text_append(text, "    ");
+    }
+    va_list args;
+    va_start(args, format);
+    text_vappend(text, format, args);
+    va_end(args);
+    text_append(text, "\n");
+}
+
+
+
+
+/***********************************************************
+* Function: emit_error
+* Description: reports a construct the translator can't express.
+* Parameters: const ASTNode* node, const char* message
+* Return: void
+* ***********************************************************/
+static void emit_error(const ASTNode* node, const char* message) {
+    if (!failed) {
+        fprintf(stderr, "Cannot translate to C (line %zu): %s\n", node ? node->line : (size_t)0, message);
+    }
+    failed = true;
+}
+
+
+
+
+/***********************************************************
+* Function: emit_alloc / emit_strdup
+* Description: allocation helpers that stop on failure, like the rest of the compiler.
+* Parameters: size_t size / const char* s
+* Return: void* / char*
+* ***********************************************************/
+static void* emit_alloc(size_t size) {
+    void* memory = calloc(1, size ? size : 1);
+    if (!memory) {
+        fprintf(stderr, "Memory allocation failed during C generation.\n");
+        exit(EXIT_FAILURE);
+    }
+    return memory;
+}
+
+static char* emit_format(const char* format, ...) {
+    TextBuffer buffer = { 0 };
+    va_list args;
+    va_start(args, format);
+    text_vappend(&buffer, format, args);
+    va_end(args);
+    return buffer.data ? buffer.data : (char*)emit_alloc(1);
+}
+
+static void* emit_grow(void* array, size_t* capacity, size_t count, size_t element) {
+    if (count < *capacity) return array;
+    *capacity = *capacity ? *capacity * 2 : 16;
+    void* grown = realloc(array, *capacity * element);
+    if (!grown) {
+        fprintf(stderr, "Memory allocation failed during C generation.\n");
+        exit(EXIT_FAILURE);
+    }
+    return grown;
+}
+
+
+
+
+/***********************************************************
+* Function: find_variable / add_variable
+* Description: look up (or add) a variable of a function or of the program.
+* Parameters: EmitFunction* fn, const char* name
+* Return: EmitVariable* (NULL if not found)
+* ***********************************************************/
+static EmitVariable* find_variable(EmitFunction* fn, const char* name) {
+    for (size_t i = 0; i < fn->variable_count; i++) {
+        if (strcmp(fn->variables[i]->name, name) == 0) return fn->variables[i];
+    }
+    return NULL;
+}
+
+static EmitVariable* add_variable(EmitFunction* fn, const char* name) {
+    EmitVariable* variable = find_variable(fn, name);
+    if (variable) return variable;
+
+    fn->variables = (EmitVariable**)emit_grow(fn->variables, &fn->variable_capacity, fn->variable_count, sizeof(EmitVariable*));
+    variable = (EmitVariable*)emit_alloc(sizeof(EmitVariable));
+    variable->name = emit_format("%s", name);
+
+    // Hidden `for` variables can't clash with user names, which always get the plain prefix
+    const char* prefix = fn->parent ? "l" : "g";
+    if (name[0] == '$') variable->cname = emit_format("%sh_%s", prefix, name + 1);
+    else variable->cname = emit_format("%s_%s", prefix, name);
+
+    fn->variables[fn->variable_count++] = variable;
+    return variable;
+}
+
+
+
+
+/***********************************************************
+* Function: resolve_variable
+* Description: the variable a load or store refers to, with the rules of the bytecode
+* generator: inside a function stores always target a local and loads use the local if
+* there is one, otherwise the global.
+* Parameters: EmitFunction* fn, const char* name, bool store
+* Return: EmitVariable*
+* ***********************************************************/
+static EmitVariable* resolve_variable(EmitFunction* fn, const char* name, bool store) {
+    if (fn->parent) {
+        EmitVariable* local = store ? add_variable(fn, name) : find_variable(fn, name);
+        if (local) return local;
+    }
+    return add_variable(program, name);
+}
+
+static bool is_global(const EmitFunction* fn, const char* name) {
+    return !fn->parent || !find_variable((EmitFunction*)fn, name);
+}
+
+
+
+
+/***********************************************************
+* Function: find_binding / find_function
+* Description: the binding a scope declares for a name, and the function of a declaration node.
+* Parameters: EmitFunction* scope, const char* name / const ASTNode* node
+* Return: EmitBinding* / EmitFunction* (NULL if none)
+* ***********************************************************/
+static EmitBinding* find_binding(EmitFunction* scope, const char* name) {
+    for (size_t i = 0; i < binding_count; i++) {
+        if (bindings[i]->scope == scope && strcmp(bindings[i]->name, name) == 0) return bindings[i];
+    }
+    return NULL;
+}
+
+static EmitFunction* find_function(const ASTNode* node) {
+    for (size_t i = 0; i < function_count; i++) {
+        if (functions[i]->node == node) return functions[i];
+    }
+    return NULL;
+}
+
+
+
+
+/***********************************************************
+* Function: hidden_name
+* Description: the hidden variables of a `for` loop at a nesting level ($forN / $endN),
+* the same names the bytecode generator uses.
+* Parameters: char* out, size_t size, const char* stem, int depth
+* Return: const char*
+* ***********************************************************/
+static const char* hidden_name(char* out, size_t size, const char* stem, int depth) {
+    snprintf(out, size, "$%s%d", stem, depth);
+    return out;
+}
+
+
+
+
+/***********************************************************
+* Function: collect_locals
+* Description: adds every variable a function body assigns to its locals
+* (nested declarations have their own scope and are skipped).
+* Parameters: const ASTNode* node, EmitFunction* fn
+* Return: void
+* ***********************************************************/
+static void collect_locals(const ASTNode* node, EmitFunction* fn) {
+    if (!node || node->type == AST_FUNCTION_DECLARATION) return;
+
+    if (node->type == AST_ASSIGNMENT && node->child_count > 0 &&
+        node->children[0] && node->children[0]->type == AST_IDENTIFIER) {
+        add_variable(fn, node->children[0]->operator_);
+    }
+    if (node->type == AST_FOR_STATEMENT && node->operator_) {
+        add_variable(fn, node->operator_);
+    }
+    for (size_t i = 0; i < node->child_count; i++) {
+        collect_locals(node->children[i], fn);
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: captures_variable
+* Description: whether a read inside a function names a variable of an enclosing
+* function, which the VM captures. The generated functions are plain C functions
+* without a closure, so such programs are not translated.
+* Parameters: const EmitFunction* fn, const char* name
+* Return: bool
+* ***********************************************************/
+static bool captures_variable(const EmitFunction* fn, const char* name) {
+    if (!fn->parent || find_variable((EmitFunction*)fn, name)) return false;
+    for (EmitFunction* enclosing = fn->parent; enclosing->parent; enclosing = enclosing->parent) {
+        if (find_variable(enclosing, name)) return true;
+    }
+    return false;
+}
+
+
+
+
+static void analyze_node(const ASTNode* node, EmitFunction* fn, int depth);
+
+/***********************************************************
+* Function: declare_function
+* Description: creates the function of a declaration, its binding in the enclosing
+* scope and its locals, then analyzes its body.
+* Parameters: const ASTNode* node, EmitFunction* scope
+* Return: void
+* ***********************************************************/
+static void declare_function(const ASTNode* node, EmitFunction* scope) {
+    if (node->child_count < 2 || !node->children[0] || node->children[0]->type != AST_IDENTIFIER) {
+        emit_error(node, "invalid function declaration.");
+        return;
+    }
+
+    EmitFunction* fn = (EmitFunction*)emit_alloc(sizeof(EmitFunction));
+    fn->node = node;
+    fn->parent = scope;
+    fn->name = node->children[0]->operator_;
+    fn->cname = emit_format("clk_f%zu_%s", function_count, fn->name);
+    functions =(EmitFunction**)realloc(functions, (function_count + 1) * sizeof(EmitFunction*));
+    if (!functions) {
+        fprintf(stderr, "Memory allocation failed during C generation.\n");
+        exit(EXIT_FAILURE);
+    }
+    functions[function_count++] = fn;
+
+    EmitBinding* binding = find_binding(scope, fn->name);
+    if (!binding) {
+        bindings = (EmitBinding**)realloc(bindings, (binding_count + 1) * sizeof(EmitBinding*));
+        if (!bindings) {
+            fprintf(stderr, "Memory allocation failed during C generation.\n");
+            exit(EXIT_FAILURE);
+        }
+        binding = (EmitBinding*)emit_alloc(sizeof(EmitBinding));
+        binding->name = fn->name;
+        binding->scope = scope;
+        binding->cname = emit_format("clk_bind%zu_%s", binding_count, fn->name);
+        bindings[binding_count++] = binding;
+    }
+    binding->declarations++;
+    binding->only = binding->declarations == 1 ? fn : NULL;
+    fn->binding = binding;
+
+    // Parameters take the first slots, then every variable assigned in the body
+    fn->param_count = (int)node->child_count - 2;
+    for (int i = 0; i < fn->param_count; i++) {
+        const ASTNode* param = node->children[1 + i];
+        if (!param || param->type != AST_IDENTIFIER || find_variable(fn, param->operator_)) {
+            emit_error(node, "invalid or repeated parameter name.");
+            return;
+        }
+        add_variable(fn, param->operator_)->parameter = true;
+    }
+    const ASTNode* body = node->children[node->child_count - 1];
+    collect_locals(body, fn);
+
+    // Loops of the caller are not visible from inside the body
+    analyze_node(body, fn, 0);
+}
+
+
+
+
+/***********************************************************
+* Function: analyze_node
+* Description: finds the functions, locals and globals of the program.
+* `depth` counts the enclosing loops and switches of the current function,
+* which names the hidden variables of `for` loops.
+* Parameters: const ASTNode* node, EmitFunction* fn, int depth
+* Return: void
+* ***********************************************************/
+static void analyze_node(const ASTNode* node, EmitFunction* fn, int depth) {
+    if (!node || failed) return;
+    char counter[32];
+    char limit[32];
+
+    switch (node->type) {
+    case AST_FUNCTION_DECLARATION:
+        declare_function(node, fn);
+        return;
+
+    case AST_ASSIGNMENT:
+        if (node->child_count < 2 || !node->children[0] || node->children[0]->type != AST_IDENTIFIER) {
+            emit_error(node, "invalid assignment.");
+            return;
+        }
+        resolve_variable(fn, node->children[0]->operator_, true)->assigned = true;
+        analyze_node(node->children[1], fn, depth);
+        return;
+
+    case AST_IDENTIFIER: {
+        if (captures_variable(fn, node->operator_)) {
+            emit_error(node, "nested functions can't read the variables of an enclosing function.");
+            return;
+        }
+        bool global = is_global(fn, node->operator_);
+        EmitVariable* variable = resolve_variable(fn, node->operator_, false);
+        if (global && fn->parent) variable->read_by_function = true;
+        return;
+    }
+
+    case AST_FUNCTION_CALL:
+        // The first child is the name of the function, not a variable
+        for (size_t i = 1; i < node->child_count; i++) {
+            analyze_node(node->children[i], fn, depth);
+        }
+        return;
+
+    case AST_FOR_STATEMENT:
+        if (node->child_count != 3) {
+            emit_error(node, "invalid 'for' loop.");
+            return;
+        }
+        if (depth >= EMIT_MAX_LOOP_DEPTH) {
+            emit_error(node, "loops nested too deeply.");
+            return;
+        }
+        resolve_variable(fn, hidden_name(counter, sizeof(counter), "for", depth), true);
+        resolve_variable(fn, hidden_name(limit, sizeof(limit), "end", depth), true);
+        if (node->operator_) resolve_variable(fn, node->operator_, true)->assigned = true;
+        analyze_node(node->children[0], fn, depth);
+        analyze_node(node->children[1], fn, depth);
+        analyze_node(node->children[2], fn, depth + 1);
+        return;
+
+    case AST_WHILE_STATEMENT:
+    case AST_SWITCH:
+        if (node->child_count < 1) {
+            emit_error(node, "invalid loop or switch.");
+            return;
+        }
+        analyze_node(node->children[0], fn, depth);
+        for (size_t i = 1; i < node->child_count; i++) {
+            analyze_node(node->children[i], fn, depth + 1);
+        }
+        return;
+
+    default:
+        for (size_t i = 0; i < node->child_count; i++) {
+            analyze_node(node->children[i], fn, depth);
+        }
+        return;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: count_occurrences / first_occurrence
+* Description: the uses of a variable name in a body, without the nested
+* function declarations and the names of called functions. A counted `for` naming
+* the variable is an occurrence for first_occurrence (it sets it before its body).
+* Parameters: const ASTNode* node, const char* name
+* Return: size_t / const ASTNode* (NULL if none)
+* ***********************************************************/
+static size_t count_occurrences(const ASTNode* node, const char* name) {
+    if (!node || node->type == AST_FUNCTION_DECLARATION) return 0;
+    if (node->type == AST_IDENTIFIER) return strcmp(node->operator_, name) == 0 ? 1 : 0;
+
+    size_t count = 0;
+    for (size_t i = node->type == AST_FUNCTION_CALL ? 1 : 0; i < node->child_count; i++) {
+        count += count_occurrences(node->children[i], name);
+    }
+    return count;
+}
+
+static const ASTNode* first_occurrence(const ASTNode* node, const char* name) {
+    if (!node || node->type == AST_FUNCTION_DECLARATION) return NULL;
+    if (node->type == AST_IDENTIFIER) return strcmp(node->operator_, name) == 0 ? node : NULL;
+
+    for (size_t i = node->type == AST_FUNCTION_CALL ? 1 : 0; i < node->child_count; i++) {
+        if (node->type == AST_FOR_STATEMENT && i == 2 && node->operator_ && strcmp(node->operator_, name) == 0) {
+            return node;
+        }
+        const ASTNode* found = first_occurrence(node->children[i], name);
+        if (found) return found;
+    }
+    return NULL;
+}
+
+
+
+
+/***********************************************************
+* Function: definitely_assigned
+* Description: tells if every read of a variable comes after an assignment of it.
+* The test is simple on purpose: its first use in the body must be a plain `=`
+* statement (whose right side doesn't use it) and all its other uses must be later
+* statements of the same block, so each time they run the assignment already did.
+* Parameters: const ASTNode* body, const char* name
+* Return: bool
+* ***********************************************************/
+static bool definitely_assigned(const ASTNode* body, const char* name) {
+    const ASTNode* first = first_occurrence(body, name);
+    if (!first) return false;
+    if (first->type == AST_FOR_STATEMENT) {
+        // Set by the loop each time its body runs, so it can only be read in there
+        return count_occurrences(first->children[2], name) == count_occurrences(body, name);
+    }
+
+    const ASTNode* assign = first->parent;
+    if (!assign || assign->type != AST_ASSIGNMENT || assign->child_count < 2 || assign->children[0] != first ||
+        !assign->operator_ || strcmp(assign->operator_, "=") != 0) {
+        return false;
+    }
+    if (count_occurrences(assign->children[1], name) > 0) return false;
+
+    const ASTNode* list = assign->parent;
+    if (!list) return false;
+    bool statement_list = list->type == AST_BLOCK || list->type == AST_PROGRAM || list->type == AST_DEFAULT ||
+        (list->type == AST_WHEN && list->child_count > 0 && list->children[0] != assign);
+    if (!statement_list) return false;
+
+    return count_occurrences(list, name) == count_occurrences(body, name);
+}
+
+
+
+
+/***********************************************************
+* Function: join_kinds / binary_kind / unary_kind
+* Description: the type rules of the generated code. A result is only native when the
+* VM would give the same type for every run: + - * of two ints or two floats, / and %
+* by a non zero constant, and the comparisons (always a bool).
+* Parameters: EmitKind a, EmitKind b / const char* op, EmitKind left, EmitKind right, const ASTNode* right_node
+* Return: EmitKind
+* ***********************************************************/
+static EmitKind join_kinds(EmitKind a, EmitKind b) {
+    if (a == KIND_NONE) return b;
+    if (b == KIND_NONE || a == b) return a;
+    return KIND_VALUE;
+}
+
+static bool is_arithmetic(const char* op) {
+    return strcmp(op, "+") == 0 || strcmp(op, "-") == 0 || strcmp(op, "*") == 0 ||
+        strcmp(op, "/") == 0 || strcmp(op, "%") == 0;
+}
+
+static bool is_comparison(const char* op) {
+    return strcmp(op, "<") == 0 || strcmp(op, ">") == 0 || strcmp(op, "<=") == 0 || strcmp(op, ">=") == 0 ||
+        strcmp(op, "==") == 0 || strcmp(op, "!=") == 0 || strcmp(op, "&&") == 0 || strcmp(op, "||") == 0;
+}
+
+static bool is_nonzero_constant(const ASTNode* node, EmitKind kind) {
+    if (!node || node->type != AST_LITERAL) return false;
+    if (kind == KIND_INT) return node->value_kind == VALUE_INT && node->value.int_val != 0;
+    if (kind == KIND_FLOAT) return node->value_kind == VALUE_FLOAT && node->value.float_val != 0.0;
+    return false;
+}
+
+static EmitKind binary_kind(const char* op, EmitKind left, EmitKind right, const ASTNode* right_node) {
+    if (is_comparison(op)) return KIND_BOOL;
+    if (!is_arithmetic(op)) return KIND_VALUE;
+    if (left == KIND_NONE || right == KIND_NONE) return KIND_NONE;
+    if (left != right || (left != KIND_INT && left != KIND_FLOAT)) return KIND_VALUE;
+
+    if (strcmp(op, "/") == 0 || strcmp(op, "%") == 0) {
+        // Division by zero is a null, and floats have no %
+        if (left == KIND_FLOAT && strcmp(op, "%") == 0) return KIND_VALUE;
+        return is_nonzero_constant(right_node, left) ? left : KIND_VALUE;
+    }
+    return left;
+}
+
+static EmitKind unary_kind(const char* op, EmitKind operand) {
+    if (strcmp(op, "!") == 0) return KIND_BOOL;
+    if (operand == KIND_NONE) return KIND_NONE;
+    if (strcmp(op, "-") == 0 && (operand == KIND_INT || operand == KIND_FLOAT)) return operand;
+    if (strcmp(op, "~") == 0 && operand == KIND_INT) return KIND_INT;
+    return KIND_VALUE;
+}
+
+static EmitKind variable_kind(const EmitVariable* variable) {
+    return variable->native ? variable->kind : KIND_VALUE;
+}
+
+
+
+
+/***********************************************************
+* Function: expression_kind
+* Description: the type of an expression with the current variable types.
+* Parameters: const ASTNode* node, EmitFunction* fn
+* Return: EmitKind
+* ***********************************************************/
+static EmitKind expression_kind(const ASTNode* node, EmitFunction* fn) {
+    if (!node) return KIND_VALUE;
+
+    switch (node->type) {
+    case AST_LITERAL:
+        if (node->value_kind == VALUE_INT) return KIND_INT;
+        if (node->value_kind == VALUE_FLOAT) return KIND_FLOAT;
+        if (node->value_kind == VALUE_BOOL) return KIND_BOOL;
+        return KIND_VALUE;
+
+    case AST_IDENTIFIER:
+        return variable_kind(resolve_variable(fn, node->operator_, false));
+
+    case AST_BINARY_EXPR:
+        if (node->child_count < 2) return KIND_VALUE;
+        if (strcmp(node->operator_, "=") == 0) return expression_kind(node->children[1], fn);
+        return binary_kind(node->operator_, expression_kind(node->children[0], fn),
+            expression_kind(node->children[1], fn), node->children[1]);
+
+    case AST_UNARY_EXPR:
+        if (node->child_count < 1) return KIND_VALUE;
+        return unary_kind(node->operator_, expression_kind(node->children[0], fn));
+
+    default:
+        return KIND_VALUE;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: compound_operator
+* Description: the operator of a compound assignment (`+=` -> "+"), NULL for a plain `=`.
+* Parameters: const ASTNode* node
+* Return: const char*
+* ***********************************************************/
+static const char* compound_operator(const ASTNode* node) {
+    const char* op = node->operator_ ? node->operator_ : "=";
+    if (strcmp(op, "+=") == 0) return "+";
+    if (strcmp(op, "-=") == 0) return "-";
+    if (strcmp(op, "*=") == 0) return "*";
+    if (strcmp(op, "/=") == 0) return "/";
+    if (strcmp(op, "%=") == 0) return "%";
+    return NULL;
+}
+
+
+
+
+/***********************************************************
+* Function: find_hidden_globals
+* Description: marks the locals that may be read before they are assigned while a global
+* of the same name is assigned by the top level code. Like on the VM, they start unset and
+* read the global until then (OP_OR_GLOBAL), so that global stays a RuntimeValue.
+* Parameters: void
+* Return: void
+* ***********************************************************/
+static void find_hidden_globals(void) {
+    for (size_t f = 0; f < function_count; f++) {
+        EmitFunction* fn = functions[f];
+        const ASTNode* body = fn->node->children[fn->node->child_count - 1];
+        for (size_t i = 0; i < fn->variable_count; i++) {
+            EmitVariable* variable = fn->variables[i];
+            if (variable->parameter || variable->name[0] == '$') continue;
+
+            EmitVariable* global = find_variable(program, variable->name);
+            if (!global || !global->assigned || definitely_assigned(body, variable->name)) continue;
+            variable->hides_global = true;
+            global->read_by_function = true;
+        }
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: infer_variable / infer_node
+* Description: one round of the type inference: every assignment joins the type
+* of its value into the type of its variable.
+* Parameters: EmitVariable* variable, EmitKind kind / const ASTNode* node, EmitFunction* fn, int depth
+* Return: void
+* ***********************************************************/
+static void infer_variable(EmitVariable* variable, EmitKind kind) {
+    if (!variable->native) return;
+    EmitKind joined = join_kinds(variable->kind, kind);
+    if (joined != variable->kind) {
+        variable->kind = joined;
+        inference_changed = true;
+    }
+}
+
+static void infer_node(const ASTNode* node, EmitFunction* fn, int depth) {
+    if (!node) return;
+    char counter[32];
+    char limit[32];
+
+    switch (node->type) {
+    case AST_FUNCTION_DECLARATION: {
+        EmitFunction* declared = find_function(node);
+        if (declared) infer_node(node->children[node->child_count - 1], declared, 0);
+        return;
+    }
+
+    case AST_ASSIGNMENT: {
+        EmitVariable* variable = resolve_variable(fn, node->children[0]->operator_, true);
+        EmitKind kind = expression_kind(node->children[1], fn);
+        const char* op = compound_operator(node);
+        if (op) kind = binary_kind(op, variable_kind(variable), kind, node->children[1]);
+        infer_variable(variable, kind);
+        return;
+    }
+
+    case AST_FOR_STATEMENT: {
+        EmitVariable* count = resolve_variable(fn, hidden_name(counter, sizeof(counter), "for", depth), true);
+        EmitVariable* end = resolve_variable(fn, hidden_name(limit, sizeof(limit), "end", depth), true);
+        infer_variable(count, expression_kind(node->children[0], fn));
+        infer_variable(count, binary_kind("+", variable_kind(count), KIND_INT, NULL));
+        infer_variable(end, expression_kind(node->children[1], fn));
+        if (node->operator_) infer_variable(resolve_variable(fn, node->operator_, true), variable_kind(count));
+        infer_node(node->children[2], fn, depth + 1);
+        return;
+    }
+
+    case AST_WHILE_STATEMENT:
+    case AST_SWITCH:
+        for (size_t i = 1; i < node->child_count; i++) {
+            infer_node(node->children[i], fn, depth + 1);
+        }
+        return;
+
+    default:
+        for (size_t i = 0; i < node->child_count; i++) {
+            infer_node(node->children[i], fn, depth);
+        }
+        return;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: infer_types
+* Description: decides which variables are native and their types. Variables start
+* with no type and only widen, so the rounds stop once nothing changes. A variable
+* left without a type (or with two) is a RuntimeValue.
+* Parameters: void
+* Return: void
+* ***********************************************************/
+static void infer_types(void) {
+    for (size_t f = 0; f <= function_count; f++) {
+        EmitFunction* fn = f < function_count ? functions[f] : program;
+        const ASTNode* body = fn->parent ? fn->node->children[fn->node->child_count - 1] : fn->node;
+        for (size_t i = 0; i < fn->variable_count; i++) {
+            EmitVariable* variable = fn->variables[i];
+            if (variable->parameter) variable->native = false;
+            else if (variable->name[0] == '$') variable->native = true;   // Always set by their loop first
+            else if (!fn->parent && variable->read_by_function) variable->native = false;
+            else variable->native = definitely_assigned(body, variable->name);
+            variable->kind = variable->native ? KIND_NONE : KIND_VALUE;
+        }
+    }
+
+    bool demoted = true;
+    while (demoted) {
+        do {
+            inference_changed = false;
+            infer_node(program->node, program, 0);
+        } while (inference_changed);
+
+        demoted = false;
+        for (size_t f = 0; f <= function_count; f++) {
+            EmitFunction* fn = f < function_count ? functions[f] : program;
+            for (size_t i = 0; i < fn->variable_count; i++) {
+                EmitVariable* variable = fn->variables[i];
+                if (variable->native && (variable->kind == KIND_NONE || variable->kind == KIND_VALUE)) {
+                    if (variable->kind == KIND_NONE) demoted = true;
+                    variable->native = false;
+                    variable->kind = KIND_VALUE;
+                }
+            }
+        }
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: c_type / boxed / truth
+* Description: the C type of a kind, an expression as a RuntimeValue, and its truthiness
+* for if/while (the rules of vm_is_truthy).
+* Parameters: EmitKind kind / const CExpr* value, char* out
+* Return: const char*
+* ***********************************************************/
+static const char* c_type(EmitKind kind) {
+    switch (kind) {
+    case KIND_INT:   return "long";
+    case KIND_FLOAT: return "double";
+    case KIND_BOOL:  return "bool";
+    default:         return "RuntimeValue";
+    }
+}
+
+static const char* boxed(const CExpr* value, char* out) {
+    switch (value->kind) {
+    case KIND_INT:   snprintf(out, EMIT_BOX_SIZE, "clk_int(%s)", value->text); break;
+    case KIND_FLOAT: snprintf(out, EMIT_BOX_SIZE, "clk_float(%s)", value->text); break;
+    case KIND_BOOL:  snprintf(out, EMIT_BOX_SIZE, "clk_bool(%s)", value->text); break;
+    default:         snprintf(out, EMIT_BOX_SIZE, "%s", value->text); break;
+    }
+    return out;
+}
+
+static const char* truth(const CExpr* value, char* out) {
+    switch (value->kind) {
+    case KIND_INT:   snprintf(out, EMIT_BOX_SIZE, "%s != 0", value->text); break;
+    case KIND_FLOAT: snprintf(out, EMIT_BOX_SIZE, "%s != 0.0", value->text); break;
+    case KIND_BOOL:  snprintf(out, EMIT_BOX_SIZE, "%s", value->text); break;
+    default:         snprintf(out, EMIT_BOX_SIZE, "clk_truthy(%s)", value->text); break;
+    }
+    return out;
+}
+
+
+
+
+/***********************************************************
+* Function: make_expr / emit_temp
+* Description: an expression made of a constant text, and a new temporary holding
+* a computed value.
+* Parameters: EmitKind kind, const char* format, ...
+* Return: CExpr
+* ***********************************************************/
+static CExpr make_expr(EmitKind kind, const char* format, ...) {
+    CExpr result;
+    result.kind = kind;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(result.text, sizeof(result.text), format, args);
+    va_end(args);
+    return result;
+}
+
+static CExpr emit_temp(EmitKind kind, const char* format, ...) {
+    int id = temp_count++;
+    for (int i = 0; i < indent_level; i++) {
+        text_append(text, "    ");
+    }
+    text_append(text, "%s t%d = ", c_type(kind), id);
+    va_list args;
+    va_start(args, format);
+    text_vappend(text, format, args);
+    va_end(args);
+    text_append(text, ";\n");
+    return make_expr(kind, "t%d", id);
+}
+
+
+
+
+/***********************************************************
+* Function: escape_string
+* Description: writes a Clock string as the body of a C string literal.
+* Parameters: TextBuffer* out, const char* s
+* Return: void
+* ***********************************************************/
+static void escape_string(TextBuffer* out, const char* s) {
+    for (const unsigned char* p = (const unsigned char*)s; *p; p++) {
+        switch (*p) {
+        case '\\': text_append(out, "\\\\"); break;
+        case '"':  text_append(out, "\\\""); break;
+        case '\n': text_append(out, "\\n"); break;
+        case '\t': text_append(out, "\\t"); break;
+        case '\r': text_append(out, "\\r"); break;
+        case '?':  text_append(out, "\\?"); break;   // No trigraphs
+        default:
+            if (*p < 0x20 || *p >= 0x7f) text_append(out, "\\%03o", *p);
+            else text_append(out, "%c", *p);
+            break;
+        }
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: emit_load / emit_store
+* Description: reads or writes a variable. Reading a global that holds null prints
+* the warning of the VM (it was never assigned), a local that hides a global reads the
+* global until it is assigned.
+* Parameters: const char* name / const char* name, const CExpr* value, const ASTNode* node
+* Return: CExpr / void
+* ***********************************************************/
+static CExpr emit_load(const char* name) {
+    bool global = is_global(current, name);
+    EmitVariable* variable = resolve_variable(current, name, false);
+    if (variable->native) {
+        return make_expr(variable->kind, "%s", variable->cname);
+    }
+    if (variable->hides_global) {
+        const EmitVariable* hidden = find_variable(program, name);
+        emit_line("if (%s.type == RUNTIME_VALUE_UNSET && %s.type == RUNTIME_VALUE_NULL) clk_global_not_found(\"%s\");",
+            variable->cname, hidden->cname, name);
+        return emit_temp(KIND_VALUE, "%s.type != RUNTIME_VALUE_UNSET ? %s : %s", variable->cname, variable->cname, hidden->cname);
+    }
+    if (global) {
+        emit_line("if (%s.type == RUNTIME_VALUE_NULL) clk_global_not_found(\"%s\");", variable->cname, variable->name);
+    }
+    return make_expr(KIND_VALUE, "%s", variable->cname);
+}
+
+static void emit_store(const char* name, const CExpr* value, const ASTNode* node) {
+    EmitVariable* variable = resolve_variable(current, name, true);
+    char box[EMIT_BOX_SIZE];
+    if (!variable->native) {
+        emit_line("%s = %s;", variable->cname, boxed(value, box));
+    }
+    else if (variable->kind == value->kind) {
+        emit_line("%s = %s;", variable->cname, value->text);
+    }
+    else {
+        emit_error(node, "internal error: type inference mismatch.");
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: operator_code
+* Description: the CLK_ operator constant of the prelude for a Clock operator.
+* Parameters: const char* op
+* Return: const char*
+* ***********************************************************/
+static const char* operator_code(const char* op) {
+    static const char* const names[][2] = {
+        { "+", "CLK_ADD" }, { "-", "CLK_SUBTRACT" }, { "*", "CLK_MULTIPLY" }, { "/", "CLK_DIVIDE" },
+        { "%", "CLK_MODULO" }, { "<", "CLK_LESS" }, { ">", "CLK_GREATER" }, { "<=", "CLK_LESS_EQUAL" },
+        { ">=", "CLK_GREATER_EQUAL" }, { "==", "CLK_EQUAL" }, { "!=", "CLK_NOT_EQUAL" },
+        { "&&", "CLK_AND" }, { "||", "CLK_OR" }
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(names[i][0], op) == 0) return names[i][1];
+    }
+    return NULL;
+}
+
+
+
+
+/***********************************************************
+* Function: emit_binary
+* Description: applies a binary operator to two evaluated operands. Native operands
+* use plain C when the result is the VM's for any value, the rest calls the prelude.
+* Parameters: const char* op, const CExpr* left, const CExpr* right, const ASTNode* right_node
+* Return: CExpr
+* ***********************************************************/
+static CExpr emit_binary(const char* op, const CExpr* left, const CExpr* right, const ASTNode* right_node) {
+    const char* code = operator_code(op);
+    char l[EMIT_BOX_SIZE];
+    char r[EMIT_BOX_SIZE];
+    bool both_native = left->kind != KIND_VALUE && right->kind != KIND_VALUE;
+
+    if (!code) {
+        emit_error(right_node, "unsupported binary operator.");
+        return make_expr(KIND_VALUE, "clk_null()");
+    }
+
+    if (is_arithmetic(op)) {
+        EmitKind kind = binary_kind(op, left->kind, right->kind, right_node);
+        if (kind == KIND_INT || kind == KIND_FLOAT) {
+            return emit_temp(kind, "%s %s %s", left->text, op, right->text);
+        }
+        return emit_temp(KIND_VALUE, "clk_arith(%s, %s, %s)", code, boxed(left, l), boxed(right, r));
+    }
+
+    // Comparisons, && and ||: values of different types never compare
+    bool logical = strcmp(op, "&&") == 0 || strcmp(op, "||") == 0;
+    if (both_native && left->kind != right->kind) {
+        return make_expr(KIND_BOOL, "false");
+    }
+    if (both_native && logical) {
+        if (left->kind != KIND_BOOL) return make_expr(KIND_BOOL, "false");
+        return emit_temp(KIND_BOOL, "%s %s %s", left->text, op, right->text);
+    }
+    if (both_native && left->kind == KIND_INT) {
+        return emit_temp(KIND_BOOL, "%s %s %s", left->text, op, right->text);
+    }
+    if (both_native && left->kind == KIND_FLOAT) {
+        // Through the ordering like vm_compare, so NaN compares the same way
+        return emit_temp(KIND_BOOL, "clk_order(%s, %s) %s 0", left->text, right->text, op);
+    }
+    if (both_native && left->kind == KIND_BOOL) {
+        if (strcmp(op, "==") != 0 && strcmp(op, "!=") != 0) return make_expr(KIND_BOOL, "false");
+        return emit_temp(KIND_BOOL, "%s %s %s", left->text, op, right->text);
+    }
+    return emit_temp(KIND_BOOL, "clk_compare(%s, %s, %s)", code, boxed(left, l), boxed(right, r));
+}
+
+
+
+
+static CExpr emit_expression(const ASTNode* node);
+
+/***********************************************************
+* Function: emit_operands
+* Description: evaluates the values of a call or an array literal in order
+* (each child may be a comma separated list) as RuntimeValues.
+* Parameters: const ASTNode* node, TextBuffer* values, int* count
+* Return: void
+* ***********************************************************/
+static void emit_operands(const ASTNode* node, TextBuffer* values, int* count) {
+    if (!node) return;
+    if (node->type == AST_BINARY_EXPR && node->operator_ && strcmp(node->operator_, ",") == 0) {
+        emit_operands(node->children[0], values, count);
+        emit_operands(node->children[1], values, count);
+        return;
+    }
+
+    CExpr value = emit_expression(node);
+    char box[EMIT_BOX_SIZE];
+    text_append(values, "%s%s", *count ? ", " : "", boxed(&value, box));
+    (*count)++;
+}
+
+static CExpr emit_operand_array(const ASTNode* const* nodes, size_t node_count, int* count) {
+    TextBuffer values = { 0 };
+    *count = 0;
+    for (size_t i = 0; i < node_count; i++) {
+        emit_operands(nodes[i], &values, count);
+    }
+    if (*count == 0) {
+        free(values.data);
+        return make_expr(KIND_VALUE, "clk_no_args");
+    }
+
+    int id = temp_count++;
+    emit_line("RuntimeValue t%d[%d] = { %s };", id, *count, values.data);
+    free(values.data);
+    return make_expr(KIND_VALUE, "t%d", id);
+}
+
+
+
+
+/***********************************************************
+* Function: emit_self_tail_call
+* Description: a call of the current function in tail position reuses its frame, like
+* the VM does: the arguments become the parameters, the other locals and the functions
+* it declared start over, and the body runs again from the top.
+* Parameters: const CExpr* args, int count
+* Return: void
+* ***********************************************************/
+static void emit_self_tail_call(const CExpr* args, int count) {
+    for (int i = 0; i < current->param_count; i++) {
+        if (i < count) emit_line("%s = %s[%d];", current->variables[i]->cname, args->text, i);
+        else emit_line("%s = clk_null();", current->variables[i]->cname);
+    }
+    for (size_t i = (size_t)current->param_count; i < current->variable_count; i++) {
+        const EmitVariable* variable = current->variables[i];
+        if (!variable->native) emit_line("%s = %s;", variable->cname, variable->hides_global ? "clk_unset()" : "clk_null()");
+    }
+    for (size_t i = 0; i < binding_count; i++) {
+        if (bindings[i]->scope == current) emit_line("%s = NULL;", bindings[i]->cname);
+    }
+    emit_line("goto clk_start;");
+    current->tail_loop = true;
+}
+
+
+
+
+/***********************************************************
+* Function: builtin_cname
+* Description: the variable holding a built in function looked up by name when the program starts.
+* Parameters: const char* name
+* Return: char* (owned by the list of built in names)
+* ***********************************************************/
+static const char* builtin_cname(const char* name) {
+    for (size_t i = 0; i < builtin_count; i++) {
+        if (strcmp(builtin_names[i], name) == 0) return builtin_names[i];
+    }
+    builtin_names = (char**)realloc(builtin_names, (builtin_count + 1) * sizeof(char*));
+    if (!builtin_names) {
+        fprintf(stderr, "Memory allocation failed during C generation.\n");
+        exit(EXIT_FAILURE);
+    }
+    builtin_names[builtin_count] = emit_format("%s", name);
+    return builtin_names[builtin_count++];
+}
+
+
+
+
+/***********************************************************
+* Function: emit_call
+* Description: calls a function by name. The declarations the name can refer to are
+* tried from the innermost scope out, then the built in functions, which is the
+* environment chain the VM looks the name up in. With `tail` the caller returns the
+* result: calls of functions the caller didn't declare then reuse its frame.
+* Parameters: const ASTNode* node, bool tail
+* Return: CExpr
+* ***********************************************************/
+static CExpr emit_call(const ASTNode* node, bool tail) {
+    const ASTNode* name_node = node->child_count > 0 ? node->children[0] : NULL;
+    if (!name_node || name_node->type != AST_IDENTIFIER) {
+        emit_error(node, "invalid function identifier in call.");
+        return make_expr(KIND_VALUE, "clk_null()");
+    }
+    const char* name = name_node->operator_;
+    const char* caller = current->parent ? current->name : "<main>";
+
+    int count = 0;
+    CExpr args = emit_operand_array((const ASTNode* const*)node->children + 1, node->child_count - 1, &count);
+    int result = temp_count++;
+    emit_line("RuntimeValue t%d;", result);
+
+    bool chained = false;
+    for (EmitFunction* scope = current; scope; scope = scope->parent) {
+        EmitBinding* binding = find_binding(scope, name);
+        if (!binding) continue;
+
+        emit_line("%sif (%s) {", chained ? "else " : "", binding->cname);
+        indent_level++;
+        const char* callee = binding->only ? binding->only->cname : binding->cname;
+        if (tail && binding->scope != current && binding->only == current) {
+            emit_self_tail_call(&args, count);
+        }
+        else if (tail && binding->scope != current) {
+            // The caller runs it once this frame is gone (the C stack doesn't grow)
+            emit_line("return clk_tail(%s, %s, %d);", callee, args.text, count);
+        }
+        else {
+            emit_line("clk_enter(\"%s\");", caller);
+            emit_line("t%d = clk_finish(%s(%s, %d));", result, callee, args.text, count);
+        }
+        indent_level--;
+        emit_line("}");
+        chained = true;
+    }
+
+    const char* builtin = builtin_cname(name);
+    if (chained) {
+        emit_line("else {");
+        indent_level++;
+    }
+    emit_line("t%d = clk_call_builtin(clk_builtin_%s, \"%s\", %s, %d);", result, builtin, name, args.text, count);
+    if (chained) {
+        indent_level--;
+        emit_line("}");
+    }
+    return make_expr(KIND_VALUE, "t%d", result);
+}
+
+
+
+
+/***********************************************************
+* Function: emit_expression
+* Description: evaluates an expression into a CExpr, writing the statements it needs.
+* Parameters: const ASTNode* node
+* Return: CExpr
+* ***********************************************************/
+static CExpr emit_expression(const ASTNode* node) {
+    if (!node) {
+        emit_error(NULL, "missing expression.");
+        return make_expr(KIND_VALUE, "clk_null()");
+    }
+
+    switch (node->type) {
+    case AST_LITERAL:
+        if (node->value_kind == VALUE_INT) return make_expr(KIND_INT, "%ldL", node->value.int_val);
+        if (node->value_kind == VALUE_BOOL) return make_expr(KIND_BOOL, node->value.bool_val ? "true" : "false");
+        if (node->value_kind == VALUE_FLOAT) {
+            double f = node->value.float_val;
+            if (isinf(f)) return make_expr(KIND_FLOAT, f > 0 ? "HUGE_VAL" : "-HUGE_VAL");
+            return make_expr(KIND_FLOAT, "%a", f);   // Hexadecimal, so the constant is exact
+        }
+        if (node->value_kind == VALUE_STRING) {
+            TextBuffer literal = { 0 };
+            escape_string(&literal, node->value.str_val ? node->value.str_val : "");
+            CExpr value = emit_temp(KIND_VALUE, "clk_string(\"%s\")", literal.data ? literal.data : "");
+            free(literal.data);
+            return value;
+        }
+        emit_error(node, "unsupported literal type.");
+        return make_expr(KIND_VALUE, "clk_null()");
+
+    case AST_IDENTIFIER:
+        return emit_load(node->operator_);
+
+    case AST_BINARY_EXPR: {
+        if (node->child_count < 2 || strcmp(node->operator_, ",") == 0) {
+            emit_error(node, "unsupported expression.");
+            return make_expr(KIND_VALUE, "clk_null()");
+        }
+
+        // a[i] = v: the assigned value is the value of the expression
+        if (strcmp(node->operator_, "=") == 0) {
+            const ASTNode* access = node->children[0];
+            if (!access || access->type != AST_ARRAY_ACCESS || access->child_count < 2) {
+                emit_error(node, "invalid array assignment.");
+                return make_expr(KIND_VALUE, "clk_null()");
+            }
+            CExpr array = emit_expression(access->children[0]);
+            CExpr index = emit_expression(access->children[1]);
+            CExpr value = emit_expression(node->children[1]);
+            char a[EMIT_BOX_SIZE], i[EMIT_BOX_SIZE], v[EMIT_BOX_SIZE];
+            emit_line("clk_array_set(%s, %s, %s);", boxed(&array, a), boxed(&index, i), boxed(&value, v));
+            return value;
+        }
+
+        CExpr left = emit_expression(node->children[0]);
+        CExpr right = emit_expression(node->children[1]);
+        return emit_binary(node->operator_, &left, &right, node->children[1]);
+    }
+
+    case AST_UNARY_EXPR: {
+        if (node->child_count < 1) {
+            emit_error(node, "invalid unary expression.");
+            return make_expr(KIND_VALUE, "clk_null()");
+        }
+        CExpr operand = emit_expression(node->children[0]);
+        const char* op = node->operator_;
+        if (strcmp(op, "!") == 0) {
+            if (operand.kind == KIND_BOOL) return emit_temp(KIND_BOOL, "!%s", operand.text);
+            if (operand.kind == KIND_INT) return emit_temp(KIND_BOOL, "%s == 0", operand.text);
+            if (operand.kind == KIND_FLOAT) return make_expr(KIND_BOOL, "true");
+            return emit_temp(KIND_BOOL, "clk_not(%s)", operand.text);
+        }
+        if (strcmp(op, "-") != 0 && strcmp(op, "~") != 0) {
+            emit_error(node, "unsupported unary operator.");
+            return make_expr(KIND_VALUE, "clk_null()");
+        }
+        EmitKind kind = unary_kind(op, operand.kind);
+        if (kind == KIND_INT || kind == KIND_FLOAT) return emit_temp(kind, "%s%s", op, operand.text);
+        char box[EMIT_BOX_SIZE];
+        return emit_temp(KIND_VALUE, "clk_unary(%s, %s)", strcmp(op, "-") == 0 ? "CLK_NEGATE" : "CLK_BIT_NOT",
+            boxed(&operand, box));
+    }
+
+    case AST_FUNCTION_CALL:
+        return emit_call(node, false);
+
+    case AST_ARRAY_LITERAL: {
+        int count = 0;
+        CExpr values = emit_operand_array((const ASTNode* const*)node->children, node->child_count, &count);
+        return emit_temp(KIND_VALUE, "clk_array(%s, %d)", values.text, count);
+    }
+
+    case AST_ARRAY_ACCESS: {
+        if (node->child_count < 2) {
+            emit_error(node, "invalid array access.");
+            return make_expr(KIND_VALUE, "clk_null()");
+        }
+        CExpr array = emit_expression(node->children[0]);
+        CExpr index = emit_expression(node->children[1]);
+        char a[EMIT_BOX_SIZE], i[EMIT_BOX_SIZE];
+        return emit_temp(KIND_VALUE, "clk_array_get(%s, %s)", boxed(&array, a), boxed(&index, i));
+    }
+
+    default:
+        emit_error(node, "unsupported expression.");
+        return make_expr(KIND_VALUE, "clk_null()");
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: begin_loop / end_loop
+* Description: open a loop (or switch) for `stop` and `continue`, and write the exit
+* label after it if a `stop` jumped there.
+* Parameters: const ASTNode* node, bool is_switch / void
+* Return: EmitLoop* / void
+* ***********************************************************/
+static EmitLoop* begin_loop(const ASTNode* node, bool is_switch) {
+    if (loop_depth >= EMIT_MAX_LOOP_DEPTH) {
+        emit_error(node, "loops nested too deeply.");
+        loop_depth = EMIT_MAX_LOOP_DEPTH - 1;
+    }
+    EmitLoop* loop = &loops[loop_depth++];
+    loop->is_switch = is_switch;
+    loop->label = label_count++;
+    loop->break_used = false;
+    loop->continue_used = false;
+    return loop;
+}
+
+static void end_loop(void) {
+    EmitLoop* loop = &loops[--loop_depth];
+    if (loop->break_used) emit_line("clk_break%d: ;", loop->label);
+}
+
+
+
+
+static void emit_statement(const ASTNode* node);
+
+/***********************************************************
+* Function: emit_body
+* Description: writes a statement as the body of an if, loop or case.
+* Parameters: const ASTNode* node
+* Return: void
+* ***********************************************************/
+static void emit_body(const ASTNode* node) {
+    indent_level++;
+    emit_statement(node);
+    indent_level--;
+}
+
+
+
+
+/***********************************************************
+* Function: emit_for
+* Description: `for (a to b)`: the counter and the limit live in the hidden variables of
+* the bytecode generator, the limit is evaluated once and the counter goes up by one
+* while it is lower than the limit. `for (i = a to b)` copies the counter to i before
+* each run of the body. `continue` jumps to the increment.
+* Parameters: const ASTNode* node
+* Return: void
+* ***********************************************************/
+static void emit_for(const ASTNode* node) {
+    char counter[32];
+    char limit[32];
+    hidden_name(counter, sizeof(counter), "for", loop_depth);
+    hidden_name(limit, sizeof(limit), "end", loop_depth);
+
+    CExpr start = emit_expression(node->children[0]);
+    emit_store(counter, &start, node);
+    CExpr end = emit_expression(node->children[1]);
+    emit_store(limit, &end, node);
+
+    EmitLoop* loop = begin_loop(node, false);
+    int label = loop->label;
+    emit_line("for (;;) {");
+    indent_level++;
+    CExpr count = emit_load(counter);
+    CExpr bound = emit_load(limit);
+    CExpr more = emit_binary("<", &count, &bound, NULL);
+    emit_line("if (!(%s)) break;", more.text);
+    if (node->operator_) emit_store(node->operator_, &count, node);
+    indent_level--;
+
+    emit_body(node->children[2]);
+
+    indent_level++;
+    if (loops[loop_depth - 1].continue_used) emit_line("clk_continue%d: ;", label);
+    CExpr current_count = emit_load(counter);
+    CExpr one = make_expr(KIND_INT, "1L");
+    CExpr next = emit_binary("+", &current_count, &one, NULL);
+    emit_store(counter, &next, node);
+    indent_level--;
+    emit_line("}");
+    end_loop();
+}
+
+
+
+
+/***********************************************************
+* Function: emit_while
+* Description: the condition is tested at the top of every iteration.
+* Parameters: const ASTNode* node
+* Return: void
+* ***********************************************************/
+static void emit_while(const ASTNode* node) {
+    if (node->child_count != 2) {
+        emit_error(node, "invalid 'while' loop.");
+        return;
+    }
+
+    EmitLoop* loop = begin_loop(node, false);
+    int label = loop->label;
+    emit_line("for (;;) {");
+    indent_level++;
+    CExpr condition = emit_expression(node->children[0]);
+    char test[EMIT_BOX_SIZE];
+    emit_line("if (!(%s)) break;", truth(&condition, test));
+    indent_level--;
+
+    emit_body(node->children[1]);
+
+    if (loops[loop_depth - 1].continue_used) emit_line("    clk_continue%d: ;", label);
+    emit_line("}");
+    end_loop();
+}
+
+
+
+
+/***********************************************************
+* Function: int_case_value
+* Description: the value of a `when` case that is an int literal, optionally negated.
+* Parameters: const ASTNode* value, long* out
+* Return: bool (false for any other case)
+* ***********************************************************/
+static bool int_case_value(const ASTNode* value, long* out) {
+    if (value && value->type == AST_LITERAL && value->value_kind == VALUE_INT) {
+        *out = value->value.int_val;
+        return true;
+    }
+    if (value && value->type == AST_UNARY_EXPR && value->operator_ && strcmp(value->operator_, "-") == 0 &&
+        value->child_count == 1 && value->children[0] &&
+        value->children[0]->type == AST_LITERAL && value->children[0]->value_kind == VALUE_INT) {
+        *out = -value->children[0]->value.int_val;
+        return true;
+    }
+    return false;
+}
+
+
+
+
+/***********************************************************
+* Function: emit_int_switch
+* Description: a switch whose cases are all int constants becomes a C switch (a jump
+* table, like OP_SWITCH_ on the VM). Only an int selector can match, and only the
+* first of equal cases.
+* Parameters: const ASTNode* node, const CExpr* selector, EmitLoop* loop
+* Return: void
+* ***********************************************************/
+static void emit_int_switch(const ASTNode* node, const CExpr* selector, EmitLoop* loop) {
+    int index = loop_depth - 1;
+    if (selector->kind == KIND_VALUE) {
+        emit_line("if (%s.type == RUNTIME_VALUE_INT) {", selector->text);
+        indent_level++;
+        emit_line("switch (%s.int_val) {", selector->text);
+    }
+    else {
+        emit_line("switch (%s) {", selector->text);
+    }
+
+    for (size_t i = 1; i < node->child_count; i++) {
+        const ASTNode* c = node->children[i];
+        if (!c || c->type != AST_WHEN || c->child_count < 1) continue;
+
+        long value = 0;
+        int_case_value(c->children[0], &value);
+        bool duplicate = false;
+        for (size_t k = 1; k < i && !duplicate; k++) {
+            const ASTNode* earlier = node->children[k];
+            long earlier_value = 0;
+            duplicate = earlier && earlier->type == AST_WHEN && earlier->child_count > 0 &&
+                int_case_value(earlier->children[0], &earlier_value) && earlier_value == value;
+        }
+        if (duplicate) continue;
+
+        emit_line("case %ldL: {", value);
+        indent_level++;
+        for (size_t j = 1; j < c->child_count; j++) {
+            emit_statement(c->children[j]);
+        }
+        emit_line("goto clk_break%d;", loop->label);
+        loops[index].break_used = true;
+        indent_level--;
+        emit_line("}");
+    }
+    emit_line("default:");
+    emit_line("    break;");
+    emit_line("}");
+    if (selector->kind == KIND_VALUE) {
+        indent_level--;
+        emit_line("}");
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: emit_switch
+* Description: the selector is evaluated once and compared with == to each case in
+* order, the default runs when none matched. `stop` leaves the switch, `continue`
+* belongs to the enclosing loop. Int constant cases go through emit_int_switch.
+* Parameters: const ASTNode* node
+* Return: void
+* ***********************************************************/
+static void emit_switch(const ASTNode* node) {
+    CExpr selector = emit_expression(node->children[0]);
+
+    // A native int selector, or a value that may hold one, against int constants only
+    bool int_cases = selector.kind == KIND_INT || selector.kind == KIND_VALUE;
+    for (size_t i = 1; i < node->child_count && int_cases; i++) {
+        const ASTNode* c = node->children[i];
+        long value;
+        if (c && c->type == AST_WHEN) int_cases = c->child_count > 0 && int_case_value(c->children[0], &value);
+    }
+
+    const ASTNode* default_node = NULL;
+    for (size_t i = 1; i < node->child_count; i++) {
+        const ASTNode* c = node->children[i];
+        if (!c) continue;
+        if (c->type == AST_DEFAULT) default_node = c;
+        else if (c->type != AST_WHEN) emit_error(c, "invalid node type inside switch.");
+    }
+
+    EmitLoop* loop = begin_loop(node, true);
+    int index = loop_depth - 1;
+    if (int_cases) emit_int_switch(node, &selector, loop);
+    for (size_t i = 1; i < node->child_count && !int_cases; i++) {
+        const ASTNode* c = node->children[i];
+        if (!c || c->type != AST_WHEN || c->child_count < 1) continue;
+
+        emit_line("{");
+        indent_level++;
+        CExpr value = emit_expression(c->children[0]);
+        CExpr match = emit_binary("==", &selector, &value, c->children[0]);
+        emit_line("if (%s) {", match.text);
+        indent_level++;
+        for (size_t j = 1; j < c->child_count; j++) {
+            emit_statement(c->children[j]);
+        }
+        emit_line("goto clk_break%d;", loop->label);
+        loops[index].break_used = true;
+        indent_level--;
+        emit_line("}");
+        indent_level--;
+        emit_line("}");
+    }
+    if (default_node) {
+        for (size_t i = 0; i < default_node->child_count; i++) {
+            emit_statement(default_node->children[i]);
+        }
+    }
+    end_loop();
+}
+
+
+
+
+/***********************************************************
+* Function: emit_loop_jump
+* Description: `stop` leaves the innermost loop or switch. `continue` goes to the
+* innermost loop, or to the end of the outermost switch when there is no loop.
+* Parameters: const ASTNode* node
+* Return: void
+* ***********************************************************/
+static void emit_loop_jump(const ASTNode* node) {
+    if (loop_depth == 0) {
+        char message[64];
+        snprintf(message, sizeof(message), "'%s' used outside of a loop.", node->type == AST_BREAK ? "stop" : "continue");
+        emit_error(node, message);
+        return;
+    }
+
+    if (node->type == AST_BREAK) {
+        loops[loop_depth - 1].break_used = true;
+        emit_line("goto clk_break%d;", loops[loop_depth - 1].label);
+        return;
+    }
+    for (int i = loop_depth - 1; i >= 0; i--) {
+        if (!loops[i].is_switch) {
+            loops[i].continue_used = true;
+            emit_line("goto clk_continue%d;", loops[i].label);
+            return;
+        }
+    }
+    loops[0].break_used = true;
+    emit_line("goto clk_break%d;", loops[0].label);
+}
+
+
+
+
+/***********************************************************
+* Function: emit_return
+* Description: inside a function returns the value (a returned call is a tail call),
+* at the top level stops the program with it as the master return value.
+* Parameters: const ASTNode* node
+* Return: void
+* ***********************************************************/
+static void emit_return(const ASTNode* node) {
+    CExpr value = make_expr(KIND_VALUE, "clk_null()");
+    if (node->child_count > 0) {
+        const ASTNode* child = node->children[0];
+        bool tail = current->parent && child && child->type == AST_FUNCTION_CALL;
+        value = tail ? emit_call(child, true) : emit_expression(child);
+    }
+
+    char box[EMIT_BOX_SIZE];
+    if (current->parent) {
+        emit_line("clk_depth--;");
+        emit_line("return %s;", boxed(&value, box));
+    }
+    else {
+        emit_line("clk_returned = true;");
+        emit_line("clk_return_value = %s;", boxed(&value, box));
+        emit_line("return;");
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: emit_statement
+* Description: writes one statement.
+* Parameters: const ASTNode* node
+* Return: void
+* ***********************************************************/
+static void emit_statement(const ASTNode* node) {
+    if (!node || failed) return;
+
+    switch (node->type) {
+    case AST_BLOCK:
+        for (size_t i = 0; i < node->child_count; i++) {
+            emit_statement(node->children[i]);
+        }
+        break;
+
+    case AST_ASSIGNMENT: {
+        // Compound assignments (+=, -=, ...) read the variable before the right side
+        const char* name = node->children[0]->operator_;
+        const char* op = compound_operator(node);
+        if (!op && node->operator_ && strcmp(node->operator_, "=") != 0) {
+            emit_error(node, "unsupported assignment operator.");
+            return;
+        }
+        CExpr value;
+        if (op) {
+            CExpr old = emit_load(name);
+            CExpr right = emit_expression(node->children[1]);
+            value = emit_binary(op, &old, &right, node->children[1]);
+        }
+        else {
+            value = emit_expression(node->children[1]);
+        }
+        emit_store(name, &value, node);
+        break;
+    }
+
+    case AST_IF_STATEMENT: {
+        if (node->child_count < 2) {
+            emit_error(node, "invalid 'if' statement.");
+            return;
+        }
+        CExpr condition = emit_expression(node->children[0]);
+        char test[EMIT_BOX_SIZE];
+        emit_line("if (%s) {", truth(&condition, test));
+        emit_body(node->children[1]);
+        if (node->child_count > 2) {
+            emit_line("}");
+            emit_line("else {");
+            emit_body(node->children[2]);
+        }
+        emit_line("}");
+        break;
+    }
+
+    case AST_WHILE_STATEMENT:
+        emit_while(node);
+        break;
+
+    case AST_FOR_STATEMENT:
+        emit_for(node);
+        break;
+
+    case AST_SWITCH:
+        emit_switch(node);
+        break;
+
+    case AST_BREAK:
+    case AST_CONTINUE:
+        emit_loop_jump(node);
+        break;
+
+    case AST_RETURN_STATEMENT:
+        emit_return(node);
+        break;
+
+    case AST_FUNCTION_DECLARATION: {
+        EmitFunction* fn = find_function(node);
+        if (fn) emit_line("%s = %s;", fn->binding->cname, fn->cname);
+        break;
+    }
+
+    case AST_LITERAL:
+    case AST_IDENTIFIER:
+    case AST_BINARY_EXPR:
+    case AST_UNARY_EXPR:
+    case AST_FUNCTION_CALL:
+    case AST_ARRAY_LITERAL:
+    case AST_ARRAY_ACCESS: {
+        CExpr value = emit_expression(node);
+        if (value.text[0] == 't') emit_line("(void)%s;", value.text);   // Result of an expression statement
+        break;
+    }
+
+    default:
+        emit_error(node, "unsupported statement.");
+        break;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: emit_variables
+* Description: declares the variables of a function: parameters from the arguments
+* (missing ones are null, extra ones are dropped), native locals as C scalars and the
+* other locals as null RuntimeValues (unset if they hide a global).
+* Parameters: TextBuffer* out, EmitFunction* fn
+* Return: void
+* ***********************************************************/
+static void emit_variables(TextBuffer* out, EmitFunction* fn) {
+    for (size_t i = 0; i < fn->variable_count; i++) {
+        EmitVariable* variable = fn->variables[i];
+        if (variable->parameter) {
+            text_append(out, "    RuntimeValue %s = argc > %zu ? args[%zu] : clk_null();\n", variable->cname, i, i);
+        }
+        else if (variable->native) {
+            // Globals that stay native are only used by the top level code, so they are its locals
+            text_append(out, "    %s %s = 0;\n", c_type(variable->kind), variable->cname);
+        }
+        else if (fn->parent) {
+            text_append(out, "    RuntimeValue %s = %s;\n", variable->cname, variable->hides_global ? "clk_unset()" : "clk_null()");
+        }
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: emit_function
+* Description: writes the C function of a declaration, or the top level program.
+* Parameters: TextBuffer* out, EmitFunction* fn
+* Return: void
+* ***********************************************************/
+static void emit_function(TextBuffer* out, EmitFunction* fn) {
+    TextBuffer body = { 0 };
+    current = fn;
+    text = &body;
+    indent_level = 1;
+    temp_count = 0;
+    loop_depth = 0;
+
+    const ASTNode* statements = fn->parent ? fn->node->children[fn->node->child_count - 1] : fn->node;
+    if (fn->parent) {
+        emit_statement(statements);
+        emit_line("clk_depth--;");
+        emit_line("return clk_null();");
+        text_append(out, "\n/* function %s */\n", fn->name);
+        text_append(out, "static RuntimeValue %s(RuntimeValue* args, size_t argc) {\n", fn->cname);
+    }
+    else {
+        for (size_t i = 0; i < statements->child_count; i++) {
+            emit_statement(statements->children[i]);
+        }
+        text_append(out, "\n/* top level code */\n");
+        text_append(out, "static void clk_program(void) {\n");
+    }
+
+    emit_variables(out, fn);
+    if (fn->tail_loop) text_append(out, "clk_start: ;\n");
+    if (body.data) text_append(out, "%s", body.data);
+    text_append(out, "}\n");
+    free(body.data);
+}
+
+
+
+
+/***********************************************************
+* Function: reset_emitter
+* Description: frees what the last translation allocated.
+* Parameters: void
+* Return: void
+* ***********************************************************/
+static void free_function(EmitFunction* fn) {
+    for (size_t i = 0; i < fn->variable_count; i++) {
+        free(fn->variables[i]->name);
+        free(fn->variables[i]->cname);
+        free(fn->variables[i]);
+    }
+    free(fn->variables);
+    free(fn->cname);
+    free(fn);
+}
+
+static void reset_emitter(void) {
+    for (size_t i = 0; i < function_count; i++) {
+        free_function(functions[i]);
+    }
+    if (program) free_function(program);
+    for (size_t i = 0; i < binding_count; i++) {
+        free(bindings[i]->cname);
+        free(bindings[i]);
+    }
+    for (size_t i = 0; i < builtin_count; i++) {
+        free(builtin_names[i]);
+    }
+    free(functions);
+    free(bindings);
+    free(builtin_names);
+    program = NULL;
+    functions = NULL;
+    bindings = NULL;
+    builtin_names = NULL;
+    function_count = binding_count = builtin_count = 0;
+    current = NULL;
+    text = NULL;
+    label_count = 0;
+    failed = false;
+}
+
+
+
+
+/***********************************************************
+* Function: emit_c_program
+* Description: translates the program to C (see emitC.h).
+* Parameters: const ASTNode* root, const char* source_name, FILE* out
+* Return: bool
+* ***********************************************************/
+bool emit_c_program(const ASTNode* root, const char* source_name, FILE* out) {
+    if (!root || root->type != AST_PROGRAM) {
+        fprintf(stderr, "Cannot translate to C: not a program.\n");
+        return false;
+    }
+    reset_emitter();
+
+    program = (EmitFunction*)emit_alloc(sizeof(EmitFunction));
+    program->node = root;
+    program->name = "<main>";
+    program->cname = emit_format("clk_program");
+    analyze_node(root, program, 0);
+    if (!failed) {
+        find_hidden_globals();
+        infer_types();
+    }
+
+    // The functions and the top level code first: they decide which built ins are needed
+    TextBuffer code = { 0 };
+    for (size_t i = 0; i < function_count && !failed; i++) {
+        emit_function(&code, functions[i]);
+    }
+    if (!failed) emit_function(&code, program);
+    if (failed) {
+        free(code.data);
+        reset_emitter();
+        return false;
+    }
+
+    TextBuffer file = { 0 };
+    text_append(&file, "/* Generated by cllc --emit-c from %s.\n", source_name ? source_name : "<input>");
+    text_append(&file, " * Build: gcc -O2 -I<clock>/include this.c <clock>/src/runtimeValue.c <clock>/src/runtimeEnv.c -lm\n");
+    text_append(&file, " * (or link against the libclockrt.a of `make runtime`). */\n\n");
+    for (size_t i = 0; prelude[i]; i++) {
+        text_append(&file, "%s\n", prelude[i]);
+    }
+
+    // Globals that can change type (and those functions read) stay RuntimeValues
+    text_append(&file, "\n/* globals */\n");
+    for (size_t i = 0; i < program->variable_count; i++) {
+        if (!program->variables[i]->native) {
+            text_append(&file, "static RuntimeValue %s = { .type = RUNTIME_VALUE_NULL };\n", program->variables[i]->cname);
+        }
+    }
+    text_append(&file, "\n/* function bindings and built ins */\n");
+    for (size_t i = 0; i < binding_count; i++) {
+        text_append(&file, "static ClockFunction %s;\n", bindings[i]->cname);
+    }
+    for (size_t i = 0; i < builtin_count; i++) {
+        text_append(&file, "static ClockFunction clk_builtin_%s;\n", builtin_names[i]);
+    }
+    text_append(&file, "\n");
+    for (size_t i = 0; i < function_count; i++) {
+        text_append(&file, "static RuntimeValue %s(RuntimeValue* args, size_t argc);\n", functions[i]->cname);
+    }
+    text_append(&file, "%s", code.data ? code.data : "");
+
+    text_append(&file, "\nint main(void) {\n");
+    text_append(&file, "    clk_builtins = create_environment(NULL);\n");
+    text_append(&file, "    if (!clk_builtins) {\n");
+    text_append(&file, "        fprintf(stderr, \"Memory allocation failed for the globals.\\n\");\n");
+    text_append(&file, "        return EXIT_FAILURE;\n");
+    text_append(&file, "    }\n");
+    text_append(&file, "    built_in_functions(clk_builtins);\n");
+    text_append(&file, "    (void)clk_no_args;\n");
+    for (size_t i = 0; i < builtin_count; i++) {
+        text_append(&file, "    clk_builtin_%s = clk_builtin(\"%s\");\n", builtin_names[i], builtin_names[i]);
+    }
+    text_append(&file, "\n    printf(\"\\033[0;36m\\n\");\n");
+    text_append(&file, "    printf(\"Program Output: \\n\\n\");\n");
+    text_append(&file, "    clk_program();\n");
+    text_append(&file, "    clk_print_return();\n");
+    text_append(&file, "    return 0;\n");
+    text_append(&file, "}\n");
+
+    bool written = fwrite(file.data, 1, file.length, out) == file.length;
+    free(file.data);
+    free(code.data);
+    reset_emitter();
+    if (!written) {
+        fprintf(stderr, "Error writing the C file.\n");
+    }
+    return written;
+}
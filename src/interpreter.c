@@ -13,7 +13,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <setjmp.h>
 #include "Interpreter.h"  
+#include "resolver.h"
+
+// Arguments and locals of the active calls: a call only moves value_stack_top
+static RuntimeValue value_stack[INTERPRETER_STACK_SIZE];
+static size_t value_stack_top = 0;
+
+// Tail call left by a return statement, eval_user_function_call runs it in the same frame
+static bool tail_call_pending = false;
+static RuntimeValue tail_callee;
+static size_t tail_arg_count = 0;
+
+// Nested user function calls, a call past INTERPRETER_MAX_CALL_DEPTH stops the program through program_abort
+static size_t call_depth = 0;
+static jmp_buf program_abort;
 
 
 
@@ -28,7 +43,7 @@ void print_return(RuntimeEnvironment* env) {
 
     // change print color to vibrant yellow
     printf("\033[0;93m\n");
-    if (env->function_returned) {
+    if (env->completion == COMPLETION_RETURN) {
         printf("Clock Returned: ");
         if (env->return_value.type == RUNTIME_VALUE_INT) {
             printf("%ld\n", env->return_value.int_val);
@@ -56,6 +71,53 @@ void print_return(RuntimeEnvironment* env) {
 
 
 
+/***********************************************************
+* Function: variable_slot
+* Description: This function finds the value of a variable the resolver placed (see VariableScope).
+* Parameters: const ASTNode* node, RuntimeEnvironment* env
+* Return: RuntimeValue* (NULL if the variable is looked up by name)
+***********************************************************/
+static RuntimeValue* variable_slot(const ASTNode* node, RuntimeEnvironment* env) {
+    switch (node->scope) {
+    case SCOPE_LOCAL:
+        return &env->slots[node->slot];
+    case SCOPE_UPVALUE:
+        return env->upvalues[node->slot];
+    case SCOPE_GLOBAL:
+        return &value_stack[node->slot]; // The globals are the bottom of the value stack
+    default:
+        return NULL;
+    }
+}
+
+
+
+
+
+/***********************************************************
+* Function: read_variable_slot
+* Description: This function finds the value a resolved variable reads: its slot, or the global
+* it hides while the local is unassigned.
+* Parameters: const ASTNode* node, RuntimeEnvironment* env
+* Return: const RuntimeValue* (NULL if the variable has no value, a global holding null was never assigned)
+***********************************************************/
+static const RuntimeValue* read_variable_slot(const ASTNode* node, RuntimeEnvironment* env) {
+    const RuntimeValue* slot = variable_slot(node, env);
+    if (!slot) return NULL;
+
+    if (slot->type == RUNTIME_VALUE_UNSET) {
+        slot = &value_stack[node->global_slot];
+    }
+    else if (node->scope != SCOPE_GLOBAL) {
+        return slot;
+    }
+    return slot->type != RUNTIME_VALUE_NULL ? slot : NULL;
+}
+
+
+
+
+
 /***********************************************************
 * Function: eval_identifier_variable
 * Description: This function evaluates the identifier as a variable.
@@ -70,11 +132,19 @@ RuntimeValue eval_identifier_variable(ASTNode* node, RuntimeEnvironment* env) {
 
     const char* varName = node->operator_;  // The identifier name
 
-    // Search for the variable in the environment
-    RuntimeValue value = env_get_var(env, varName);
-	if (value.type != RUNTIME_VALUE_NULL) {
-		return value;
-	}
+    // Resolved variables are read in place, the others are searched by name
+    if (node->scope != SCOPE_UNRESOLVED) {
+        const RuntimeValue* slot = read_variable_slot(node, env);
+        if (slot) {
+            return *slot;
+        }
+    }
+    else {
+        RuntimeValue value = env_get_var(env, varName);
+        if (value.type != RUNTIME_VALUE_NULL) {
+            return value;
+        }
+    }
 
     // Variable not found
     fprintf(stderr, "Variable '%s' not found in the current environment.\n", varName);
@@ -115,36 +185,75 @@ RuntimeValue eval_function_identifier(ASTNode* node, RuntimeEnvironment* env) {
 * Function: interpret
 * Description: this function interprets the whole program.
 * Parameters: ASTNode* root
-* Return: Void
+* Return: bool (false if a runtime error stopped the program)
 * ***********************************************************/
-void interpret(ASTNode* root) {
+bool interpret(ASTNode* root) {
+    // Give every variable its slot before anything runs
+    resolve_program(root);
+
     // Create a global environment (hash table or similar)
     RuntimeEnvironment* globalEnv = create_environment(NULL);
     built_in_functions(globalEnv);
 
-    // Evaluate the top-level AST (AST_PROGRAM).
-    eval_ast_node(root, globalEnv);
+    // The global variables are the bottom slots of the value stack
+    const ASTNode* globals = root ? root->frame_layout : NULL;
+    if (globals && globals->child_count > 0) {
+        if (globals->child_count > INTERPRETER_STACK_SIZE) {
+            fprintf(stderr, "Runtime Error: too many global variables.\n");
+            free(globalEnv);
+            return false;
+        }
+        for (size_t i = 0; i < globals->child_count; i++) {
+            value_stack[i] = make_null_value();
+        }
+        globalEnv->slots = value_stack;
+        globalEnv->layout = globals;
+        value_stack_top = globals->child_count;
+    }
+
+    // Evaluate the top-level AST (AST_PROGRAM), a call stack overflow unwinds back here
+    call_depth = 0;
+    bool completed = true;
+    if (setjmp(program_abort) == 0) {
+        eval_ast_node(root, globalEnv);
+    }
+    else {
+        completed = false;
+    }
+    tail_call_pending = false;
 
     // environment return value
     print_return(globalEnv);
 
+    value_stack_top = 0;
     free(globalEnv);
+    return completed;
 }
 
 
 
 
 /***********************************************************
-* Function: make_special_value
-* Description: this function prepares a runtime value of type special (return, stop).
-* Parameters: const char* special
-* Return: RuntimeValue
+* Function: end_iteration
+* Description: this function handles how the body of a loop completed. stop ends the loop
+* and continue goes on with the next iteration (both are consumed here), a return is left
+* for the function call.
+* Parameters: RuntimeEnvironment* env
+* Return: bool (true if the loop goes on)
 * ***********************************************************/
-RuntimeValue make_special_value(const char* special) {
-    RuntimeValue value = make_null_value();
-    value.type = RUNTIME_VALUE_SPECIAL;
-    value.special_val = special;
-    return value;
+static bool end_iteration(RuntimeEnvironment* env) {
+    switch (env->completion) {
+    case COMPLETION_NORMAL:
+        return true;
+    case COMPLETION_CONTINUE:
+        env->completion = COMPLETION_NORMAL;
+        return true;
+    case COMPLETION_BREAK:
+        env->completion = COMPLETION_NORMAL;
+        return false;
+    default:
+        return false;
+    }
 }
 
 
@@ -161,9 +270,6 @@ RuntimeValue eval_ast_node(ASTNode* node, RuntimeEnvironment* env) {
         return make_null_value();
     }
 
-    if (env->function_returned) {
-        return env->return_value;
-    }
     switch (node->type) {
     case AST_PROGRAM:
         return eval_program(node, env); // Evaluate the program
@@ -208,7 +314,12 @@ RuntimeValue eval_ast_node(ASTNode* node, RuntimeEnvironment* env) {
         return eval_array_access(node, env); // Evaluate array access
 
     case AST_BREAK:
-        return make_special_value("stop"); // Stop the current loop
+        env->completion = COMPLETION_BREAK; // Stop the current loop or switch
+        return make_null_value();
+
+    case AST_CONTINUE:
+        env->completion = COMPLETION_CONTINUE; // Next iteration of the current loop
+        return make_null_value();
 
     case AST_FUNCTION_CALL:
 		env->is_Function = true;
@@ -219,14 +330,7 @@ RuntimeValue eval_ast_node(ASTNode* node, RuntimeEnvironment* env) {
         return eval_function_declaration(node, env); // Evaluate function declarations
 
     case AST_RETURN_STATEMENT:
-        if (env->parent == NULL) {
-            ASTNode* returnExpressionNode = find_next_node_after_return(node);
-            RuntimeValue resultValue = eval_ast_node(returnExpressionNode, env);
-            env->return_value = resultValue;
-            env->function_returned = true;
-            return resultValue;           // Return the result of the expression
-        }
-        return make_special_value("return"); // Return from the current function
+        return eval_return_statement(node, env); // Return from the current function (or the program)
 
     case AST_SWITCH:
         return eval_switch_statement(node, env); // Evaluate switch statements
@@ -242,62 +346,20 @@ RuntimeValue eval_ast_node(ASTNode* node, RuntimeEnvironment* env) {
 
 
 /***********************************************************
-* Function: eval_when_case
-* Description: this function evaluates the when case of switch statement.
-* Parameters: ASTNode* caseNode, RuntimeValue switchValue, RuntimeEnvironment* env
-* Return: RuntimeValue
+* Function: eval_case_statements
+* Description: this function runs the statements of the selected case of a switch statement
+* until one of them doesn't complete normally. The stop that ends the case is consumed here.
+* Parameters: ASTNode* caseNode, size_t first, RuntimeEnvironment* env
+* Return: void
 * ***********************************************************/
-RuntimeValue eval_when_case(ASTNode* caseNode, RuntimeValue switchValue, RuntimeEnvironment* env) {
-    // Evaluate the "when" condition
-    RuntimeValue caseValue = eval_ast_node(caseNode->children[0], env);
-
-    // Check if the "when" condition matches the switch value
-    if (switchValue.int_val == caseValue.int_val) {
-        // Execute the statements in the matching "when"
-        for (size_t i = 1; i < caseNode->child_count; i++) {
-            RuntimeValue result = eval_ast_node(caseNode->children[i], env);
-
-            // If "stop" is encountered, terminate this case
-            if (result.type == RUNTIME_VALUE_SPECIAL && strcmp(result.special_val, "stop") == 0) {
-                break;
-            }
-
-            // Return the result of the case
-            result = make_special_value("when");
-            return result;
-        }
+static void eval_case_statements(ASTNode* caseNode, size_t first, RuntimeEnvironment* env) {
+    for (size_t i = first; i < caseNode->child_count; i++) {
+        eval_ast_node(caseNode->children[i], env);
+        if (env->completion != COMPLETION_NORMAL) break;
     }
-
-    // No match or no value returned
-    return make_null_value();
-}
-
-
-
-
-/***********************************************************
-* Function: eval_default_case
-* Description: this function evaluates the default case of switch statement.
-* Parameters: ASTNode* defaultNode, RuntimeEnvironment* env
-* Return: RuntimeValue
-* ***********************************************************/
-RuntimeValue eval_default_case(ASTNode* defaultNode, RuntimeEnvironment* env) {
-
-    // Execute the statements in the default case
-    for (size_t i = 0; i < defaultNode->child_count; i++) {
-        RuntimeValue result = eval_ast_node(defaultNode->children[i], env);
-
-        // If "stop" is encountered, terminate the default case
-        if (result.type == RUNTIME_VALUE_SPECIAL && strcmp(result.special_val, "stop") == 0) {
-            break;
-        }
-
-        // Return the result of the default case
-        return result;
+    if (env->completion == COMPLETION_BREAK) {
+        env->completion = COMPLETION_NORMAL;
     }
-
-    // No value returned from default
-    return make_null_value();
 }
 
 
@@ -305,7 +367,8 @@ RuntimeValue eval_default_case(ASTNode* defaultNode, RuntimeEnvironment* env) {
 
 /***********************************************************
 * Function: eval_switch_statement
-* Description: this function evaluates the switch statement.
+* Description: this function evaluates the switch statement. The first "when" whose value
+* matches runs, the default case only runs if none does.
 * Parameters: ASTNode* node, RuntimeEnvironment* env
 * Return: RuntimeValue
 * ***********************************************************/
@@ -313,26 +376,26 @@ RuntimeValue eval_switch_statement(ASTNode* node, RuntimeEnvironment* env) {
 
     // Evaluate the switch expression
     RuntimeValue switchValue = eval_ast_node(node->children[0], env);
-    bool hasDefault = true;
-    // Traverse the "when" cases
+    ASTNode* defaultNode = NULL;
+    // Traverse the "when" cases, the value of a case is its first child
     for (size_t i = 1; i < node->child_count; i++) {
         ASTNode* caseNode = node->children[i];
 
         if (caseNode->type == AST_WHEN) {
-            // Evaluate the "when" case
-            RuntimeValue result = eval_when_case(caseNode, switchValue, env);
-            if (result.type != RUNTIME_VALUE_NULL) {
-                hasDefault = false;
-                return result; // Return the result if a value is produced
+            RuntimeValue caseValue = eval_ast_node(caseNode->children[0], env);
+            if (switchValue.int_val == caseValue.int_val) {
+                eval_case_statements(caseNode, 1, env);
+                return make_null_value();
             }
         }
-        else if (caseNode->type == AST_DEFAULT && hasDefault) {
-            // Evaluate the default case
-            return eval_default_case(caseNode, env);
+        else if (caseNode->type == AST_DEFAULT) {
+            defaultNode = caseNode;
         }
     }
 
-    // If no cases matched and no default exists, return null
+    if (defaultNode) {
+        eval_case_statements(defaultNode, 0, env);
+    }
     return make_null_value();
 }
 
@@ -342,12 +405,13 @@ RuntimeValue eval_switch_statement(ASTNode* node, RuntimeEnvironment* env) {
 
 
 /***********************************************************
-* Function: eval_function_call
-* Description: this function evaluates the function call.
+* Function: resolve_callee
+* Description: this function finds the function a call node calls.
+* The call site remembers a builtin or global callee until a declaration changes what its name resolves to.
 * Parameters: ASTNode* node, RuntimeEnvironment* env
-* Return: RuntimeValue
+* Return: RuntimeValue (null after reporting the error if it is not a function)
 * ***********************************************************/
-RuntimeValue eval_function_call(ASTNode* node, RuntimeEnvironment* env) {
+static RuntimeValue resolve_callee(ASTNode* node, RuntimeEnvironment* env) {
     if (node->child_count < 1) {
         fprintf(stderr, "Runtime Error: No function specified.\n");
         return make_null_value();
@@ -355,7 +419,24 @@ RuntimeValue eval_function_call(ASTNode* node, RuntimeEnvironment* env) {
 
     // Evaluate the function identifier in the current env (not the parent!)
     ASTNode* functionIdentNode = node->children[0];
-    RuntimeValue functionVal = eval_ast_node(functionIdentNode, env);
+    FunctionCache* cache = (FunctionCache*)node->call_cache;
+    RuntimeValue functionVal;
+    if (cache && cache->version == function_definition_version) {
+        functionVal = cache->function;
+    }
+    else {
+        functionVal = eval_ast_node(functionIdentNode, env);
+        if (function_is_cacheable(functionVal)) {
+            if (!cache) {
+                cache = (FunctionCache*)malloc(sizeof(FunctionCache));
+                node->call_cache = cache;
+            }
+            if (cache) {
+                cache->version = function_definition_version;
+                cache->function = functionVal;
+            }
+        }
+    }
 
 
     if (functionVal.type == RUNTIME_VALUE_NULL) {
@@ -369,52 +450,93 @@ RuntimeValue eval_function_call(ASTNode* node, RuntimeEnvironment* env) {
         fprintf(stderr, "Runtime Error: Attempt to call a non-function.\n");
         return make_null_value();
     }
+    return functionVal;
+}
+
+
+
+
+/***********************************************************
+* Function: call_resolved
+* Description: this function evaluates the arguments of a call node and calls the
+* function resolve_callee found for it.
+* Parameters: RuntimeValue functionVal, ASTNode* node, RuntimeEnvironment* env
+* Return: RuntimeValue
+* ***********************************************************/
+static RuntimeValue call_resolved(RuntimeValue functionVal, ASTNode* node, RuntimeEnvironment* env) {
+    if (functionVal.type != RUNTIME_VALUE_BUILTIN &&
+        functionVal.type != RUNTIME_VALUE_FUNCTION)
+    {
+        return make_null_value();
+    }
 
-    // Collect arguments (also from the current env, so we can use local vars!)
+    // Evaluate the arguments straight onto the value stack (also from the current env, so we can use local vars!)
+    size_t base = value_stack_top;
     size_t arg_count = 0;
-    RuntimeValue* args = NULL;
-    if (node->child_count > 1) {
-        ASTNode* argsNode = node->children[1];
-        args = collect_arguments(argsNode, env, &arg_count);
-        if (!args) {
-            fprintf(stderr, "Runtime Error: Failed to evaluate arguments.\n");
-            return make_null_value();
-        }
+    if (!push_arguments(node, env, &arg_count)) {
+        fprintf(stderr, "Runtime Error: Failed to evaluate arguments.\n");
+        value_stack_top = base;
+        return make_null_value();
     }
 
-    // Dispatch user function vs builtin
+    // Dispatch user function vs builtin, the arguments are popped afterwards
+    RuntimeValue* args = &value_stack[base];
+    RuntimeValue result;
     if (functionVal.type == RUNTIME_VALUE_FUNCTION) {
-        return eval_user_function_call(functionVal, args, arg_count);
+        result = eval_user_function_call(functionVal, args, arg_count);
     }
-    else if (functionVal.type == RUNTIME_VALUE_BUILTIN) {
-        RuntimeValue result = functionVal.builtin_val.fn(args, arg_count);
-        free(args);
-        return result;
+    else {
+        result = functionVal.builtin_val.fn(args, arg_count);
     }
+    value_stack_top = base;
 
-    return make_null_value();
+    return result;
 }
 
 
 
 
 /***********************************************************
-* Function: create_param_list_node
-* Description: this function creates a parameter list node.
-* Parameters: ASTNode** paramList, size_t paramCount
-* Return: ASTNode*
+* Function: eval_function_call
+* Description: this function evaluates the function call.
+* Parameters: ASTNode* node, RuntimeEnvironment* env
+* Return: RuntimeValue
 * ***********************************************************/
-ASTNode* create_param_list_node(ASTNode** paramList, size_t paramCount) {
-    ASTNode* paramNode = (ASTNode*)malloc(sizeof(ASTNode));
-    if (!paramNode) {
-        fprintf(stderr, "Memory allocation failed in create_param_list_node\n");
-        exit(EXIT_FAILURE);
+RuntimeValue eval_function_call(ASTNode* node, RuntimeEnvironment* env) {
+    return call_resolved(resolve_callee(node, env), node, env);
+}
+
+
+
+
+/***********************************************************
+* Function: eval_tail_call
+* Description: this function evaluates a call in tail position (see mark_tail_calls).
+* The callee and its arguments are left on the value stack for eval_user_function_call,
+* which runs the call in the frame of the returning function instead of nesting a new one.
+* Builtins and functions declared by the returning call itself are called normally.
+* Parameters: ASTNode* node, RuntimeEnvironment* env
+* Return: RuntimeValue (null when the call was left pending)
+* ***********************************************************/
+static RuntimeValue eval_tail_call(ASTNode* node, RuntimeEnvironment* env) {
+    env->is_Function = true;
+    RuntimeValue functionVal = resolve_callee(node, env);
+    if (functionVal.type != RUNTIME_VALUE_FUNCTION || functionVal.function_val.env == env) {
+        return call_resolved(functionVal, node, env);
     }
-    paramNode->type = AST_PARAMETER_LIST;
-    paramNode->child_count = paramCount;
-    paramNode->children = paramList;
-    // set other fields to defaults (e.g., operator_ = NULL, etc.)
-    return paramNode;
+
+    size_t base = value_stack_top;
+    size_t arg_count = 0;
+    if (!push_arguments(node, env, &arg_count)) {
+        fprintf(stderr, "Runtime Error: Failed to evaluate arguments.\n");
+        value_stack_top = base;
+        return make_null_value();
+    }
+
+    tail_call_pending = true;
+    tail_callee = functionVal;
+    tail_arg_count = arg_count;
+    return make_null_value();
 }
 
 
@@ -446,33 +568,35 @@ RuntimeValue eval_function_declaration(ASTNode* node, RuntimeEnvironment* env) {
     // The LAST child is always the body (AST_BLOCK).
     ASTNode* bodyNode = node->children[node->child_count - 1];
 
-    // Everything between [1..child_count-2] are parameter nodes
-    size_t paramCount = (node->child_count >= 2) ? node->child_count - 2 : 0; // Ensure paramCount is non-negative
-    ASTNode** paramList = NULL;
+    // The resolver built the frame layout: the parameters, then the locals of the body
+    ASTNode* paramsNode = node->frame_layout;
+    if (!paramsNode) {
+        fprintf(stderr, "Error: Function '%s' was not resolved.\n", functionName);
+        return make_null_value();
+    }
 
-    if (paramCount > 0) {
-        paramList = (ASTNode**)malloc(sizeof(ASTNode*) * paramCount);
-        if (!paramList) {
+    // Capture the variables of the enclosing functions the body uses, they stay in their frames
+    const ASTNode* captures = node->upvalue_layout;
+    RuntimeValue** upvalues = NULL;
+    if (captures && captures->child_count > 0) {
+        upvalues = (RuntimeValue**)malloc(sizeof(RuntimeValue*) * captures->child_count);
+        if (!upvalues) {
             fprintf(stderr, "Memory allocation failed in eval_function_declaration.\n");
             exit(EXIT_FAILURE);
         }
-
-        for (size_t i = 0; i < paramCount; i++) {
-            // Ensure we don't access beyond bounds of node->children
-            paramList[i] = (1 + i < node->child_count) ? node->children[1 + i] : NULL;
+        for (size_t i = 0; i < captures->child_count; i++) {
+            upvalues[i] = variable_slot(captures->children[i], env);
         }
     }
 
-    // Create a node for the parameter list
-    ASTNode* paramsNode = create_param_list_node(paramList, paramCount);
-
     // Build the RuntimeValue for the user function
     RuntimeValue functionValue;
     functionValue.type = RUNTIME_VALUE_FUNCTION;
-    functionValue.function_val.fn = NULL;  // user-defined function pointer is null
-    functionValue.function_val.env = env;  // capture current env (closure)
+    functionValue.function_val.env = env;  // functions are looked up from the declaring env
+    functionValue.function_val.upvalues = upvalues;
     functionValue.function_val.body = bodyNode ? bodyNode : NULL;
     functionValue.function_val.parameters = paramsNode ? paramsNode : NULL;
+    functionValue.function_val.code = NULL;
 
     // Insert into the environment
 	env_set_func(env, functionName, functionValue);
@@ -486,40 +610,78 @@ RuntimeValue eval_function_declaration(ASTNode* node, RuntimeEnvironment* env) {
 /***********************************************************
 * Function: eval_user_function_call
 * Description: this function evaluates the user function call.
+* The call frame is a window of the value stack: the arguments (already pushed by
+* eval_function_call) become the first slots and the locals follow them. A call nested
+* deeper than INTERPRETER_MAX_CALL_DEPTH stops the program (see interpret).
 * Parameters: RuntimeValue functionVal, RuntimeValue* args, size_t arg_count
 * Return: RuntimeValue
 * ***********************************************************/
 RuntimeValue eval_user_function_call(RuntimeValue functionVal, RuntimeValue* args, size_t arg_count) {
-    // 1) Create a new environment
-    RuntimeEnvironment* functionEnv = create_environment(128);
-    functionEnv->parent = functionVal.function_val.env;
-
-    // 2) Use the parameter list stored in functionVal
-    ASTNode* paramList = functionVal.function_val.parameters;
-    if (!paramList) {
-        fprintf(stderr, "Error: Function parameters are missing.\n");
-        free(functionEnv);
-        return make_null_value();
+    // 0) Runaway recursion stops the program before it runs out of C stack, like the VM does
+    // (the top level counts as a frame there)
+    if (call_depth + 1 >= INTERPRETER_MAX_CALL_DEPTH) {
+        fprintf(stderr, "Runtime Error: call stack overflow.\n");
+        longjmp(program_abort, 1);
+    }
+
+    // 1) The frame starts at the arguments if they are on top of the value stack, otherwise they are copied there
+    size_t base = value_stack_top;
+    if (arg_count <= value_stack_top && args == &value_stack[value_stack_top - arg_count]) {
+        base = value_stack_top - arg_count;
     }
 
-    // Bind each parameter to the corresponding argument
-    size_t paramCount = paramList->child_count;
-    for (size_t i = 0; i < arg_count && i < paramCount; i++) {
-        ASTNode* paramNode = paramList->children[i];
-        const char* paramName = paramNode->operator_;
-        if (!paramName) {
-            fprintf(stderr, "Error: Parameter name is missing.\n");
-            free(functionEnv);
+    RuntimeValue result;
+    for (;;) {
+        // 2) Use the frame layout stored in functionVal
+        const ASTNode* layout = functionVal.function_val.parameters;
+        if (!layout) {
+            fprintf(stderr, "Error: Function parameters are missing.\n");
             return make_null_value();
         }
-		env_set_func(functionEnv, paramName, args[i]);
-    }
+        size_t paramCount = (size_t)layout->value.int_val;
+        size_t slotCount = layout->child_count;
 
-    // 3) Evaluate the body in the new environment
-    RuntimeValue result = eval_ast_node(functionVal.function_val.body, functionEnv);
+        size_t frameSize = slotCount > arg_count ? slotCount : arg_count;
+        if (base + frameSize > INTERPRETER_STACK_SIZE) {
+            fprintf(stderr, "Runtime Error: call stack overflow.\n");
+            return make_null_value();
+        }
+        if (args != &value_stack[base] && arg_count > 0) {
+            memmove(&value_stack[base], args, sizeof(RuntimeValue) * arg_count);
+        }
 
-    // 4) Clean up
-    free(functionEnv);
+        // Extra arguments are dropped, missing parameters and the locals start null, the locals
+        // that hide a global start unassigned (see resolve_function)
+        for (size_t i = arg_count < paramCount ? arg_count : paramCount; i < slotCount; i++) {
+            value_stack[base + i] = layout->children[i]->global_slot >= 0 ? make_unset_value() : make_null_value();
+        }
+        value_stack_top = base + frameSize;
+
+        // 3) The frame environment only holds what is not in a slot (functions declared in the body)
+        RuntimeEnvironment functionEnv;
+        memset(&functionEnv, 0, sizeof(functionEnv));
+        functionEnv.parent = functionVal.function_val.env;
+        functionEnv.return_value = make_null_value();
+        functionEnv.slots = &value_stack[base];
+        functionEnv.layout = layout;
+        functionEnv.upvalues = functionVal.function_val.upvalues;
+
+        // 4) Evaluate the body in the new environment
+        call_depth++;
+        result = eval_ast_node(functionVal.function_val.body, &functionEnv);
+        call_depth--;
+        release_environment_entries(&functionEnv);
+
+        // 5) A call in tail position reuses the frame: its arguments (on top of the value stack) move down to the base
+        if (!tail_call_pending) break;
+        tail_call_pending = false;
+        functionVal = tail_callee;
+        arg_count = tail_arg_count;
+        args = &value_stack[value_stack_top - arg_count];
+    }
+
+    // 6) Clean up: pop the frame
+    value_stack_top = base;
 
     // If there's no explicit return, 'result' is likely null from 'eval_block(...)'
     return result;
@@ -545,7 +707,7 @@ RuntimeValue eval_array_literal(ASTNode* node, RuntimeEnvironment* env) {
     size_t count = 0;
     ASTNode* current = node->children[0];
 
-    while (current && current->type == AST_BINARY_EXPR && strcmp(current->operator_, ",") == 0) {
+    while (current && current->type == AST_BINARY_EXPR && current->operator_kind == OPERATOR_COMMA) {
         count++;
         current = current->children[0]; // Move left in the binary expression
     }
@@ -561,7 +723,7 @@ RuntimeValue eval_array_literal(ASTNode* node, RuntimeEnvironment* env) {
     // Traverse the AST to populate the array
     current = node->children[0];
     for (size_t i = count; i > 0; i--) {
-        if (current->type == AST_BINARY_EXPR && strcmp(current->operator_, ",") == 0) {
+        if (current->type == AST_BINARY_EXPR && current->operator_kind == OPERATOR_COMMA) {
             elements[i - 1] = eval_ast_node(current->children[1], env); // Right child
             current = current->children[0]; // Move left
         }
@@ -591,10 +753,10 @@ RuntimeValue eval_array_literal(ASTNode* node, RuntimeEnvironment* env) {
 /***********************************************************
 * Function: apply_compound_operator
 * Description: this function applies the compound operator.
-* Parameters: const char* op, RuntimeValue leftVal, RuntimeValue rightVal
+* Parameters: ASTOperator op, RuntimeValue leftVal, RuntimeValue rightVal
 * Return: RuntimeValue
 * ***********************************************************/
-RuntimeValue apply_compound_operator(const char* op, RuntimeValue leftVal, RuntimeValue rightVal) {
+RuntimeValue apply_compound_operator(ASTOperator op, RuntimeValue leftVal, RuntimeValue rightVal) {
     if (leftVal.type != rightVal.type) {
         fprintf(stderr, "Runtime Error: Type mismatch in compound assignment.\n");
         return make_null_value();
@@ -604,22 +766,24 @@ RuntimeValue apply_compound_operator(const char* op, RuntimeValue leftVal, Runti
         long left = leftVal.int_val;
         long right = rightVal.int_val;
 
-        if (strcmp(op, "+=") == 0) return make_int_value(left + right);
-        if (strcmp(op, "-=") == 0) return make_int_value(left - right);
-        if (strcmp(op, "*=") == 0) return make_int_value(left * right);
-        if (strcmp(op, "/=") == 0) {
+        switch (op) {
+        case OPERATOR_ADD_ASSIGN: return make_int_value(left + right);
+        case OPERATOR_SUBTRACT_ASSIGN: return make_int_value(left - right);
+        case OPERATOR_MULTIPLY_ASSIGN: return make_int_value(left * right);
+        case OPERATOR_DIVIDE_ASSIGN:
             if (right == 0) {
                 fprintf(stderr, "Runtime Error: Division by zero.\n");
                 return make_null_value();
             }
             return make_int_value(left / right);
-        }
-        if (strcmp(op, "%=") == 0) {
+        case OPERATOR_MODULO_ASSIGN:
             if (right == 0) {
                 fprintf(stderr, "Runtime Error: Modulo by zero.\n");
                 return make_null_value();
             }
             return make_int_value(left % right);
+        default:
+            break;
         }
     }
 
@@ -627,19 +791,22 @@ RuntimeValue apply_compound_operator(const char* op, RuntimeValue leftVal, Runti
         double left = leftVal.float_val;
         double right = rightVal.float_val;
 
-        if (strcmp(op, "+=") == 0) return make_float_value(left + right);
-        if (strcmp(op, "-=") == 0) return make_float_value(left - right);
-        if (strcmp(op, "*=") == 0) return make_float_value(left * right);
-        if (strcmp(op, "/=") == 0) {
+        switch (op) {
+        case OPERATOR_ADD_ASSIGN: return make_float_value(left + right);
+        case OPERATOR_SUBTRACT_ASSIGN: return make_float_value(left - right);
+        case OPERATOR_MULTIPLY_ASSIGN: return make_float_value(left * right);
+        case OPERATOR_DIVIDE_ASSIGN:
             if (right == 0.0) {
                 fprintf(stderr, "Runtime Error: Division by zero.\n");
                 return make_null_value();
             }
             return make_float_value(left / right);
+        default:
+            break;
         }
     }
 
-    fprintf(stderr, "Runtime Error: Unsupported operator '%s' for type.\n", op);
+    fprintf(stderr, "Runtime Error: Unsupported operator '%s' for type.\n", ASTOperatorSymbols[op]);
     return make_null_value();
 }
 
@@ -717,21 +884,10 @@ RuntimeValue eval_assignment(ASTNode* node, RuntimeEnvironment* env) {
 
     ASTNode* leftNode = node->children[0];
     ASTNode* rightNode = node->children[1];
-    const char* op = node->operator_; // Assignment operator (e.g., "=", "+=", "-=")
+    ASTOperator op = node->operator_kind; // Assignment operator (e.g., "=", "+=", "-=")
 
     RuntimeValue rightVal = eval_ast_node(rightNode, env);
 
-    if (rightVal.type == RUNTIME_VALUE_SPECIAL &&
-        strcmp(rightVal.special_val, "return") == 0) {
-        if (rightVal.return_val) {
-            rightVal = env->return_value;
-        }
-        else {
-            fprintf(stderr, "Error: Invalid return value in assignment.\n");
-            return make_null_value();
-        }
-    }
-
     if (rightVal.type == AST_FUNCTION_CALL) {
         rightVal = eval_user_function_call(rightVal, NULL, 0);
     }
@@ -761,7 +917,7 @@ RuntimeValue eval_assignment(ASTNode* node, RuntimeEnvironment* env) {
 
         RuntimeValue* targetVal = &arrayVal.array_val.elements[index];
 
-        if (strcmp(op, "=") == 0) {
+        if (op == OPERATOR_ASSIGN) {
             *targetVal = rightVal; // Simple assignment
         }
         else {
@@ -773,8 +929,20 @@ RuntimeValue eval_assignment(ASTNode* node, RuntimeEnvironment* env) {
         // Handle normal variable assignment
         const char* varName = leftNode->operator_;
 
+        // The resolver gave every assigned variable a slot of the current frame
+        RuntimeValue* slot = variable_slot(leftNode, env);
+        if (slot) {
+            if (op == OPERATOR_ASSIGN) {
+                *slot = rightVal;
+            }
+            else {
+                const RuntimeValue* current = read_variable_slot(leftNode, env);
+                *slot = apply_compound_operator(op, current ? *current : make_null_value(), rightVal);
+            }
+            return rightVal;
+        }
 
-        if (strcmp(op, "=") == 0) {
+        if (op == OPERATOR_ASSIGN) {
 			env_set_var(env, varName, rightVal); // Simple assignment
         }
         else {
@@ -862,6 +1030,10 @@ RuntimeValue eval_program(ASTNode* node, RuntimeEnvironment* env) {
     RuntimeValue lastVal = make_null_value();
     for (size_t i = 0; i < node->child_count; i++) {
         lastVal = eval_ast_node(node->children[i], env);
+
+        // A return ends the program, a stray stop or continue only ends its statement
+        if (env->completion == COMPLETION_RETURN) break;
+        env->completion = COMPLETION_NORMAL;
     }
     return lastVal;
 }
@@ -870,88 +1042,53 @@ RuntimeValue eval_program(ASTNode* node, RuntimeEnvironment* env) {
 
 
 /***********************************************************
-* Function: collect_arguments
-* Description: this function collects the arguments.
-* Parameters: ASTNode* argsNode, RuntimeEnvironment* env, size_t* out_count
-* Return: RuntimeValue*
+* Function: push_arguments
+* Description: this function evaluates the arguments of a call (its children after the
+* callee, see add_call_arguments) onto the value stack, in order.
+* Parameters: ASTNode* callNode, RuntimeEnvironment* env, size_t* out_count
+* Return: bool (false if the value stack is full)
 * ***********************************************************/
-RuntimeValue* collect_arguments(ASTNode* argsNode, RuntimeEnvironment* env, size_t* out_count) {
-    if (!argsNode) {
-        *out_count = 0;
-        return NULL;
-    }
+bool push_arguments(ASTNode* callNode, RuntimeEnvironment* env, size_t* out_count) {
+    size_t arg_count = callNode->child_count > 1 ? callNode->child_count - 1 : 0;
+    *out_count = 0;
 
-    // Determine the number of arguments
-    size_t arg_count = 0;
-    ASTNode* current = argsNode;
-
-    while (current->type == AST_BINARY_EXPR && strcmp(current->operator_, ",") == 0) {
-        arg_count++;
-        current = current->children[0]; // Move left in the binary expression
-    }
-    arg_count++; // Add the last argument
-
-    // Allocate space for arguments
-    RuntimeValue* args = (RuntimeValue*)malloc(arg_count * sizeof(RuntimeValue));
-    if (!args) {
-        fprintf(stderr, "Memory allocation failed.\n");
-        exit(EXIT_FAILURE);
+    // Reserve the slots first, calls inside the arguments push above them
+    if (value_stack_top + arg_count > INTERPRETER_STACK_SIZE) {
+        fprintf(stderr, "Runtime Error: call stack overflow.\n");
+        return false;
     }
+    RuntimeValue* args = &value_stack[value_stack_top];
+    value_stack_top += arg_count;
 
-    // Traverse again to evaluate arguments
-    current = argsNode;
     env->is_Function = false;
-    for (size_t i = arg_count; i > 0; i--) {
-        if (current->type == AST_BINARY_EXPR && strcmp(current->operator_, ",") == 0) {
-            args[i - 1] = eval_ast_node(current->children[1], env); // Right child
-            current = current->children[0]; // Move left
-        }
-        else {
-            args[i - 1] = eval_ast_node(current, env); // Final argument
-        }
+    for (size_t i = 0; i < arg_count; i++) {
+        args[i] = eval_ast_node(callNode->children[1 + i], env);
     }
 
     *out_count = arg_count;
-    return args;
+    return true;
 }
 
 
 
 
 /***********************************************************
-* Function: find_next_node_after_return
-* Description: this function finds the next node after return.
-* Parameters: ASTNode* returnNode
-* Return: ASTNode*
+* Function: eval_return_statement
+* Description: this function evaluates the return statement: its value goes to the frame,
+* which completes with a return. A returned call reuses the frame (see eval_tail_call).
+* Parameters: ASTNode* node, RuntimeEnvironment* env
+* Return: RuntimeValue
 * ***********************************************************/
-ASTNode* find_next_node_after_return(ASTNode* returnNode) {
-    if (!returnNode) return NULL;
-
-    if (returnNode->type == AST_RETURN_STATEMENT) {
-        return returnNode->children[0];
-    }
-
-    // Traverse all children of the `return` node
-    for (size_t i = 0; i < returnNode->child_count; i++) {
-        ASTNode* child = returnNode->children[i];
-
-        // If the child is a return node, check for adjacent nodes
-        if (child->type == AST_RETURN_STATEMENT) {
-            // Ensure there's a next child
-            if (0 < child->child_count) {
-                return child->children[0]; // Return the next adjacent node
-            }
-            else {
-                return NULL; // No adjacent node
-            }
-        }
-
-        // Recursively search within this child
-        ASTNode* result = find_next_node_after_return(child);
-        if (result) return result; // Return the first valid result
-    }
-
-    return NULL; // No adjacent node found
+RuntimeValue eval_return_statement(ASTNode* node, RuntimeEnvironment* env) {
+    RuntimeValue resultValue = make_null_value();
+    if (node->child_count > 0) {
+        resultValue = node->tail_call
+            ? eval_tail_call(node->children[0], env)
+            : eval_ast_node(node->children[0], env);
+    }
+    env->return_value = resultValue;
+    env->completion = COMPLETION_RETURN;
+    return resultValue;
 }
 
 
@@ -964,33 +1101,11 @@ ASTNode* find_next_node_after_return(ASTNode* returnNode) {
 * Return: RuntimeValue
 * ***********************************************************/
 RuntimeValue eval_block(ASTNode* node, RuntimeEnvironment* env) {
-    if (!env->function_returned)
-    {
-        for (size_t i = 0; i < node->child_count; i++) {
-            RuntimeValue result = eval_ast_node(node->children[i], env);
-
-            // Propagate `break` signals (e.g., in loops)
-            if (result.type == RUNTIME_VALUE_SPECIAL && strcmp(result.special_val, "stop") == 0) {
-                return result;
-            }
-
-            // Propagate `return` signals
-            if (result.type == RUNTIME_VALUE_SPECIAL && strcmp(result.special_val, "return") == 0) {
-                if (node->children[0]->child_count > 0) {
-                    ASTNode* returnExpressionNode = find_next_node_after_return(node);
-
-                    // Evaluate the entire expression inside the return node
-                    RuntimeValue resultValue = eval_ast_node(returnExpressionNode, env);
-                    env->function_returned = true;
-                    env->return_value = resultValue;
-                    return resultValue;
-                }
+    for (size_t i = 0; i < node->child_count; i++) {
+        eval_ast_node(node->children[i], env);
 
-                // If no expression exists, return null
-                fprintf(stderr, "Error: Return statement missing a value.\n");
-                return make_null_value();
-            }
-        }
+        // stop, continue and return leave the block, the statement that handles them is above it
+        if (env->completion != COMPLETION_NORMAL) break;
     }
 
     return env->return_value;
@@ -1040,19 +1155,19 @@ RuntimeValue eval_condition(ASTNode* node, RuntimeEnvironment* env) {
     if (!node) return make_null_value();
 
     if (node->type == AST_BINARY_EXPR) {
-        const char* op = node->operator_;
+        ASTOperator op = node->operator_kind;
         ASTNode* leftNode = node->children[0];
         ASTNode* rightNode = node->children[1];
 
         RuntimeValue leftVal = eval_condition(leftNode, env);
         RuntimeValue rightVal = eval_condition(rightNode, env);
 
-        if (strcmp(op, "&&") == 0) {
+        if (op == OPERATOR_AND) {
             bool left = (leftVal.type == RUNTIME_VALUE_BOOL && leftVal.bool_val);
             bool right = (rightVal.type == RUNTIME_VALUE_BOOL && rightVal.bool_val);
             return make_bool_value(left && right);
         }
-        else if (strcmp(op, "||") == 0) {
+        else if (op == OPERATOR_OR) {
             bool left = (leftVal.type == RUNTIME_VALUE_BOOL && leftVal.bool_val);
             bool right = (rightVal.type == RUNTIME_VALUE_BOOL && rightVal.bool_val);
             return make_bool_value(left || right);
@@ -1130,7 +1245,7 @@ RuntimeValue eval_while_statement(ASTNode* node, RuntimeEnvironment* env) {
     ASTNode* conditionNode = node->children[0];
     ASTNode* bodyNode = node->children[1];
 
-    while (1 && !env->function_returned) {
+    while (1) {
         // Evaluate condition
         RuntimeValue condVal = eval_ast_node(conditionNode, env);
 
@@ -1147,10 +1262,8 @@ RuntimeValue eval_while_statement(ASTNode* node, RuntimeEnvironment* env) {
         }
 
         // Evaluate the body
-        RuntimeValue result = eval_ast_node(bodyNode, env);
-
-        // Check for break signal
-        if (result.type == RUNTIME_VALUE_SPECIAL && strcmp(result.special_val, "stop") == 0) {
+        eval_ast_node(bodyNode, env);
+        if (!end_iteration(env)) {
             break;
         }
     }
@@ -1168,7 +1281,7 @@ RuntimeValue eval_while_statement(ASTNode* node, RuntimeEnvironment* env) {
 * Return: RuntimeValue
 * ***********************************************************/
 RuntimeValue eval_for_statement(ASTNode* node, RuntimeEnvironment* env) {
-    if (node->child_count < 3 && !env->function_returned) {
+    if (node->child_count < 3) {
         return make_null_value();
     }
 
@@ -1179,12 +1292,18 @@ RuntimeValue eval_for_statement(ASTNode* node, RuntimeEnvironment* env) {
     // Ensure body is ready
     ASTNode* bodyNode = node->children[2];
 
-    // Loop execution
+    // Loop execution, a named counter (for (i = a to b)) gets the value of each iteration
+    const char* counterName = node->operator_;
+    RuntimeValue* counterSlot = counterName ? variable_slot(node, env) : NULL;
     for (long i = start; i < end; i++) {
-        RuntimeValue indexValue = make_int_value(i);
-        RuntimeValue result = eval_ast_node(bodyNode, env);
-        // Check for break signal
-        if (result.type == RUNTIME_VALUE_SPECIAL && strcmp(result.special_val, "stop") == 0) {
+        if (counterSlot) {
+            *counterSlot = make_int_value(i);
+        }
+        else if (counterName) {
+            env_set_var(env, counterName, make_int_value(i));
+        }
+        eval_ast_node(bodyNode, env);
+        if (!end_iteration(env)) {
             break;
         }
     }
@@ -1212,9 +1331,8 @@ RuntimeValue eval_binary_expr(ASTNode* node, RuntimeEnvironment* env) {
     RuntimeValue leftVal = eval_ast_node(leftNode, env);
     RuntimeValue rightVal = eval_ast_node(rightNode, env);
 
-    const char* op = node->operator_;
-
-    if (strcmp(op, "+") == 0) {
+    switch (node->operator_kind) {
+    case OPERATOR_ADD:
         // If both int => int addition
         if (leftVal.type == RUNTIME_VALUE_INT && rightVal.type == RUNTIME_VALUE_INT) {
             return make_int_value(leftVal.int_val + rightVal.int_val);
@@ -1224,8 +1342,8 @@ RuntimeValue eval_binary_expr(ASTNode* node, RuntimeEnvironment* env) {
             return make_float_value(leftVal.float_val + rightVal.float_val);
         }
         return make_null_value();
-    }
-    else if (strcmp(op, "-") == 0) {
+
+    case OPERATOR_SUBTRACT:
         // Similar to above
         if (leftVal.type == RUNTIME_VALUE_INT && rightVal.type == RUNTIME_VALUE_INT) {
             return make_int_value(leftVal.int_val - rightVal.int_val);
@@ -1234,8 +1352,8 @@ RuntimeValue eval_binary_expr(ASTNode* node, RuntimeEnvironment* env) {
             return make_float_value(leftVal.float_val - rightVal.float_val);
         }
         return make_null_value();
-    }
-    else if (strcmp(op, "*") == 0) {
+
+    case OPERATOR_MULTIPLY:
         // ...
         if (leftVal.type == RUNTIME_VALUE_INT && rightVal.type == RUNTIME_VALUE_INT) {
             return make_int_value(leftVal.int_val * rightVal.int_val);
@@ -1244,8 +1362,8 @@ RuntimeValue eval_binary_expr(ASTNode* node, RuntimeEnvironment* env) {
             return make_float_value(leftVal.float_val * rightVal.float_val);
         }
         return make_null_value();
-    }
-    else if (strcmp(op, "/") == 0) {
+
+    case OPERATOR_DIVIDE:
         // ...
         if (leftVal.type == RUNTIME_VALUE_INT && rightVal.type == RUNTIME_VALUE_INT) {
             if (rightVal.int_val == 0) {
@@ -1262,9 +1380,8 @@ RuntimeValue eval_binary_expr(ASTNode* node, RuntimeEnvironment* env) {
             return make_float_value(leftVal.float_val / rightVal.float_val);
         }
         return make_null_value();
-    }
 
-    else if (strcmp(op, "%") == 0) {
+    case OPERATOR_MODULO:
         // ...
         if (leftVal.type == RUNTIME_VALUE_INT && rightVal.type == RUNTIME_VALUE_INT) {
             if (rightVal.int_val == 0) {
@@ -1274,15 +1391,20 @@ RuntimeValue eval_binary_expr(ASTNode* node, RuntimeEnvironment* env) {
             return make_int_value(leftVal.int_val % rightVal.int_val);
         }
         return make_null_value();
-    }
 
-    else if (strcmp(op, "==") == 0 || strcmp(op, "!=") == 0 ||
-        strcmp(op, "<") == 0 || strcmp(op, ">") == 0 ||
-        strcmp(op, "<=") == 0 || strcmp(op, ">=") == 0 || strcmp(op, "&&") == 0 || strcmp(op, "||") == 0) {
-        return evaluate_comparison(op, leftVal, rightVal);
-    }
+    case OPERATOR_EQUAL:
+    case OPERATOR_NOT_EQUAL:
+    case OPERATOR_LESS:
+    case OPERATOR_GREATER:
+    case OPERATOR_LESS_EQUAL:
+    case OPERATOR_GREATER_EQUAL:
+    case OPERATOR_AND:
+    case OPERATOR_OR:
+        return evaluate_comparison(node->operator_kind, leftVal, rightVal);
 
-    return make_null_value();
+    default:
+        return make_null_value();
+    }
 }
 
 
@@ -1291,10 +1413,10 @@ RuntimeValue eval_binary_expr(ASTNode* node, RuntimeEnvironment* env) {
 /***********************************************************
 * Function: evaluate_comparison
 * Description: this function evaluates the comparison.
-* Parameters: const char* op, RuntimeValue leftVal, RuntimeValue rightVal
+* Parameters: ASTOperator op, RuntimeValue leftVal, RuntimeValue rightVal
 * Return: RuntimeValue
 * ***********************************************************/
-RuntimeValue evaluate_comparison(const char* op, RuntimeValue leftVal, RuntimeValue rightVal) {
+RuntimeValue evaluate_comparison(ASTOperator op, RuntimeValue leftVal, RuntimeValue rightVal) {
     // Ensure both operands are of the same type, or convert if possible.
     if (leftVal.type != rightVal.type) {
         // Handle type mismatches (e.g., implicit conversions)
@@ -1302,12 +1424,12 @@ RuntimeValue evaluate_comparison(const char* op, RuntimeValue leftVal, RuntimeVa
         return make_bool_value(false);
     }
 
-    if (strcmp(op, "&&") == 0) {
+    if (op == OPERATOR_AND) {
         bool left = (leftVal.type == RUNTIME_VALUE_BOOL && leftVal.bool_val);
         bool right = (rightVal.type == RUNTIME_VALUE_BOOL && rightVal.bool_val);
         return make_bool_value(left && right);
     }
-    else if (strcmp(op, "||") == 0) {
+    else if (op == OPERATOR_OR) {
         bool left = (leftVal.type == RUNTIME_VALUE_BOOL && leftVal.bool_val);
         bool right = (rightVal.type == RUNTIME_VALUE_BOOL && rightVal.bool_val);
         return make_bool_value(left || right);
@@ -1318,13 +1440,15 @@ RuntimeValue evaluate_comparison(const char* op, RuntimeValue leftVal, RuntimeVa
         long left = leftVal.int_val;
         long right = rightVal.int_val;
 
-        if (strcmp(op, "==") == 0) return make_bool_value(left == right);
-        if (strcmp(op, "!=") == 0) return make_bool_value(left != right);
-        if (strcmp(op, "<") == 0) return make_bool_value(left < right);
-        if (strcmp(op, ">") == 0) return make_bool_value(left > right);
-        if (strcmp(op, "<=") == 0) return make_bool_value(left <= right);
-        if (strcmp(op, ">=") == 0) return make_bool_value(left >= right);
-
+        switch (op) {
+        case OPERATOR_EQUAL: return make_bool_value(left == right);
+        case OPERATOR_NOT_EQUAL: return make_bool_value(left != right);
+        case OPERATOR_LESS: return make_bool_value(left < right);
+        case OPERATOR_GREATER: return make_bool_value(left > right);
+        case OPERATOR_LESS_EQUAL: return make_bool_value(left <= right);
+        case OPERATOR_GREATER_EQUAL: return make_bool_value(left >= right);
+        default: break;
+        }
         break;
     }
 
@@ -1332,13 +1456,15 @@ RuntimeValue evaluate_comparison(const char* op, RuntimeValue leftVal, RuntimeVa
         double left = leftVal.float_val;
         double right = rightVal.float_val;
 
-        if (strcmp(op, "==") == 0) return make_bool_value(left == right);
-        if (strcmp(op, "!=") == 0) return make_bool_value(left != right);
-        if (strcmp(op, "<") == 0) return make_bool_value(left < right);
-        if (strcmp(op, ">") == 0) return make_bool_value(left > right);
-        if (strcmp(op, "<=") == 0) return make_bool_value(left <= right);
-        if (strcmp(op, ">=") == 0) return make_bool_value(left >= right);
-
+        switch (op) {
+        case OPERATOR_EQUAL: return make_bool_value(left == right);
+        case OPERATOR_NOT_EQUAL: return make_bool_value(left != right);
+        case OPERATOR_LESS: return make_bool_value(left < right);
+        case OPERATOR_GREATER: return make_bool_value(left > right);
+        case OPERATOR_LESS_EQUAL: return make_bool_value(left <= right);
+        case OPERATOR_GREATER_EQUAL: return make_bool_value(left >= right);
+        default: break;
+        }
         break;
     }
 
@@ -1346,24 +1472,25 @@ RuntimeValue evaluate_comparison(const char* op, RuntimeValue leftVal, RuntimeVa
         bool left = leftVal.bool_val;
         bool right = rightVal.bool_val;
 
-        if (strcmp(op, "==") == 0) return make_bool_value(left == right);
-        if (strcmp(op, "!=") == 0) return make_bool_value(left != right);
+        if (op == OPERATOR_EQUAL) return make_bool_value(left == right);
+        if (op == OPERATOR_NOT_EQUAL) return make_bool_value(left != right);
 
         // For booleans, <, >, <=, >= are typically not meaningful.
         break;
     }
 
     case RUNTIME_VALUE_STRING: {
-        const char* left = leftVal.string_val;
-        const char* right = rightVal.string_val;
-
-        if (strcmp(op, "==") == 0) return make_bool_value(strcmp(left, right) == 0);
-        if (strcmp(op, "!=") == 0) return make_bool_value(strcmp(left, right) != 0);
-        if (strcmp(op, "<") == 0) return make_bool_value(strcmp(left, right) < 0);
-        if (strcmp(op, ">") == 0) return make_bool_value(strcmp(left, right) > 0);
-        if (strcmp(op, "<=") == 0) return make_bool_value(strcmp(left, right) <= 0);
-        if (strcmp(op, ">=") == 0) return make_bool_value(strcmp(left, right) >= 0);
-
+        int order = strcmp(leftVal.string_val, rightVal.string_val);
+
+        switch (op) {
+        case OPERATOR_EQUAL: return make_bool_value(order == 0);
+        case OPERATOR_NOT_EQUAL: return make_bool_value(order != 0);
+        case OPERATOR_LESS: return make_bool_value(order < 0);
+        case OPERATOR_GREATER: return make_bool_value(order > 0);
+        case OPERATOR_LESS_EQUAL: return make_bool_value(order <= 0);
+        case OPERATOR_GREATER_EQUAL: return make_bool_value(order >= 0);
+        default: break;
+        }
         break;
     }
 
@@ -1389,9 +1516,9 @@ RuntimeValue eval_unary_expr(ASTNode* node, RuntimeEnvironment* env) {
         return make_null_value();
     }
     RuntimeValue val = eval_ast_node(node->children[0], env);
-    const char* op = node->operator_;
 
-    if (strcmp(op, "!") == 0) {
+    switch (node->operator_kind) {
+    case OPERATOR_NOT: {
         // interpret val as bool
         bool isTrue = false;
         if (val.type == RUNTIME_VALUE_BOOL) {
@@ -1402,7 +1529,7 @@ RuntimeValue eval_unary_expr(ASTNode* node, RuntimeEnvironment* env) {
         }
         return make_bool_value(!isTrue);
     }
-    else if (strcmp(op, "-") == 0) {
+    case OPERATOR_SUBTRACT:
         // unary minus
         if (val.type == RUNTIME_VALUE_INT) {
             return make_int_value(-val.int_val);
@@ -1412,13 +1539,14 @@ RuntimeValue eval_unary_expr(ASTNode* node, RuntimeEnvironment* env) {
         }
         // fallback
         return make_null_value();
-    }
-    else if (strcmp(op, "~") == 0) {
+    case OPERATOR_COMPLEMENT:
         // bitwise complement (only for int)
         if (val.type == RUNTIME_VALUE_INT) {
             return make_int_value(~val.int_val);
         }
         return make_null_value();
+    default:
+        break;
     }
     // etc.
     return make_null_value();
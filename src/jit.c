@@ -0,0 +1,986 @@
+/***********************************************************
+* File: jit.c
+* This file have the baseline JIT of the stack engine.
+* A hot code object is translated into x86-64 machine code by stitching one template
+* per instruction into an executable buffer. The templates keep the operand stack in
+* memory, inline the int fast paths and call back into the VM for everything else.
+* Only Linux x86-64 has a code generator, on other targets jit_compile always fails.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "jit.h"
+
+#if JIT_SUPPORTED
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+
+
+// Totals of the current run
+static JitStats stats;
+
+
+
+
+#if JIT_SUPPORTED
+
+// x86-64 general purpose registers, in encoding order
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+// Registers the templates keep their state in. They are callee saved, so the runtime calls keep them
+#define TOP     RBX   // First free operand stack slot
+#define LOCALS  R12   // First local slot of the frame
+#define GLOBALS R13   // Global slots
+#define CONTEXT R14   // The VirtualMachine passed back to the runtime
+
+// Condition codes (the opposite condition is cc ^ 1)
+#define CC_AE 0x3
+#define CC_E  0x4
+#define CC_NE 0x5
+#define CC_L  0xC
+#define CC_GE 0xD
+#define CC_LE 0xE
+#define CC_G  0xF
+
+// Layout of a RuntimeValue
+#define VALUE_SIZE     ((int32_t)sizeof(RuntimeValue))
+#define TYPE_FIELD     ((int32_t)offsetof(RuntimeValue, type))
+#define INT_FIELD      ((int32_t)offsetof(RuntimeValue, int_val))
+#define BOOL_FIELD     ((int32_t)offsetof(RuntimeValue, bool_val))
+#define ELEMENTS_FIELD ((int32_t)offsetof(RuntimeValue, array_val.elements))
+#define COUNT_FIELD    ((int32_t)offsetof(RuntimeValue, array_val.count))
+
+_Static_assert(sizeof(long) == 8, "the templates do 64 bit int arithmetic");
+_Static_assert(sizeof(RuntimeValueType) == 4, "the templates compare the type as a dword");
+_Static_assert(sizeof(RuntimeValue) % 8 == 0, "the templates copy values 8 bytes at a time");
+
+/**
+ * Machine code being generated.
+ */
+typedef struct {
+    uint8_t* bytes;
+    size_t size;
+    size_t capacity;
+    bool failed;               // Out of memory
+} Emitter;
+
+/**
+ * A jump to a bytecode offset, patched once every instruction has its machine code.
+ */
+typedef struct {
+    size_t at;                 // Position of the rel32 operand
+    uint32_t target;           // Bytecode offset
+} JitJump;
+
+typedef struct {
+    JitJump* jumps;
+    size_t count;
+    size_t capacity;
+    bool failed;
+} JitJumpList;
+
+// Signature of the entry stub at the start of the machine code
+typedef JitExit(*JitEntry)(void* vm, RuntimeValue* locals, RuntimeValue* globals, RuntimeValue* top, const void* target);
+
+
+
+
+/***********************************************************
+* Function: emit8 / emit32 / emit64
+* Description: appends little endian bytes to the machine code.
+* Parameters: Emitter* e, value
+* Return: void
+* ***********************************************************/
+static void emit8(Emitter* e, uint8_t byte) {
+    if (e->failed) return;
+    if (e->size == e->capacity) {
+        size_t capacity = e->capacity ? e->capacity * 2 : 4096;
+        uint8_t* bytes = (uint8_t*)realloc(e->bytes, capacity);
+        if (!bytes) {
+            e->failed = true;
+            return;
+        }
+        e->bytes = bytes;
+        e->capacity = capacity;
+    }
+    e->bytes[e->size++] = byte;
+}
+
+static void emit32(Emitter* e, uint32_t value) {
+    for (int i = 0; i < 4; i++) emit8(e, (uint8_t)(value >> (8 * i)));
+}
+
+static void emit64(Emitter* e, uint64_t value) {
+    for (int i = 0; i < 8; i++) emit8(e, (uint8_t)(value >> (8 * i)));
+}
+
+
+
+
+/***********************************************************
+* Function: emit_mem
+* Description: emits an instruction with a [base + disp32] memory operand. Opcodes above 0xFF
+* are two byte opcodes (0x0F xx). `reg` is the register operand or the /digit of the opcode.
+* Parameters: Emitter* e, bool wide (REX.W), uint16_t opcode, int reg, int base, int32_t disp
+* Return: void
+* ***********************************************************/
+static void emit_mem(Emitter* e, bool wide, uint16_t opcode, int reg, int base, int32_t disp) {
+    uint8_t rex = 0x40 | (wide ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((base & 8) ? 0x01 : 0);
+    if (rex != 0x40) emit8(e, rex);
+    if (opcode > 0xFF) emit8(e, (uint8_t)(opcode >> 8));
+    emit8(e, (uint8_t)opcode);
+    emit8(e, (uint8_t)(0x80 | ((reg & 7) << 3) | (base & 7)));
+    if ((base & 7) == RSP) emit8(e, 0x24);   // rsp and r12 as a base need a SIB byte
+    emit32(e, (uint32_t)disp);
+}
+
+
+
+
+/***********************************************************
+* Function: emit_* instruction helpers
+* Description: the handful of x86-64 instructions the templates are made of.
+* ***********************************************************/
+static void emit_load(Emitter* e, int reg, int base, int32_t disp) {          // mov reg, [base + disp]
+    emit_mem(e, true, 0x8B, reg, base, disp);
+}
+
+static void emit_store(Emitter* e, int base, int32_t disp, int reg) {         // mov [base + disp], reg
+    emit_mem(e, true, 0x89, reg, base, disp);
+}
+
+static void emit_lea(Emitter* e, int reg, int base, int32_t disp) {           // lea reg, [base + disp]
+    emit_mem(e, true, 0x8D, reg, base, disp);
+}
+
+static void emit_mov_reg(Emitter* e, int dst, int src) {                      // mov dst, src
+    emit8(e, (uint8_t)(0x48 | ((src & 8) ? 0x04 : 0) | ((dst & 8) ? 0x01 : 0)));
+    emit8(e, 0x89);
+    emit8(e, (uint8_t)(0xC0 | ((src & 7) << 3) | (dst & 7)));
+}
+
+static void emit_mov_imm32(Emitter* e, int reg, int32_t value) {              // mov reg32, imm32
+    if (reg & 8) emit8(e, 0x41);
+    emit8(e, (uint8_t)(0xB8 + (reg & 7)));
+    emit32(e, (uint32_t)value);
+}
+
+static void emit_mov_imm64(Emitter* e, int reg, uint64_t value) {             // mov reg, imm64
+    emit8(e, (uint8_t)(0x48 | ((reg & 8) ? 0x01 : 0)));
+    emit8(e, (uint8_t)(0xB8 + (reg & 7)));
+    emit64(e, value);
+}
+
+static void emit_call(Emitter* e, uint64_t function) {                        // mov rax, function; call rax
+    emit_mov_imm64(e, RAX, function);
+    emit8(e, 0xFF);
+    emit8(e, 0xD0);
+}
+
+static size_t emit_jump(Emitter* e) {                                         // jmp rel32, returns the operand to patch
+    emit8(e, 0xE9);
+    emit32(e, 0);
+    return e->size - 4;
+}
+
+static size_t emit_branch(Emitter* e, int cc) {                               // jcc rel32, returns the operand to patch
+    emit8(e, 0x0F);
+    emit8(e, (uint8_t)(0x80 | cc));
+    emit32(e, 0);
+    return e->size - 4;
+}
+
+static void emit_set_type(Emitter* e, int base, int32_t disp, RuntimeValueType type) {
+    emit_mem(e, true, 0xC7, 0, base, disp + TYPE_FIELD);                      // mov qword [type], imm32 (with the padding)
+    emit32(e, (uint32_t)type);
+}
+
+static void emit_check_type(Emitter* e, int base, int32_t disp, RuntimeValueType type) {
+    emit_mem(e, false, 0x83, 7, base, disp + TYPE_FIELD);                     // cmp dword [type], imm8
+    emit8(e, (uint8_t)type);
+}
+
+static void emit_setcc(Emitter* e, int cc) {                                  // setcc al; movzx eax, al
+    emit8(e, 0x0F);
+    emit8(e, (uint8_t)(0x90 | cc));
+    emit8(e, 0xC0);
+    emit8(e, 0x0F);
+    emit8(e, 0xB6);
+    emit8(e, 0xC0);
+}
+
+static void emit_test_al(Emitter* e) {                                        // test al, al
+    emit8(e, 0x84);
+    emit8(e, 0xC0);
+}
+
+// Copies a RuntimeValue through rcx. Every template writes values in aligned qwords and this reads
+// them back the same way, so the loads are forwarded from the stores still in flight
+static void emit_copy(Emitter* e, int dst, int32_t dst_disp, int src, int32_t src_disp) {
+    for (int32_t i = 0; i < VALUE_SIZE; i += 8) {
+        emit_load(e, RCX, src, src_disp + i);
+        emit_store(e, dst, dst_disp + i, RCX);
+    }
+}
+
+// Points a rel32 operand at the given machine code offset
+static void patch(Emitter* e, size_t at, size_t target) {
+    if (e->failed) return;
+    uint32_t rel = (uint32_t)(int32_t)((int64_t)target - (int64_t)(at + 4));
+    for (int i = 0; i < 4; i++) e->bytes[at + i] = (uint8_t)(rel >> (8 * i));
+}
+
+static void add_jump(JitJumpList* list, size_t at, uint32_t target) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 32;
+        JitJump* jumps = (JitJump*)realloc(list->jumps, capacity * sizeof(JitJump));
+        if (!jumps) {
+            list->failed = true;
+            return;
+        }
+        list->jumps = jumps;
+        list->capacity = capacity;
+    }
+    list->jumps[list->count].at = at;
+    list->jumps[list->count].target = target;
+    list->count++;
+}
+
+
+
+
+/***********************************************************
+* Function: generic_opcode
+* Description: the generic operator of a quickened one. The templates do their own type
+* checks, so a quickened site compiles like the generic operator it came from.
+* Parameters: uint8_t op
+* Return: uint8_t
+* ***********************************************************/
+static uint8_t generic_opcode(uint8_t op) {
+    switch (op) {
+    case OP_ADD_INT_INT: case OP_ADD_FLOAT_FLOAT:                 return OP_ADD_;
+    case OP_SUBTRACT_INT_INT: case OP_SUBTRACT_FLOAT_FLOAT:       return OP_SUBTRACT;
+    case OP_MULTIPLY_INT_INT: case OP_MULTIPLY_FLOAT_FLOAT:       return OP_MULTIPLY;
+    case OP_DIVIDE_INT_INT: case OP_DIVIDE_FLOAT_FLOAT:           return OP_DIVIDE;
+    case OP_MODULO_INT_INT:                                       return OP_MODULO;
+    case OP_LESS_INT_INT: case OP_LESS_FLOAT_FLOAT:               return OP_LESS;
+    case OP_GREATER_INT_INT: case OP_GREATER_FLOAT_FLOAT:         return OP_GREATER;
+    case OP_LESS_EQUAL_INT_INT:                                   return OP_LESS_EQUAL;
+    case OP_GREATER_EQUAL_INT_INT:                                return OP_GREATER_EQUAL;
+    case OP_EQUAL_INT_INT:                                        return OP_EQUAL;
+    case OP_NOT_EQUAL_INT_INT:                                    return OP_NOT_EQUAL;
+    default:                                                      return op;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: int_condition
+* Description: the condition code of a comparison of two ints, -1 for the other operators.
+* Parameters: uint8_t op
+* Return: int
+* ***********************************************************/
+static int int_condition(uint8_t op) {
+    switch (op) {
+    case OP_LESS:          return CC_L;
+    case OP_GREATER:       return CC_G;
+    case OP_LESS_EQUAL:    return CC_LE;
+    case OP_GREATER_EQUAL: return CC_GE;
+    case OP_EQUAL:         return CC_E;
+    case OP_NOT_EQUAL:     return CC_NE;
+    default:               return -1;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: emit_binary
+* Description: template of the arithmetic and comparison operators. + - * and the comparisons
+* of two ints are done inline, every other operand pair goes through runtime->binary.
+* Parameters: Emitter* e, const JitRuntime* runtime, uint8_t op
+* Return: void
+* ***********************************************************/
+static void emit_binary(Emitter* e, const JitRuntime* runtime, uint8_t op) {
+    uint16_t alu = op == OP_ADD_ ? 0x03 : op == OP_SUBTRACT ? 0x2B : op == OP_MULTIPLY ? 0x0FAF : 0;
+    int cc = int_condition(op);
+    size_t done = 0;
+
+    if (alu || cc >= 0) {
+        emit_check_type(e, TOP, -2 * VALUE_SIZE, RUNTIME_VALUE_INT);
+        size_t left_miss = emit_branch(e, CC_NE);
+        emit_check_type(e, TOP, -VALUE_SIZE, RUNTIME_VALUE_INT);
+        size_t right_miss = emit_branch(e, CC_NE);
+        emit_load(e, RAX, TOP, -2 * VALUE_SIZE + INT_FIELD);
+        if (alu) {
+            emit_mem(e, true, alu, RAX, TOP, -VALUE_SIZE + INT_FIELD);         // add/sub/imul rax, [right]
+            emit_store(e, TOP, -2 * VALUE_SIZE + INT_FIELD, RAX);
+        }
+        else {
+            emit_mem(e, true, 0x3B, RAX, TOP, -VALUE_SIZE + INT_FIELD);        // cmp rax, [right]
+            emit_setcc(e, cc);
+            emit_set_type(e, TOP, -2 * VALUE_SIZE, RUNTIME_VALUE_BOOL);
+            emit_store(e, TOP, -2 * VALUE_SIZE + BOOL_FIELD, RAX);
+        }
+        done = emit_jump(e);
+        patch(e, left_miss, e->size);
+        patch(e, right_miss, e->size);
+    }
+    emit_mov_reg(e, RDI, TOP);
+    emit_mov_imm32(e, RSI, op);
+    emit_call(e, (uint64_t)(uintptr_t)runtime->binary);
+    if (done) patch(e, done, e->size);
+    emit_lea(e, TOP, TOP, -VALUE_SIZE);
+}
+
+
+
+
+/***********************************************************
+* Function: emit_compare_jump
+* Description: template of the fused compare-and-jumps: jumps to target when the comparison
+* of [base + left] and [base + right] is false. The operands are dropped first (pop bytes).
+* Parameters: Emitter* e, const JitRuntime* runtime, JitJumpList* jumps, int base,
+* int32_t left, int32_t right, uint8_t op, int32_t pop, uint32_t target
+* Return: void
+* ***********************************************************/
+static void emit_compare_jump(Emitter* e, const JitRuntime* runtime, JitJumpList* jumps, int base,
+    int32_t left, int32_t right, uint8_t op, int32_t pop, uint32_t target) {
+    int cc = int_condition(op);
+    size_t done = 0;
+
+    if (cc >= 0) {
+        emit_check_type(e, base, left, RUNTIME_VALUE_INT);
+        size_t left_miss = emit_branch(e, CC_NE);
+        emit_check_type(e, base, right, RUNTIME_VALUE_INT);
+        size_t right_miss = emit_branch(e, CC_NE);
+        emit_load(e, RAX, base, left + INT_FIELD);
+        emit_mem(e, true, 0x3B, RAX, base, right + INT_FIELD);                // cmp rax, [right]
+        if (pop) emit_lea(e, TOP, TOP, pop);                                   // lea keeps the flags
+        add_jump(jumps, emit_branch(e, cc ^ 1), target);
+        done = emit_jump(e);
+        patch(e, left_miss, e->size);
+        patch(e, right_miss, e->size);
+    }
+    emit_lea(e, RDI, base, left);
+    emit_lea(e, RSI, base, right);
+    emit_mov_imm32(e, RDX, op);
+    emit_call(e, (uint64_t)(uintptr_t)runtime->test);
+    if (pop) emit_lea(e, TOP, TOP, pop);
+    emit_test_al(e);
+    add_jump(jumps, emit_branch(e, CC_E), target);
+    if (done) patch(e, done, e->size);
+}
+
+
+
+
+/***********************************************************
+* Function: emit_array_get
+* Description: template of an array read into [TOP + result]. An int index inside the bounds
+* is read inline, anything else goes through runtime->array_get for its error message.
+* Parameters: Emitter* e, const JitRuntime* runtime, int array_base, int32_t array,
+* int index_base, int32_t index, int32_t result
+* Return: void
+* ***********************************************************/
+static void emit_array_get(Emitter* e, const JitRuntime* runtime, int array_base, int32_t array,
+    int index_base, int32_t index, int32_t result) {
+    emit_check_type(e, array_base, array, RUNTIME_VALUE_ARRAY);
+    size_t array_miss = emit_branch(e, CC_NE);
+    emit_check_type(e, index_base, index, RUNTIME_VALUE_INT);
+    size_t index_miss = emit_branch(e, CC_NE);
+    emit_load(e, RAX, index_base, index + INT_FIELD);
+    emit_mem(e, true, 0x3B, RAX, array_base, array + COUNT_FIELD);            // cmp rax, [count]
+    size_t bounds_miss = emit_branch(e, CC_AE);                                // unsigned, so < 0 misses too
+    emit8(e, 0x48); emit8(e, 0x69); emit8(e, 0xC0); emit32(e, (uint32_t)VALUE_SIZE); // imul rax, rax, size
+    emit_mem(e, true, 0x03, RAX, array_base, array + ELEMENTS_FIELD);         // add rax, [elements]
+    emit_copy(e, TOP, result, RAX, 0);
+    size_t done = emit_jump(e);
+    patch(e, array_miss, e->size);
+    patch(e, index_miss, e->size);
+    patch(e, bounds_miss, e->size);
+    emit_lea(e, RDI, TOP, result);
+    emit_lea(e, RSI, array_base, array);
+    emit_lea(e, RDX, index_base, index);
+    emit_call(e, (uint64_t)(uintptr_t)runtime->array_get);
+    patch(e, done, e->size);
+}
+
+
+
+
+/***********************************************************
+* Function: emit_global_check
+* Description: reading an unset global prints a warning (like OP_LOAD_GLOBAL) and goes on.
+* Parameters: Emitter* e, const JitRuntime* runtime, uint16_t slot
+* Return: void
+* ***********************************************************/
+static void emit_global_check(Emitter* e, const JitRuntime* runtime, uint16_t slot) {
+    emit_check_type(e, GLOBALS, slot * VALUE_SIZE, RUNTIME_VALUE_NULL);
+    size_t set = emit_branch(e, CC_NE);
+    emit_mov_reg(e, RDI, CONTEXT);
+    emit_mov_imm32(e, RSI, slot);
+    emit_call(e, (uint64_t)(uintptr_t)runtime->unset_global);
+    patch(e, set, e->size);
+}
+
+
+
+
+/***********************************************************
+* Function: emit_increment
+* Description: template of OP_INC_LOCAL / OP_INC_GLOBAL: an int slot is incremented in place.
+* Parameters: Emitter* e, const JitRuntime* runtime, int base, int32_t slot, int16_t delta
+* Return: void
+* ***********************************************************/
+static void emit_increment(Emitter* e, const JitRuntime* runtime, int base, int32_t slot, int16_t delta) {
+    emit_check_type(e, base, slot, RUNTIME_VALUE_INT);
+    size_t miss = emit_branch(e, CC_NE);
+    emit_mem(e, true, 0x81, 0, base, slot + INT_FIELD);                       // add qword [int], imm32
+    emit32(e, (uint32_t)(int32_t)delta);
+    size_t done = emit_jump(e);
+    patch(e, miss, e->size);
+    emit_lea(e, RDI, base, slot);
+    emit_mov_imm32(e, RSI, delta);
+    emit_call(e, (uint64_t)(uintptr_t)runtime->increment);
+    patch(e, done, e->size);
+}
+
+
+
+
+/***********************************************************
+* Function: emit_for
+* Description: template of the counted loop instructions. OP_FOR_LOOP_* increments the counter
+* and jumps back to target while it is lower than the limit (the value right after it),
+* OP_FOR_PREP_* jumps to target (the loop exit) unless it is. Either way, a loop that goes on
+* copies the counter to the named counter. Counters that aren't ints go through runtime->for_next.
+* Parameters: Emitter* e, const JitRuntime* runtime, JitJumpList* jumps, int base,
+* int32_t counter, int32_t named, bool loop, uint32_t target
+* Return: void
+* ***********************************************************/
+static void emit_for(Emitter* e, const JitRuntime* runtime, JitJumpList* jumps, int base,
+    int32_t counter, int32_t named, bool loop, uint32_t target) {
+    int32_t limit = counter + VALUE_SIZE;
+    emit_check_type(e, base, counter, RUNTIME_VALUE_INT);
+    size_t counter_miss = emit_branch(e, CC_NE);
+    emit_check_type(e, base, limit, RUNTIME_VALUE_INT);
+    size_t limit_miss = emit_branch(e, CC_NE);
+    emit_load(e, RAX, base, counter + INT_FIELD);
+    if (loop) {
+        emit8(e, 0x48); emit8(e, 0x83); emit8(e, 0xC0); emit8(e, 0x01);        // add rax, 1
+        emit_store(e, base, counter + INT_FIELD, RAX);
+    }
+    emit_mem(e, true, 0x3B, RAX, base, limit + INT_FIELD);                    // cmp rax, [limit]
+    size_t finished = 0;
+    if (loop) finished = emit_branch(e, CC_GE);
+    else add_jump(jumps, emit_branch(e, CC_GE), target);
+    if (named != counter) {
+        emit_set_type(e, base, named, RUNTIME_VALUE_INT);
+        emit_store(e, base, named + INT_FIELD, RAX);
+    }
+    size_t done = 0;
+    if (loop) add_jump(jumps, emit_jump(e), target);
+    else done = emit_jump(e);
+
+    patch(e, counter_miss, e->size);
+    patch(e, limit_miss, e->size);
+    emit_lea(e, RDI, base, counter);
+    emit_lea(e, RSI, base, limit);
+    emit_lea(e, RDX, base, named);
+    emit_mov_imm32(e, RCX, loop ? 1 : 0);
+    emit_call(e, (uint64_t)(uintptr_t)runtime->for_next);
+    emit_test_al(e);
+    add_jump(jumps, emit_branch(e, loop ? CC_NE : CC_E), target);
+    if (finished) patch(e, finished, e->size);
+    if (done) patch(e, done, e->size);
+}
+
+
+
+
+/***********************************************************
+* Function: emit_template
+* Description: appends the template of one bytecode instruction. Calls, returns, function
+* declarations and halt jump to the exit stub with their own address: the interpreter runs them.
+* Parameters: Emitter* e, const JitRuntime* runtime, JitJumpList* jumps, const CodeObject* function,
+* const uint8_t* p (the instruction), uint8_t op (generic opcode), size_t exit_stub,
+* const uint32_t* entries (machine code offset of every instruction, filled in by jit_compile)
+* Return: void
+* ***********************************************************/
+static void emit_template(Emitter* e, const JitRuntime* runtime, JitJumpList* jumps,
+    const CodeObject* function, const uint8_t* p, uint8_t op, size_t exit_stub, const uint32_t* entries) {
+    switch (op) {
+    case OP_PUSH_INT:
+        emit_set_type(e, TOP, 0, RUNTIME_VALUE_INT);
+        emit_mem(e, true, 0xC7, 0, TOP, INT_FIELD);                            // mov qword [int], imm32
+        emit32(e, (uint32_t)(int32_t)(int16_t)read_u16(p + 1));
+        emit_lea(e, TOP, TOP, VALUE_SIZE);
+        break;
+
+    case OP_PUSH_BOOL:
+        emit_set_type(e, TOP, 0, RUNTIME_VALUE_BOOL);
+        emit_mem(e, true, 0xC7, 0, TOP, BOOL_FIELD);                           // mov qword [bool], imm32
+        emit32(e, p[1] != 0);
+        emit_lea(e, TOP, TOP, VALUE_SIZE);
+        break;
+
+    case OP_LOAD_CONST_:
+        // Constants are referenced in place, the code object outlives its machine code
+        emit_mov_imm64(e, RAX, (uint64_t)(uintptr_t)&function->constants[read_u16(p + 1)]);
+        emit_copy(e, TOP, 0, RAX, 0);
+        emit_lea(e, TOP, TOP, VALUE_SIZE);
+        break;
+
+    case OP_PUSH_NULL:
+        emit_set_type(e, TOP, 0, RUNTIME_VALUE_NULL);
+        emit_lea(e, TOP, TOP, VALUE_SIZE);
+        break;
+
+    case OP_POP:
+        emit_lea(e, TOP, TOP, -VALUE_SIZE);
+        break;
+
+    case OP_DUP:
+        emit_copy(e, TOP, 0, TOP, -VALUE_SIZE);
+        emit_lea(e, TOP, TOP, VALUE_SIZE);
+        break;
+
+    case OP_LOAD_LOCAL:
+        emit_copy(e, TOP, 0, LOCALS, p[1] * VALUE_SIZE);
+        emit_lea(e, TOP, TOP, VALUE_SIZE);
+        break;
+
+    case OP_STORE_LOCAL:
+        emit_lea(e, TOP, TOP, -VALUE_SIZE);
+        emit_copy(e, LOCALS, p[1] * VALUE_SIZE, TOP, 0);
+        break;
+
+    case OP_LOAD_GLOBAL: {
+        uint16_t slot = read_u16(p + 1);
+        emit_global_check(e, runtime, slot);
+        emit_copy(e, TOP, 0, GLOBALS, slot * VALUE_SIZE);
+        emit_lea(e, TOP, TOP, VALUE_SIZE);
+        break;
+    }
+
+    case OP_STORE_GLOBAL:
+        emit_lea(e, TOP, TOP, -VALUE_SIZE);
+        emit_copy(e, GLOBALS, read_u16(p + 1) * VALUE_SIZE, TOP, 0);
+        break;
+
+    case OP_UNSET_LOCAL:
+        emit_set_type(e, LOCALS, p[1] * VALUE_SIZE, RUNTIME_VALUE_UNSET);
+        break;
+
+    case OP_OR_GLOBAL: {
+        uint16_t slot = read_u16(p + 1);
+        emit_check_type(e, TOP, -VALUE_SIZE, RUNTIME_VALUE_UNSET);
+        size_t assigned = emit_branch(e, CC_NE);
+        emit_global_check(e, runtime, slot);
+        emit_copy(e, TOP, -VALUE_SIZE, GLOBALS, slot * VALUE_SIZE);
+        patch(e, assigned, e->size);
+        break;
+    }
+
+    case OP_ADD_: case OP_SUBTRACT: case OP_MULTIPLY: case OP_DIVIDE: case OP_MODULO:
+    case OP_LESS: case OP_GREATER: case OP_LESS_EQUAL: case OP_GREATER_EQUAL: case OP_EQUAL: case OP_NOT_EQUAL:
+    case OP_AND_: case OP_OR_:
+        emit_binary(e, runtime, op);
+        break;
+
+    case OP_NEGATE: case OP_NOT_: case OP_BIT_NOT:
+        emit_mov_reg(e, RDI, TOP);
+        emit_mov_imm32(e, RSI, op);
+        emit_call(e, (uint64_t)(uintptr_t)runtime->unary);
+        break;
+
+    case OP_JUMP_TO:
+        add_jump(jumps, emit_jump(e), read_u32(p + 1));
+        break;
+
+    case OP_JUMP_TO_IF_FALSE: {
+        uint32_t target = read_u32(p + 1);
+        emit_lea(e, TOP, TOP, -VALUE_SIZE);
+        emit_check_type(e, TOP, 0, RUNTIME_VALUE_BOOL);
+        size_t not_bool = emit_branch(e, CC_NE);
+        emit_mem(e, false, 0x80, 7, TOP, BOOL_FIELD);                          // cmp byte [bool], 0
+        emit8(e, 0);
+        add_jump(jumps, emit_branch(e, CC_E), target);
+        size_t done = emit_jump(e);
+        patch(e, not_bool, e->size);
+        emit_mov_reg(e, RDI, TOP);
+        emit_call(e, (uint64_t)(uintptr_t)runtime->truthy);
+        emit_test_al(e);
+        add_jump(jumps, emit_branch(e, CC_E), target);
+        patch(e, done, e->size);
+        break;
+    }
+
+    case OP_SWITCH_:
+        // The table gives a bytecode offset, entries turns it into machine code of this function
+        emit_lea(e, TOP, TOP, -VALUE_SIZE);
+        emit_mov_imm64(e, RDI, (uint64_t)(uintptr_t)function);
+        emit_mov_imm64(e, RSI, (uint64_t)(uintptr_t)p);
+        emit_mov_reg(e, RDX, TOP);
+        emit_call(e, (uint64_t)(uintptr_t)switch_target);
+        emit8(e, 0x89); emit8(e, 0xC0);                                        // mov eax, eax
+        emit_mov_imm64(e, RCX, (uint64_t)(uintptr_t)entries);
+        emit8(e, 0x8B); emit8(e, 0x04); emit8(e, 0x81);                        // mov eax, [rcx + rax * 4]
+        emit8(e, 0x48); emit8(e, 0x8D); emit8(e, 0x0D);                        // lea rcx, [rip - code start]
+        emit32(e, (uint32_t)-(int32_t)(e->size + 4));
+        emit8(e, 0x48); emit8(e, 0x01); emit8(e, 0xC8);                        // add rax, rcx
+        emit8(e, 0xFF); emit8(e, 0xE0);                                        // jmp rax
+        break;
+
+    case OP_BUILD_ARRAY: {
+        int count = read_u16(p + 1);
+        emit_mov_reg(e, RDI, CONTEXT);
+        emit_mov_reg(e, RSI, TOP);
+        emit_mov_imm32(e, RDX, count);
+        emit_call(e, (uint64_t)(uintptr_t)runtime->build_array);
+        emit_lea(e, TOP, TOP, (1 - count) * VALUE_SIZE);
+        break;
+    }
+
+    case OP_ARRAY_GET_:
+        emit_array_get(e, runtime, TOP, -2 * VALUE_SIZE, TOP, -VALUE_SIZE, -2 * VALUE_SIZE);
+        emit_lea(e, TOP, TOP, -VALUE_SIZE);
+        break;
+
+    case OP_ARRAY_SET_:
+        emit_mov_reg(e, RDI, TOP);
+        emit_call(e, (uint64_t)(uintptr_t)runtime->array_set);
+        emit_lea(e, TOP, TOP, -2 * VALUE_SIZE);
+        break;
+
+    case OP_INC_LOCAL:
+        emit_increment(e, runtime, LOCALS, p[1] * VALUE_SIZE, (int16_t)read_u16(p + 2));
+        break;
+
+    case OP_INC_GLOBAL: {
+        uint16_t slot = read_u16(p + 1);
+        emit_global_check(e, runtime, slot);
+        emit_increment(e, runtime, GLOBALS, slot * VALUE_SIZE, (int16_t)read_u16(p + 3));
+        break;
+    }
+
+    case OP_COMPARE_JUMP_IF_FALSE:
+        emit_compare_jump(e, runtime, jumps, TOP, -2 * VALUE_SIZE, -VALUE_SIZE, p[1], -2 * VALUE_SIZE, read_u32(p + 2));
+        break;
+
+    case OP_COMPARE_LOCALS_JUMP_IF_FALSE:
+        emit_compare_jump(e, runtime, jumps, LOCALS, p[1] * VALUE_SIZE, p[2] * VALUE_SIZE, p[3], 0, read_u32(p + 4));
+        break;
+
+    case OP_LOAD_LOCAL_ELEMENT:
+        emit_array_get(e, runtime, LOCALS, p[1] * VALUE_SIZE, LOCALS, p[2] * VALUE_SIZE, 0);
+        emit_lea(e, TOP, TOP, VALUE_SIZE);
+        break;
+
+    case OP_FOR_PREP_LOCAL:
+    case OP_FOR_LOOP_LOCAL:
+        emit_for(e, runtime, jumps, LOCALS, p[1] * VALUE_SIZE, p[2] * VALUE_SIZE, op == OP_FOR_LOOP_LOCAL, read_u32(p + 3));
+        break;
+
+    case OP_FOR_PREP_GLOBAL:
+    case OP_FOR_LOOP_GLOBAL:
+        emit_for(e, runtime, jumps, GLOBALS, read_u16(p + 1) * VALUE_SIZE, read_u16(p + 3) * VALUE_SIZE,
+            op == OP_FOR_LOOP_GLOBAL, read_u32(p + 5));
+        break;
+
+    default:
+        // Left to the interpreter: rax = the instruction, the exit stub returns it
+        emit_mov_imm64(e, RAX, (uint64_t)(uintptr_t)p);
+        patch(e, emit_jump(e), exit_stub);
+        break;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: record_depth
+* Description: records the operand stack depth at a bytecode offset. Every path reaching an
+* instruction must agree on it (the compiler guarantees it), otherwise the code isn't compiled.
+* Parameters: int* depths, size_t code_size, uint32_t offset, int depth
+* Return: bool (false on a disagreement or an offset outside the code)
+* ***********************************************************/
+static bool record_depth(int* depths, size_t code_size, uint32_t offset, int depth) {
+    if (offset >= code_size) return false;
+    if (depths[offset] >= 0) return depths[offset] == depth;
+    depths[offset] = depth;
+    return true;
+}
+
+
+
+
+/***********************************************************
+* Function: map_code
+* Description: copies the machine code into a fresh mapping and makes it executable.
+* The mapping is never writable and executable at the same time.
+* Parameters: const uint8_t* bytes, size_t size, size_t* mapped_size (out)
+* Return: uint8_t* (NULL on failure)
+* ***********************************************************/
+static uint8_t* map_code(const uint8_t* bytes, size_t size, size_t* mapped_size) {
+    long page = sysconf(_SC_PAGESIZE);
+    if (page <= 0) page = 4096;
+    size_t mapped = (size + (size_t)page - 1) / (size_t)page * (size_t)page;
+    void* memory = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return NULL;
+    }
+    memcpy(memory, bytes, size);
+    if (mprotect(memory, mapped, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, mapped);
+        return NULL;
+    }
+    *mapped_size = mapped;
+    return (uint8_t*)memory;
+}
+
+#endif // JIT_SUPPORTED
+
+
+
+
+/***********************************************************
+* Function: jit_compile
+* Description: translates a code object into machine code. The code starts with an entry stub
+* (saves the registers the templates keep, loads them from the arguments and jumps to the
+* requested instruction) and an exit stub, followed by one template per instruction.
+* Parameters: const CodeObject* function, const JitRuntime* runtime
+* Return: JitCode* (NULL if the code object can't be compiled)
+* ***********************************************************/
+JitCode* jit_compile(const CodeObject* function, const JitRuntime* runtime) {
+#if JIT_SUPPORTED
+    size_t code_size = function->code_size;
+    uint32_t* entries = (uint32_t*)malloc((code_size ? code_size : 1) * sizeof(uint32_t));
+    int* depths = (int*)malloc((code_size ? code_size : 1) * sizeof(int));
+    Emitter e = { 0 };
+    JitJumpList jumps = { 0 };
+    JitCode* code = NULL;
+    bool ok = entries && depths;
+
+    for (size_t i = 0; ok && i < code_size; i++) {
+        entries[i] = UINT32_MAX;
+        depths[i] = -1;
+    }
+
+    // Entry stub: (vm, locals, globals, top, target) arrive in rdi, rsi, rdx, rcx, r8.
+    // Five pushes over the return address leave rsp 16 byte aligned for the runtime calls
+    emit8(&e, 0x53);                                    // push rbx
+    emit8(&e, 0x41); emit8(&e, 0x54);                   // push r12
+    emit8(&e, 0x41); emit8(&e, 0x55);                   // push r13
+    emit8(&e, 0x41); emit8(&e, 0x56);                   // push r14
+    emit8(&e, 0x41); emit8(&e, 0x57);                   // push r15
+    emit_mov_reg(&e, CONTEXT, RDI);
+    emit_mov_reg(&e, LOCALS, RSI);
+    emit_mov_reg(&e, GLOBALS, RDX);
+    emit_mov_reg(&e, TOP, RCX);
+    emit8(&e, 0x41); emit8(&e, 0xFF); emit8(&e, 0xE0);  // jmp r8
+
+    // Exit stub: rax holds the next instruction for the interpreter, the top goes back in rdx
+    size_t exit_stub = e.size;
+    emit_mov_reg(&e, RDX, TOP);
+    emit8(&e, 0x41); emit8(&e, 0x5F);                   // pop r15
+    emit8(&e, 0x41); emit8(&e, 0x5E);                   // pop r14
+    emit8(&e, 0x41); emit8(&e, 0x5D);                   // pop r13
+    emit8(&e, 0x41); emit8(&e, 0x5C);                   // pop r12
+    emit8(&e, 0x5B);                                    // pop rbx
+    emit8(&e, 0xC3);                                    // ret
+
+    // The operand stack depth is tracked along the way: the deepest point decides whether
+    // there is room to enter the code, since the templates don't check for overflow
+    int depth = 0;
+    int max_depth = 0;
+    bool reachable = true;
+    size_t offset = 0;
+    while (ok && offset < code_size) {
+        const uint8_t* p = function->code + offset;
+        uint8_t op = generic_opcode(p[0]);
+        size_t length = packed_instruction_size(op);
+        if (length == 0 || offset + length > code_size) {
+            ok = false;
+            break;
+        }
+        if (!reachable) {
+            // Only reached by jumps: a later backward jump is checked against this guess
+            depth = depths[offset] >= 0 ? depths[offset] : 0;
+        }
+        if (!record_depth(depths, code_size, (uint32_t)offset, depth)) {
+            ok = false;
+            break;
+        }
+
+        entries[offset] = (uint32_t)e.size;
+        emit_template(&e, runtime, &jumps, function, p, op, exit_stub, entries);
+
+        int pops;
+        int pushes;
+        packed_stack_effect(op, p, &pops, &pushes);
+        depth += pushes - pops;
+        if (depth < 0) {
+            ok = false;
+            break;
+        }
+        if (op == OP_BUILD_ARRAY && depth + read_u16(p + 1) > max_depth) max_depth = depth + read_u16(p + 1);
+        if (depth > max_depth) max_depth = depth;
+
+        size_t jump_operand = packed_jump_operand(op);
+        if (jump_operand && !record_depth(depths, code_size, read_u32(p + jump_operand), depth)) {
+            ok = false;
+            break;
+        }
+        if (op == OP_SWITCH_) {
+            size_t slots = switch_slot_count(function, p);
+            ok = slots > 0;
+            for (size_t slot = 0; ok && slot < slots; slot++) {
+                ok = record_depth(depths, code_size, switch_slot_target(function, p, slot), depth);
+            }
+            if (!ok) break;
+        }
+        reachable = op != OP_JUMP_TO && op != OP_SWITCH_ && op != OP_RETURN_ && op != OP_HALT;
+        offset += length;
+    }
+
+    // Falling off the end of the code would run past the last template
+    ok = ok && !reachable && !e.failed && !jumps.failed;
+    for (size_t i = 0; ok && i < jumps.count; i++) {
+        uint32_t target = jumps.jumps[i].target;
+        if (target >= code_size || entries[target] == UINT32_MAX) {
+            ok = false;
+            break;
+        }
+        patch(&e, jumps.jumps[i].at, entries[target]);
+    }
+
+    // A switch reads its target from entries at run time, so every case must start an instruction
+    for (size_t i = 0; ok && i < code_size; i++) {
+        if (depths[i] >= 0 && entries[i] == UINT32_MAX) ok = false;
+    }
+
+    if (ok) {
+        code = (JitCode*)malloc(sizeof(JitCode));
+        if (code) {
+            code->memory = map_code(e.bytes, e.size, &code->memory_size);
+            code->entries = entries;
+            code->code_size = code_size;
+            code->max_depth = (size_t)max_depth;
+            if (!code->memory) {
+                free(code);
+                code = NULL;
+            }
+        }
+    }
+
+    free(e.bytes);
+    free(jumps.jumps);
+    free(depths);
+    if (!code) {
+        free(entries);
+        stats.functions_rejected++;
+        return NULL;
+    }
+    stats.functions_compiled++;
+    stats.code_bytes += e.size;
+    return code;
+#else
+    (void)function;
+    (void)runtime;
+    stats.functions_rejected++;
+    return NULL;
+#endif
+}
+
+
+
+
+/***********************************************************
+* Function: jit_enter
+* Description: runs the machine code from the instruction at ip until it leaves to the interpreter.
+* Parameters: const JitCode* code, const CodeObject* function, const uint8_t* ip,
+* void* vm, RuntimeValue* locals, RuntimeValue* globals, RuntimeValue* top
+* Return: JitExit (next instruction for the interpreter and new top of the operand stack)
+* ***********************************************************/
+JitExit jit_enter(const JitCode* code, const CodeObject* function, const uint8_t* ip,
+    void* vm, RuntimeValue* locals, RuntimeValue* globals, RuntimeValue* top) {
+#if JIT_SUPPORTED
+    uint32_t target = code->entries[ip - function->code];
+    if (target != UINT32_MAX) {
+        JitEntry entry = (JitEntry)(void*)code->memory;
+        stats.entries++;
+        return entry(vm, locals, globals, top, code->memory + target);
+    }
+#else
+    (void)code;
+    (void)function;
+    (void)vm;
+    (void)locals;
+    (void)globals;
+#endif
+    // Not the start of an instruction: nothing runs
+    JitExit stop = { ip, top };
+    return stop;
+}
+
+
+
+
+/***********************************************************
+* Function: jit_free
+* Description: frees the machine code.
+* Parameters: JitCode* code
+* Return: void
+* ***********************************************************/
+void jit_free(JitCode* code) {
+    if (!code) return;
+#if JIT_SUPPORTED
+    munmap(code->memory, code->memory_size);
+#endif
+    free(code->entries);
+    free(code);
+}
+
+
+
+
+/***********************************************************
+* Function: jit_stats / jit_reset_stats / print_jit_stats
+* Description: statistics of the current run.
+* Parameters: FILE* out
+* Return: const JitStats* / void / void
+* ***********************************************************/
+const JitStats* jit_stats(void) {
+    return &stats;
+}
+
+void jit_reset_stats(void) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+void print_jit_stats(FILE* out) {
+    fprintf(out, "=== JIT ===\n");
+#if !JIT_SUPPORTED
+    fprintf(out, "not available on this target\n");
+#endif
+    fprintf(out, "functions compiled: %zu\n", stats.functions_compiled);
+    fprintf(out, "functions rejected: %zu\n", stats.functions_rejected);
+    fprintf(out, "machine code bytes: %zu\n", stats.code_bytes);
+    fprintf(out, "entries into machine code: %llu\n", stats.entries);
+}
@@ -0,0 +1,557 @@
+/***********************************************************
+* File: optimizer.c
+* This file have the peephole optimizer of the bytecode (see optimizer.h).
+* Every pass only marks or rewrites instructions, compact_bytecode then removes
+* the marked ones and renumbers the jumps.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include "optimizer.h"
+
+#define MAX_OPTIMIZER_ROUNDS 16
+#define MAX_JUMP_CHAIN 64
+
+static OptimizerStats stats;
+
+
+
+
+/***********************************************************
+* Function: is_jump / is_conditional_jump
+* Description: instructions whose int_operand is a jump target.
+* Parameters: BytecodeOpcode opcode
+* Return: bool
+* ***********************************************************/
+static bool is_conditional_jump(BytecodeOpcode opcode) {
+    return opcode == OP_JUMP_TO_IF_FALSE || opcode == OP_COMPARE_JUMP_IF_FALSE || opcode == OP_COMPARE_LOCALS_JUMP_IF_FALSE ||
+        opcode == OP_FOR_PREP_LOCAL || opcode == OP_FOR_LOOP_LOCAL || opcode == OP_FOR_PREP_GLOBAL || opcode == OP_FOR_LOOP_GLOBAL;
+}
+
+static bool is_jump(BytecodeOpcode opcode) {
+    return opcode == OP_JUMP_TO || is_conditional_jump(opcode);
+}
+
+static bool is_comparison(BytecodeOpcode opcode) {
+    return opcode >= OP_LESS && opcode <= OP_NOT_EQUAL;
+}
+
+
+
+
+/***********************************************************
+* Function: mark_leaders
+* Description: marks the instructions control can reach from somewhere else than the
+* previous instruction (jump targets and function entries). Sequences are only rewritten
+* when none of their inner instructions is a leader.
+* Parameters: const BytecodeInstruction* bytecode, size_t count, bool* leader (count + 1 entries)
+* Return: void
+* ***********************************************************/
+static void mark_leaders(const BytecodeInstruction* bytecode, size_t count, bool* leader) {
+    memset(leader, 0, (count + 1) * sizeof(bool));
+    for (size_t i = 0; i < count; i++) {
+        const BytecodeInstruction* instr = &bytecode[i];
+        if (is_jump(instr->opcode)) {
+            if (instr->operand.int_operand >= 0 && (size_t)instr->operand.int_operand <= count) {
+                leader[instr->operand.int_operand] = true;
+            }
+        }
+        else if (instr->opcode == OP_SWITCH_) {
+            leader[instr->operand.switch_.default_index] = true;
+            for (int c = 0; c < instr->operand.switch_.when_count; c++) {
+                leader[instr->operand.switch_.cases[c].target_index] = true;
+            }
+        }
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: fold_int_binary
+* Description: evaluates an int/int operator like the VM does.
+* Parameters: BytecodeOpcode op, long long a, long long b, BytecodeInstruction* out
+* Return: bool (false if the result can't be folded)
+* ***********************************************************/
+static bool fold_int_binary(BytecodeOpcode op, long long a, long long b, BytecodeInstruction* out) {
+    // Operands past 32 bits are left to the VM, so the arithmetic below can't overflow
+    if (a < INT32_MIN || a > INT32_MAX || b < INT32_MIN || b > INT32_MAX) return false;
+    long long result;
+    switch (op) {
+    case OP_ADD_:      result = a + b; break;
+    case OP_SUBTRACT:  result = a - b; break;
+    case OP_MULTIPLY:  result = a * b; break;
+    case OP_DIVIDE:    if (b == 0) return false; result = a / b; break;   // Keep the runtime error
+    case OP_MODULO:    if (b == 0) return false; result = a % b; break;
+    case OP_LESS:          out->opcode = OP_PUSH_BOOL; out->operand.bool_operand = a < b; return true;
+    case OP_GREATER:       out->opcode = OP_PUSH_BOOL; out->operand.bool_operand = a > b; return true;
+    case OP_LESS_EQUAL:    out->opcode = OP_PUSH_BOOL; out->operand.bool_operand = a <= b; return true;
+    case OP_GREATER_EQUAL: out->opcode = OP_PUSH_BOOL; out->operand.bool_operand = a >= b; return true;
+    case OP_EQUAL:         out->opcode = OP_PUSH_BOOL; out->operand.bool_operand = a == b; return true;
+    case OP_NOT_EQUAL:     out->opcode = OP_PUSH_BOOL; out->operand.bool_operand = a != b; return true;
+    default:
+        return false;
+    }
+
+    out->opcode = OP_PUSH_INT;
+    out->operand.int_value = (long)result;
+    return true;
+}
+
+
+
+
+/***********************************************************
+* Function: fold_bool_binary
+* Description: evaluates a bool/bool operator like the VM does.
+* Parameters: BytecodeOpcode op, bool a, bool b, BytecodeInstruction* out
+* Return: bool
+* ***********************************************************/
+static bool fold_bool_binary(BytecodeOpcode op, bool a, bool b, BytecodeInstruction* out) {
+    bool result;
+    switch (op) {
+    case OP_EQUAL:     result = a == b; break;
+    case OP_NOT_EQUAL: result = a != b; break;
+    case OP_AND_:      result = a && b; break;
+    case OP_OR_:       result = a || b; break;
+    default:
+        return false;
+    }
+    out->opcode = OP_PUSH_BOOL;
+    out->operand.bool_operand = result;
+    return true;
+}
+
+
+
+
+/***********************************************************
+* Function: fold_constants
+* Description: folds push/push/op and push/op sequences into a single push, and removes
+* conditional jumps on a constant.
+* Parameters: BytecodeInstruction* bytecode, size_t count, const bool* leader, bool* removed
+* Return: bool (true if something changed)
+* ***********************************************************/
+static bool fold_constants(BytecodeInstruction* bytecode, size_t count, const bool* leader, bool* removed) {
+    bool changed = false;
+
+    for (size_t i = 0; i + 1 < count; i++) {
+        BytecodeInstruction* a = &bytecode[i];
+        BytecodeInstruction* b = &bytecode[i + 1];
+        if (removed[i] || removed[i + 1] || leader[i + 1]) continue;
+
+        // push/push/op
+        if (i + 2 < count && !removed[i + 2] && !leader[i + 2]) {
+            BytecodeInstruction folded;
+            BytecodeOpcode op = bytecode[i + 2].opcode;
+            bool ok = false;
+            if (a->opcode == OP_PUSH_INT && b->opcode == OP_PUSH_INT) {
+                ok = fold_int_binary(op, a->operand.int_value, b->operand.int_value, &folded);
+            }
+            else if (a->opcode == OP_PUSH_BOOL && b->opcode == OP_PUSH_BOOL) {
+                ok = fold_bool_binary(op, a->operand.bool_operand, b->operand.bool_operand, &folded);
+            }
+            if (ok) {
+                *a = folded;
+                removed[i + 1] = removed[i + 2] = true;
+                stats.constants_folded++;
+                changed = true;
+                i += 2;
+                continue;
+            }
+        }
+
+        // push/unary op
+        if (a->opcode == OP_PUSH_INT && b->opcode == OP_NEGATE && a->operand.int_value != LONG_MIN) {
+            a->operand.int_value = -a->operand.int_value;
+        }
+        else if (a->opcode == OP_PUSH_INT && b->opcode == OP_BIT_NOT) {
+            a->operand.int_value = ~a->operand.int_value;
+        }
+        else if ((a->opcode == OP_PUSH_INT || a->opcode == OP_PUSH_BOOL) && b->opcode == OP_NOT_) {
+            bool value = a->opcode == OP_PUSH_INT ? a->operand.int_value != 0 : a->operand.bool_operand;
+            a->opcode = OP_PUSH_BOOL;
+            a->operand.bool_operand = !value;
+        }
+        else if ((a->opcode == OP_PUSH_INT || a->opcode == OP_PUSH_BOOL) && b->opcode == OP_JUMP_TO_IF_FALSE) {
+            // while (true) / if (false): the test is gone, the jump is either never or always taken
+            bool value = a->opcode == OP_PUSH_INT ? a->operand.int_value != 0 : a->operand.bool_operand;
+            removed[i] = true;
+            if (value) removed[i + 1] = true;
+            else b->opcode = OP_JUMP_TO;
+            stats.branches_folded++;
+            changed = true;
+            i++;
+            continue;
+        }
+        else {
+            continue;
+        }
+        removed[i + 1] = true;
+        stats.constants_folded++;
+        changed = true;
+        i++;
+    }
+    return changed;
+}
+
+
+
+
+/***********************************************************
+* Function: thread_jumps
+* Description: retargets jumps that land on an OP_JUMP_TO to the end of the chain.
+* Parameters: BytecodeInstruction* bytecode, size_t count, const bool* removed
+* Return: bool (true if something changed)
+* ***********************************************************/
+static bool thread_jumps(BytecodeInstruction* bytecode, size_t count, const bool* removed) {
+    bool changed = false;
+
+    for (size_t i = 0; i < count; i++) {
+        BytecodeInstruction* instr = &bytecode[i];
+        if (removed[i] || (instr->opcode != OP_JUMP_TO && instr->opcode != OP_JUMP_TO_IF_FALSE)) continue;
+
+        size_t target = (size_t)instr->operand.int_operand;
+        for (int hops = 0; hops < MAX_JUMP_CHAIN && target < count && !removed[target] &&
+            bytecode[target].opcode == OP_JUMP_TO &&
+            (size_t)bytecode[target].operand.int_operand != target; hops++) {
+            target = (size_t)bytecode[target].operand.int_operand;
+        }
+
+        if (target != (size_t)instr->operand.int_operand) {
+            instr->operand.int_operand = (int)target;
+            stats.jumps_threaded++;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+
+
+
+/***********************************************************
+* Function: forward_stores
+* Description: store x / load x becomes dup / store x, and load x / store x (a no op) is removed.
+* Only locals are rewritten: a global load of null prints a runtime error that must be kept.
+* Parameters: BytecodeInstruction* bytecode, size_t count, const bool* leader, bool* removed
+* Return: bool (true if something changed)
+* ***********************************************************/
+static bool forward_stores(BytecodeInstruction* bytecode, size_t count, const bool* leader, bool* removed) {
+    bool changed = false;
+
+    for (size_t i = 0; i + 1 < count; i++) {
+        BytecodeInstruction* a = &bytecode[i];
+        BytecodeInstruction* b = &bytecode[i + 1];
+        if (removed[i] || removed[i + 1] || leader[i + 1]) continue;
+        if (a->operand.scope.local_index != b->operand.scope.local_index) continue;
+
+        if (a->opcode == OP_STORE_LOCAL && b->opcode == OP_LOAD_LOCAL) {
+            BytecodeInstruction store = *a;
+            a->opcode = OP_DUP;
+            *b = store;
+            stats.stores_forwarded++;
+            changed = true;
+            i++;
+        }
+        else if (a->opcode == OP_LOAD_LOCAL && b->opcode == OP_STORE_LOCAL) {
+            removed[i] = removed[i + 1] = true;
+            stats.stores_forwarded++;
+            changed = true;
+            i++;
+        }
+    }
+    return changed;
+}
+
+
+
+
+/***********************************************************
+* Function: remove_unreachable
+* Description: marks every instruction no path reaches (code after OP_RETURN_, OP_HALT or
+* an OP_JUMP_TO that nothing jumps to, bodies of functions never declared...).
+* Parameters: const BytecodeInstruction* bytecode, size_t count, bool* removed
+* Return: bool (true if something changed)
+* ***********************************************************/
+static bool remove_unreachable(const BytecodeInstruction* bytecode, size_t count, bool* removed) {
+    bool* reached = (bool*)calloc(count ? count : 1, sizeof(bool));
+    size_t* worklist = (size_t*)malloc((count ? count : 1) * 2 * sizeof(size_t));
+    if (!reached || !worklist) {
+        fprintf(stderr, "Memory allocation failed during bytecode optimization.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t pending = 0;
+    if (count) worklist[pending++] = 0;
+    while (pending) {
+        size_t i = worklist[--pending];
+        // Removed instructions fall through to the next one
+        while (i < count && !reached[i]) {
+            reached[i] = true;
+            if (removed[i]) { i++; continue; }
+
+            const BytecodeInstruction* instr = &bytecode[i];
+            if (instr->opcode == OP_JUMP_TO) {
+                i = (size_t)instr->operand.int_operand;
+                continue;
+            }
+            if (is_conditional_jump(instr->opcode)) {
+                worklist[pending++] = (size_t)instr->operand.int_operand;
+            }
+            else if (instr->opcode == OP_SWITCH_) {
+                // Every case body ends with its own jump, so this pushes at most one entry per instruction
+                for (int c = 0; c < instr->operand.switch_.when_count; c++) {
+                    worklist[pending++] = (size_t)instr->operand.switch_.cases[c].target_index;
+                }
+                i = (size_t)instr->operand.switch_.default_index;
+                continue;
+            }
+            else if (instr->opcode == OP_RETURN_ || instr->opcode == OP_HALT) {
+                break;
+            }
+            i++;
+        }
+    }
+
+    bool changed = false;
+    for (size_t i = 0; i < count; i++) {
+        if (!reached[i] && !removed[i]) {
+            removed[i] = true;
+            stats.dead_removed++;
+            changed = true;
+        }
+    }
+
+    free(reached);
+    free(worklist);
+    return changed;
+}
+
+
+
+
+/***********************************************************
+* Function: fuse_increment
+* Description: recognizes load x / push k / add (or subtract) / store x.
+* Parameters: const BytecodeInstruction* seq, BytecodeOpcode load, BytecodeOpcode store, int* delta
+* Return: bool
+* ***********************************************************/
+static bool fuse_increment(const BytecodeInstruction* seq, BytecodeOpcode load, BytecodeOpcode store, int* delta) {
+    if (seq[0].opcode != load || seq[1].opcode != OP_PUSH_INT || seq[3].opcode != store) return false;
+    if (seq[2].opcode != OP_ADD_ && seq[2].opcode != OP_SUBTRACT) return false;
+
+    long k = seq[1].operand.int_value;
+    if (k < -INT16_MAX || k > INT16_MAX) return false;   // The increment is packed as an i16
+    if (load == OP_LOAD_LOCAL && seq[0].operand.scope.local_index != seq[3].operand.scope.local_index) return false;
+    if (load == OP_LOAD_GLOBAL && seq[0].operand.scope.global_index != seq[3].operand.scope.global_index) return false;
+
+    *delta = (int)(seq[2].opcode == OP_ADD_ ? k : -k);
+    return true;
+}
+
+
+
+
+/***********************************************************
+* Function: fuse_superinstructions
+* Description: replaces the hottest instruction sequences with one superinstruction.
+* The sequences come from the opcode pair histogram of the benchmarks: loop counters
+* (load/push/add/store), loop conditions (compare/jump) and indexed reads of locals.
+* Parameters: BytecodeInstruction* bytecode, size_t count, const bool* leader, bool* removed
+* Return: bool (true if something changed)
+* ***********************************************************/
+static bool fuse_superinstructions(BytecodeInstruction* bytecode, size_t count, const bool* leader, bool* removed) {
+    bool changed = false;
+
+    for (size_t i = 0; i < count; i++) {
+        BytecodeInstruction* seq = &bytecode[i];
+        // Longest sequence first, no instruction after the first may be a jump target
+        size_t room = 1;
+        while (room < 4 && i + room < count && !leader[i + room]) room++;
+
+        BytecodeInstruction fused;
+        size_t length = 0;
+        int delta;
+        memset(&fused, 0, sizeof(fused));
+
+        if (room >= 4 && seq[0].opcode == OP_LOAD_LOCAL && seq[1].opcode == OP_LOAD_LOCAL &&
+            is_comparison(seq[2].opcode) && seq[3].opcode == OP_JUMP_TO_IF_FALSE) {
+            fused.opcode = OP_COMPARE_LOCALS_JUMP_IF_FALSE;
+            fused.operand.fused.target_index = seq[3].operand.jump.target_index;
+            fused.operand.fused.first = seq[0].operand.scope.local_index;
+            fused.operand.fused.second = seq[1].operand.scope.local_index;
+            fused.operand.fused.compare = seq[2].opcode;
+            length = 4;
+        }
+        else if (room >= 4 && fuse_increment(seq, OP_LOAD_LOCAL, OP_STORE_LOCAL, &delta)) {
+            fused.opcode = OP_INC_LOCAL;
+            fused.operand.fused.first = seq[0].operand.scope.local_index;
+            fused.operand.fused.second = delta;
+            length = 4;
+        }
+        else if (room >= 4 && fuse_increment(seq, OP_LOAD_GLOBAL, OP_STORE_GLOBAL, &delta)) {
+            fused.opcode = OP_INC_GLOBAL;
+            fused.operand.fused.first = seq[0].operand.scope.global_index;
+            fused.operand.fused.second = delta;
+            length = 4;
+        }
+        else if (room >= 3 && seq[0].opcode == OP_LOAD_LOCAL && seq[1].opcode == OP_LOAD_LOCAL &&
+            seq[2].opcode == OP_ARRAY_GET_) {
+            fused.opcode = OP_LOAD_LOCAL_ELEMENT;
+            fused.operand.fused.first = seq[0].operand.scope.local_index;
+            fused.operand.fused.second = seq[1].operand.scope.local_index;
+            length = 3;
+        }
+        else if (room >= 2 && is_comparison(seq[0].opcode) && seq[1].opcode == OP_JUMP_TO_IF_FALSE) {
+            fused.opcode = OP_COMPARE_JUMP_IF_FALSE;
+            fused.operand.fused.target_index = seq[1].operand.jump.target_index;
+            fused.operand.fused.compare = seq[0].opcode;
+            length = 2;
+        }
+
+        if (length == 0) continue;
+        seq[0] = fused;
+        for (size_t k = 1; k < length; k++) removed[i + k] = true;
+        stats.superinstructions++;
+        changed = true;
+        i += length - 1;
+    }
+    return changed;
+}
+
+
+
+
+/***********************************************************
+* Function: compact_bytecode
+* Description: removes the marked instructions and renumbers jump targets.
+* A target that was removed moves to the next instruction that is kept.
+* Parameters: BytecodeInstruction* bytecode, size_t count, const bool* removed
+* Return: size_t (new count)
+* ***********************************************************/
+static size_t compact_bytecode(BytecodeInstruction* bytecode, size_t count, const bool* removed) {
+    size_t* new_index = (size_t*)malloc((count + 1) * sizeof(size_t));
+    if (!new_index) {
+        fprintf(stderr, "Memory allocation failed during bytecode optimization.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        new_index[i] = kept;
+        if (!removed[i]) kept++;
+    }
+    new_index[count] = kept;
+
+    size_t out = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (removed[i]) {
+            if (bytecode[i].opcode == OP_SWITCH_) free(bytecode[i].operand.switch_.cases);
+            continue;
+        }
+        BytecodeInstruction instr = bytecode[i];
+        if (is_jump(instr.opcode)) {
+            instr.operand.int_operand = (int)new_index[instr.operand.int_operand];
+        }
+        else if (instr.opcode == OP_SWITCH_) {
+            instr.operand.switch_.default_index = (int)new_index[instr.operand.switch_.default_index];
+            for (int c = 0; c < instr.operand.switch_.when_count; c++) {
+                SwitchCase* when = &instr.operand.switch_.cases[c];
+                when->target_index = (int)new_index[when->target_index];
+            }
+        }
+        bytecode[out++] = instr;
+    }
+
+    free(new_index);
+    return out;
+}
+
+
+
+
+/***********************************************************
+* Function: optimize_bytecode
+* Description: runs the peephole passes until nothing changes. The statistics add up over
+* the calls (one per function) since the last reset_optimizer_stats.
+* Parameters: BytecodeInstruction* bytecode, size_t bytecode_count
+* Return: size_t (new instruction count)
+* ***********************************************************/
+size_t optimize_bytecode(BytecodeInstruction* bytecode, size_t bytecode_count) {
+    stats.instructions_before += bytecode_count;
+
+    for (int round = 0; round < MAX_OPTIMIZER_ROUNDS; round++) {
+        bool* leader = (bool*)malloc((bytecode_count + 1) * sizeof(bool));
+        bool* removed = (bool*)calloc(bytecode_count + 1, sizeof(bool));
+        if (!leader || !removed) {
+            fprintf(stderr, "Memory allocation failed during bytecode optimization.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        mark_leaders(bytecode, bytecode_count, leader);
+        bool changed = fold_constants(bytecode, bytecode_count, leader, removed);
+        changed |= forward_stores(bytecode, bytecode_count, leader, removed);
+        changed |= thread_jumps(bytecode, bytecode_count, removed);
+        changed |= remove_unreachable(bytecode, bytecode_count, removed);
+        bytecode_count = compact_bytecode(bytecode, bytecode_count, removed);
+
+        free(leader);
+        free(removed);
+        if (!changed) break;
+    }
+
+    // Superinstructions last, the passes above only know the plain opcodes
+    bool* leader = (bool*)malloc((bytecode_count + 1) * sizeof(bool));
+    bool* removed = (bool*)calloc(bytecode_count + 1, sizeof(bool));
+    if (!leader || !removed) {
+        fprintf(stderr, "Memory allocation failed during bytecode optimization.\n");
+        exit(EXIT_FAILURE);
+    }
+    mark_leaders(bytecode, bytecode_count, leader);
+    if (fuse_superinstructions(bytecode, bytecode_count, leader, removed)) {
+        bytecode_count = compact_bytecode(bytecode, bytecode_count, removed);
+    }
+    free(leader);
+    free(removed);
+
+    stats.instructions_after += bytecode_count;
+    return bytecode_count;
+}
+
+
+
+
+/***********************************************************
+* Function: optimizer_stats / reset_optimizer_stats / print_optimizer_stats
+* Description: statistics of the optimize_bytecode calls since the last reset.
+* Parameters: FILE* out
+* Return: const OptimizerStats* / void
+* ***********************************************************/
+const OptimizerStats* optimizer_stats(void) {
+    return &stats;
+}
+
+void reset_optimizer_stats(void) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+void print_optimizer_stats(FILE* out) {
+    fprintf(out, "=== PEEPHOLE OPTIMIZER ===\n");
+    fprintf(out, "instructions: %zu -> %zu (%zu removed)\n",
+        stats.instructions_before, stats.instructions_after, stats.instructions_before - stats.instructions_after);
+    fprintf(out, "constants folded: %zu\n", stats.constants_folded);
+    fprintf(out, "branches folded: %zu\n", stats.branches_folded);
+    fprintf(out, "jumps threaded: %zu\n", stats.jumps_threaded);
+    fprintf(out, "stores forwarded: %zu\n", stats.stores_forwarded);
+    fprintf(out, "unreachable removed: %zu\n", stats.dead_removed);
+    fprintf(out, "superinstructions: %zu\n", stats.superinstructions);
+}
@@ -673,9 +673,19 @@ ASTNode* parse_for_statement(Parser* parser) {
         parser_error(parser, "Expected '(' after 'for'.");
     }
 
+    /* optional counter: for (i = start to end), the name is kept as the node's operator */
+    const char* counterName = NULL;
+    Token nameTok = peek_token(parser);
+    if (nameTok.type == TOKEN_IDENTIFIER && parser->position + 1 < parser->tokens->size &&
+        parser->tokens->data[parser->position + 1].type == TOKEN_EQUALS) {
+        consume_token(parser);
+        consume_token(parser);
+        counterName = nameTok.value;
+    }
+
     ASTNode* forNode = create_ast_node(AST_FOR_STATEMENT,
         fTok.line, fTok.column,
-        NULL);
+        counterName);
 
     /* Instead of parse_binary, we use parse_expression for the start and end. */
     ASTNode* startExpr = parse_expression(parser);
@@ -866,10 +876,11 @@ ASTNode* parse_binary(Parser* parser, int precedence) {
             return NULL;
         }
 
-        /* build binary node */
+        /* build binary node, `and` / `or` are spelled like && / || so every engine sees one operator */
+        const char* symbol = t.type == TOKEN_AND ? "&&" : t.type == TOKEN_OR ? "||" : t.value;
         ASTNode* bin = create_ast_node(AST_BINARY_EXPR,
             t.line, t.column,
-            t.value);
+            symbol);
         ast_add_child(bin, left);
         ast_add_child(bin, right);
         left = bin;
@@ -912,6 +923,27 @@ ASTNode* parse_unary(Parser* parser) {
 
 
 
+/***********************************************************
+* Function: add_call_arguments
+* Description: this function adds the arguments of a call to its node, one child each in order.
+* A comma separated list (a, b, c) is flattened and its comma nodes are freed.
+* Parameters: ASTNode* callNode, ASTNode* arg
+* Return: void
+* ***********************************************************/
+static void add_call_arguments(ASTNode* callNode, ASTNode* arg) {
+    if (arg->type == AST_BINARY_EXPR && arg->operator_kind == OPERATOR_COMMA && arg->child_count == 2) {
+        add_call_arguments(callNode, arg->children[0]);
+        add_call_arguments(callNode, arg->children[1]);
+        arg->child_count = 0; // The operands now belong to the call
+        free_ast_node(arg);
+        return;
+    }
+    ast_add_child(callNode, arg);
+}
+
+
+
+
 /***********************************************************
 * Function: parse_postfix
 * Description: this function parses the postfix expressions
@@ -948,7 +980,7 @@ ASTNode* parse_postfix(Parser* parser) {
                 if (!arg) {
                     parser_error(parser, "Error: Invalid expression in function call.");
                 }
-                ast_add_child(callNode, arg);
+                add_call_arguments(callNode, arg);
 
                 /* Check for ',' or ')' */
                 if (peek_token(parser).type == TOKEN_ENDPARAMS) {
@@ -0,0 +1,1507 @@
+/***********************************************************
+* File: registerCode.c
+* This file translates the packed stack code into register code (see registerCode.h).
+* The translation runs the operand stack symbolically: loads of locals and constants
+* just push their register, operators write a new virtual register, and stores
+* retarget the instruction that computed the value when they can. At the end of a
+* block the values left on the stack move to one virtual register per stack depth.
+* A linear scan over the live intervals then packs the virtual registers into as
+* few real ones as possible.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#include <string.h>
+#include "registerCode.h"
+
+// Operands of the translation: a kind and an index, given a register number after allocation
+#define OPERAND_LOCAL     0   // Parameter/local (global slot in <main>)
+#define OPERAND_CONSTANT  1   // Constant register
+#define OPERAND_TEMP      2   // Virtual register
+#define OPERAND_OUTGOING  3   // Outgoing argument of the next call or array literal
+#define MAKE_OPERAND(kind, index) (((kind) << 24) | (index))
+#define OPERAND_KIND(operand)     ((operand) >> 24)
+#define OPERAND_INDEX(operand)    ((operand) & 0xFFFFFF)
+#define NO_OPERAND (-1)
+
+#define TEMP_UNDEFINED (-2)   // temp_def of a virtual register not written yet
+#define TEMP_STACK_SLOT (-1)  // temp_def of the register of a stack depth (written on several paths)
+
+const char* RegisterOpcodeNames[] = {
+    "REG_MOVE",
+    "REG_LOAD_GLOBAL",
+    "REG_STORE_GLOBAL",
+    "REG_LOAD_UPVALUE",
+    "REG_OR_GLOBAL",
+    "REG_ADD",
+    "REG_SUBTRACT",
+    "REG_MULTIPLY",
+    "REG_DIVIDE",
+    "REG_MODULO",
+    "REG_LESS",
+    "REG_GREATER",
+    "REG_LESS_EQUAL",
+    "REG_GREATER_EQUAL",
+    "REG_EQUAL",
+    "REG_NOT_EQUAL",
+    "REG_AND",
+    "REG_OR",
+    "REG_NEGATE",
+    "REG_NOT",
+    "REG_BIT_NOT",
+    "REG_JUMP",
+    "REG_JUMP_IF_FALSE",
+    "REG_SWITCH",
+    "REG_FOR_PREP",
+    "REG_FOR_LOOP",
+    "REG_LESS_JUMP_IF_FALSE",
+    "REG_GREATER_JUMP_IF_FALSE",
+    "REG_LESS_EQUAL_JUMP_IF_FALSE",
+    "REG_GREATER_EQUAL_JUMP_IF_FALSE",
+    "REG_EQUAL_JUMP_IF_FALSE",
+    "REG_NOT_EQUAL_JUMP_IF_FALSE",
+    "REG_GET_ELEMENT",
+    "REG_SET_ELEMENT",
+    "REG_BUILD_ARRAY",
+    "REG_DECL_FUNCTION",
+    "REG_CALL",
+    "REG_TAIL_CALL",
+    "REG_RETURN",
+    "REG_HALT",
+};
+
+/***********************************************************
+* Struct: RegisterInstr
+* Description: an instruction of the translation, before register allocation.
+************************************************************/
+typedef struct {
+    RegisterOpcode opcode;
+    int a, b, c;        // Operands (NO_OPERAND when unused)
+    int count;          // Outgoing registers read by the calls and REG_BUILD_ARRAY
+    uint32_t extra;     // Jump target (stack code offset), global slot, name constant or function index
+} RegisterInstr;
+
+/***********************************************************
+* Struct: Translator
+* Description: state of the translation of one function.
+************************************************************/
+typedef struct {
+    const BytecodeProgram* program;
+    const CodeObject* source;        // Stack code being translated
+    RegisterFunction* out;
+    bool is_main;                    // <main> keeps the global slots in its registers
+    bool globals_written;            // Some function stores to a global slot
+    bool ended;                      // The last instruction never falls through
+    bool has_switch;                 // Some REG_SWITCH needs the labels of the function
+    bool failed;
+
+    RegisterInstr* code;             // Translated instructions
+    size_t count;
+    size_t capacity;
+
+    int* stack;                      // Symbolic operand stack (operands)
+    size_t depth;
+    size_t stack_capacity;
+
+    int* temp_def;                   // Instruction writing each virtual register
+    int* temp_uses;                  // Reads of each virtual register emitted so far
+    int temp_count;
+    size_t temp_capacity;
+
+    int* slot_temps;                 // Virtual register of each stack depth between blocks (-1 until needed)
+    size_t slot_capacity;
+
+    bool* leaders;                   // Stack code offsets that start a block
+    int* labels;                     // Translated instruction of each block start (-1 otherwise)
+    int* entry_depth;                // Stack depth at each block start (-1 if not known yet)
+
+    size_t constant_capacity;
+    int max_outgoing;
+} Translator;
+
+
+
+
+/***********************************************************
+* Function: grow_array
+* Description: makes room for `needed` elements in a growable array.
+* Parameters: void* array, size_t* capacity, size_t needed, size_t element_size
+* Return: void* (the array, possibly moved)
+* ***********************************************************/
+static void* grow_array(void* array, size_t* capacity, size_t needed, size_t element_size) {
+    if (needed <= *capacity) return array;
+    size_t new_capacity = *capacity ? *capacity : 16;
+    while (new_capacity < needed) new_capacity *= 2;
+    void* grown = realloc(array, new_capacity * element_size);
+    if (!grown) {
+        fprintf(stderr, "Memory allocation failed for the register code.\n");
+        exit(EXIT_FAILURE);
+    }
+    *capacity = new_capacity;
+    return grown;
+}
+
+
+
+
+/***********************************************************
+* Function: is_compare_jump
+* Description: register opcodes that compare two registers and jump.
+* Parameters: RegisterOpcode opcode
+* Return: bool
+* ***********************************************************/
+static bool is_compare_jump(RegisterOpcode opcode) {
+    return opcode >= REG_LESS_JUMP_IF_FALSE && opcode <= REG_NOT_EQUAL_JUMP_IF_FALSE;
+}
+
+
+
+
+
+/***********************************************************
+* Function: is_for
+* Description: register opcodes of counted loops.
+* Parameters: RegisterOpcode opcode
+* Return: bool
+* ***********************************************************/
+static bool is_for(RegisterOpcode opcode) {
+    return opcode == REG_FOR_PREP || opcode == REG_FOR_LOOP;
+}
+
+
+
+
+/***********************************************************
+* Function: is_call
+* Description: register opcodes that call a function with the outgoing registers.
+* Parameters: RegisterOpcode opcode
+* Return: bool
+* ***********************************************************/
+static bool is_call(RegisterOpcode opcode) {
+    return opcode == REG_CALL || opcode == REG_TAIL_CALL;
+}
+
+
+
+
+/***********************************************************
+* Function: instruction_words
+* Description: number of 32 bit words of an encoded register instruction.
+* Parameters: RegisterOpcode opcode
+* Return: size_t
+* ***********************************************************/
+static size_t instruction_words(RegisterOpcode opcode) {
+    return (opcode == REG_JUMP_IF_FALSE || opcode == REG_SWITCH || opcode == REG_OR_GLOBAL ||
+        is_for(opcode) || is_call(opcode) || is_compare_jump(opcode)) ? 2 : 1;
+}
+
+
+
+
+/***********************************************************
+* Function: instruction_operands
+* Description: the register written and the registers read by an instruction.
+* Parameters: const RegisterInstr* instr, int* def, int uses[3]
+* Return: int (number of uses)
+* ***********************************************************/
+static int instruction_operands(const RegisterInstr* instr, int* def, int uses[3]) {
+    *def = NO_OPERAND;
+    switch (instr->opcode) {
+    case REG_MOVE:
+    case REG_OR_GLOBAL:
+    case REG_NEGATE:
+    case REG_NOT:
+    case REG_BIT_NOT:
+        *def = instr->a;
+        uses[0] = instr->b;
+        return 1;
+
+    case REG_LOAD_GLOBAL:
+    case REG_LOAD_UPVALUE:
+    case REG_BUILD_ARRAY:
+    case REG_CALL:
+    case REG_TAIL_CALL:
+        *def = instr->a;
+        return 0;
+
+    case REG_STORE_GLOBAL:
+    case REG_JUMP_IF_FALSE:
+    case REG_SWITCH:
+    case REG_RETURN:
+        uses[0] = instr->a;
+        return 1;
+
+    case REG_SET_ELEMENT:
+        uses[0] = instr->a;
+        uses[1] = instr->b;
+        uses[2] = instr->c;
+        return 3;
+
+    case REG_FOR_PREP:
+    case REG_FOR_LOOP:
+        // The counter is written too, but it is always a local
+        *def = instr->c;
+        uses[0] = instr->a;
+        uses[1] = instr->b;
+        return 2;
+
+    case REG_JUMP:
+    case REG_DECL_FUNCTION:
+    case REG_HALT:
+        return 0;
+
+    default:
+        if (is_compare_jump(instr->opcode)) {
+            uses[0] = instr->b;
+            uses[1] = instr->c;
+            return 2;
+        }
+        // Binary operators and REG_GET_ELEMENT
+        *def = instr->a;
+        uses[0] = instr->b;
+        uses[1] = instr->c;
+        return 2;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: translator_fail
+* Description: gives up on the translation (the program then runs on the stack engine).
+* Parameters: Translator* t
+* Return: void
+* ***********************************************************/
+static void translator_fail(Translator* t) {
+    t->failed = true;
+}
+
+
+
+
+/***********************************************************
+* Function: new_temp
+* Description: creates a virtual register.
+* Parameters: Translator* t, int def (TEMP_UNDEFINED or TEMP_STACK_SLOT)
+* Return: int (the operand)
+* ***********************************************************/
+static int new_temp(Translator* t, int def) {
+    if ((size_t)t->temp_count >= t->temp_capacity) {
+        size_t capacity = t->temp_capacity;
+        t->temp_def = (int*)grow_array(t->temp_def, &capacity, t->temp_count + 1, sizeof(int));
+        capacity = t->temp_capacity;
+        t->temp_uses = (int*)grow_array(t->temp_uses, &capacity, t->temp_count + 1, sizeof(int));
+        t->temp_capacity = capacity;
+    }
+    t->temp_def[t->temp_count] = def;
+    t->temp_uses[t->temp_count] = 0;
+    return MAKE_OPERAND(OPERAND_TEMP, t->temp_count++);
+}
+
+
+
+
+/***********************************************************
+* Function: emit
+* Description: appends an instruction and records its reads and writes of virtual registers.
+* Parameters: Translator* t, RegisterOpcode opcode, int a, int b, int c
+* Return: RegisterInstr* (to fill the count and extra fields)
+* ***********************************************************/
+static RegisterInstr* emit(Translator* t, RegisterOpcode opcode, int a, int b, int c) {
+    t->code = (RegisterInstr*)grow_array(t->code, &t->capacity, t->count + 1, sizeof(RegisterInstr));
+    RegisterInstr* instr = &t->code[t->count];
+    instr->opcode = opcode;
+    instr->a = a;
+    instr->b = b;
+    instr->c = c;
+    instr->count = 0;
+    instr->extra = 0;
+
+    int def;
+    int uses[3];
+    int use_count = instruction_operands(instr, &def, uses);
+    for (int i = 0; i < use_count; i++) {
+        if (OPERAND_KIND(uses[i]) == OPERAND_TEMP) t->temp_uses[OPERAND_INDEX(uses[i])]++;
+    }
+    if (def != NO_OPERAND && OPERAND_KIND(def) == OPERAND_TEMP && t->temp_def[OPERAND_INDEX(def)] == TEMP_UNDEFINED) {
+        t->temp_def[OPERAND_INDEX(def)] = (int)t->count;
+    }
+    t->count++;
+    return instr;
+}
+
+
+
+
+/***********************************************************
+* Function: push / pop
+* Description: symbolic operand stack helpers.
+* Parameters: Translator* t, int operand
+* Return: void / int (the operand)
+* ***********************************************************/
+static void push(Translator* t, int operand) {
+    t->stack = (int*)grow_array(t->stack, &t->stack_capacity, t->depth + 1, sizeof(int));
+    t->stack[t->depth++] = operand;
+}
+
+static int pop(Translator* t) {
+    if (t->depth == 0) {
+        translator_fail(t);
+        return MAKE_OPERAND(OPERAND_LOCAL, 0);
+    }
+    return t->stack[--t->depth];
+}
+
+
+
+
+/***********************************************************
+* Function: constant_operand
+* Description: the constant register holding a value, added to the function if needed.
+* Parameters: Translator* t, RuntimeValue value
+* Return: int (the operand)
+* ***********************************************************/
+static int constant_operand(Translator* t, RuntimeValue value) {
+    RegisterFunction* out = t->out;
+    for (size_t i = 0; i < out->constant_count; i++) {
+        const RuntimeValue* existing = &out->constants[i];
+        if (existing->type != value.type) continue;
+        switch (value.type) {
+        case RUNTIME_VALUE_INT:    if (existing->int_val == value.int_val) return MAKE_OPERAND(OPERAND_CONSTANT, (int)i); break;
+        case RUNTIME_VALUE_FLOAT:  if (memcmp(&existing->float_val, &value.float_val, sizeof(double)) == 0) return MAKE_OPERAND(OPERAND_CONSTANT, (int)i); break;
+        case RUNTIME_VALUE_BOOL:   if (existing->bool_val == value.bool_val) return MAKE_OPERAND(OPERAND_CONSTANT, (int)i); break;
+        case RUNTIME_VALUE_STRING: if (strcmp(existing->string_val, value.string_val) == 0) return MAKE_OPERAND(OPERAND_CONSTANT, (int)i); break;
+        case RUNTIME_VALUE_NULL:
+        case RUNTIME_VALUE_UNSET:  return MAKE_OPERAND(OPERAND_CONSTANT, (int)i);
+        default:                   break;
+        }
+    }
+
+    // Strings stay owned by the stack program's constant pool
+    out->constants = (RuntimeValue*)grow_array(out->constants, &t->constant_capacity, out->constant_count + 1, sizeof(RuntimeValue));
+    out->constants[out->constant_count] = value;
+    return MAKE_OPERAND(OPERAND_CONSTANT, (int)out->constant_count++);
+}
+
+
+
+
+/***********************************************************
+* Function: touches
+* Description: whether an instruction reads or writes a register that a store wants to
+* write earlier. Calls overwrite the outgoing registers (the callee's window starts there)
+* and, in <main>, read the global slots.
+* Parameters: const Translator* t, const RegisterInstr* instr, int operand
+* Return: bool
+* ***********************************************************/
+static bool touches(const Translator* t, const RegisterInstr* instr, int operand) {
+    int def;
+    int uses[3];
+    int use_count = instruction_operands(instr, &def, uses);
+    if (def == operand) return true;
+    for (int i = 0; i < use_count; i++) {
+        if (uses[i] == operand) return true;
+    }
+    if (is_call(instr->opcode) || instr->opcode == REG_BUILD_ARRAY) {
+        if (OPERAND_KIND(operand) == OPERAND_OUTGOING) return true;
+        if (is_call(instr->opcode) && t->is_main && OPERAND_KIND(operand) == OPERAND_LOCAL) return true;
+    }
+    return false;
+}
+
+
+
+
+/***********************************************************
+* Function: preserve_operand
+* Description: before a register is overwritten, the stack entries still holding
+* its old value get a copy of it.
+* Parameters: Translator* t, int operand
+* Return: void
+* ***********************************************************/
+static void preserve_operand(Translator* t, int operand) {
+    int copy = NO_OPERAND;
+    for (size_t i = 0; i < t->depth; i++) {
+        if (t->stack[i] != operand) continue;
+        if (copy == NO_OPERAND) {
+            copy = new_temp(t, TEMP_UNDEFINED);
+            emit(t, REG_MOVE, copy, operand, NO_OPERAND);
+        }
+        t->stack[i] = copy;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: store_operand
+* Description: writes a value to a register. When the value was computed into a virtual
+* register nobody has read yet, the instruction computing it writes the target directly.
+* Parameters: Translator* t, int target, int value
+* Return: void
+* ***********************************************************/
+static void store_operand(Translator* t, int target, int value) {
+    if (value == target) return;
+    preserve_operand(t, target);
+
+    if (OPERAND_KIND(value) == OPERAND_TEMP) {
+        int temp = OPERAND_INDEX(value);
+        int def = t->temp_def[temp];
+        if (def >= 0 && t->temp_uses[temp] == 0 && t->code[def].a == value) {
+            // Outgoing registers don't survive the next call, so the value must not stay on the stack
+            bool clobbered = false;
+            for (size_t i = 0; i < t->depth && OPERAND_KIND(target) == OPERAND_OUTGOING; i++) {
+                clobbered = clobbered || t->stack[i] == value;
+            }
+            for (size_t i = (size_t)def + 1; i < t->count && !clobbered; i++) {
+                clobbered = touches(t, &t->code[i], target);
+            }
+            if (!clobbered) {
+                t->code[def].a = target;
+                for (size_t i = 0; i < t->depth; i++) {
+                    if (t->stack[i] == value) t->stack[i] = target;
+                }
+                return;
+            }
+        }
+    }
+    emit(t, REG_MOVE, target, value, NO_OPERAND);
+}
+
+
+
+
+/***********************************************************
+* Function: pop_outgoing
+* Description: moves the top `count` stack values to the outgoing registers of a call
+* or array literal. The last one is moved first, as it is the one most likely computed
+* by the previous instruction.
+* Parameters: Translator* t, int count
+* Return: void
+* ***********************************************************/
+static void pop_outgoing(Translator* t, int count) {
+    if ((size_t)count > t->depth) {
+        translator_fail(t);
+        return;
+    }
+    if (count > t->max_outgoing) t->max_outgoing = count;
+    for (int i = count - 1; i >= 0; i--) {
+        store_operand(t, MAKE_OPERAND(OPERAND_OUTGOING, i), pop(t));
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: slot_temp
+* Description: the virtual register holding a stack depth between blocks.
+* Parameters: Translator* t, size_t depth
+* Return: int (the operand)
+* ***********************************************************/
+static int slot_temp(Translator* t, size_t depth) {
+    if (depth >= t->slot_capacity) {
+        size_t old_capacity = t->slot_capacity;
+        t->slot_temps = (int*)grow_array(t->slot_temps, &t->slot_capacity, depth + 1, sizeof(int));
+        for (size_t i = old_capacity; i < t->slot_capacity; i++) t->slot_temps[i] = NO_OPERAND;
+    }
+    if (t->slot_temps[depth] == NO_OPERAND) {
+        t->slot_temps[depth] = new_temp(t, TEMP_STACK_SLOT);
+    }
+    return t->slot_temps[depth];
+}
+
+
+
+
+/***********************************************************
+* Function: flush_stack
+* Description: at the end of a block, moves every stack value to the virtual register
+* of its depth, so all the paths into the next block agree on where the values are.
+* Parameters: Translator* t
+* Return: void
+* ***********************************************************/
+static void flush_stack(Translator* t) {
+    for (size_t i = 0; i < t->depth; i++) {
+        int slot = slot_temp(t, i);
+        if (t->stack[i] != slot) {
+            emit(t, REG_MOVE, slot, t->stack[i], NO_OPERAND);
+            t->stack[i] = slot;
+        }
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: enter_block
+* Description: records the stack depth expected at a block start.
+* Parameters: Translator* t, size_t offset
+* Return: void
+* ***********************************************************/
+static void enter_block(Translator* t, size_t offset) {
+    if (t->entry_depth[offset] < 0) t->entry_depth[offset] = (int)t->depth;
+    else if ((size_t)t->entry_depth[offset] != t->depth) translator_fail(t);
+}
+
+
+
+
+/***********************************************************
+* Function: emit_jump
+* Description: ends the block with a jump to a stack code offset.
+* Parameters: Translator* t, RegisterOpcode opcode, int b, int c, uint32_t target
+* Return: void
+* ***********************************************************/
+static void emit_jump(Translator* t, RegisterOpcode opcode, int a, int b, int c, uint32_t target) {
+    flush_stack(t);
+    if (target > t->source->code_size || !t->leaders[target]) {
+        translator_fail(t);
+        return;
+    }
+    enter_block(t, target);
+    emit(t, opcode, a, b, c)->extra = target;
+}
+
+
+
+
+/***********************************************************
+* Function: begin_block
+* Description: starts the block at a stack code offset.
+* Parameters: Translator* t, size_t offset
+* Return: void
+* ***********************************************************/
+static void begin_block(Translator* t, size_t offset) {
+    if (!t->ended) {
+        flush_stack(t);
+        enter_block(t, offset);
+    }
+    else {
+        // Only reached by jumps (or never, then its stack starts empty)
+        size_t depth = t->entry_depth[offset] < 0 ? 0 : (size_t)t->entry_depth[offset];
+        t->depth = 0;
+        for (size_t i = 0; i < depth; i++) push(t, slot_temp(t, i));
+        t->entry_depth[offset] = (int)depth;
+    }
+    t->labels[offset] = (int)t->count;
+    t->ended = false;
+}
+
+
+
+
+/***********************************************************
+* Function: local_operand
+* Description: the register of a local slot, checked against the function's locals.
+* Parameters: Translator* t, int index
+* Return: int (the operand)
+* ***********************************************************/
+static int local_operand(Translator* t, int index) {
+    if (index < 0 || index >= t->out->local_count) {
+        translator_fail(t);
+        index = 0;
+    }
+    return MAKE_OPERAND(OPERAND_LOCAL, index);
+}
+
+
+
+
+/***********************************************************
+* Function: binary_opcode / compare_jump_opcode
+* Description: the register opcode of a stack operator.
+* Parameters: uint8_t opcode
+* Return: RegisterOpcode (REG_COUNT_ if there is none)
+* ***********************************************************/
+static RegisterOpcode binary_opcode(uint8_t opcode) {
+    switch (opcode) {
+    case OP_ADD_:          return REG_ADD;
+    case OP_SUBTRACT:      return REG_SUBTRACT;
+    case OP_MULTIPLY:      return REG_MULTIPLY;
+    case OP_DIVIDE:        return REG_DIVIDE;
+    case OP_MODULO:        return REG_MODULO;
+    case OP_LESS:          return REG_LESS;
+    case OP_GREATER:       return REG_GREATER;
+    case OP_LESS_EQUAL:    return REG_LESS_EQUAL;
+    case OP_GREATER_EQUAL: return REG_GREATER_EQUAL;
+    case OP_EQUAL:         return REG_EQUAL;
+    case OP_NOT_EQUAL:     return REG_NOT_EQUAL;
+    case OP_AND_:          return REG_AND;
+    case OP_OR_:           return REG_OR;
+    default:               return REG_COUNT_;
+    }
+}
+
+static RegisterOpcode compare_jump_opcode(uint8_t opcode) {
+    switch (opcode) {
+    case OP_LESS:          return REG_LESS_JUMP_IF_FALSE;
+    case OP_GREATER:       return REG_GREATER_JUMP_IF_FALSE;
+    case OP_LESS_EQUAL:    return REG_LESS_EQUAL_JUMP_IF_FALSE;
+    case OP_GREATER_EQUAL: return REG_GREATER_EQUAL_JUMP_IF_FALSE;
+    case OP_EQUAL:         return REG_EQUAL_JUMP_IF_FALSE;
+    case OP_NOT_EQUAL:     return REG_NOT_EQUAL_JUMP_IF_FALSE;
+    default:               return REG_COUNT_;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: mark_block_starts
+* Description: marks the stack code offsets that start a block: jump and switch targets and
+* the instructions after a jump, return or halt. Jumps into the middle of an instruction fail.
+* Parameters: Translator* t
+* Return: void
+* ***********************************************************/
+static void mark_block_starts(Translator* t) {
+    const CodeObject* source = t->source;
+    bool* starts = (bool*)calloc(source->code_size + 1, sizeof(bool));
+    if (!starts) {
+        fprintf(stderr, "Memory allocation failed for the register code.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t offset = 0;
+    while (offset < source->code_size) {
+        const uint8_t* p = &source->code[offset];
+        size_t size = packed_instruction_size(p[0]);
+        if (size == 0 || offset + size > source->code_size) {
+            translator_fail(t);
+            break;
+        }
+        starts[offset] = true;
+        size_t jump = packed_jump_operand(p[0]);
+        if (jump) {
+            uint32_t target = read_u32(p + jump);
+            if (target > source->code_size) translator_fail(t);
+            else t->leaders[target] = true;
+        }
+        if (p[0] == OP_SWITCH_) {
+            size_t slots = switch_slot_count(source, p);
+            if (slots == 0) translator_fail(t);
+            for (size_t slot = 0; slot < slots; slot++) {
+                t->leaders[switch_slot_target(source, p, slot)] = true;
+            }
+        }
+        if ((jump || p[0] == OP_RETURN_ || p[0] == OP_HALT) && offset + size < source->code_size) {
+            t->leaders[offset + size] = true;
+        }
+        offset += size;
+    }
+    starts[source->code_size] = true;
+
+    for (size_t i = 0; i <= source->code_size; i++) {
+        if (t->leaders[i] && !starts[i]) translator_fail(t);
+    }
+    free(starts);
+}
+
+
+
+
+/***********************************************************
+* Function: translate_instruction
+* Description: translates one stack instruction.
+* Parameters: Translator* t, const uint8_t* p
+* Return: void
+* ***********************************************************/
+static void translate_instruction(Translator* t, const uint8_t* p) {
+    const CodeObject* source = t->source;
+    RegisterOpcode opcode;
+
+    switch (p[0]) {
+    case OP_PUSH_INT:
+        push(t, constant_operand(t, make_int_value((int16_t)read_u16(p + 1))));
+        break;
+
+    case OP_PUSH_BOOL:
+        push(t, constant_operand(t, make_bool_value(p[1] != 0)));
+        break;
+
+    case OP_LOAD_CONST_:
+        if (read_u16(p + 1) >= source->constant_count) {
+            translator_fail(t);
+            break;
+        }
+        push(t, constant_operand(t, source->constants[read_u16(p + 1)]));
+        break;
+
+    case OP_PUSH_NULL:
+        push(t, constant_operand(t, make_null_value()));
+        break;
+
+    case OP_POP:
+        pop(t);
+        break;
+
+    case OP_DUP: {
+        int value = pop(t);
+        push(t, value);
+        push(t, value);
+        break;
+    }
+
+    case OP_LOAD_LOCAL:
+        push(t, local_operand(t, p[1]));
+        break;
+
+    case OP_STORE_LOCAL: {
+        int target = local_operand(t, p[1]);
+        store_operand(t, target, pop(t));
+        break;
+    }
+
+    case OP_LOAD_GLOBAL:
+    case OP_STORE_GLOBAL: {
+        uint16_t slot = read_u16(p + 1);
+        if (slot >= t->program->global_count) {
+            translator_fail(t);
+            break;
+        }
+        if (t->is_main) {
+            // The global slots are <main>'s own registers
+            if (p[0] == OP_LOAD_GLOBAL) push(t, local_operand(t, slot));
+            else store_operand(t, local_operand(t, slot), pop(t));
+        }
+        else if (p[0] == OP_LOAD_GLOBAL) {
+            int temp = new_temp(t, TEMP_UNDEFINED);
+            emit(t, REG_LOAD_GLOBAL, temp, NO_OPERAND, NO_OPERAND)->extra = slot;
+            push(t, temp);
+        }
+        else {
+            emit(t, REG_STORE_GLOBAL, pop(t), NO_OPERAND, NO_OPERAND)->extra = slot;
+        }
+        break;
+    }
+
+    case OP_LOAD_UPVALUE: {
+        int temp = new_temp(t, TEMP_UNDEFINED);
+        emit(t, REG_LOAD_UPVALUE, temp, NO_OPERAND, NO_OPERAND)->extra = p[1];
+        push(t, temp);
+        break;
+    }
+
+    case OP_UNSET_LOCAL:
+        store_operand(t, local_operand(t, p[1]), constant_operand(t, make_unset_value()));
+        break;
+
+    case OP_OR_GLOBAL: {
+        uint16_t slot = read_u16(p + 1);
+        if (slot >= t->program->global_count) {
+            translator_fail(t);
+            break;
+        }
+        int value = pop(t);
+        int temp = new_temp(t, TEMP_UNDEFINED);
+        emit(t, REG_OR_GLOBAL, temp, value, NO_OPERAND)->extra = slot;
+        push(t, temp);
+        break;
+    }
+
+    case OP_ADD_:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+    case OP_DIVIDE:
+    case OP_MODULO:
+    case OP_LESS:
+    case OP_GREATER:
+    case OP_LESS_EQUAL:
+    case OP_GREATER_EQUAL:
+    case OP_EQUAL:
+    case OP_NOT_EQUAL:
+    case OP_AND_:
+    case OP_OR_: {
+        int right = pop(t);
+        int left = pop(t);
+        int temp = new_temp(t, TEMP_UNDEFINED);
+        emit(t, binary_opcode(p[0]), temp, left, right);
+        push(t, temp);
+        break;
+    }
+
+    case OP_NEGATE:
+    case OP_NOT_:
+    case OP_BIT_NOT: {
+        int value = pop(t);
+        int temp = new_temp(t, TEMP_UNDEFINED);
+        opcode = p[0] == OP_NEGATE ? REG_NEGATE : (p[0] == OP_NOT_ ? REG_NOT : REG_BIT_NOT);
+        emit(t, opcode, temp, value, NO_OPERAND);
+        push(t, temp);
+        break;
+    }
+
+    case OP_JUMP_TO:
+        emit_jump(t, REG_JUMP, NO_OPERAND, NO_OPERAND, NO_OPERAND, read_u32(p + 1));
+        t->ended = true;
+        break;
+
+    case OP_JUMP_TO_IF_FALSE: {
+        int condition = pop(t);
+        emit_jump(t, REG_JUMP_IF_FALSE, condition, NO_OPERAND, NO_OPERAND, read_u32(p + 1));
+        break;
+    }
+
+    case OP_SWITCH_: {
+        // Every target gets the stack as it is once the selector is popped
+        int selector = pop(t);
+        flush_stack(t);
+        size_t slots = switch_slot_count(source, p);
+        uint32_t default_target = read_u32(p + 4);
+        if (slots == 0 || default_target > source->code_size || !t->leaders[default_target]) {
+            translator_fail(t);
+            break;
+        }
+        enter_block(t, default_target);
+        for (size_t slot = 0; slot < slots; slot++) {
+            enter_block(t, switch_slot_target(source, p, slot));
+        }
+        emit(t, REG_SWITCH, selector, NO_OPERAND, NO_OPERAND)->extra = (uint32_t)(p - source->code);
+        t->has_switch = true;
+        t->ended = true;
+        break;
+    }
+
+    case OP_COMPARE_JUMP_IF_FALSE: {
+        opcode = compare_jump_opcode(p[1]);
+        int right = pop(t);
+        int left = pop(t);
+        if (opcode == REG_COUNT_) {
+            translator_fail(t);
+            break;
+        }
+        emit_jump(t, opcode, NO_OPERAND, left, right, read_u32(p + 2));
+        break;
+    }
+
+    case OP_COMPARE_LOCALS_JUMP_IF_FALSE:
+        opcode = compare_jump_opcode(p[3]);
+        if (opcode == REG_COUNT_) {
+            translator_fail(t);
+            break;
+        }
+        emit_jump(t, opcode, NO_OPERAND, local_operand(t, p[1]), local_operand(t, p[2]), read_u32(p + 4));
+        break;
+
+    case OP_INC_LOCAL:
+    case OP_INC_GLOBAL: {
+        int16_t delta = (int16_t)read_u16(p + (p[0] == OP_INC_LOCAL ? 2 : 3));
+        int increment = constant_operand(t, make_int_value(delta));
+        if (p[0] == OP_INC_GLOBAL && !t->is_main) {
+            int temp = new_temp(t, TEMP_UNDEFINED);
+            emit(t, REG_LOAD_GLOBAL, temp, NO_OPERAND, NO_OPERAND)->extra = read_u16(p + 1);
+            emit(t, REG_ADD, temp, temp, increment);
+            emit(t, REG_STORE_GLOBAL, temp, NO_OPERAND, NO_OPERAND)->extra = read_u16(p + 1);
+            break;
+        }
+        int target = local_operand(t, p[0] == OP_INC_LOCAL ? p[1] : read_u16(p + 1));
+        preserve_operand(t, target);
+        emit(t, REG_ADD, target, target, increment);
+        break;
+    }
+
+    case OP_FOR_PREP_LOCAL:
+    case OP_FOR_LOOP_LOCAL:
+    case OP_FOR_PREP_GLOBAL:
+    case OP_FOR_LOOP_GLOBAL: {
+        bool global = p[0] == OP_FOR_PREP_GLOBAL || p[0] == OP_FOR_LOOP_GLOBAL;
+        if (global && !t->is_main) {
+            // Only <main> has the global slots as registers
+            translator_fail(t);
+            break;
+        }
+        int slot = global ? read_u16(p + 1) : p[1];
+        int named = global ? read_u16(p + 3) : p[2];
+        opcode = (p[0] == OP_FOR_PREP_LOCAL || p[0] == OP_FOR_PREP_GLOBAL) ? REG_FOR_PREP : REG_FOR_LOOP;
+        emit_jump(t, opcode, local_operand(t, slot), local_operand(t, slot + 1), local_operand(t, named),
+            read_u32(p + (global ? 5 : 3)));
+        break;
+    }
+
+    case OP_LOAD_LOCAL_ELEMENT: {
+        int temp = new_temp(t, TEMP_UNDEFINED);
+        emit(t, REG_GET_ELEMENT, temp, local_operand(t, p[1]), local_operand(t, p[2]));
+        push(t, temp);
+        break;
+    }
+
+    case OP_ARRAY_GET_: {
+        int index = pop(t);
+        int array = pop(t);
+        int temp = new_temp(t, TEMP_UNDEFINED);
+        emit(t, REG_GET_ELEMENT, temp, array, index);
+        push(t, temp);
+        break;
+    }
+
+    case OP_ARRAY_SET_: {
+        int value = pop(t);
+        int index = pop(t);
+        int array = pop(t);
+        emit(t, REG_SET_ELEMENT, array, index, value);
+        push(t, value);
+        break;
+    }
+
+    case OP_BUILD_ARRAY: {
+        int count = read_u16(p + 1);
+        pop_outgoing(t, count);
+        int temp = new_temp(t, TEMP_UNDEFINED);
+        emit(t, REG_BUILD_ARRAY, temp, NO_OPERAND, NO_OPERAND)->count = count;
+        push(t, temp);
+        break;
+    }
+
+    case OP_DECL_FUNCTION:
+        if (read_u16(p + 1) >= t->program->function_count) {
+            translator_fail(t);
+            break;
+        }
+        emit(t, REG_DECL_FUNCTION, NO_OPERAND, NO_OPERAND, NO_OPERAND)->extra = read_u16(p + 1);
+        break;
+
+    case OP_CALL_FUNCTION:
+    case OP_TAIL_CALL: {
+        int arg_count = p[3];
+        pop_outgoing(t, arg_count);
+
+        // A callee that stores to a global slot changes <main>'s registers under the stack values
+        if (t->is_main && t->globals_written) {
+            for (size_t i = 0; i < t->depth; i++) {
+                if (OPERAND_KIND(t->stack[i]) == OPERAND_LOCAL) preserve_operand(t, t->stack[i]);
+            }
+        }
+
+        int temp = new_temp(t, TEMP_UNDEFINED);
+        RegisterInstr* call = emit(t, p[0] == OP_TAIL_CALL ? REG_TAIL_CALL : REG_CALL, temp, NO_OPERAND, NO_OPERAND);
+        call->count = arg_count;
+        call->extra = read_u16(p + 1);
+        push(t, temp);
+        break;
+    }
+
+    case OP_RETURN_:
+        emit(t, REG_RETURN, pop(t), NO_OPERAND, NO_OPERAND);
+        t->ended = true;
+        break;
+
+    case OP_HALT:
+        emit(t, REG_HALT, NO_OPERAND, NO_OPERAND, NO_OPERAND);
+        t->ended = true;
+        break;
+
+    default:
+        translator_fail(t);
+        break;
+    }
+}
+
+
+
+
+// Start of the live interval of each virtual register, for qsort
+static const int* interval_starts;
+
+static int compare_interval_starts(const void* a, const void* b) {
+    int left = interval_starts[*(const int*)a];
+    int right = interval_starts[*(const int*)b];
+    return (left > right) - (left < right);
+}
+
+
+
+
+/***********************************************************
+* Function: allocate_registers
+* Description: linear scan register allocation. Every virtual register gets the live
+* interval from its first to its last appearance; the ones holding a stack depth across
+* blocks may be live around loops, so they conservatively get the whole function.
+* Walking the intervals by start, each takes the lowest register free before it starts.
+* Parameters: Translator* t, int* assigned (out: register of each virtual register)
+* Return: int (number of registers used, -1 if they don't fit the window)
+* ***********************************************************/
+static int allocate_registers(Translator* t, int* assigned) {
+    int temp_count = t->temp_count;
+    int* start = (int*)malloc((temp_count ? temp_count : 1) * sizeof(int));
+    int* end = (int*)malloc((temp_count ? temp_count : 1) * sizeof(int));
+    int* order = (int*)malloc((temp_count ? temp_count : 1) * sizeof(int));
+    if (!start || !end || !order) {
+        fprintf(stderr, "Memory allocation failed for the register code.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < temp_count; i++) {
+        start[i] = -1;
+        end[i] = -1;
+        assigned[i] = -1;
+    }
+    for (size_t i = 0; i < t->count; i++) {
+        int def;
+        int operands[4];
+        int operand_count = instruction_operands(&t->code[i], &def, operands);
+        operands[operand_count++] = def;
+        for (int k = 0; k < operand_count; k++) {
+            if (operands[k] == NO_OPERAND || OPERAND_KIND(operands[k]) != OPERAND_TEMP) continue;
+            int temp = OPERAND_INDEX(operands[k]);
+            if (start[temp] < 0) start[temp] = (int)i;
+            end[temp] = (int)i;
+        }
+    }
+
+    int interval_count = 0;
+    for (int i = 0; i < temp_count; i++) {
+        if (t->temp_def[i] == TEMP_STACK_SLOT) {
+            start[i] = 0;
+            end[i] = (int)t->count;
+        }
+        // Retargeted virtual registers never appear in the code
+        if (start[i] >= 0) order[interval_count++] = i;
+    }
+    interval_starts = start;
+    qsort(order, (size_t)interval_count, sizeof(int), compare_interval_starts);
+
+    // busy_until[r]: last instruction where register r is live
+    int window = REGISTER_WINDOW_MAX - t->out->local_count;
+    int busy_until[REGISTER_WINDOW_MAX];
+    int used = 0;
+    for (int r = 0; r < REGISTER_WINDOW_MAX; r++) busy_until[r] = -1;
+    for (int i = 0; i < interval_count && used >= 0; i++) {
+        int temp = order[i];
+        int r = 0;
+        while (r < window && busy_until[r] >= start[temp]) r++;
+        if (r >= window) {
+            used = -1;
+            break;
+        }
+        assigned[temp] = r;
+        busy_until[r] = end[temp];
+        if (r + 1 > used) used = r + 1;
+    }
+
+    free(start);
+    free(end);
+    free(order);
+    return used;
+}
+
+
+
+
+/***********************************************************
+* Function: encode_function
+* Description: gives every operand its register and encodes the instructions into words.
+* Parameters: Translator* t, const int* assigned
+* Return: bool (false if the registers or the code don't fit the encoding)
+* ***********************************************************/
+static bool encode_function(Translator* t, const int* assigned) {
+    RegisterFunction* out = t->out;
+    out->constant_base = out->local_count + out->temp_count;
+    out->register_count = out->constant_base + (int)out->constant_count;
+    out->frame_size = out->register_count + t->max_outgoing;
+    if (out->frame_size > REGISTER_WINDOW_MAX) return false;
+
+    // Word position of every instruction, jumps point to the first instruction of their block
+    size_t* positions = (size_t*)malloc((t->count + 1) * sizeof(size_t));
+    if (!positions) {
+        fprintf(stderr, "Memory allocation failed for the register code.\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t words = 0;
+    for (size_t i = 0; i < t->count; i++) {
+        positions[i] = words;
+        words += instruction_words(t->code[i].opcode);
+    }
+    positions[t->count] = words;
+    if (words >= (1u << 24)) {
+        free(positions);
+        return false;
+    }
+
+    out->code = (uint32_t*)malloc((words ? words : 1) * sizeof(uint32_t));
+    if (!out->code) {
+        fprintf(stderr, "Memory allocation failed for the register code.\n");
+        exit(EXIT_FAILURE);
+    }
+    out->code_size = words;
+    out->instruction_count = t->count;
+
+    for (size_t i = 0; i < t->count; i++) {
+        const RegisterInstr* instr = &t->code[i];
+        uint32_t registers[3] = { 0, 0, 0 };
+        int operands[3] = { instr->a, instr->b, instr->c };
+        for (int k = 0; k < 3; k++) {
+            int operand = operands[k];
+            if (operand == NO_OPERAND) continue;
+            int index = OPERAND_INDEX(operand);
+            switch (OPERAND_KIND(operand)) {
+            case OPERAND_LOCAL:    registers[k] = (uint32_t)index; break;
+            case OPERAND_TEMP:     registers[k] = (uint32_t)(out->local_count + assigned[index]); break;
+            case OPERAND_CONSTANT: registers[k] = (uint32_t)(out->constant_base + index); break;
+            case OPERAND_OUTGOING: registers[k] = (uint32_t)(out->register_count + index); break;
+            }
+        }
+
+        uint32_t* word = &out->code[positions[i]];
+        word[0] = (uint32_t)instr->opcode | (registers[0] << 8) | (registers[1] << 16) | (registers[2] << 24);
+        switch (instr->opcode) {
+        case REG_JUMP:
+            word[0] = (uint32_t)REG_JUMP | (uint32_t)(positions[t->labels[instr->extra]] << 8);
+            break;
+        case REG_JUMP_IF_FALSE:
+        case REG_FOR_PREP:
+        case REG_FOR_LOOP:
+            word[1] = (uint32_t)positions[t->labels[instr->extra]];
+            break;
+        case REG_SWITCH:
+        case REG_OR_GLOBAL:
+            word[1] = instr->extra;
+            break;
+        case REG_LOAD_GLOBAL:
+        case REG_STORE_GLOBAL:
+        case REG_LOAD_UPVALUE:
+            word[0] = (uint32_t)instr->opcode | (registers[0] << 8) | (instr->extra << 16);
+            break;
+        case REG_BUILD_ARRAY:
+            word[0] = (uint32_t)instr->opcode | (registers[0] << 8) | ((uint32_t)instr->count << 16);
+            break;
+        case REG_CALL:
+        case REG_TAIL_CALL:
+            word[0] = (uint32_t)instr->opcode | (registers[0] << 8) | ((uint32_t)instr->count << 16);
+            word[1] = instr->extra;
+            break;
+        case REG_DECL_FUNCTION:
+            word[0] = (uint32_t)instr->opcode | (instr->extra << 8);
+            break;
+        default:
+            if (is_compare_jump(instr->opcode)) {
+                word[1] = (uint32_t)positions[t->labels[instr->extra]];
+            }
+            break;
+        }
+    }
+
+    // The targets of a switch are only known when it runs
+    if (t->has_switch) {
+        out->labels = (uint32_t*)malloc((t->source->code_size + 1) * sizeof(uint32_t));
+        if (!out->labels) {
+            fprintf(stderr, "Memory allocation failed for the register code.\n");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i <= t->source->code_size; i++) {
+            out->labels[i] = t->labels[i] >= 0 ? (uint32_t)positions[t->labels[i]] : UINT32_MAX;
+        }
+    }
+
+    free(positions);
+    return true;
+}
+
+
+
+
+/***********************************************************
+* Function: translate_function
+* Description: translates the stack code of one function into register code.
+* Parameters: const BytecodeProgram* program, size_t index, bool globals_written, RegisterFunction* out
+* Return: bool (false if the function can't be translated)
+* ***********************************************************/
+static bool translate_function(const BytecodeProgram* program, size_t index, bool globals_written, RegisterFunction* out) {
+    const CodeObject* source = &program->functions[index];
+    Translator t;
+    memset(&t, 0, sizeof(t));
+    t.program = program;
+    t.source = source;
+    t.out = out;
+    t.is_main = index == 0;
+    t.globals_written = globals_written;
+
+    out->param_count = source->param_count;
+    out->local_count = t.is_main ? (int)program->global_count : source->local_count;
+
+    t.leaders = (bool*)calloc(source->code_size + 1, sizeof(bool));
+    t.labels = (int*)malloc((source->code_size + 1) * sizeof(int));
+    t.entry_depth = (int*)malloc((source->code_size + 1) * sizeof(int));
+    if (!t.leaders || !t.labels || !t.entry_depth) {
+        fprintf(stderr, "Memory allocation failed for the register code.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i <= source->code_size; i++) {
+        t.labels[i] = -1;
+        t.entry_depth[i] = -1;
+    }
+    t.entry_depth[0] = 0;
+
+    if (out->local_count >= REGISTER_WINDOW_MAX) translator_fail(&t);
+    else mark_block_starts(&t);
+
+    size_t offset = 0;
+    while (!t.failed && offset < source->code_size) {
+        const uint8_t* p = &source->code[offset];
+        if (t.leaders[offset]) begin_block(&t, offset);
+        translate_instruction(&t, p);
+        out->stack_instruction_count++;
+        offset += packed_instruction_size(p[0]);
+    }
+
+    // A jump to the end of the code stops the program like OP_HALT
+    if (!t.failed && (t.leaders[source->code_size] || !t.ended)) {
+        begin_block(&t, source->code_size);
+        emit(&t, REG_HALT, NO_OPERAND, NO_OPERAND, NO_OPERAND);
+    }
+
+    bool translated = !t.failed;
+    if (translated) {
+        int* assigned = (int*)malloc((t.temp_count ? t.temp_count : 1) * sizeof(int));
+        if (!assigned) {
+            fprintf(stderr, "Memory allocation failed for the register code.\n");
+            exit(EXIT_FAILURE);
+        }
+        out->virtual_count = t.temp_count;
+        out->temp_count = allocate_registers(&t, assigned);
+        translated = out->temp_count >= 0 && encode_function(&t, assigned);
+        free(assigned);
+    }
+
+    free(t.code);
+    free(t.stack);
+    free(t.temp_def);
+    free(t.temp_uses);
+    free(t.slot_temps);
+    free(t.leaders);
+    free(t.labels);
+    free(t.entry_depth);
+    return translated;
+}
+
+
+
+
+/***********************************************************
+* Function: build_register_program
+* Description: translates every function of a packed program into register code.
+* Parameters: const BytecodeProgram* program
+* Return: RegisterProgram* (NULL if some function doesn't fit the register window)
+* ***********************************************************/
+RegisterProgram* build_register_program(const BytecodeProgram* program) {
+    // <main>'s registers start with the global slots, whose count is only final once every function is compiled
+    compile_all_functions(program);
+
+    RegisterProgram* registers = (RegisterProgram*)calloc(1, sizeof(RegisterProgram));
+    if (!registers) {
+        fprintf(stderr, "Memory allocation failed for the register code.\n");
+        exit(EXIT_FAILURE);
+    }
+    registers->program = program;
+    registers->function_count = program->function_count;
+    registers->functions = (RegisterFunction*)calloc(program->function_count ? program->function_count : 1, sizeof(RegisterFunction));
+    if (!registers->functions) {
+        fprintf(stderr, "Memory allocation failed for the register code.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // The compiler only stores to global slots from the top level, but loaded files may not
+    bool globals_written = false;
+    for (size_t f = 1; f < program->function_count && !globals_written; f++) {
+        const CodeObject* function = &program->functions[f];
+        size_t offset = 0;
+        while (offset < function->code_size) {
+            uint8_t opcode = function->code[offset];
+            if (opcode == OP_STORE_GLOBAL || opcode == OP_INC_GLOBAL) {
+                globals_written = true;
+                break;
+            }
+            size_t size = packed_instruction_size(opcode);
+            if (size == 0) break;
+            offset += size;
+        }
+    }
+
+    for (size_t f = 0; f < program->function_count; f++) {
+        if (!translate_function(program, f, globals_written, &registers->functions[f])) {
+            free_register_program(registers);
+            return NULL;
+        }
+    }
+    return registers;
+}
+
+
+
+
+/***********************************************************
+* Function: free_register_program
+* Description: frees a register program.
+* Parameters: RegisterProgram* registers
+* Return: void
+* ***********************************************************/
+void free_register_program(RegisterProgram* registers) {
+    if (!registers) return;
+    for (size_t f = 0; f < registers->function_count; f++) {
+        free(registers->functions[f].code);
+        free(registers->functions[f].constants);
+        free(registers->functions[f].labels);
+    }
+    free(registers->functions);
+    free(registers);
+}
+
+
+
+
+/***********************************************************
+* Function: print_register_value
+* Description: prints the initial value of a constant register.
+* Parameters: const RuntimeValue* value
+* Return: void
+* ***********************************************************/
+static void print_register_value(const RuntimeValue* value) {
+    switch (value->type) {
+    case RUNTIME_VALUE_INT:    printf("%ld", value->int_val); break;
+    case RUNTIME_VALUE_FLOAT:  printf("%f", value->float_val); break;
+    case RUNTIME_VALUE_BOOL:   printf("%s", value->bool_val ? "true" : "false"); break;
+    case RUNTIME_VALUE_STRING: printf("\"%s\"", value->string_val); break;
+    case RUNTIME_VALUE_NULL:   printf("null"); break;
+    default:                   printf("?"); break;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: print_register_code
+* Description: prints the register code of every function of the program.
+* Parameters: const RegisterProgram* registers
+* Return: void
+* ***********************************************************/
+void print_register_code(const RegisterProgram* registers) {
+    printf("=== REGISTER CODE ===\n");
+    for (size_t f = 0; f < registers->function_count; f++) {
+        const RegisterFunction* function = &registers->functions[f];
+        const CodeObject* source = &registers->program->functions[f];
+        printf("--- FUNCTION %zu: %s (LOCALS: R0-R%d, TEMPS: %d from %d virtual, %zu instructions) ---\n",
+            f, source->name, function->local_count - 1, function->temp_count, function->virtual_count, function->instruction_count);
+
+        for (size_t c = 0; c < function->constant_count; c++) {
+            printf("  R%zu = ", function->constant_base + c);
+            print_register_value(&function->constants[c]);
+            printf("\n");
+        }
+
+        size_t pc = 0;
+        while (pc < function->code_size) {
+            uint32_t word = function->code[pc];
+            RegisterOpcode opcode = (RegisterOpcode)(word & 0xFF);
+            unsigned a = (word >> 8) & 0xFF;
+            unsigned b = (word >> 16) & 0xFF;
+            unsigned c = word >> 24;
+            if (opcode >= REG_COUNT_) {
+                printf("[%4zu] <invalid opcode %u>\n", pc, (unsigned)opcode);
+                break;
+            }
+
+            printf("[%4zu] %s", pc, RegisterOpcodeNames[opcode]);
+            switch (opcode) {
+            case REG_MOVE:
+            case REG_NEGATE:
+            case REG_NOT:
+            case REG_BIT_NOT:
+                printf(" R%u, R%u", a, b);
+                break;
+            case REG_LOAD_GLOBAL:
+            case REG_STORE_GLOBAL: {
+                unsigned slot = word >> 16;
+                printf(" R%u, GLOBAL_INDEX: %u", a, slot);
+                if (slot < registers->program->global_count) printf(" (\"%s\")", registers->program->global_names[slot]);
+                break;
+            }
+            case REG_LOAD_UPVALUE:
+                printf(" R%u, UPVALUE_INDEX: %u", a, word >> 16);
+                break;
+            case REG_OR_GLOBAL: {
+                uint32_t slot = function->code[pc + 1];
+                printf(" R%u, R%u, GLOBAL_INDEX: %u", a, b, slot);
+                if (slot < registers->program->global_count) printf(" (\"%s\")", registers->program->global_names[slot]);
+                break;
+            }
+            case REG_JUMP:
+                printf(" TARGET: %u", word >> 8);
+                break;
+            case REG_JUMP_IF_FALSE:
+                printf(" R%u, TARGET: %u", a, function->code[pc + 1]);
+                break;
+            case REG_FOR_PREP:
+            case REG_FOR_LOOP:
+                printf(" R%u, R%u, R%u, TARGET: %u", a, b, c, function->code[pc + 1]);
+                break;
+            case REG_SWITCH: {
+                uint32_t offset = function->code[pc + 1];
+                printf(" R%u, TABLE OF [%u]", a, offset);
+                if (function->labels && offset < source->code_size && source->code[offset] == OP_SWITCH_) {
+                    printf(", DEFAULT: %u", function->labels[read_u32(source->code + offset + 4)]);
+                }
+                break;
+            }
+            case REG_BUILD_ARRAY:
+                printf(" R%u, COUNT: %u", a, word >> 16);
+                break;
+            case REG_DECL_FUNCTION:
+                printf(" FUNCTION: %u", word >> 8);
+                break;
+            case REG_CALL:
+            case REG_TAIL_CALL: {
+                uint32_t name = function->code[pc + 1];
+                printf(" R%u, NAME: ", a);
+                if (name < source->constant_count && source->constants[name].type == RUNTIME_VALUE_STRING) printf("%s", source->constants[name].string_val);
+                else printf("CONST[%u]", name);
+                printf(", ARG_COUNT: %u", b);
+                break;
+            }
+            case REG_RETURN:
+                printf(" R%u", a);
+                break;
+            case REG_HALT:
+                break;
+            default:
+                if (is_compare_jump(opcode)) printf(" R%u, R%u, TARGET: %u", b, c, function->code[pc + 1]);
+                else printf(" R%u, R%u, R%u", a, b, c);
+                break;
+            }
+            printf("\n");
+            pc += instruction_words(opcode);
+        }
+    }
+    printf("=== END REGISTER CODE ===\n");
+}
+
+
+
+
+/***********************************************************
+* Function: print_register_stats
+* Description: prints the instruction and register counts of the translation.
+* Parameters: const RegisterProgram* registers, FILE* out
+* Return: void
+* ***********************************************************/
+void print_register_stats(const RegisterProgram* registers, FILE* out) {
+    size_t stack_total = 0;
+    size_t register_total = 0;
+    fprintf(out, "=== REGISTER CODE ===\n");
+    fprintf(out, "%-24s %8s %10s %10s %8s\n", "function", "stack", "registers", "virtual", "window");
+    for (size_t f = 0; f < registers->function_count; f++) {
+        const RegisterFunction* function = &registers->functions[f];
+        fprintf(out, "%-24s %8zu %10zu %10d %8d\n", registers->program->functions[f].name,
+            function->stack_instruction_count, function->instruction_count, function->virtual_count, function->frame_size);
+        stack_total += function->stack_instruction_count;
+        register_total += function->instruction_count;
+    }
+    fprintf(out, "Instructions: %zu stack, %zu register\n", stack_total, register_total);
+}
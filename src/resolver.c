@@ -0,0 +1,299 @@
+/***********************************************************
+* File: resolver.c
+* This file have the resolver of the tree-walking interpreter (see resolver.h).
+* The first pass over a function body builds the layout of its frame, the second one
+* annotates every use of a variable with where it lives and collects the variables the
+* function captures from the functions around it.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "resolver.h"
+
+// A function frame being resolved (or the global variables, the outermost one)
+typedef struct ResolverScope {
+    ASTNode* layout;                 // One node per slot, its operator_ is the name of the variable
+    ASTNode* upvalues;               // Captured variables of the function (NULL for the globals)
+    struct ResolverScope* enclosing; // Scope the function is declared in (NULL for the globals)
+} ResolverScope;
+
+
+
+
+/***********************************************************
+* Function: find_slot
+* Description: finds the slot of a variable in a frame layout.
+* Parameters: const ASTNode* layout, const char* name
+* Return: int (-1 if the frame has no such variable)
+* ***********************************************************/
+static int find_slot(const ASTNode* layout, const char* name) {
+    for (size_t i = 0; i < layout->child_count; i++) {
+        if (strcmp(layout->children[i]->operator_, name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+
+
+
+/***********************************************************
+* Function: append_slot
+* Description: gives the next slot of a frame layout to a named node. The node stays a child
+* of its own parent, the layout only points at it.
+* Parameters: ASTNode* layout, ASTNode* named
+* Return: void
+* ***********************************************************/
+static void append_slot(ASTNode* layout, ASTNode* named) {
+    ASTNode** children = (ASTNode**)realloc(layout->children, sizeof(ASTNode*) * (layout->child_count + 1));
+    if (!children) {
+        fprintf(stderr, "Memory allocation failed in append_slot.\n");
+        exit(EXIT_FAILURE);
+    }
+    children[layout->child_count++] = named;
+    layout->children = children;
+}
+
+
+
+
+/***********************************************************
+* Function: collect_locals
+* Description: gives a slot to every variable assigned in a function body (or at the top
+* level) and to every named for counter. Nested function declarations have their own frame
+* and are skipped.
+* Parameters: ASTNode* layout, ASTNode* node
+* Return: void
+* ***********************************************************/
+static void collect_locals(ASTNode* layout, ASTNode* node) {
+    if (!node || node->type == AST_FUNCTION_DECLARATION) return;
+
+    ASTNode* named = NULL;
+    if (node->type == AST_ASSIGNMENT && node->child_count > 0 &&
+        node->children[0] && node->children[0]->type == AST_IDENTIFIER) {
+        named = node->children[0];
+    }
+    else if (node->type == AST_FOR_STATEMENT && node->operator_) {
+        named = node;
+    }
+    if (named && find_slot(layout, named->operator_) < 0) {
+        append_slot(layout, named);
+    }
+
+    for (size_t i = 0; i < node->child_count; i++) {
+        collect_locals(layout, node->children[i]);
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: mark_tail_calls
+* Description: marks the return statements of a function body that return a call, so
+* eval_return_statement runs them as tail calls (see eval_tail_call).
+* Nested function declarations are marked with their own body.
+* Parameters: ASTNode* node
+* Return: void
+* ***********************************************************/
+static void mark_tail_calls(ASTNode* node) {
+    if (!node || node->type == AST_FUNCTION_DECLARATION) return;
+
+    if (node->type == AST_RETURN_STATEMENT) {
+        node->tail_call = node->child_count > 0 && node->children[0] &&
+            node->children[0]->type == AST_FUNCTION_CALL;
+        return;
+    }
+    for (size_t i = 0; i < node->child_count; i++) {
+        mark_tail_calls(node->children[i]);
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: resolve_capture
+* Description: finds a variable of the functions enclosing a function and captures it: from a
+* slot of the frame the function is declared in, or else from a variable that frame captured
+* itself. Each variable is captured once per function.
+* Parameters: const ResolverScope* scope, const char* name
+* Return: int (index of the capture, -1 if no enclosing function has the variable)
+* ***********************************************************/
+static int resolve_capture(const ResolverScope* scope, const char* name) {
+    const ResolverScope* enclosing = scope->enclosing;
+    if (!enclosing || !enclosing->enclosing) return -1; // Globals aren't captured
+
+    int captured = find_slot(scope->upvalues, name);
+    if (captured >= 0) return captured;
+
+    VariableScope from = SCOPE_LOCAL;
+    int slot = find_slot(enclosing->layout, name);
+    if (slot < 0) {
+        from = SCOPE_UPVALUE;
+        slot = resolve_capture(enclosing, name);
+        if (slot < 0) return -1;
+    }
+
+    ASTNode* capture = create_ast_node(AST_IDENTIFIER, scope->upvalues->line, scope->upvalues->column, name);
+    capture->scope = from;
+    capture->slot = slot;
+    capture->global_slot = (from == SCOPE_LOCAL ? enclosing->layout : enclosing->upvalues)->children[slot]->global_slot;
+    ast_add_child(scope->upvalues, capture);
+    return (int)scope->upvalues->child_count - 1;
+}
+
+
+
+
+/***********************************************************
+* Function: resolve_name
+* Description: annotates a node naming a variable with where it lives: a slot of the current
+* frame, a captured variable of an enclosing function or a global. Names nobody has are
+* left to be looked up by name. A local that hides a global also keeps the global slot,
+* which is read until the local is first assigned.
+* Parameters: const ResolverScope* scope, ASTNode* node
+* Return: void
+* ***********************************************************/
+static void resolve_name(const ResolverScope* scope, ASTNode* node) {
+    if (!node->operator_) return;
+
+    const ResolverScope* globals = scope;
+    while (globals->enclosing) globals = globals->enclosing;
+
+    int slot = find_slot(scope->layout, node->operator_);
+    if (slot >= 0) {
+        node->scope = scope == globals ? SCOPE_GLOBAL : SCOPE_LOCAL;
+        node->slot = slot;
+        node->global_slot = scope->layout->children[slot]->global_slot;
+        return;
+    }
+    slot = resolve_capture(scope, node->operator_);
+    if (slot >= 0) {
+        node->scope = SCOPE_UPVALUE;
+        node->slot = slot;
+        node->global_slot = scope->upvalues->children[slot]->global_slot;
+        return;
+    }
+    slot = find_slot(globals->layout, node->operator_);
+    if (slot >= 0) {
+        node->scope = SCOPE_GLOBAL;
+        node->slot = slot;
+    }
+}
+
+
+
+
+static void resolve_node(const ResolverScope* scope, ASTNode* node);
+
+/***********************************************************
+* Function: resolve_function
+* Description: builds the frame layout of a function declaration (its parameters, then its
+* locals) and resolves its body against it, which also collects its captures. The locals
+* named like a global start unassigned and read the global until then (see RUNTIME_VALUE_UNSET).
+* Parameters: const ResolverScope* scope, ASTNode* node
+* Return: void
+* ***********************************************************/
+static void resolve_function(const ResolverScope* scope, ASTNode* node) {
+    if (node->child_count < 2) return;
+
+    // children: name, parameters..., body
+    size_t param_count = node->child_count - 2;
+    ASTNode* body = node->children[node->child_count - 1];
+    ASTNode* layout = create_ast_node(AST_PARAMETER_LIST, node->line, node->column, NULL);
+    ast_node_set_int(layout, (long)param_count);
+    for (size_t i = 0; i < param_count; i++) {
+        ASTNode* parameter = node->children[1 + i];
+        parameter->scope = SCOPE_LOCAL;
+        parameter->slot = (int)i;
+        append_slot(layout, parameter);
+    }
+    if (body) {
+        for (size_t i = 0; i < body->child_count; i++) {
+            collect_locals(layout, body->children[i]);
+            mark_tail_calls(body->children[i]);
+        }
+    }
+    const ResolverScope* globals = scope;
+    while (globals->enclosing) globals = globals->enclosing;
+    for (size_t i = param_count; i < layout->child_count; i++) {
+        layout->children[i]->global_slot = find_slot(globals->layout, layout->children[i]->operator_);
+    }
+    node->frame_layout = layout;
+    node->upvalue_layout = create_ast_node(AST_PARAMETER_LIST, node->line, node->column, NULL);
+
+    ResolverScope inner = { layout, node->upvalue_layout, (ResolverScope*)scope };
+    resolve_node(&inner, body);
+}
+
+
+
+
+/***********************************************************
+* Function: resolve_node
+* Description: annotates every variable used under a node.
+* Parameters: const ResolverScope* scope, ASTNode* node
+* Return: void
+* ***********************************************************/
+static void resolve_node(const ResolverScope* scope, ASTNode* node) {
+    if (!node) return;
+
+    switch (node->type) {
+    case AST_IDENTIFIER:
+        resolve_name(scope, node);
+        return;
+
+    case AST_FOR_STATEMENT:
+        if (node->operator_) resolve_name(scope, node);
+        break;
+
+    case AST_FUNCTION_CALL:
+        // The callee is looked up among the functions, only the arguments are variables
+        for (size_t i = 1; i < node->child_count; i++) {
+            resolve_node(scope, node->children[i]);
+        }
+        return;
+
+    case AST_FUNCTION_DECLARATION:
+        resolve_function(scope, node);
+        return;
+
+    default:
+        break;
+    }
+
+    for (size_t i = 0; i < node->child_count; i++) {
+        resolve_node(scope, node->children[i]);
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: resolve_program
+* Description: resolves every variable of a program, the top level code runs in the frame
+* of the global variables.
+* Parameters: ASTNode* root
+* Return: void
+* ***********************************************************/
+void resolve_program(ASTNode* root) {
+    if (!root || root->frame_layout) return;
+
+    ASTNode* layout = create_ast_node(AST_PARAMETER_LIST, root->line, root->column, NULL);
+    ast_node_set_int(layout, 0);
+    collect_locals(layout, root);
+    root->frame_layout = layout;
+
+    ResolverScope globals = { layout, NULL, NULL };
+    resolve_node(&globals, root);
+}
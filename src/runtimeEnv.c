@@ -9,6 +9,9 @@
 
 #pragma warning(disable : 4996)
 
+// Starts at 1 so a zeroed FunctionCache is empty
+unsigned long function_definition_version = 1;
+
 /***********************************************************
 * Function: hash_string
 * Description: this function hashes a string
@@ -42,11 +45,14 @@ RuntimeEnvironment* create_environment(RuntimeEnvironment* parent) {
     }
 
     // Initialize fields
-    env->function_returned = false;             // No function has returned yet
+    env->completion = COMPLETION_NORMAL;        // Nothing has returned yet
     env->return_value = make_null_value();      // Initialize return value as null
     env->parent = parent;                       // Link to the parent environment
     env->variables = NULL;                      // Initialize variable list to empty
     env->functions = NULL;                      // Initialize function list to empty
+    env->is_Function = false;
+    env->slots = NULL;                          // Not a call frame
+    env->layout = NULL;
 
     return env;
 }
@@ -555,6 +561,8 @@ void free_runtime_value(RuntimeValue* val)
             free(val->function_val.parameters);
             val->function_val.parameters = NULL;
         }
+        free(val->function_val.upvalues);
+        val->function_val.upvalues = NULL;
         break;
     case RUNTIME_VALUE_SPECIAL:
         if (val->special_val) {
@@ -611,6 +619,56 @@ void free_environment(RuntimeEnvironment* env) {
 
 
 
+/***********************************************************
+* Function: release_environment_entries
+* Description: this function frees the bindings of an environment but not their values
+* Parameters: RuntimeEnvironment* env
+* Return: void
+* ***********************************************************/
+void release_environment_entries(RuntimeEnvironment* env) {
+    if (!env) return;
+
+    EnvEntry* lists[2] = { env->variables, env->functions };
+    for (int i = 0; i < 2; i++) {
+        EnvEntry* entry = lists[i];
+        while (entry) {
+            EnvEntry* next = entry->next;
+            // The captures of a function declared in the frame point into the frame
+            if (entry->value.type == RUNTIME_VALUE_FUNCTION) {
+                free(entry->value.function_val.upvalues);
+            }
+            free(entry->key);
+            free(entry);
+            entry = next;
+        }
+    }
+    env->variables = NULL;
+    env->functions = NULL;
+}
+
+
+
+
+/***********************************************************
+* Function: env_find_slot
+* Description: this function finds a variable in the value stack window of a call frame
+* Parameters: RuntimeEnvironment* env, const char* key
+* Return: RuntimeValue* (NULL if the name has no slot)
+* ***********************************************************/
+static RuntimeValue* env_find_slot(RuntimeEnvironment* env, const char* key) {
+    if (!env->slots) return NULL;
+
+    for (size_t i = 0; i < env->layout->child_count; i++) {
+        if (strcmp(env->layout->children[i]->operator_, key) == 0) {
+            return &env->slots[i];
+        }
+    }
+    return NULL;
+}
+
+
+
+
 
 void env_set_var(RuntimeEnvironment* env, const char* key, RuntimeValue value) {
     if (!env || !key) {
@@ -618,6 +676,13 @@ void env_set_var(RuntimeEnvironment* env, const char* key, RuntimeValue value) {
         return;
     }
 
+    // Parameters and locals of a call live in its frame
+    RuntimeValue* slot = env_find_slot(env, key);
+    if (slot) {
+        *slot = value;
+        return;
+    }
+
     // Search for an existing variable in the current environment
     EnvEntry* entry = env->variables;
     while (entry) {
@@ -654,12 +719,22 @@ void env_set_func(RuntimeEnvironment* env, const char* key, RuntimeValue value)
     EnvEntry* entry = env->functions;
     while (entry) {
         if (strcmp(entry->key, key) == 0) {
+            if (entry->value.type == RUNTIME_VALUE_FUNCTION && entry->value.function_val.upvalues != value.function_val.upvalues) {
+                free(entry->value.function_val.upvalues);
+            }
+            // A redefined global function may be in the call site caches
+            if (!env->parent) function_definition_version++;
             entry->value = value; // Update value
             return;
         }
         entry = entry->next;
     }
 
+    // A function declared inside a call hides the outer function of the same name
+    if (env->parent && env_get_func(env->parent, key).type != RUNTIME_VALUE_NULL) {
+        function_definition_version++;
+    }
+
     // Function not found: Create a new entry
     EnvEntry* new_entry = (EnvEntry*)malloc(sizeof(EnvEntry));
     if (!new_entry) {
@@ -688,6 +763,12 @@ RuntimeValue env_get_var(RuntimeEnvironment* env, const char* key) {
 
     // Traverse the stack of environments
     while (current) {
+        // A local that hides a global is not bound until it is assigned, the lookup goes on
+        RuntimeValue* slot = env_find_slot(current, key);
+        if (slot && slot->type != RUNTIME_VALUE_UNSET) {
+            return *slot;
+        }
+
         EnvEntry* entry = current->variables;
         while (entry) {
             if (strcmp(entry->key, key) == 0) {
@@ -705,6 +786,19 @@ RuntimeValue env_get_var(RuntimeEnvironment* env, const char* key) {
 
 
 
+/***********************************************************
+* Function: function_is_cacheable
+* Description: this function tells if a call site may cache the callee (see FunctionCache)
+* Parameters: RuntimeValue function
+* Return: bool
+* ***********************************************************/
+bool function_is_cacheable(RuntimeValue function) {
+    if (function.type == RUNTIME_VALUE_BUILTIN) return true;
+    return function.type == RUNTIME_VALUE_FUNCTION && function.function_val.env && !function.function_val.env->parent;
+}
+
+
+
 
 RuntimeValue env_get_func(RuntimeEnvironment* env, const char* key) {
     if (!env || !key) {
@@ -126,3 +126,20 @@ RuntimeValue make_null_value(void) {
     v.type = RUNTIME_VALUE_NULL;
     return v;
 }
+
+
+
+
+
+/***********************************************************
+* Function: make_unset_value
+* Description: this function prepares the value of a local that hides a global until it is
+* first assigned (reads of it fall back to the global).
+* Parameters: void
+* Return: RuntimeValue
+* ***********************************************************/
+RuntimeValue make_unset_value(void) {
+    RuntimeValue v;
+    v.type = RUNTIME_VALUE_UNSET;
+    return v;
+}
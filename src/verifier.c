@@ -0,0 +1,263 @@
+/***********************************************************
+* File: verifier.c
+* This file have the bytecode verifier (see verifier.h). It works on the packed code,
+* which is what a .clkb file holds: the first pass decodes every instruction and checks
+* its operands, the second checks the jump targets and the last one follows every path
+* from the start of the code with the depth of the operand stack.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#include <stdlib.h>
+#include "verifier.h"
+
+
+
+
+/***********************************************************
+* Function: check_captures
+* Description: every variable a declared function captures must be a local slot or a
+* capture of the function declaring it.
+* Parameters: const CodeObject* function, const CodeObject* declared
+* Return: bool
+* ***********************************************************/
+static bool check_captures(const CodeObject* function, const CodeObject* declared) {
+    for (int i = 0; i < declared->capture_count; i++) {
+        const Capture* capture = &declared->captures[i];
+        int limit = capture->from_local ? function->local_count : function->capture_count;
+        if (capture->index >= limit) return false;
+    }
+    return true;
+}
+
+
+
+
+/***********************************************************
+* Function: check_operands
+* Description: decodes every instruction, checks its operands are in range and marks where
+* the instructions start. The code must end with OP_HALT/OP_RETURN_, so no path runs past it.
+* Parameters: const CodeObject* function, const BytecodeProgram* program, uint8_t* starts
+* Return: bool
+* ***********************************************************/
+static bool check_operands(const CodeObject* function, const BytecodeProgram* program, uint8_t* starts) {
+    bool ok = true;
+    size_t offset = 0;
+    uint8_t last = 0;
+    while (ok && offset < function->code_size) {
+        const uint8_t* p = function->code + offset;
+        size_t size = packed_instruction_size(p[0]);
+        if (size == 0 || offset + size > function->code_size) {
+            return false;
+        }
+        starts[offset] = 1;
+
+        switch (p[0]) {
+        case OP_LOAD_CONST_:
+            ok = read_u16(p + 1) < function->constant_count;
+            break;
+        case OP_CALL_FUNCTION:
+        case OP_TAIL_CALL:
+            ok = read_u16(p + 1) < function->constant_count &&
+                function->constants[read_u16(p + 1)].type == RUNTIME_VALUE_STRING;
+            break;
+        case OP_LOAD_GLOBAL:
+        case OP_STORE_GLOBAL:
+        case OP_OR_GLOBAL:
+            ok = read_u16(p + 1) < program->global_count;
+            break;
+        case OP_LOAD_LOCAL:
+        case OP_STORE_LOCAL:
+        case OP_UNSET_LOCAL:
+        case OP_INC_LOCAL:
+            ok = p[1] < function->local_count;
+            break;
+        case OP_LOAD_UPVALUE:
+            ok = p[1] < function->capture_count;
+            break;
+        case OP_INC_GLOBAL:
+            ok = read_u16(p + 1) < program->global_count;
+            break;
+        case OP_LOAD_LOCAL_ELEMENT:
+            ok = p[1] < function->local_count && p[2] < function->local_count;
+            break;
+        case OP_COMPARE_LOCALS_JUMP_IF_FALSE:
+            ok = p[1] < function->local_count && p[2] < function->local_count &&
+                p[3] >= OP_LESS && p[3] <= OP_NOT_EQUAL;
+            break;
+        case OP_COMPARE_JUMP_IF_FALSE:
+            ok = p[1] >= OP_LESS && p[1] <= OP_NOT_EQUAL;
+            break;
+        case OP_FOR_PREP_LOCAL:
+        case OP_FOR_LOOP_LOCAL:
+            ok = p[1] + 1 < function->local_count && p[2] < function->local_count;
+            break;
+        case OP_FOR_PREP_GLOBAL:
+        case OP_FOR_LOOP_GLOBAL:
+            ok = read_u16(p + 1) + 1u < program->global_count && read_u16(p + 3) < program->global_count;
+            break;
+        case OP_DECL_FUNCTION:
+            ok = read_u16(p + 1) > 0 && read_u16(p + 1) < program->function_count &&
+                check_captures(function, &program->functions[read_u16(p + 1)]);
+            break;
+        case OP_SWITCH_:
+            ok = switch_slot_count(function, p) > 0;
+            break;
+        default:
+            break;
+        }
+        last = p[0];
+        offset += size;
+    }
+    return ok && (last == OP_HALT || last == OP_RETURN_);
+}
+
+
+
+
+/***********************************************************
+* Function: check_targets
+* Description: jumps (and every case of a switch) must land on the start of an instruction.
+* Parameters: const CodeObject* function, const uint8_t* starts
+* Return: bool
+* ***********************************************************/
+static bool check_targets(const CodeObject* function, const uint8_t* starts) {
+    for (size_t offset = 0; offset < function->code_size; offset += packed_instruction_size(function->code[offset])) {
+        const uint8_t* p = function->code + offset;
+        size_t jump = packed_jump_operand(p[0]);
+        if (jump) {
+            uint32_t target = read_u32(p + jump);
+            if (target >= function->code_size || !starts[target]) return false;
+        }
+        if (p[0] == OP_SWITCH_) {
+            size_t slots = switch_slot_count(function, p);
+            for (size_t slot = 0; slot < slots; slot++) {
+                if (!starts[switch_slot_target(function, p, slot)]) return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+
+
+/***********************************************************
+* Function: reach
+* Description: the operand stack depth a path brings to an instruction. The first path to
+* reach it queues the instruction, every later one must bring the same depth.
+* Parameters: int* depths, uint32_t* pending, size_t* pending_count, uint32_t offset, int depth
+* Return: bool (false on a disagreement)
+* ***********************************************************/
+static bool reach(int* depths, uint32_t* pending, size_t* pending_count, uint32_t offset, int depth) {
+    if (depths[offset] >= 0) return depths[offset] == depth;
+    depths[offset] = depth;
+    pending[(*pending_count)++] = offset;
+    return true;
+}
+
+
+
+
+/***********************************************************
+* Function: check_stack
+* Description: follows every path from the start of the code with the operand stack depth.
+* No instruction may take more values than the stack holds (the values below belong to the
+* caller), and paths that meet must agree on the depth. Instructions no path reaches
+* never run and aren't checked.
+* Parameters: const CodeObject* function, size_t* max_stack (out)
+* Return: bool
+* ***********************************************************/
+static bool check_stack(const CodeObject* function, size_t* max_stack) {
+    size_t code_size = function->code_size;
+    int* depths = (int*)malloc(code_size * sizeof(int));
+    uint32_t* pending = (uint32_t*)malloc(code_size * sizeof(uint32_t));
+    bool ok = depths && pending;
+
+    for (size_t i = 0; ok && i < code_size; i++) depths[i] = -1;
+
+    size_t pending_count = 0;
+    int max_depth = 0;
+    if (ok) reach(depths, pending, &pending_count, 0, 0);
+    while (ok && pending_count > 0) {
+        uint32_t offset = pending[--pending_count];
+        const uint8_t* p = function->code + offset;
+        int pops;
+        int pushes;
+        packed_stack_effect(p[0], p, &pops, &pushes);
+        if (pops > depths[offset]) {
+            ok = false;
+            break;
+        }
+        int depth = depths[offset] - pops + pushes;
+        if (depth > max_depth) max_depth = depth;
+
+        // Every code ends with OP_HALT/OP_RETURN_, so an instruction that falls through has a next one
+        if (p[0] != OP_JUMP_TO && p[0] != OP_SWITCH_ && p[0] != OP_RETURN_ && p[0] != OP_HALT) {
+            ok = reach(depths, pending, &pending_count, offset + (uint32_t)packed_instruction_size(p[0]), depth);
+        }
+        size_t jump = packed_jump_operand(p[0]);
+        if (ok && jump) {
+            ok = reach(depths, pending, &pending_count, read_u32(p + jump), depth);
+        }
+        if (p[0] == OP_SWITCH_) {
+            size_t slots = switch_slot_count(function, p);
+            for (size_t slot = 0; ok && slot < slots; slot++) {
+                ok = reach(depths, pending, &pending_count, switch_slot_target(function, p, slot), depth);
+            }
+        }
+    }
+
+    free(depths);
+    free(pending);
+    *max_stack = (size_t)max_depth;
+    return ok;
+}
+
+
+
+
+/***********************************************************
+* Function: verify_function
+* Description: checks that a code object can be run without any check of the operands or of
+* the operand stack, and records its deepest operand stack in max_stack.
+* Parameters: CodeObject* function, const BytecodeProgram* program
+* Return: bool
+* ***********************************************************/
+bool verify_function(CodeObject* function, const BytecodeProgram* program) {
+    if (function->code_size == 0 || function->code_size > UINT32_MAX) return false;
+
+    uint8_t* starts = (uint8_t*)calloc(function->code_size, 1);
+    if (!starts) return false;
+    size_t max_stack = 0;
+    bool ok = check_operands(function, program, starts) && check_targets(function, starts) &&
+        check_stack(function, &max_stack);
+    free(starts);
+
+    function->max_stack = ok ? max_stack : 0;
+    return ok;
+}
+
+
+
+
+/***********************************************************
+* Function: verify_program
+* Description: verifies every function of a program. Stubs have no code yet,
+* compile_function verifies each one once it is compiled.
+* Parameters: BytecodeProgram* program
+* Return: bool
+* ***********************************************************/
+bool verify_program(BytecodeProgram* program) {
+    program->verified = false;
+    for (size_t f = 0; f < program->function_count; f++) {
+        if (program->functions[f].declaration) continue;
+        if (!verify_function(&program->functions[f], program)) return false;
+    }
+    program->verified = true;
+    return true;
+}
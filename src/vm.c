@@ -0,0 +1,1950 @@
+/***********************************************************
+* File: vm.c
+* This file contains the virtual machine for the Clock coding language.
+* The virtual machine executes the bytecode produced by generate_bytecode
+* with an operand stack and call frames instead of walking the AST.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "vm.h"
+#include "vmProfile.h"
+#include "interpreter.h"
+
+
+
+
+// Direct threading needs the labels as values extension of GCC/Clang
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(CLOCK_SWITCH_DISPATCH)
+#define VM_COMPUTED_GOTO 1
+#else
+#define VM_COMPUTED_GOTO 0
+#endif
+
+// Opcodes with a handler in vm_run (used to build the dispatch table)
+#define VM_OPCODES(X) \
+    X(OP_PUSH_INT) X(OP_PUSH_BOOL) X(OP_LOAD_CONST_) X(OP_PUSH_NULL) \
+    X(OP_POP) X(OP_DUP) X(OP_LOAD_LOCAL) X(OP_STORE_LOCAL) X(OP_LOAD_GLOBAL) X(OP_STORE_GLOBAL) \
+    X(OP_LOAD_UPVALUE) X(OP_UNSET_LOCAL) X(OP_OR_GLOBAL) X(OP_FOR_PREP_LOCAL) X(OP_FOR_LOOP_LOCAL) X(OP_FOR_PREP_GLOBAL) X(OP_FOR_LOOP_GLOBAL) \
+    X(OP_ADD_) X(OP_SUBTRACT) X(OP_MULTIPLY) X(OP_DIVIDE) X(OP_MODULO) \
+    X(OP_LESS) X(OP_GREATER) X(OP_LESS_EQUAL) X(OP_GREATER_EQUAL) X(OP_EQUAL) X(OP_NOT_EQUAL) \
+    X(OP_AND_) X(OP_OR_) X(OP_NEGATE) X(OP_NOT_) X(OP_BIT_NOT) \
+    X(OP_JUMP_TO) X(OP_JUMP_TO_IF_FALSE) X(OP_SWITCH_) X(OP_BUILD_ARRAY) X(OP_ARRAY_GET_) X(OP_ARRAY_SET_) \
+    X(OP_DECL_FUNCTION) X(OP_CALL_FUNCTION) X(OP_RETURN_) X(OP_HALT) \
+    X(OP_INC_LOCAL) X(OP_INC_GLOBAL) X(OP_COMPARE_JUMP_IF_FALSE) X(OP_COMPARE_LOCALS_JUMP_IF_FALSE) \
+    X(OP_LOAD_LOCAL_ELEMENT) X(OP_TAIL_CALL) \
+    X(OP_ADD_INT_INT) X(OP_SUBTRACT_INT_INT) X(OP_MULTIPLY_INT_INT) X(OP_DIVIDE_INT_INT) X(OP_MODULO_INT_INT) \
+    X(OP_LESS_INT_INT) X(OP_GREATER_INT_INT) X(OP_LESS_EQUAL_INT_INT) X(OP_GREATER_EQUAL_INT_INT) \
+    X(OP_EQUAL_INT_INT) X(OP_NOT_EQUAL_INT_INT) \
+    X(OP_ADD_FLOAT_FLOAT) X(OP_SUBTRACT_FLOAT_FLOAT) X(OP_MULTIPLY_FLOAT_FLOAT) X(OP_DIVIDE_FLOAT_FLOAT) \
+    X(OP_LESS_FLOAT_FLOAT) X(OP_GREATER_FLOAT_FLOAT)
+
+// Register opcodes with a handler in vm_run_registers
+#define VM_REGISTER_OPCODES(X) \
+    X(REG_MOVE) X(REG_LOAD_GLOBAL) X(REG_STORE_GLOBAL) X(REG_LOAD_UPVALUE) X(REG_OR_GLOBAL) \
+    X(REG_ADD) X(REG_SUBTRACT) X(REG_MULTIPLY) X(REG_DIVIDE) X(REG_MODULO) \
+    X(REG_LESS) X(REG_GREATER) X(REG_LESS_EQUAL) X(REG_GREATER_EQUAL) X(REG_EQUAL) X(REG_NOT_EQUAL) \
+    X(REG_AND) X(REG_OR) X(REG_NEGATE) X(REG_NOT) X(REG_BIT_NOT) \
+    X(REG_JUMP) X(REG_JUMP_IF_FALSE) X(REG_SWITCH) X(REG_FOR_PREP) X(REG_FOR_LOOP) \
+    X(REG_LESS_JUMP_IF_FALSE) X(REG_GREATER_JUMP_IF_FALSE) X(REG_LESS_EQUAL_JUMP_IF_FALSE) \
+    X(REG_GREATER_EQUAL_JUMP_IF_FALSE) X(REG_EQUAL_JUMP_IF_FALSE) X(REG_NOT_EQUAL_JUMP_IF_FALSE) \
+    X(REG_GET_ELEMENT) X(REG_SET_ELEMENT) X(REG_BUILD_ARRAY) \
+    X(REG_DECL_FUNCTION) X(REG_CALL) X(REG_TAIL_CALL) X(REG_RETURN) X(REG_HALT)
+
+// Every program the VM runs passed the verifier (verifier.h), so the operand stack can't overflow
+// within a frame nor underflow. Build with -DCLOCK_CHECK_STACK to check every push and pop anyway
+#ifdef CLOCK_CHECK_STACK
+#define VM_CHECK_STACK 1
+#else
+#define VM_CHECK_STACK 0
+#endif
+
+// Build with -DCLOCK_COUNT_DISPATCH to count the executed instructions (benchmarks/run_registers.sh)
+#ifdef CLOCK_COUNT_DISPATCH
+#define VM_COUNT_DISPATCH() (vm->dispatch_count++)
+#else
+#define VM_COUNT_DISPATCH() ((void)0)
+#endif
+
+static VmEngine selected_engine = VM_ENGINE_STACK;
+static bool jit_enabled = JIT_SUPPORTED;
+static bool profiling = false;
+
+// Rewrites done by the last run (see vm_quicken)
+static QuickeningStats quickening;
+
+
+
+
+/***********************************************************
+* Function: vm_runtime_error
+* Description: reports a fatal error of the virtual machine and stops the program.
+* Parameters: VirtualMachine* vm, const char* message
+* Return: void
+* ***********************************************************/
+static void vm_runtime_error(VirtualMachine* vm, const char* message) {
+    fprintf(stderr, "VM Runtime Error in %s: %s\n", vm->function ? vm->function->name : "<main>", message);
+    exit(EXIT_FAILURE);
+}
+
+
+
+
+/***********************************************************
+* Function: vm_push / vm_pop
+* Description: operand stack helpers. The room for the deepest stack of a call is checked
+* once when the call starts (see vm_call), so they don't check anything.
+* Parameters: VirtualMachine* vm, RuntimeValue value
+* Return: void / RuntimeValue
+* ***********************************************************/
+static inline void vm_push(VirtualMachine* vm, RuntimeValue value) {
+    if (VM_CHECK_STACK && vm->sp >= VM_STACK_SIZE) {
+        vm_runtime_error(vm, "operand stack overflow.");
+    }
+    vm->stack[vm->sp++] = value;
+}
+
+static inline RuntimeValue vm_pop(VirtualMachine* vm) {
+    if (VM_CHECK_STACK && vm->sp <= vm->frames[vm->frame_count - 1].stack_base) {
+        vm_runtime_error(vm, "operand stack underflow.");
+    }
+    return vm->stack[--vm->sp];
+}
+
+
+
+
+/***********************************************************
+* Function: vm_is_truthy
+* Description: the truthiness rules used by if/while (bool, non zero int/float).
+* Parameters: RuntimeValue value
+* Return: bool
+* ***********************************************************/
+static inline bool vm_is_truthy(RuntimeValue value) {
+    switch (value.type) {
+    case RUNTIME_VALUE_BOOL:
+        return value.bool_val;
+    case RUNTIME_VALUE_INT:
+        return value.int_val != 0;
+    case RUNTIME_VALUE_FLOAT:
+        return value.float_val != 0.0;
+    default:
+        return false;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: vm_arithmetic
+* Description: applies + - * / % with the same typing rules as eval_binary_expr.
+* Parameters: BytecodeOpcode op, RuntimeValue left, RuntimeValue right
+* Return: RuntimeValue
+* ***********************************************************/
+static RuntimeValue vm_arithmetic(BytecodeOpcode op, RuntimeValue left, RuntimeValue right) {
+    if (left.type == RUNTIME_VALUE_INT && right.type == RUNTIME_VALUE_INT) {
+        long l = left.int_val;
+        long r = right.int_val;
+        switch (op) {
+        case OP_ADD_:      return make_int_value(l + r);
+        case OP_SUBTRACT:  return make_int_value(l - r);
+        case OP_MULTIPLY:  return make_int_value(l * r);
+        case OP_DIVIDE:
+            if (r == 0) {
+                fprintf(stderr, "Runtime Error: division by zero.\n");
+                return make_null_value();
+            }
+            return make_int_value(l / r);
+        case OP_MODULO:
+            if (r == 0) {
+                fprintf(stderr, "Runtime Error: modulo by zero.\n");
+                return make_null_value();
+            }
+            return make_int_value(l % r);
+        default:
+            break;
+        }
+    }
+    else if (left.type == RUNTIME_VALUE_FLOAT && right.type == RUNTIME_VALUE_FLOAT) {
+        double l = left.float_val;
+        double r = right.float_val;
+        switch (op) {
+        case OP_ADD_:      return make_float_value(l + r);
+        case OP_SUBTRACT:  return make_float_value(l - r);
+        case OP_MULTIPLY:  return make_float_value(l * r);
+        case OP_DIVIDE:
+            if (r == 0.0) {
+                fprintf(stderr, "Runtime Error: division by zero.\n");
+                return make_null_value();
+            }
+            return make_float_value(l / r);
+        default:
+            break;
+        }
+    }
+    return make_null_value();
+}
+
+
+
+
+/***********************************************************
+* Function: vm_compare
+* Description: applies the comparison and logical operators with the same rules as evaluate_comparison.
+* Parameters: BytecodeOpcode op, RuntimeValue left, RuntimeValue right
+* Return: RuntimeValue
+* ***********************************************************/
+static RuntimeValue vm_compare(BytecodeOpcode op, RuntimeValue left, RuntimeValue right) {
+    // Values of different types never compare
+    if (left.type != right.type) {
+        return make_bool_value(false);
+    }
+
+    if (op == OP_AND_ || op == OP_OR_) {
+        bool l = (left.type == RUNTIME_VALUE_BOOL && left.bool_val);
+        bool r = (right.type == RUNTIME_VALUE_BOOL && right.bool_val);
+        return make_bool_value(op == OP_AND_ ? (l && r) : (l || r));
+    }
+
+    int order;
+    switch (left.type) {
+    case RUNTIME_VALUE_INT:
+        order = (left.int_val > right.int_val) - (left.int_val < right.int_val);
+        break;
+    case RUNTIME_VALUE_FLOAT:
+        order = (left.float_val > right.float_val) - (left.float_val < right.float_val);
+        break;
+    case RUNTIME_VALUE_STRING:
+        order = strcmp(left.string_val, right.string_val);
+        break;
+    case RUNTIME_VALUE_BOOL:
+        // For booleans only == and != are meaningful
+        if (op == OP_EQUAL) return make_bool_value(left.bool_val == right.bool_val);
+        if (op == OP_NOT_EQUAL) return make_bool_value(left.bool_val != right.bool_val);
+        return make_bool_value(false);
+    default:
+        return make_bool_value(false);
+    }
+
+    switch (op) {
+    case OP_EQUAL:         return make_bool_value(order == 0);
+    case OP_NOT_EQUAL:     return make_bool_value(order != 0);
+    case OP_LESS:          return make_bool_value(order < 0);
+    case OP_GREATER:       return make_bool_value(order > 0);
+    case OP_LESS_EQUAL:    return make_bool_value(order <= 0);
+    case OP_GREATER_EQUAL: return make_bool_value(order >= 0);
+    default:               return make_bool_value(false);
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: vm_test
+* Description: the comparison of a fused compare-and-jump, with a fast path for two ints.
+* Parameters: BytecodeOpcode op, RuntimeValue left, RuntimeValue right
+* Return: bool
+* ***********************************************************/
+static inline bool vm_test(BytecodeOpcode op, RuntimeValue left, RuntimeValue right) {
+    if (left.type == RUNTIME_VALUE_INT && right.type == RUNTIME_VALUE_INT) {
+        switch (op) {
+        case OP_LESS:          return left.int_val < right.int_val;
+        case OP_GREATER:       return left.int_val > right.int_val;
+        case OP_LESS_EQUAL:    return left.int_val <= right.int_val;
+        case OP_GREATER_EQUAL: return left.int_val >= right.int_val;
+        case OP_EQUAL:         return left.int_val == right.int_val;
+        case OP_NOT_EQUAL:     return left.int_val != right.int_val;
+        default:               break;
+        }
+    }
+    return vm_compare(op, left, right).bool_val;
+}
+
+
+
+
+/***********************************************************
+* Function: vm_quick_opcode
+* Description: the type specialized form of a generic operator for the operand types it saw.
+* Only the pairs whose result is exactly the generic one have a form: two ints, and two floats
+* for the operators without a NaN corner case.
+* Parameters: BytecodeOpcode op, RuntimeValueType left, RuntimeValueType right
+* Return: BytecodeOpcode (op itself when there is no specialized form)
+* ***********************************************************/
+static BytecodeOpcode vm_quick_opcode(BytecodeOpcode op, RuntimeValueType left, RuntimeValueType right) {
+    if (left == RUNTIME_VALUE_INT && right == RUNTIME_VALUE_INT) {
+        switch (op) {
+        case OP_ADD_:          return OP_ADD_INT_INT;
+        case OP_SUBTRACT:      return OP_SUBTRACT_INT_INT;
+        case OP_MULTIPLY:      return OP_MULTIPLY_INT_INT;
+        case OP_DIVIDE:        return OP_DIVIDE_INT_INT;
+        case OP_MODULO:        return OP_MODULO_INT_INT;
+        case OP_LESS:          return OP_LESS_INT_INT;
+        case OP_GREATER:       return OP_GREATER_INT_INT;
+        case OP_LESS_EQUAL:    return OP_LESS_EQUAL_INT_INT;
+        case OP_GREATER_EQUAL: return OP_GREATER_EQUAL_INT_INT;
+        case OP_EQUAL:         return OP_EQUAL_INT_INT;
+        case OP_NOT_EQUAL:     return OP_NOT_EQUAL_INT_INT;
+        default:               break;
+        }
+    }
+    else if (left == RUNTIME_VALUE_FLOAT && right == RUNTIME_VALUE_FLOAT) {
+        switch (op) {
+        case OP_ADD_:          return OP_ADD_FLOAT_FLOAT;
+        case OP_SUBTRACT:      return OP_SUBTRACT_FLOAT_FLOAT;
+        case OP_MULTIPLY:      return OP_MULTIPLY_FLOAT_FLOAT;
+        case OP_DIVIDE:        return OP_DIVIDE_FLOAT_FLOAT;
+        case OP_LESS:          return OP_LESS_FLOAT_FLOAT;
+        case OP_GREATER:       return OP_GREATER_FLOAT_FLOAT;
+        default:               break;
+        }
+    }
+    return op;
+}
+
+
+
+
+/***********************************************************
+* Function: vm_quicken
+* Description: rewrites the generic operator at the given address to its specialized form for
+* the operands it just saw. The specialized handler checks the types again and puts the generic
+* operator back on a miss, so a polymorphic site only pays for the rewrites.
+* Parameters: const uint8_t* at, RuntimeValue left, RuntimeValue right
+* Return: void
+* ***********************************************************/
+static inline void vm_quicken(const uint8_t* at, RuntimeValue left, RuntimeValue right) {
+    BytecodeOpcode quick = vm_quick_opcode((BytecodeOpcode)*at, left.type, right.type);
+    if (quick != (BytecodeOpcode)*at) {
+        *(uint8_t*)at = (uint8_t)quick;   // The running code is writable (see map_file)
+        quickening.quickened++;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: vm_increment
+* Description: adds a constant to a variable slot in place (OP_INC_LOCAL / OP_INC_GLOBAL).
+* Parameters: RuntimeValue* slot, int delta
+* Return: void
+* ***********************************************************/
+static inline void vm_increment(RuntimeValue* slot, int delta) {
+    if (slot->type == RUNTIME_VALUE_INT) slot->int_val += delta;
+    else *slot = vm_arithmetic(OP_ADD_, *slot, make_int_value(delta));
+}
+
+
+
+
+/***********************************************************
+* Function: vm_for_next
+* Description: one step of a counted loop: adds `step` to the counter (0 when the loop starts,
+* 1 at the end of the body) and, if the counter is still lower than the limit, copies it to
+* the named counter. Other types than ints step and compare like `counter + 1` and `<`.
+* Parameters: RuntimeValue* counter, const RuntimeValue* limit, RuntimeValue* named, int step
+* Return: bool (true if the body runs again)
+* ***********************************************************/
+static inline bool vm_for_next(RuntimeValue* counter, const RuntimeValue* limit, RuntimeValue* named, int step) {
+    if (counter->type == RUNTIME_VALUE_INT && limit->type == RUNTIME_VALUE_INT) {
+        counter->int_val += step;
+        if (counter->int_val >= limit->int_val) return false;
+    }
+    else {
+        if (step) vm_increment(counter, step);
+        if (!vm_test(OP_LESS, *counter, *limit)) return false;
+    }
+    *named = *counter;
+    return true;
+}
+
+
+
+
+/***********************************************************
+* Function: vm_array_get
+* Description: reads an array element, reporting the same errors as the tree walker.
+* Parameters: RuntimeValue array, RuntimeValue index
+* Return: RuntimeValue (null on error)
+* ***********************************************************/
+static RuntimeValue vm_array_get(RuntimeValue array, RuntimeValue index) {
+    if (array.type != RUNTIME_VALUE_ARRAY) {
+        fprintf(stderr, "Error: Variable is not an array.\n");
+        return make_null_value();
+    }
+    if (index.type != RUNTIME_VALUE_INT) {
+        fprintf(stderr, "Error: Array index must be an integer.\n");
+        return make_null_value();
+    }
+    if (index.int_val < 0 || (size_t)index.int_val >= array.array_val.count) {
+        fprintf(stderr, "Error: Array index out of bounds.\n");
+        return make_null_value();
+    }
+    return array.array_val.elements[index.int_val];
+}
+
+
+
+
+/***********************************************************
+* Function: vm_array_set
+* Description: writes an array element, reporting the same errors as the tree walker.
+* Parameters: RuntimeValue array, RuntimeValue index, RuntimeValue value
+* Return: void
+* ***********************************************************/
+static void vm_array_set(RuntimeValue array, RuntimeValue index, RuntimeValue value) {
+    if (array.type != RUNTIME_VALUE_ARRAY) {
+        fprintf(stderr, "Error: Variable is not an array.\n");
+    }
+    else if (index.type != RUNTIME_VALUE_INT) {
+        fprintf(stderr, "Error: Array index must be an integer.\n");
+    }
+    else if (index.int_val < 0 || (size_t)index.int_val >= array.array_val.count) {
+        fprintf(stderr, "Error: Array index out of bounds.\n");
+    }
+    else {
+        array.array_val.elements[index.int_val] = value;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: vm_build_array
+* Description: creates an array holding a copy of the given values.
+* Parameters: VirtualMachine* vm, const RuntimeValue* values, size_t count
+* Return: RuntimeValue
+* ***********************************************************/
+static RuntimeValue vm_build_array(VirtualMachine* vm, const RuntimeValue* values, size_t count) {
+    RuntimeValue* elements = (RuntimeValue*)malloc((count ? count : 1) * sizeof(RuntimeValue));
+    if (!elements) {
+        vm_runtime_error(vm, "memory allocation failed for array.");
+    }
+    memcpy(elements, values, count * sizeof(RuntimeValue));
+    return make_array_value(elements, count);
+}
+
+
+
+
+/***********************************************************
+* Function: vm_unary
+* Description: applies - ! ~ to a value.
+* Parameters: BytecodeOpcode op, RuntimeValue value
+* Return: RuntimeValue
+* ***********************************************************/
+static RuntimeValue vm_unary(BytecodeOpcode op, RuntimeValue value) {
+    switch (op) {
+    case OP_NEGATE:
+        if (value.type == RUNTIME_VALUE_INT) return make_int_value(-value.int_val);
+        if (value.type == RUNTIME_VALUE_FLOAT) return make_float_value(-value.float_val);
+        return make_null_value();
+    case OP_NOT_: {
+        bool isTrue = (value.type == RUNTIME_VALUE_BOOL && value.bool_val) ||
+            (value.type == RUNTIME_VALUE_INT && value.int_val != 0);
+        return make_bool_value(!isTrue);
+    }
+    default:
+        return value.type == RUNTIME_VALUE_INT ? make_int_value(~value.int_val) : make_null_value();
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: vm_global_not_found
+* Description: the warning of a read of a global variable that was never assigned.
+* Parameters: VirtualMachine* vm, size_t slot
+* Return: void
+* ***********************************************************/
+static void vm_global_not_found(VirtualMachine* vm, size_t slot) {
+    fprintf(stderr, "Variable '%s' not found in the current environment.\n", vm->program->global_names[slot]);
+}
+
+
+
+
+/***********************************************************
+* Function: vm_jit_*
+* Description: the slow paths of the machine code (see JitRuntime). `top` is the first free
+* operand stack slot, so the operands of an instruction are right below it.
+* ***********************************************************/
+static void vm_jit_binary(RuntimeValue* top, int op) {
+    switch ((BytecodeOpcode)op) {
+    case OP_ADD_: case OP_SUBTRACT: case OP_MULTIPLY: case OP_DIVIDE: case OP_MODULO:
+        top[-2] = vm_arithmetic((BytecodeOpcode)op, top[-2], top[-1]);
+        break;
+    default:
+        top[-2] = vm_compare((BytecodeOpcode)op, top[-2], top[-1]);
+        break;
+    }
+}
+
+static void vm_jit_unary(RuntimeValue* top, int op) {
+    top[-1] = vm_unary((BytecodeOpcode)op, top[-1]);
+}
+
+static bool vm_jit_truthy(const RuntimeValue* value) {
+    return vm_is_truthy(*value);
+}
+
+static bool vm_jit_test(const RuntimeValue* left, const RuntimeValue* right, int op) {
+    return vm_test((BytecodeOpcode)op, *left, *right);
+}
+
+static void vm_jit_increment(RuntimeValue* slot, int delta) {
+    vm_increment(slot, delta);
+}
+
+static bool vm_jit_for_next(RuntimeValue* counter, const RuntimeValue* limit, RuntimeValue* named, int step) {
+    return vm_for_next(counter, limit, named, step);
+}
+
+static void vm_jit_unset_global(void* vm, int slot) {
+    vm_global_not_found((VirtualMachine*)vm, (size_t)slot);
+}
+
+static void vm_jit_array_get(RuntimeValue* result, const RuntimeValue* array, const RuntimeValue* index) {
+    *result = vm_array_get(*array, *index);
+}
+
+static void vm_jit_array_set(RuntimeValue* top) {
+    vm_array_set(top[-3], top[-2], top[-1]);
+    top[-3] = top[-1];
+}
+
+static void vm_jit_build_array(void* vm, RuntimeValue* top, int count) {
+    top[-count] = vm_build_array((VirtualMachine*)vm, top - count, (size_t)count);
+}
+
+static const JitRuntime jit_runtime = {
+    vm_jit_binary,
+    vm_jit_unary,
+    vm_jit_truthy,
+    vm_jit_test,
+    vm_jit_increment,
+    vm_jit_for_next,
+    vm_jit_unset_global,
+    vm_jit_array_get,
+    vm_jit_array_set,
+    vm_jit_build_array
+};
+
+
+
+
+/***********************************************************
+* Function: vm_jit_run
+* Description: runs the current function as machine code from ip once it has been compiled.
+* With `count`, the call or loop backedge that led to ip counts towards the function getting
+* hot, and the function is compiled when it reaches JIT_HOT_THRESHOLD.
+* Parameters: VirtualMachine* vm, const uint8_t* ip, bool count
+* Return: const uint8_t* (the instruction the interpreter goes on with)
+* ***********************************************************/
+static const uint8_t* vm_jit_run(VirtualMachine* vm, const uint8_t* ip, bool count) {
+    size_t index = (size_t)(vm->function - vm->program->functions);
+    JitCode* code = vm->jit_code[index];
+    if (!code) {
+        if (!count || vm->jit_counters[index] == UINT_MAX || ++vm->jit_counters[index] < JIT_HOT_THRESHOLD) {
+            return ip;
+        }
+        code = jit_compile(vm->function, &jit_runtime);
+        if (!code) {
+            vm->jit_counters[index] = UINT_MAX;
+            return ip;
+        }
+        vm->jit_code[index] = code;
+    }
+
+    // The machine code doesn't check for overflow, it only runs when its deepest stack fits
+    if (vm->sp + code->max_depth > VM_STACK_SIZE) {
+        return ip;
+    }
+    RuntimeValue* locals = &vm->stack[vm->frames[vm->frame_count - 1].stack_base];
+    JitExit stop = jit_enter(code, vm->function, ip, vm, locals, vm->global_slots, &vm->stack[vm->sp]);
+    vm->sp = (size_t)(stop.top - vm->stack);
+    return stop.ip;
+}
+
+
+
+
+/***********************************************************
+* Function: vm_release_environment
+* Description: frees the bindings of a finished call. The values themselves are not
+* freed because they may still be referenced from the operand stack (e.g. the return value).
+* Parameters: RuntimeEnvironment* env
+* Return: void
+* ***********************************************************/
+static void vm_release_environment(RuntimeEnvironment* env) {
+    release_environment_entries(env);
+    free(env);
+}
+
+
+
+
+/***********************************************************
+* Function: vm_function_caches
+* Description: the inline caches of a function's call sites, allocated on its first call.
+* Parameters: VirtualMachine* vm, const CodeObject* function
+* Return: FunctionCache*
+* ***********************************************************/
+static FunctionCache* vm_function_caches(VirtualMachine* vm, const CodeObject* function) {
+    size_t index = (size_t)(function - vm->program->functions);
+    if (!vm->call_caches[index]) {
+        vm->call_caches[index] = (FunctionCache*)calloc(function->constant_count ? function->constant_count : 1, sizeof(FunctionCache));
+        if (!vm->call_caches[index]) {
+            vm_runtime_error(vm, "could not allocate the call caches.");
+        }
+    }
+    return vm->call_caches[index];
+}
+
+
+
+
+/***********************************************************
+* Function: vm_compile_function
+* Description: compiles a function on its first call (see compile_function). Its body may
+* read global variables no code compiled before did, which get their slots here.
+* Parameters: VirtualMachine* vm, const CodeObject* function
+* Return: void
+* ***********************************************************/
+static void vm_compile_function(VirtualMachine* vm, const CodeObject* function) {
+    compile_function(vm->program, function);
+
+    size_t global_count = vm->program->global_count;
+    if (global_count > vm->global_count) {
+        RuntimeValue* slots = (RuntimeValue*)realloc(vm->global_slots, global_count * sizeof(RuntimeValue));
+        if (!slots) {
+            vm_runtime_error(vm, "could not allocate the global variables.");
+        }
+        for (size_t i = vm->global_count; i < global_count; i++) {
+            slots[i] = make_null_value();
+        }
+        vm->global_slots = slots;
+        vm->global_count = global_count;
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: vm_declare_function
+* Description: declares a function in the environment of the current call (see OP_DECL_FUNCTION).
+* The function captures the variables it reads from the call: pointers to its local slots,
+* which stay valid while the call runs, and so while the function can be called.
+* Parameters: VirtualMachine* vm, CallFrame* frame, const CodeObject* function
+* Return: void
+* ***********************************************************/
+static void vm_declare_function(VirtualMachine* vm, CallFrame* frame, const CodeObject* function) {
+    // Functions declared inside a call are only visible to that call
+    if (vm->frame_count > 1 && !frame->owns_env) {
+        frame->env = create_environment(frame->env);
+        if (!frame->env) {
+            vm_runtime_error(vm, "could not allocate a call frame.");
+        }
+        frame->env->is_Function = false;
+        frame->owns_env = true;
+    }
+
+    // Freed with the entry of the environment (see release_environment_entries)
+    RuntimeValue** upvalues = NULL;
+    if (function->capture_count > 0) {
+        upvalues = (RuntimeValue**)malloc(sizeof(RuntimeValue*) * function->capture_count);
+        if (!upvalues) {
+            vm_runtime_error(vm, "could not allocate the captured variables.");
+        }
+        for (int i = 0; i < function->capture_count; i++) {
+            const Capture* capture = &function->captures[i];
+            upvalues[i] = capture->from_local ? &vm->stack[frame->stack_base + capture->index] : frame->upvalues[capture->index];
+        }
+    }
+
+    // The function closes over the environment it is declared in
+    RuntimeValue functionValue;
+    functionValue.type = RUNTIME_VALUE_FUNCTION;
+    functionValue.function_val.env = frame->env;
+    functionValue.function_val.body = NULL;
+    functionValue.function_val.parameters = NULL;
+    functionValue.function_val.upvalues = upvalues;
+    functionValue.function_val.code = function;
+    env_set_func(frame->env, function->name, functionValue);
+}
+
+
+
+
+/***********************************************************
+* Function: vm_call
+* Description: calls the function value with the top arg_count stack values as arguments.
+* Builtins run directly on the stack slots, user functions get a new call frame.
+* A tail call replaces the current frame instead: the arguments move down to its base and
+* the callee returns straight to the caller's caller.
+* Parameters: VirtualMachine* vm, RuntimeValue callee, int arg_count, bool tail
+* Return: void
+* ***********************************************************/
+static void vm_call(VirtualMachine* vm, RuntimeValue callee, int arg_count, bool tail) {
+    RuntimeValue* args = &vm->stack[vm->sp - arg_count];
+
+    if (callee.type == RUNTIME_VALUE_BUILTIN) {
+        RuntimeValue result = callee.builtin_val.fn(args, (size_t)arg_count);
+        vm->sp -= arg_count;
+        vm_push(vm, result);
+        return;
+    }
+
+    const CodeObject* function = (const CodeObject*)callee.function_val.code;
+    if (callee.type != RUNTIME_VALUE_FUNCTION || !function) {
+        fprintf(stderr, "Runtime Error: Attempt to call a non-function.\n");
+        vm->sp -= arg_count;
+        vm_push(vm, make_null_value());
+        return;
+    }
+    if (function->declaration) {
+        vm_compile_function(vm, function);
+    }
+
+    // <main> has no frame to give away, and functions declared by the current call
+    // need its environment, so those calls nest normally
+    CallFrame* frame = &vm->frames[vm->frame_count - 1];
+    tail = tail && vm->frame_count > 1 && !(frame->owns_env && callee.function_val.env == frame->env);
+    if (!tail && vm->frame_count >= VM_MAX_FRAMES) {
+        vm_runtime_error(vm, "call stack overflow.");
+    }
+
+    // The arguments become the first local slots of the new frame: extra arguments are
+    // dropped, missing ones and the rest of the locals start as null
+    int param_count = function->param_count;
+    int local_count = function->local_count;
+    size_t base = vm->sp - arg_count;
+    if (tail) {
+        base = frame->stack_base;
+        memmove(&vm->stack[base], args, arg_count * sizeof(RuntimeValue));
+        if (frame->owns_env) {
+            vm_release_environment(frame->env);
+        }
+    }
+    if (base + local_count + function->max_stack > VM_STACK_SIZE) {
+        vm_runtime_error(vm, "operand stack overflow.");
+    }
+    vm->sp = base + (arg_count < param_count ? arg_count : param_count);
+    while (vm->sp < base + local_count) {
+        vm->stack[vm->sp++] = make_null_value();
+    }
+
+    // Functions declared in the body get their own environment on first use (see OP_DECL_FUNCTION)
+    if (!tail) {
+        frame = &vm->frames[vm->frame_count++];
+        frame->return_ip = vm->ip;
+        frame->stack_base = base;
+    }
+    frame->caches = vm_function_caches(vm, function);
+    frame->function = function;
+    frame->env = callee.function_val.env;
+    frame->owns_env = false;
+    frame->upvalues = callee.function_val.upvalues;
+    vm->function = function;
+    vm->ip = function->code;
+}
+
+
+
+
+/***********************************************************
+* Function: vm_init
+* Description: prepares a virtual machine to run the given program, which must have passed
+* the verifier (assemble_program and load_program always verify it).
+* Parameters: VirtualMachine* vm, const BytecodeProgram* program
+* Return: void
+* ***********************************************************/
+void vm_init(VirtualMachine* vm, const BytecodeProgram* program) {
+    // The handlers trust the verifier (see VM_CHECK_STACK), <main> gets its room here like calls do in vm_call
+    if (!program->verified) {
+        fprintf(stderr, "VM Runtime Error: the program was not verified.\n");
+        exit(EXIT_FAILURE);
+    }
+    if ((size_t)program->functions[0].local_count + program->functions[0].max_stack > VM_STACK_SIZE) {
+        fprintf(stderr, "VM Runtime Error in <main>: operand stack overflow.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t global_count = program->global_count;
+    vm->program = program;
+    vm->function = &program->functions[0];
+    vm->ip = vm->function->code;
+    vm->sp = 0;
+    vm->returned = false;
+    vm->return_value = make_null_value();
+    vm->registers = NULL;
+    vm->dispatch_count = 0;
+    vm->jit_code = NULL;
+    vm->jit_counters = NULL;
+
+    // Global environment (hash table or similar) with the built in functions
+    vm->globals = create_environment(NULL);
+    if (!vm->globals) {
+        fprintf(stderr, "Memory allocation failed for the VM globals.\n");
+        exit(EXIT_FAILURE);
+    }
+    vm->globals->is_Function = false;
+    built_in_functions(vm->globals);
+
+    // Global variables live in slots resolved by the compiler
+    vm->global_count = global_count;
+    vm->global_slots = (RuntimeValue*)malloc((global_count ? global_count : 1) * sizeof(RuntimeValue));
+    if (!vm->global_slots) {
+        fprintf(stderr, "Memory allocation failed for the VM globals.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < global_count; i++) {
+        vm->global_slots[i] = make_null_value();
+    }
+
+    // Call sites calling the same name from the same function always resolve alike,
+    // so every function gets one inline cache per constant (the callee names are constants).
+    // Stubs compiled later (see vm_call) take the rest of the function table
+    vm->call_caches = (FunctionCache**)calloc(program->function_capacity, sizeof(FunctionCache*));
+    if (!vm->call_caches) {
+        fprintf(stderr, "Memory allocation failed for the VM call caches.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Every function starts interpreted, the JIT compiles the ones that get hot
+    if (jit_enabled) {
+        vm->jit_code = (JitCode**)calloc(program->function_capacity, sizeof(JitCode*));
+        vm->jit_counters = (unsigned*)calloc(program->function_capacity, sizeof(unsigned));
+        if (!vm->jit_code || !vm->jit_counters) {
+            fprintf(stderr, "Memory allocation failed for the JIT.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Frame 0 is the top level program
+    vm->frame_count = 1;
+    vm->frames[0].function = vm->function;
+    vm->frames[0].return_ip = NULL;
+    vm->frames[0].stack_base = 0;
+    vm->frames[0].env = vm->globals;
+    vm->frames[0].owns_env = false;
+    vm->frames[0].upvalues = NULL;
+    vm->frames[0].caches = vm_function_caches(vm, vm->function);
+}
+
+
+
+
+/***********************************************************
+* Function: vm_run
+* Description: the fetch/decode/execute loop of the virtual machine.
+* With GCC/Clang the handlers are direct threaded (labels as values), otherwise
+* a portable switch is used. Build with -DCLOCK_SWITCH_DISPATCH to force the switch.
+* While the profiler is on (--vm-stats), every dispatch goes through profile_instruction.
+* Parameters: VirtualMachine* vm
+* Return: RuntimeValue (the top level return value, null if none)
+* ***********************************************************/
+RuntimeValue vm_run(VirtualMachine* vm) {
+    // The instruction pointer stays in a local, vm->ip is only synced around calls
+    const uint8_t* ip = vm->ip;
+    CallFrame* frame = &vm->frames[vm->frame_count - 1];
+
+#define READ_U8()  (ip += 1, ip[-1])
+#define READ_U16() (ip += 2, read_u16(ip - 2))
+#define READ_U32() (ip += 4, read_u32(ip - 4))
+
+    // Function entries, returns and loop backedges are where compiled code takes over
+#define VM_JIT(count) do { if (vm->jit_code) ip = vm_jit_run(vm, ip, count); } while (0)
+
+#if VM_COMPUTED_GOTO
+    // One label per opcode, opcodes without a handler go to the unsupported label.
+    // The profiler takes every entry of the dispatch table and jumps on to the handler
+    static void* handlers[OP_COUNT_];
+    static void* dispatch_table[OP_COUNT_];
+    static bool dispatch_ready = false;
+    static bool dispatch_profiled = false;
+    if (!dispatch_ready || dispatch_profiled != vm_profile.active) {
+        for (int i = 0; i < OP_COUNT_; i++) handlers[i] = &&op_unsupported;
+#define VM_REGISTER(op) handlers[op] = &&op_##op;
+        VM_OPCODES(VM_REGISTER)
+#undef VM_REGISTER
+        for (int i = 0; i < OP_COUNT_; i++) dispatch_table[i] = vm_profile.active ? &&op_profile : handlers[i];
+        dispatch_profiled = vm_profile.active;
+        dispatch_ready = true;
+    }
+
+    // Every handler ends with its own copy of the dispatch, so each indirect
+    // jump gets its own branch predictor entry
+#define VM_CASE(op) op_##op
+#define VM_DEFAULT op_unsupported
+#define VM_NEXT() do { VM_COUNT_DISPATCH(); goto *dispatch_table[*ip++]; } while (0)
+
+    VM_NEXT();
+    {
+        {
+#else
+#define VM_CASE(op) case op
+#define VM_DEFAULT default
+#define VM_NEXT() continue
+
+    // Every code object ends with OP_HALT or OP_RETURN_, so there is no end check
+    const bool profiled = vm_profile.active;
+    for (;;) {
+        VM_COUNT_DISPATCH();
+        if (profiled) profile_instruction(vm->function, ip);
+        switch (*ip++) {
+#endif
+        VM_CASE(OP_PUSH_INT):
+            vm_push(vm, make_int_value((int16_t)READ_U16()));
+            VM_NEXT();
+
+        VM_CASE(OP_PUSH_BOOL):
+            vm_push(vm, make_bool_value(READ_U8() != 0));
+            VM_NEXT();
+
+        VM_CASE(OP_LOAD_CONST_):
+            // Constants are never mutated, so string values can share the pool's copy
+            vm_push(vm, vm->function->constants[READ_U16()]);
+            VM_NEXT();
+
+        VM_CASE(OP_PUSH_NULL):
+            vm_push(vm, make_null_value());
+            VM_NEXT();
+
+        VM_CASE(OP_POP):
+            vm_pop(vm);
+            VM_NEXT();
+
+        VM_CASE(OP_DUP): {
+            RuntimeValue top = vm_pop(vm);
+            vm_push(vm, top);
+            vm_push(vm, top);
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_LOAD_LOCAL):
+            vm_push(vm, vm->stack[frame->stack_base + READ_U8()]);
+            VM_NEXT();
+
+        VM_CASE(OP_STORE_LOCAL):
+            vm->stack[frame->stack_base + READ_U8()] = vm_pop(vm);
+            VM_NEXT();
+
+        VM_CASE(OP_LOAD_GLOBAL): {
+            uint16_t slot = READ_U16();
+            RuntimeValue value = vm->global_slots[slot];
+            if (value.type == RUNTIME_VALUE_NULL) {
+                vm_global_not_found(vm, slot);
+            }
+            vm_push(vm, value);
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_STORE_GLOBAL):
+            vm->global_slots[READ_U16()] = vm_pop(vm);
+            VM_NEXT();
+
+        VM_CASE(OP_LOAD_UPVALUE):
+            vm_push(vm, *frame->upvalues[READ_U8()]);
+            VM_NEXT();
+
+        VM_CASE(OP_UNSET_LOCAL):
+            vm->stack[frame->stack_base + READ_U8()] = make_unset_value();
+            VM_NEXT();
+
+        VM_CASE(OP_OR_GLOBAL): {
+            // A local that hides a global reads the global until it is assigned
+            uint16_t slot = READ_U16();
+            RuntimeValue* top = &vm->stack[vm->sp - 1];
+            if (top->type == RUNTIME_VALUE_UNSET) {
+                *top = vm->global_slots[slot];
+                if (top->type == RUNTIME_VALUE_NULL) {
+                    vm_global_not_found(vm, slot);
+                }
+            }
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_ADD_):
+        VM_CASE(OP_SUBTRACT):
+        VM_CASE(OP_MULTIPLY):
+        VM_CASE(OP_DIVIDE):
+        VM_CASE(OP_MODULO): {
+            RuntimeValue right = vm_pop(vm);
+            RuntimeValue left = vm_pop(vm);
+            vm_push(vm, vm_arithmetic((BytecodeOpcode)ip[-1], left, right));
+            vm_quicken(ip - 1, left, right);
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_LESS):
+        VM_CASE(OP_GREATER):
+        VM_CASE(OP_LESS_EQUAL):
+        VM_CASE(OP_GREATER_EQUAL):
+        VM_CASE(OP_EQUAL):
+        VM_CASE(OP_NOT_EQUAL):
+        VM_CASE(OP_AND_):
+        VM_CASE(OP_OR_): {
+            RuntimeValue right = vm_pop(vm);
+            RuntimeValue left = vm_pop(vm);
+            vm_push(vm, vm_compare((BytecodeOpcode)ip[-1], left, right));
+            vm_quicken(ip - 1, left, right);
+            VM_NEXT();
+        }
+
+        // Quickened operators: the guard checks the operand types, a miss puts the generic operator
+        // back and runs it. The site already ran generically, so its two operands are on the stack
+#define VM_DEQUICKEN(generic_op) \
+            *(uint8_t*)(ip - 1) = (uint8_t)(generic_op); \
+            quickening.dequickened++; \
+            ip--; \
+            VM_NEXT();
+
+#define VM_QUICK_ARITHMETIC(quick_op, generic_op, value_type, field, c_operator, guard) \
+        VM_CASE(quick_op): { \
+            RuntimeValue* left = &vm->stack[vm->sp - 2]; \
+            const RuntimeValue* right = &vm->stack[vm->sp - 1]; \
+            if (left->type != value_type || right->type != value_type) { \
+                VM_DEQUICKEN(generic_op) \
+            } \
+            if (guard) left->field = left->field c_operator right->field; \
+            else *left = vm_arithmetic(generic_op, *left, *right); \
+            vm->sp--; \
+            VM_NEXT(); \
+        }
+
+#define VM_QUICK_COMPARISON(quick_op, generic_op, value_type, field, c_operator) \
+        VM_CASE(quick_op): { \
+            RuntimeValue* left = &vm->stack[vm->sp - 2]; \
+            const RuntimeValue* right = &vm->stack[vm->sp - 1]; \
+            if (left->type != value_type || right->type != value_type) { \
+                VM_DEQUICKEN(generic_op) \
+            } \
+            bool result = left->field c_operator right->field; \
+            left->type = RUNTIME_VALUE_BOOL; \
+            left->bool_val = result; \
+            vm->sp--; \
+            VM_NEXT(); \
+        }
+
+        VM_QUICK_ARITHMETIC(OP_ADD_INT_INT, OP_ADD_, RUNTIME_VALUE_INT, int_val, +, true)
+        VM_QUICK_ARITHMETIC(OP_SUBTRACT_INT_INT, OP_SUBTRACT, RUNTIME_VALUE_INT, int_val, -, true)
+        VM_QUICK_ARITHMETIC(OP_MULTIPLY_INT_INT, OP_MULTIPLY, RUNTIME_VALUE_INT, int_val, *, true)
+        VM_QUICK_ARITHMETIC(OP_DIVIDE_INT_INT, OP_DIVIDE, RUNTIME_VALUE_INT, int_val, /, right->int_val != 0)
+        VM_QUICK_ARITHMETIC(OP_MODULO_INT_INT, OP_MODULO, RUNTIME_VALUE_INT, int_val, %, right->int_val != 0)
+        VM_QUICK_COMPARISON(OP_LESS_INT_INT, OP_LESS, RUNTIME_VALUE_INT, int_val, <)
+        VM_QUICK_COMPARISON(OP_GREATER_INT_INT, OP_GREATER, RUNTIME_VALUE_INT, int_val, >)
+        VM_QUICK_COMPARISON(OP_LESS_EQUAL_INT_INT, OP_LESS_EQUAL, RUNTIME_VALUE_INT, int_val, <=)
+        VM_QUICK_COMPARISON(OP_GREATER_EQUAL_INT_INT, OP_GREATER_EQUAL, RUNTIME_VALUE_INT, int_val, >=)
+        VM_QUICK_COMPARISON(OP_EQUAL_INT_INT, OP_EQUAL, RUNTIME_VALUE_INT, int_val, ==)
+        VM_QUICK_COMPARISON(OP_NOT_EQUAL_INT_INT, OP_NOT_EQUAL, RUNTIME_VALUE_INT, int_val, !=)
+        VM_QUICK_ARITHMETIC(OP_ADD_FLOAT_FLOAT, OP_ADD_, RUNTIME_VALUE_FLOAT, float_val, +, true)
+        VM_QUICK_ARITHMETIC(OP_SUBTRACT_FLOAT_FLOAT, OP_SUBTRACT, RUNTIME_VALUE_FLOAT, float_val, -, true)
+        VM_QUICK_ARITHMETIC(OP_MULTIPLY_FLOAT_FLOAT, OP_MULTIPLY, RUNTIME_VALUE_FLOAT, float_val, *, true)
+        VM_QUICK_ARITHMETIC(OP_DIVIDE_FLOAT_FLOAT, OP_DIVIDE, RUNTIME_VALUE_FLOAT, float_val, /, right->float_val != 0.0)
+        VM_QUICK_COMPARISON(OP_LESS_FLOAT_FLOAT, OP_LESS, RUNTIME_VALUE_FLOAT, float_val, <)
+        VM_QUICK_COMPARISON(OP_GREATER_FLOAT_FLOAT, OP_GREATER, RUNTIME_VALUE_FLOAT, float_val, >)
+
+#undef VM_QUICK_COMPARISON
+#undef VM_QUICK_ARITHMETIC
+#undef VM_DEQUICKEN
+
+        VM_CASE(OP_NEGATE):
+        VM_CASE(OP_NOT_):
+        VM_CASE(OP_BIT_NOT): {
+            RuntimeValue value = vm_pop(vm);
+            vm_push(vm, vm_unary((BytecodeOpcode)ip[-1], value));
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_JUMP_TO): {
+            const uint8_t* target = vm->function->code + read_u32(ip);
+            // A jump backwards closes a loop, which makes the function hot like a call does
+            bool backedge = target < ip;
+            ip = target;
+            if (backedge) VM_JIT(true);
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_JUMP_TO_IF_FALSE): {
+            uint32_t target = READ_U32();
+            if (!vm_is_truthy(vm_pop(vm))) {
+                ip = vm->function->code + target;
+            }
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_SWITCH_): {
+            // Case bodies always follow the switch, so this is never a backedge
+            RuntimeValue selector = vm_pop(vm);
+            ip = vm->function->code + switch_target(vm->function, ip - 1, &selector);
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_BUILD_ARRAY): {
+            size_t count = READ_U16();
+            if (VM_CHECK_STACK && count > vm->sp - frame->stack_base) {
+                vm_runtime_error(vm, "operand stack underflow.");
+            }
+            RuntimeValue array = vm_build_array(vm, &vm->stack[vm->sp - count], count);
+            vm->sp -= count;
+            vm_push(vm, array);
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_ARRAY_GET_): {
+            RuntimeValue index = vm_pop(vm);
+            RuntimeValue array = vm_pop(vm);
+            vm_push(vm, vm_array_get(array, index));
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_ARRAY_SET_): {
+            RuntimeValue value = vm_pop(vm);
+            RuntimeValue index = vm_pop(vm);
+            RuntimeValue array = vm_pop(vm);
+            vm_array_set(array, index, value);
+            vm_push(vm, value);
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_DECL_FUNCTION):
+            vm_declare_function(vm, frame, &vm->program->functions[READ_U16()]);
+            VM_NEXT();
+
+        VM_CASE(OP_TAIL_CALL):
+        VM_CASE(OP_CALL_FUNCTION): {
+            bool tail = ip[-1] == OP_TAIL_CALL;
+            uint16_t name_index = READ_U16();
+            int arg_count = READ_U8();
+            if (VM_CHECK_STACK && (size_t)arg_count > vm->sp - frame->stack_base) {
+                vm_runtime_error(vm, "operand stack underflow.");
+            }
+
+            // Only look the name up again when a function was (re)defined since the last call
+            FunctionCache* cache = &frame->caches[name_index];
+            RuntimeValue callee;
+            if (cache->version == function_definition_version) {
+                callee = cache->function;
+            }
+            else {
+                callee = env_get_func(frame->env, vm->function->constants[name_index].string_val);
+                if (function_is_cacheable(callee)) {
+                    cache->version = function_definition_version;
+                    cache->function = callee;
+                }
+            }
+            if (callee.type == RUNTIME_VALUE_NULL) {
+                const char* name = vm->function->constants[name_index].string_val;
+                fprintf(stderr, "Function '%s' not found in the current environment.\n", name);
+                vm->sp -= arg_count;
+                vm_push(vm, make_null_value());
+                VM_NEXT();
+            }
+            vm->ip = ip;
+            vm_call(vm, callee, arg_count, tail);
+            ip = vm->ip;
+            frame = &vm->frames[vm->frame_count - 1];
+            VM_JIT(ip == vm->function->code);   // Only calls of user functions start at the code
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_RETURN_): {
+            RuntimeValue result = vm_pop(vm);
+
+            // A return outside of any function stops the whole program
+            if (vm->frame_count == 1) {
+                vm->returned = true;
+                vm->return_value = result;
+                return result;
+            }
+
+            vm->frame_count--;
+            if (frame->owns_env) {
+                vm_release_environment(frame->env);
+            }
+            vm->sp = frame->stack_base;
+            ip = frame->return_ip;
+            frame = &vm->frames[vm->frame_count - 1];
+            vm->function = frame->function;
+            vm_push(vm, result);
+            VM_JIT(false);
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_HALT):
+            return make_null_value();
+
+        // Superinstructions: same effect as the sequences they replace, one dispatch
+        VM_CASE(OP_INC_LOCAL): {
+            RuntimeValue* slot = &vm->stack[frame->stack_base + READ_U8()];
+            vm_increment(slot, (int16_t)READ_U16());
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_INC_GLOBAL): {
+            uint16_t index = READ_U16();
+            RuntimeValue* slot = &vm->global_slots[index];
+            if (slot->type == RUNTIME_VALUE_NULL) {
+                vm_global_not_found(vm, index);
+            }
+            vm_increment(slot, (int16_t)READ_U16());
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_COMPARE_JUMP_IF_FALSE): {
+            BytecodeOpcode op = (BytecodeOpcode)READ_U8();
+            uint32_t target = READ_U32();
+            RuntimeValue right = vm_pop(vm);
+            RuntimeValue left = vm_pop(vm);
+            if (!vm_test(op, left, right)) {
+                ip = vm->function->code + target;
+            }
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_COMPARE_LOCALS_JUMP_IF_FALSE): {
+            const RuntimeValue* locals = &vm->stack[frame->stack_base];
+            RuntimeValue left = locals[READ_U8()];
+            RuntimeValue right = locals[READ_U8()];
+            BytecodeOpcode op = (BytecodeOpcode)READ_U8();
+            uint32_t target = READ_U32();
+            if (!vm_test(op, left, right)) {
+                ip = vm->function->code + target;
+            }
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_LOAD_LOCAL_ELEMENT): {
+            const RuntimeValue* locals = &vm->stack[frame->stack_base];
+            RuntimeValue array = locals[READ_U8()];
+            RuntimeValue index = locals[READ_U8()];
+            vm_push(vm, vm_array_get(array, index));
+            VM_NEXT();
+        }
+
+        // Counted loops: the limit is in the slot right after the counter
+        VM_CASE(OP_FOR_PREP_LOCAL): {
+            RuntimeValue* locals = &vm->stack[frame->stack_base];
+            RuntimeValue* counter = &locals[READ_U8()];
+            RuntimeValue* named = &locals[READ_U8()];
+            uint32_t target = READ_U32();
+            if (!vm_for_next(counter, counter + 1, named, 0)) {
+                ip = vm->function->code + target;
+            }
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_FOR_LOOP_LOCAL): {
+            RuntimeValue* locals = &vm->stack[frame->stack_base];
+            RuntimeValue* counter = &locals[READ_U8()];
+            RuntimeValue* named = &locals[READ_U8()];
+            uint32_t target = READ_U32();
+            if (vm_for_next(counter, counter + 1, named, 1)) {
+                ip = vm->function->code + target;
+                VM_JIT(true);
+            }
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_FOR_PREP_GLOBAL): {
+            RuntimeValue* counter = &vm->global_slots[READ_U16()];
+            RuntimeValue* named = &vm->global_slots[READ_U16()];
+            uint32_t target = READ_U32();
+            if (!vm_for_next(counter, counter + 1, named, 0)) {
+                ip = vm->function->code + target;
+            }
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_FOR_LOOP_GLOBAL): {
+            RuntimeValue* counter = &vm->global_slots[READ_U16()];
+            RuntimeValue* named = &vm->global_slots[READ_U16()];
+            uint32_t target = READ_U32();
+            if (vm_for_next(counter, counter + 1, named, 1)) {
+                ip = vm->function->code + target;
+                VM_JIT(true);
+            }
+            VM_NEXT();
+        }
+
+        VM_DEFAULT:
+            fprintf(stderr, "VM Runtime Error: unsupported opcode %s.\n",
+                ip[-1] < OP_COUNT_ ? ByteCodeNames[ip[-1]] : "?");
+            exit(EXIT_FAILURE);
+
+#if VM_COMPUTED_GOTO
+        op_profile:
+            profile_instruction(vm->function, ip - 1);
+            goto *handlers[ip[-1]];
+#endif
+        }
+    }
+
+#undef READ_U8
+#undef READ_U16
+#undef READ_U32
+#undef VM_JIT
+#undef VM_CASE
+#undef VM_DEFAULT
+#undef VM_NEXT
+}
+
+
+
+
+/***********************************************************
+* Function: vm_unset_global
+* Description: in <main> the global slots are read straight from the registers, so the
+* instructions reading a null register report the unset variable the way OP_LOAD_GLOBAL does.
+* Parameters: VirtualMachine* vm, size_t reg
+* Return: void
+* ***********************************************************/
+static void vm_unset_global(VirtualMachine* vm, size_t reg) {
+    if (vm->frame_count == 1 && reg < vm->global_count) {
+        vm_global_not_found(vm, reg);
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: vm_register_binary
+* Description: the generic path of the register operators (anything but two ints).
+* Parameters: VirtualMachine* vm, BytecodeOpcode op, const RuntimeValue* registers, uint32_t word
+* Return: RuntimeValue
+* ***********************************************************/
+static RuntimeValue vm_register_binary(VirtualMachine* vm, BytecodeOpcode op, const RuntimeValue* registers, uint32_t word) {
+    size_t left = (word >> 16) & 0xFF;
+    size_t right = word >> 24;
+    if (registers[left].type == RUNTIME_VALUE_NULL) vm_unset_global(vm, left);
+    if (registers[right].type == RUNTIME_VALUE_NULL) vm_unset_global(vm, right);
+
+    switch (op) {
+    case OP_ADD_:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+    case OP_DIVIDE:
+    case OP_MODULO:
+        return vm_arithmetic(op, registers[left], registers[right]);
+    default:
+        return vm_compare(op, registers[left], registers[right]);
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: vm_register_function
+* Description: the register code of a function of the program.
+* Parameters: const VirtualMachine* vm, const CodeObject* function
+* Return: const RegisterFunction*
+* ***********************************************************/
+static inline const RegisterFunction* vm_register_function(const VirtualMachine* vm, const CodeObject* function) {
+    return &vm->registers->functions[function - vm->program->functions];
+}
+
+
+
+
+/***********************************************************
+* Function: vm_init_registers
+* Description: switches a virtual machine prepared by vm_init to the register code.
+* <main>'s window holds the global slots followed by its temporaries and constants.
+* Parameters: VirtualMachine* vm, const RegisterProgram* registers
+* Return: void
+* ***********************************************************/
+void vm_init_registers(VirtualMachine* vm, const RegisterProgram* registers) {
+    const RegisterFunction* main_function = &registers->functions[0];
+    if ((size_t)main_function->frame_size > VM_STACK_SIZE) {
+        vm_runtime_error(vm, "operand stack overflow.");
+    }
+
+    vm->registers = registers;
+    if (vm->global_slots != vm->stack) free(vm->global_slots);
+    vm->global_slots = vm->stack;
+    vm->global_count = vm->program->global_count;   // The register code compiled every function
+    for (int i = 0; i < main_function->local_count; i++) {
+        vm->stack[i] = make_null_value();
+    }
+    if (main_function->constant_count) {
+        memcpy(&vm->stack[main_function->constant_base], main_function->constants, main_function->constant_count * sizeof(RuntimeValue));
+    }
+    vm->frames[0].return_pc = NULL;
+    vm->frames[0].return_register = 0;
+}
+
+
+
+
+/***********************************************************
+* Function: vm_run_registers
+* Description: the fetch/decode/execute loop of the register code. Same dispatch
+* styles as vm_run; every operand is an index into the frame's register window.
+* Parameters: VirtualMachine* vm
+* Return: RuntimeValue (the top level return value, null if none)
+* ***********************************************************/
+RuntimeValue vm_run_registers(VirtualMachine* vm) {
+    CallFrame* frame = &vm->frames[vm->frame_count - 1];
+    const RegisterFunction* function = vm_register_function(vm, frame->function);
+    const uint32_t* code = function->code;
+    const uint32_t* pc = code;
+    RuntimeValue* R = &vm->stack[frame->stack_base];
+    uint32_t word;
+
+#define RA ((word >> 8) & 0xFF)
+#define RB ((word >> 16) & 0xFF)
+#define RC (word >> 24)
+
+#if VM_COMPUTED_GOTO
+    static void* dispatch_table[256];
+    static bool dispatch_ready = false;
+    if (!dispatch_ready) {
+        for (int i = 0; i < 256; i++) dispatch_table[i] = &&op_unsupported;
+#define VM_REGISTER(op) dispatch_table[op] = &&op_##op;
+        VM_REGISTER_OPCODES(VM_REGISTER)
+#undef VM_REGISTER
+        dispatch_ready = true;
+    }
+
+#define VM_CASE(op) op_##op
+#define VM_DEFAULT op_unsupported
+#define VM_NEXT() do { VM_COUNT_DISPATCH(); word = *pc++; goto *dispatch_table[word & 0xFF]; } while (0)
+
+    VM_NEXT();
+    {
+        {
+#else
+#define VM_CASE(op) case op
+#define VM_DEFAULT default
+#define VM_NEXT() continue
+
+    // Every function ends with REG_HALT or REG_RETURN, so there is no end check
+    for (;;) {
+        VM_COUNT_DISPATCH();
+        word = *pc++;
+        switch (word & 0xFF) {
+#endif
+
+// Operators with an int/int fast path, the rest goes through vm_register_binary
+#define VM_INT_ARITHMETIC(reg_op, stack_op, c_operator, guard) \
+        VM_CASE(reg_op): { \
+            const RuntimeValue* left = &R[RB]; \
+            const RuntimeValue* right = &R[RC]; \
+            if (left->type == RUNTIME_VALUE_INT && right->type == RUNTIME_VALUE_INT && (guard)) { \
+                long result = left->int_val c_operator right->int_val; \
+                R[RA].type = RUNTIME_VALUE_INT; \
+                R[RA].int_val = result; \
+            } \
+            else { \
+                R[RA] = vm_register_binary(vm, stack_op, R, word); \
+            } \
+            VM_NEXT(); \
+        }
+
+#define VM_INT_COMPARISON(reg_op, stack_op, c_operator) \
+        VM_CASE(reg_op): { \
+            const RuntimeValue* left = &R[RB]; \
+            const RuntimeValue* right = &R[RC]; \
+            if (left->type == RUNTIME_VALUE_INT && right->type == RUNTIME_VALUE_INT) { \
+                bool result = left->int_val c_operator right->int_val; \
+                R[RA].type = RUNTIME_VALUE_BOOL; \
+                R[RA].bool_val = result; \
+            } \
+            else { \
+                R[RA] = vm_register_binary(vm, stack_op, R, word); \
+            } \
+            VM_NEXT(); \
+        }
+
+#define VM_COMPARE_JUMP(reg_op, stack_op, c_operator) \
+        VM_CASE(reg_op): { \
+            const RuntimeValue* left = &R[RB]; \
+            const RuntimeValue* right = &R[RC]; \
+            bool holds; \
+            if (left->type == RUNTIME_VALUE_INT && right->type == RUNTIME_VALUE_INT) { \
+                holds = left->int_val c_operator right->int_val; \
+            } \
+            else { \
+                holds = vm_register_binary(vm, stack_op, R, word).bool_val; \
+            } \
+            pc = holds ? pc + 1 : code + *pc; \
+            VM_NEXT(); \
+        }
+
+        VM_CASE(REG_MOVE):
+            R[RA] = R[RB];
+            if (R[RA].type == RUNTIME_VALUE_NULL) vm_unset_global(vm, RB);
+            VM_NEXT();
+
+        VM_CASE(REG_LOAD_GLOBAL): {
+            uint32_t slot = word >> 16;
+            R[RA] = vm->global_slots[slot];
+            if (R[RA].type == RUNTIME_VALUE_NULL) {
+                vm_global_not_found(vm, slot);
+            }
+            VM_NEXT();
+        }
+
+        VM_CASE(REG_LOAD_UPVALUE):
+            R[RA] = *frame->upvalues[word >> 16];
+            VM_NEXT();
+
+        VM_CASE(REG_OR_GLOBAL): {
+            uint32_t slot = *pc++;
+            R[RA] = R[RB];
+            if (R[RA].type == RUNTIME_VALUE_UNSET) {
+                R[RA] = vm->global_slots[slot];
+                if (R[RA].type == RUNTIME_VALUE_NULL) {
+                    vm_global_not_found(vm, slot);
+                }
+            }
+            VM_NEXT();
+        }
+
+        VM_CASE(REG_STORE_GLOBAL):
+            if (R[RA].type == RUNTIME_VALUE_NULL) vm_unset_global(vm, RA);
+            vm->global_slots[word >> 16] = R[RA];
+            VM_NEXT();
+
+        VM_INT_ARITHMETIC(REG_ADD, OP_ADD_, +, true)
+        VM_INT_ARITHMETIC(REG_SUBTRACT, OP_SUBTRACT, -, true)
+        VM_INT_ARITHMETIC(REG_MULTIPLY, OP_MULTIPLY, *, true)
+        VM_INT_ARITHMETIC(REG_DIVIDE, OP_DIVIDE, /, right->int_val != 0)
+        VM_INT_ARITHMETIC(REG_MODULO, OP_MODULO, %, right->int_val != 0)
+
+        VM_INT_COMPARISON(REG_LESS, OP_LESS, <)
+        VM_INT_COMPARISON(REG_GREATER, OP_GREATER, >)
+        VM_INT_COMPARISON(REG_LESS_EQUAL, OP_LESS_EQUAL, <=)
+        VM_INT_COMPARISON(REG_GREATER_EQUAL, OP_GREATER_EQUAL, >=)
+        VM_INT_COMPARISON(REG_EQUAL, OP_EQUAL, ==)
+        VM_INT_COMPARISON(REG_NOT_EQUAL, OP_NOT_EQUAL, !=)
+
+        VM_CASE(REG_AND):
+            R[RA] = vm_register_binary(vm, OP_AND_, R, word);
+            VM_NEXT();
+
+        VM_CASE(REG_OR):
+            R[RA] = vm_register_binary(vm, OP_OR_, R, word);
+            VM_NEXT();
+
+        VM_CASE(REG_NEGATE): {
+            RuntimeValue value = R[RB];
+            if (value.type == RUNTIME_VALUE_INT) R[RA] = make_int_value(-value.int_val);
+            else if (value.type == RUNTIME_VALUE_FLOAT) R[RA] = make_float_value(-value.float_val);
+            else {
+                if (value.type == RUNTIME_VALUE_NULL) vm_unset_global(vm, RB);
+                R[RA] = make_null_value();
+            }
+            VM_NEXT();
+        }
+
+        VM_CASE(REG_NOT): {
+            RuntimeValue value = R[RB];
+            if (value.type == RUNTIME_VALUE_NULL) vm_unset_global(vm, RB);
+            bool isTrue = (value.type == RUNTIME_VALUE_BOOL && value.bool_val) ||
+                (value.type == RUNTIME_VALUE_INT && value.int_val != 0);
+            R[RA] = make_bool_value(!isTrue);
+            VM_NEXT();
+        }
+
+        VM_CASE(REG_BIT_NOT): {
+            RuntimeValue value = R[RB];
+            if (value.type == RUNTIME_VALUE_NULL) vm_unset_global(vm, RB);
+            R[RA] = value.type == RUNTIME_VALUE_INT ? make_int_value(~value.int_val) : make_null_value();
+            VM_NEXT();
+        }
+
+        VM_CASE(REG_JUMP):
+            pc = code + (word >> 8);
+            VM_NEXT();
+
+        VM_CASE(REG_JUMP_IF_FALSE): {
+            const RuntimeValue* value = &R[RA];
+            if (value->type == RUNTIME_VALUE_NULL) vm_unset_global(vm, RA);
+            pc = vm_is_truthy(*value) ? pc + 1 : code + *pc;
+            VM_NEXT();
+        }
+
+        VM_CASE(REG_SWITCH): {
+            // The table belongs to the stack code, its byte offsets map to words through labels
+            const RuntimeValue* value = &R[RA];
+            if (value->type == RUNTIME_VALUE_NULL) vm_unset_global(vm, RA);
+            const CodeObject* source = frame->function;
+            pc = code + function->labels[switch_target(source, source->code + *pc, value)];
+            VM_NEXT();
+        }
+
+        VM_CASE(REG_FOR_PREP):
+            pc = vm_for_next(&R[RA], &R[RB], &R[RC], 0) ? pc + 1 : code + *pc;
+            VM_NEXT();
+
+        VM_CASE(REG_FOR_LOOP):
+            pc = vm_for_next(&R[RA], &R[RB], &R[RC], 1) ? code + *pc : pc + 1;
+            VM_NEXT();
+
+        VM_COMPARE_JUMP(REG_LESS_JUMP_IF_FALSE, OP_LESS, <)
+        VM_COMPARE_JUMP(REG_GREATER_JUMP_IF_FALSE, OP_GREATER, >)
+        VM_COMPARE_JUMP(REG_LESS_EQUAL_JUMP_IF_FALSE, OP_LESS_EQUAL, <=)
+        VM_COMPARE_JUMP(REG_GREATER_EQUAL_JUMP_IF_FALSE, OP_GREATER_EQUAL, >=)
+        VM_COMPARE_JUMP(REG_EQUAL_JUMP_IF_FALSE, OP_EQUAL, ==)
+        VM_COMPARE_JUMP(REG_NOT_EQUAL_JUMP_IF_FALSE, OP_NOT_EQUAL, !=)
+
+        VM_CASE(REG_GET_ELEMENT): {
+            const RuntimeValue* array = &R[RB];
+            const RuntimeValue* index = &R[RC];
+            if (array->type == RUNTIME_VALUE_ARRAY && index->type == RUNTIME_VALUE_INT &&
+                index->int_val >= 0 && (size_t)index->int_val < array->array_val.count) {
+                R[RA] = array->array_val.elements[index->int_val];
+                VM_NEXT();
+            }
+            if (array->type == RUNTIME_VALUE_NULL) vm_unset_global(vm, RB);
+            if (index->type == RUNTIME_VALUE_NULL) vm_unset_global(vm, RC);
+            R[RA] = vm_array_get(*array, *index);
+            VM_NEXT();
+        }
+
+        VM_CASE(REG_SET_ELEMENT): {
+            RuntimeValue array = R[RA];
+            RuntimeValue index = R[RB];
+            if (array.type == RUNTIME_VALUE_NULL) vm_unset_global(vm, RA);
+            if (index.type == RUNTIME_VALUE_NULL) vm_unset_global(vm, RB);
+            if (R[RC].type == RUNTIME_VALUE_NULL) vm_unset_global(vm, RC);
+            if (array.type != RUNTIME_VALUE_ARRAY) {
+                fprintf(stderr, "Error: Variable is not an array.\n");
+            }
+            else if (index.type != RUNTIME_VALUE_INT) {
+                fprintf(stderr, "Error: Array index must be an integer.\n");
+            }
+            else if (index.int_val < 0 || (size_t)index.int_val >= array.array_val.count) {
+                fprintf(stderr, "Error: Array index out of bounds.\n");
+            }
+            else {
+                array.array_val.elements[index.int_val] = R[RC];
+            }
+            VM_NEXT();
+        }
+
+        VM_CASE(REG_BUILD_ARRAY): {
+            size_t count = word >> 16;
+            RuntimeValue* elements = (RuntimeValue*)malloc((count ? count : 1) * sizeof(RuntimeValue));
+            if (!elements) {
+                vm_runtime_error(vm, "memory allocation failed for array.");
+            }
+            memcpy(elements, &R[function->register_count], count * sizeof(RuntimeValue));
+            R[RA] = make_array_value(elements, count);
+            VM_NEXT();
+        }
+
+        VM_CASE(REG_DECL_FUNCTION):
+            vm_declare_function(vm, frame, &vm->program->functions[word >> 8]);
+            VM_NEXT();
+
+        VM_CASE(REG_TAIL_CALL):
+        VM_CASE(REG_CALL): {
+            bool tail = (word & 0xFF) == REG_TAIL_CALL;
+            size_t result_register = RA;
+            int arg_count = (int)RB;
+            uint32_t name_index = *pc++;
+            RuntimeValue* args = &R[function->register_count];
+
+            // Only look the name up again when a function was (re)defined since the last call
+            FunctionCache* cache = &frame->caches[name_index];
+            RuntimeValue callee;
+            if (cache->version == function_definition_version) {
+                callee = cache->function;
+            }
+            else {
+                callee = env_get_func(frame->env, frame->function->constants[name_index].string_val);
+                if (function_is_cacheable(callee)) {
+                    cache->version = function_definition_version;
+                    cache->function = callee;
+                }
+            }
+
+            if (callee.type == RUNTIME_VALUE_NULL) {
+                fprintf(stderr, "Function '%s' not found in the current environment.\n", frame->function->constants[name_index].string_val);
+                R[result_register] = make_null_value();
+                VM_NEXT();
+            }
+            if (callee.type == RUNTIME_VALUE_BUILTIN) {
+                R[result_register] = callee.builtin_val.fn(args, (size_t)arg_count);
+                VM_NEXT();
+            }
+            const CodeObject* target = (const CodeObject*)callee.function_val.code;
+            if (callee.type != RUNTIME_VALUE_FUNCTION || !target) {
+                fprintf(stderr, "Runtime Error: Attempt to call a non-function.\n");
+                R[result_register] = make_null_value();
+                VM_NEXT();
+            }
+
+            // The callee's window starts at the outgoing registers, so the arguments are already
+            // its first locals: extra arguments are dropped, missing ones and the rest of the locals start as null.
+            // A tail call moves them down to the current window instead and takes over the frame
+            // (not in <main>, nor for functions declared by the current call, see vm_call)
+            const RegisterFunction* callee_function = vm_register_function(vm, target);
+            size_t base = frame->stack_base + function->register_count;
+            tail = tail && vm->frame_count > 1 && !(frame->owns_env && callee.function_val.env == frame->env);
+            if (tail) {
+                base = frame->stack_base;
+                memmove(R, args, arg_count * sizeof(RuntimeValue));
+                args = R;
+                if (frame->owns_env) {
+                    vm_release_environment(frame->env);
+                }
+            }
+            else if (vm->frame_count >= VM_MAX_FRAMES) {
+                vm_runtime_error(vm, "call stack overflow.");
+            }
+            if (base + callee_function->frame_size > VM_STACK_SIZE) {
+                vm_runtime_error(vm, "operand stack overflow.");
+            }
+            int first_null = arg_count < callee_function->param_count ? arg_count : callee_function->param_count;
+            for (int i = first_null; i < callee_function->local_count; i++) {
+                args[i] = make_null_value();
+            }
+            if (callee_function->constant_count) {   // A function without constants has no pool (NULL)
+                memcpy(&args[callee_function->constant_base], callee_function->constants, callee_function->constant_count * sizeof(RuntimeValue));
+            }
+
+            // Functions declared in the body get their own environment on first use (see REG_DECL_FUNCTION)
+            if (!tail) {
+                frame = &vm->frames[vm->frame_count++];
+                frame->return_pc = pc;
+                frame->return_register = result_register;
+                frame->stack_base = base;
+            }
+            frame->function = target;
+            frame->env = callee.function_val.env;
+            frame->owns_env = false;
+            frame->upvalues = callee.function_val.upvalues;
+            frame->caches = vm_function_caches(vm, target);
+            vm->function = target;
+            function = callee_function;
+            code = function->code;
+            pc = code;
+            R = args;
+            VM_NEXT();
+        }
+
+        VM_CASE(REG_RETURN): {
+            RuntimeValue result = R[RA];
+            if (result.type == RUNTIME_VALUE_NULL) vm_unset_global(vm, RA);
+
+            // A return outside of any function stops the whole program
+            if (vm->frame_count == 1) {
+                vm->returned = true;
+                vm->return_value = result;
+                return result;
+            }
+
+            size_t result_register = frame->return_register;
+            pc = frame->return_pc;
+            vm->frame_count--;
+            if (frame->owns_env) {
+                vm_release_environment(frame->env);
+            }
+            frame = &vm->frames[vm->frame_count - 1];
+            vm->function = frame->function;
+            function = vm_register_function(vm, frame->function);
+            code = function->code;
+            R = &vm->stack[frame->stack_base];
+            R[result_register] = result;
+            VM_NEXT();
+        }
+
+        VM_CASE(REG_HALT):
+            return make_null_value();
+
+        VM_DEFAULT:
+            fprintf(stderr, "VM Runtime Error: unsupported register opcode %u.\n", (unsigned)(word & 0xFF));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+#undef VM_INT_ARITHMETIC
+#undef VM_INT_COMPARISON
+#undef VM_COMPARE_JUMP
+#undef RA
+#undef RB
+#undef RC
+#undef VM_CASE
+#undef VM_DEFAULT
+#undef VM_NEXT
+}
+
+
+
+
+/***********************************************************
+* Function: vm_free
+* Description: releases the environments owned by the virtual machine.
+* Parameters: VirtualMachine* vm
+* Return: void
+* ***********************************************************/
+void vm_free(VirtualMachine* vm) {
+    while (vm->frame_count > 1) {
+        CallFrame* frame = &vm->frames[--vm->frame_count];
+        if (frame->owns_env) {
+            vm_release_environment(frame->env);
+        }
+    }
+    free(vm->globals);
+    vm->globals = NULL;
+    // In the register engine the global slots are <main>'s registers
+    if (vm->global_slots != vm->stack) free(vm->global_slots);
+    vm->global_slots = NULL;
+    for (size_t i = 0; i < vm->program->function_count; i++) {
+        free(vm->call_caches[i]);
+    }
+    free(vm->call_caches);
+    vm->call_caches = NULL;
+    if (vm->jit_code) {
+        for (size_t i = 0; i < vm->program->function_count; i++) {
+            jit_free(vm->jit_code[i]);
+        }
+    }
+    free(vm->jit_code);
+    vm->jit_code = NULL;
+    free(vm->jit_counters);
+    vm->jit_counters = NULL;
+}
+
+
+
+
+/***********************************************************
+* Function: vm_select_engine
+* Description: selects the encoding run_program executes.
+* Parameters: VmEngine engine
+* Return: void
+* ***********************************************************/
+void vm_select_engine(VmEngine engine) {
+    selected_engine = engine;
+}
+
+
+
+
+/***********************************************************
+* Function: vm_set_jit
+* Description: enables or disables the JIT of the stack engine.
+* Parameters: bool enabled
+* Return: void
+* ***********************************************************/
+void vm_set_jit(bool enabled) {
+    jit_enabled = enabled && JIT_SUPPORTED;
+}
+
+
+
+
+/***********************************************************
+* Function: vm_set_profile
+* Description: enables or disables the instruction profiler of the stack engine.
+* Parameters: bool enabled
+* Return: void
+* ***********************************************************/
+void vm_set_profile(bool enabled) {
+    profiling = enabled;
+}
+
+
+
+
+/***********************************************************
+* Function: vm_quickening_stats / print_quickening_stats
+* Description: statistics of the quickening done by the last run.
+* Parameters: FILE* out
+* Return: const QuickeningStats* / void
+* ***********************************************************/
+const QuickeningStats* vm_quickening_stats(void) {
+    return &quickening;
+}
+
+void print_quickening_stats(FILE* out) {
+    fprintf(out, "=== QUICKENING ===\n");
+    fprintf(out, "rewritten to typed opcodes: %llu\n", quickening.quickened);
+    fprintf(out, "put back after a type miss: %llu\n", quickening.dequickened);
+}
+
+
+
+
+/***********************************************************
+* Function: run_program
+* Description: runs a compiled program on the virtual machine and prints its master return value.
+* Parameters: const BytecodeProgram* program
+* Return: Void
+* ***********************************************************/
+void run_program(const BytecodeProgram* program) {
+    // The VM is big (operand stack + frames), keep it off the C stack
+    VirtualMachine* vm = (VirtualMachine*)malloc(sizeof(VirtualMachine));
+    if (!vm) {
+        fprintf(stderr, "Memory allocation failed for the VM.\n");
+        exit(EXIT_FAILURE);
+    }
+    vm_init(vm, program);
+    memset(&quickening, 0, sizeof(quickening));
+    jit_reset_stats();
+
+    RegisterProgram* registers = NULL;
+    if (selected_engine == VM_ENGINE_REGISTER) {
+        registers = build_register_program(program);
+        if (!registers) {
+            fprintf(stderr, "The program doesn't fit the register windows, running it on the stack engine.\n");
+        }
+    }
+    if (registers) {
+        vm_init_registers(vm, registers);
+        vm_run_registers(vm);
+    }
+    else {
+        if (profiling) profile_start(program);
+        vm_run(vm);
+    }
+
+    // environment return value
+    vm->globals->completion = vm->returned ? COMPLETION_RETURN : COMPLETION_NORMAL;
+    vm->globals->return_value = vm->return_value;
+    print_return(vm->globals);
+
+#ifdef CLOCK_COUNT_DISPATCH
+    fprintf(stderr, "Instructions executed: %llu\n", vm->dispatch_count);
+#endif
+
+    vm_free(vm);
+    free_register_program(registers);
+    free(vm);
+}
+
+
+
+
+/***********************************************************
+* Function: interpret_bytecode
+* Description: compiles the program to bytecode and runs it on the virtual machine.
+* Parameters: ASTNode* root
+* Return: Void
+* ***********************************************************/
+void interpret_bytecode(ASTNode* root) {
+    BytecodeProgram* program = compile_program(root);
+    run_program(program);
+    free_program(program);
+}
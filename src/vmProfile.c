@@ -0,0 +1,237 @@
+/***********************************************************
+* File: vmProfile.c
+* This file have the instruction profiler of the stack engine (see vmProfile.h) and
+* the report --vm-stats prints with it.
+* This Code was written by Lukas Fukuoka Vieira.
+* Contact: lukas.fvieira@hotmail.com
+* GitHub:https://github.com/comet400
+************************************************************/
+
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "vmProfile.h"
+#include "jit.h"
+
+#define PROFILE_TOP_PAIRS 20      // Opcode pairs printed
+#define PROFILE_TOP_FUNCTIONS 3   // Functions printed with their annotated code
+
+VmProfile vm_profile;
+
+// One opcode pair of the report
+typedef struct {
+    uint8_t first;
+    uint8_t second;
+    unsigned long long count;
+} ProfilePair;
+
+// One function of the report
+typedef struct {
+    size_t index;
+    unsigned long long executed;
+} ProfileFunction;
+
+
+
+
+/***********************************************************
+* Function: profile_start
+* Description: clears the profile and starts profiling a program.
+* Parameters: const BytecodeProgram* program
+* Return: void
+* ***********************************************************/
+void profile_start(const BytecodeProgram* program) {
+    free_profile();
+    vm_profile.program = program;
+    vm_profile.executions = (unsigned long long**)calloc(program->function_capacity, sizeof(unsigned long long*));
+    if (!vm_profile.executions) {
+        fprintf(stderr, "Memory allocation failed for the profiler.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // The clock read that ends the bookkeeping is charged to every instruction
+    vm_profile.clock_overhead = UINT64_MAX;
+    for (int i = 0; i < 100; i++) {
+        uint64_t start = profile_clock();
+        uint64_t cost = profile_clock() - start;
+        if (cost < vm_profile.clock_overhead) vm_profile.clock_overhead = cost;
+    }
+
+    vm_profile.previous = OP_COUNT_;
+    vm_profile.active = true;
+}
+
+
+
+
+/***********************************************************
+* Function: profile_function
+* Description: allocates the execution counts of a function, one per byte of its code.
+* Parameters: const CodeObject* function
+* Return: unsigned long long*
+* ***********************************************************/
+unsigned long long* profile_function(const CodeObject* function) {
+    size_t index = (size_t)(function - vm_profile.program->functions);
+    vm_profile.executions[index] = (unsigned long long*)calloc(function->code_size, sizeof(unsigned long long));
+    if (!vm_profile.executions[index]) {
+        fprintf(stderr, "Memory allocation failed for the profiler.\n");
+        exit(EXIT_FAILURE);
+    }
+    return vm_profile.executions[index];
+}
+
+
+
+
+/***********************************************************
+* Function: compare_opcodes / compare_pairs / compare_functions
+* Description: qsort orders of the report: most time, most frequent pair, most
+* instructions executed first.
+* Parameters: const void* a, const void* b
+* Return: int
+* ***********************************************************/
+static int compare_opcodes(const void* a, const void* b) {
+    unsigned long long left = vm_profile.cycles[*(const uint8_t*)a];
+    unsigned long long right = vm_profile.cycles[*(const uint8_t*)b];
+    return (left < right) - (left > right);
+}
+
+static int compare_pairs(const void* a, const void* b) {
+    unsigned long long left = ((const ProfilePair*)a)->count;
+    unsigned long long right = ((const ProfilePair*)b)->count;
+    return (left < right) - (left > right);
+}
+
+static int compare_functions(const void* a, const void* b) {
+    unsigned long long left = ((const ProfileFunction*)a)->executed;
+    unsigned long long right = ((const ProfileFunction*)b)->executed;
+    return (left < right) - (left > right);
+}
+
+
+
+
+/***********************************************************
+* Function: percent
+* Description: share of a total, 0 for an empty total.
+* Parameters: unsigned long long part, unsigned long long total
+* Return: double
+* ***********************************************************/
+static double percent(unsigned long long part, unsigned long long total) {
+    return total ? 100.0 * (double)part / (double)total : 0.0;
+}
+
+
+
+
+/***********************************************************
+* Function: print_profile
+* Description: prints the opcodes sorted by their share of the time, the most frequent
+* pairs of consecutive opcodes (the candidates for superinstructions) and the code of the
+* functions that executed the most instructions, each instruction with its count.
+* Parameters: FILE* out
+* Return: void
+* ***********************************************************/
+void print_profile(FILE* out) {
+    if (!vm_profile.active) return;
+    const BytecodeProgram* program = vm_profile.program;
+
+    unsigned long long instructions = 0;
+    unsigned long long time = 0;
+    uint8_t opcodes[OP_COUNT_];
+    size_t opcode_count = 0;
+    for (int op = 0; op < OP_COUNT_; op++) {
+        if (vm_profile.counts[op] == 0) continue;
+        instructions += vm_profile.counts[op];
+        time += vm_profile.cycles[op];
+        opcodes[opcode_count++] = (uint8_t)op;
+    }
+    qsort(opcodes, opcode_count, sizeof(uint8_t), compare_opcodes);
+
+    fprintf(out, "=== OPCODE PROFILE ===\n");
+    fprintf(out, "instructions executed: %llu, time: %llu %s (about %llu per instruction are the profiler's)\n",
+        instructions, time, PROFILE_UNIT, (unsigned long long)vm_profile.clock_overhead);
+    fprintf(out, "%-34s %14s %7s %16s %7s %10s\n", "opcode", "count", "%", PROFILE_UNIT, "%", "per exec");
+    for (size_t i = 0; i < opcode_count; i++) {
+        uint8_t op = opcodes[i];
+        fprintf(out, "%-34s %14llu %6.2f%% %16llu %6.2f%% %10.1f\n", ByteCodeNames[op],
+            vm_profile.counts[op], percent(vm_profile.counts[op], instructions),
+            vm_profile.cycles[op], percent(vm_profile.cycles[op], time),
+            (double)vm_profile.cycles[op] / (double)vm_profile.counts[op]);
+    }
+
+    // Pairs: at most one per executed opcode pair, sorted by count
+    size_t pair_count = 0;
+    ProfilePair* pairs = (ProfilePair*)malloc((opcode_count * opcode_count + 1) * sizeof(ProfilePair));
+    if (!pairs) {
+        fprintf(stderr, "Memory allocation failed for the profiler.\n");
+        return;
+    }
+    for (size_t i = 0; i < opcode_count; i++) {
+        for (size_t j = 0; j < opcode_count; j++) {
+            unsigned long long count = vm_profile.pairs[opcodes[i]][opcodes[j]];
+            if (count == 0) continue;
+            pairs[pair_count].first = opcodes[i];
+            pairs[pair_count].second = opcodes[j];
+            pairs[pair_count].count = count;
+            pair_count++;
+        }
+    }
+    qsort(pairs, pair_count, sizeof(ProfilePair), compare_pairs);
+
+    fprintf(out, "=== OPCODE PAIRS ===\n");
+    for (size_t i = 0; i < pair_count && i < PROFILE_TOP_PAIRS; i++) {
+        fprintf(out, "%-34s -> %-34s %14llu %6.2f%%\n", ByteCodeNames[pairs[i].first],
+            ByteCodeNames[pairs[i].second], pairs[i].count, percent(pairs[i].count, instructions));
+    }
+    free(pairs);
+
+    // Hottest functions with the count of each instruction
+    ProfileFunction* functions = (ProfileFunction*)malloc(program->function_count * sizeof(ProfileFunction));
+    if (!functions) {
+        fprintf(stderr, "Memory allocation failed for the profiler.\n");
+        return;
+    }
+    for (size_t f = 0; f < program->function_count; f++) {
+        functions[f].index = f;
+        functions[f].executed = 0;
+        for (size_t offset = 0; vm_profile.executions[f] && offset < program->functions[f].code_size; offset++) {
+            functions[f].executed += vm_profile.executions[f][offset];
+        }
+    }
+    qsort(functions, program->function_count, sizeof(ProfileFunction), compare_functions);
+
+    fprintf(out, "=== HOTTEST FUNCTIONS ===\n");
+    for (size_t i = 0; i < program->function_count && i < PROFILE_TOP_FUNCTIONS; i++) {
+        if (functions[i].executed == 0) break;
+        fprintf(out, "%s: %llu instructions (%.2f%%)\n", program->functions[functions[i].index].name,
+            functions[i].executed, percent(functions[i].executed, instructions));
+        print_function_code(program, functions[i].index, vm_profile.executions[functions[i].index], out);
+    }
+    free(functions);
+
+    if (jit_stats()->entries > 0) {
+        fprintf(out, "Code run by the JIT isn't counted (use --no-jit to profile every instruction).\n");
+    }
+}
+
+
+
+
+/***********************************************************
+* Function: free_profile
+* Description: releases the execution counts and stops profiling.
+* Parameters: None
+* Return: void
+* ***********************************************************/
+void free_profile(void) {
+    if (vm_profile.executions) {
+        for (size_t f = 0; f < vm_profile.program->function_capacity; f++) {
+            free(vm_profile.executions[f]);
+        }
+    }
+    free(vm_profile.executions);
+    memset(&vm_profile, 0, sizeof(vm_profile));
+}